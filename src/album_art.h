@@ -0,0 +1,736 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <cwctype>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#include <wincodec.h>
+#endif
+
+#include "log.h"
+#include "md5.h"
+#include "tag_reader.h"
+#include "utf8.h"
+
+// Cover art for the player window. A track's picture comes from its tags
+// (ID3v2 APIC/PIC, FLAC PICTURE) or else from a cover/folder image beside
+// it. A background thread extracts it, decodes it and shrinks it to the
+// size it is shown at. Thumbnails are keyed by an MD5 of the picture bytes,
+// so the tracks of an album share one. They are kept in a byte-bounded
+// in-memory LRU and in a byte-bounded folder of raw thumbnail files, so a
+// thumbnail is only ever decoded once. The UI thread asks for finished
+// premultiplied BGRA pixels and only uploads them.
+
+const size_t kMaxArtBytes = 16u << 20;          // larger pictures are ignored
+const uint32_t kFrontCoverPicture = 3;          // APIC and FLAC picture type
+
+// Premultiplied 32bpp BGRA, rows of width * 4 bytes
+struct ArtThumbnail
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> pixels;
+};
+
+// Thumbnail size for art shown 'displayPixels' wide. Sizes come in steps so
+// that resizing the window re-decodes only when the step changes.
+inline uint32_t ArtThumbnailEdge(float displayPixels)
+{
+    static const uint32_t kEdges[] = { 96, 128, 192, 256, 384, 512, 768, 1024 };
+    for (uint32_t edge : kEdges)
+    {
+        if (displayPixels <= (float)edge) return edge;
+    }
+    return 1024;
+}
+
+// Largest size with the picture's aspect ratio that fits 'edge' x 'edge';
+// pictures are never enlarged
+inline void FitArt(uint32_t width, uint32_t height, uint32_t edge, uint32_t& fitWidth, uint32_t& fitHeight)
+{
+    uint32_t longest = std::max(width, height);
+    if (longest <= edge)
+    {
+        fitWidth = width;
+        fitHeight = height;
+        return;
+    }
+    fitWidth = std::max<uint32_t>(1, (uint32_t)(((uint64_t)width * edge + longest / 2) / longest));
+    fitHeight = std::max<uint32_t>(1, (uint32_t)(((uint64_t)height * edge + longest / 2) / longest));
+}
+
+// Undo ID3v2 unsynchronisation: every 0xFF 0x00 becomes 0xFF
+inline void ResyncId3(std::vector<uint8_t>& data, size_t begin, size_t end)
+{
+    size_t out = begin;
+    for (size_t i = begin; i < end; i++)
+    {
+        data[out++] = data[i];
+        if (data[i] == 0xFF && i + 1 < end && data[i + 1] == 0x00) i++;
+    }
+    data.erase(data.begin() + out, data.begin() + end);
+}
+
+// Picture frame body: APIC is encoding, MIME type, picture type, description,
+// data; PIC (v2.2) has a three-letter format in place of the MIME type
+inline bool ParseId3Picture(const uint8_t* body, size_t size, bool v22, uint32_t& type, size_t& offset)
+{
+    if (size < 2) return false;
+    uint8_t encoding = body[0];
+    size_t pos = 1;
+    if (v22)
+    {
+        pos += 3;
+    }
+    else
+    {
+        while (pos < size && body[pos] != 0) pos++;
+        pos++;
+    }
+    if (pos >= size) return false;
+    type = body[pos++];
+
+    // Description, terminated by a NUL of the text encoding's width
+    if (encoding == 1 || encoding == 2)
+    {
+        while (pos + 1 < size && (body[pos] | body[pos + 1]) != 0) pos += 2;
+        pos += 2;
+    }
+    else
+    {
+        while (pos < size && body[pos] != 0) pos++;
+        pos++;
+    }
+    if (pos >= size) return false;
+    offset = pos;
+    return true;
+}
+
+inline bool ReadId3Art(std::ifstream& file, std::vector<uint8_t>& image)
+{
+    uint8_t header[10];
+    file.seekg(0, std::ios::beg);
+    if (!file.read((char*)header, 10) || memcmp(header, "ID3", 3) != 0) return false;
+    int major = header[3];
+    if (major < 2 || major > 4) return false;
+    uint32_t tagSize = ((uint32_t)(header[6] & 0x7F) << 21) | ((uint32_t)(header[7] & 0x7F) << 14) |
+                       ((uint32_t)(header[8] & 0x7F) << 7) | (header[9] & 0x7F);
+    if (tagSize > kMaxArtBytes + (1u << 20)) return false;
+
+    std::vector<uint8_t> tag(tagSize);
+    if (!file.read((char*)tag.data(), tagSize)) return false;
+    // v2.2 and v2.3 unsynchronise the whole tag, v2.4 frame by frame
+    if ((header[5] & 0x80) && major < 4) ResyncId3(tag, 0, tag.size());
+
+    size_t pos = 0;
+    if ((header[5] & 0x40) && major >= 3 && tag.size() >= 4)
+    {
+        const uint8_t* ext = tag.data();
+        pos = major == 4 ? (((uint32_t)(ext[0] & 0x7F) << 21) | ((uint32_t)(ext[1] & 0x7F) << 14) | ((uint32_t)(ext[2] & 0x7F) << 7) | (ext[3] & 0x7F))
+                         : 4 + ReadBE32(ext);
+    }
+
+    size_t idLength = major == 2 ? 3 : 4;
+    size_t frameHeaderLength = major == 2 ? 6 : 10;
+    bool found = false;
+    while (pos + frameHeaderLength <= tag.size() && tag[pos] != 0)
+    {
+        const uint8_t* frame = tag.data() + pos;
+        uint32_t size = major == 2 ? (((uint32_t)frame[3] << 16) | ((uint32_t)frame[4] << 8) | frame[5])
+                      : major == 4 ? (((uint32_t)(frame[4] & 0x7F) << 21) | ((uint32_t)(frame[5] & 0x7F) << 14) | ((uint32_t)(frame[6] & 0x7F) << 7) | (frame[7] & 0x7F))
+                      : ReadBE32(frame + 4);
+        size_t bodyStart = pos + frameHeaderLength;
+        if (size > tag.size() - bodyStart) break;
+        pos = bodyStart + size;
+
+        bool isPicture = major == 2 ? memcmp(frame, "PIC", idLength) == 0 : memcmp(frame, "APIC", idLength) == 0;
+        if (!isPicture) continue;
+
+        std::vector<uint8_t> body(tag.begin() + bodyStart, tag.begin() + bodyStart + size);
+        if (major == 4)
+        {
+            // Format flags: unsynchronised, and a data length indicator before the body
+            uint8_t flags = frame[9];
+            if (flags & 0x02) ResyncId3(body, (flags & 0x01) ? std::min<size_t>(4, body.size()) : 0, body.size());
+            if (flags & 0x01) body.erase(body.begin(), body.begin() + std::min<size_t>(4, body.size()));
+        }
+
+        uint32_t type = 0;
+        size_t offset = 0;
+        if (!ParseId3Picture(body.data(), body.size(), major == 2, type, offset)) continue;
+        if (!found || type == kFrontCoverPicture)
+        {
+            image.assign(body.begin() + offset, body.end());
+            found = true;
+        }
+        if (type == kFrontCoverPicture) break;
+    }
+    return found;
+}
+
+// METADATA_BLOCK_PICTURE: type, MIME type, description, geometry, data
+inline bool ReadFlacArt(std::ifstream& file, std::vector<uint8_t>& image)
+{
+    file.seekg(4, std::ios::beg);
+    bool found = false;
+    bool last = false;
+    while (!last)
+    {
+        uint8_t header[4];
+        if (!file.read((char*)header, 4)) break;
+        last = (header[0] & 0x80) != 0;
+        uint32_t type = header[0] & 0x7F;
+        uint32_t length = ((uint32_t)header[1] << 16) | ((uint32_t)header[2] << 8) | header[3];
+        if (type != 6 || length < 32)
+        {
+            file.seekg(length, std::ios::cur);
+            continue;
+        }
+
+        std::vector<uint8_t> block(length);
+        if (!file.read((char*)block.data(), length)) break;
+        uint32_t pictureType = ReadBE32(block.data());
+        size_t pos = 4;
+        uint32_t mimeLength = ReadBE32(block.data() + pos);
+        if (mimeLength > length - pos - 8) continue;
+        pos += 4 + mimeLength;
+        uint32_t descriptionLength = ReadBE32(block.data() + pos);
+        if (descriptionLength > length - pos - 4 || length - pos - 4 - descriptionLength < 20) continue;
+        pos += 4 + descriptionLength + 16;
+        uint32_t dataLength = ReadBE32(block.data() + pos);
+        pos += 4;
+        if (dataLength > length - pos) continue;
+
+        if (!found || pictureType == kFrontCoverPicture)
+        {
+            image.assign(block.begin() + pos, block.begin() + pos + dataLength);
+            found = true;
+        }
+        if (pictureType == kFrontCoverPicture) break;
+    }
+    return found;
+}
+
+// Picture embedded in the track's tags, the front cover if there are several
+inline bool ReadEmbeddedArt(const std::filesystem::path& path, std::vector<uint8_t>& image)
+{
+    image.clear();
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    uint8_t magic[4] = {};
+    file.read((char*)magic, 4);
+    file.clear();
+    if (memcmp(magic, "fLaC", 4) == 0) return ReadFlacArt(file, image);
+    if (memcmp(magic, "ID3", 3) == 0) return ReadId3Art(file, image);
+    return false;
+}
+
+inline bool HasArtExtension(const std::filesystem::path& path)
+{
+    std::wstring extension = path.extension().wstring();
+    for (auto& ch : extension) ch = (wchar_t)towlower(ch);
+    return extension == L".jpg" || extension == L".jpeg" || extension == L".png";
+}
+
+// Cover image beside the tracks: cover, folder, front or albumart as .jpg,
+// .jpeg or .png, in that order of preference, any case. Empty if none.
+inline std::filesystem::path FindFolderArt(const std::filesystem::path& folder)
+{
+    static const wchar_t* kNames[] = { L"cover", L"folder", L"front", L"albumart" };
+    std::filesystem::path best;
+    size_t bestRank = sizeof(kNames) / sizeof(kNames[0]);
+    std::error_code ec;
+    for (std::filesystem::directory_iterator it(folder, ec), end; !ec && it != end; it.increment(ec))
+    {
+        if (!HasArtExtension(it->path())) continue;
+        std::wstring stem = it->path().stem().wstring();
+        for (auto& ch : stem) ch = (wchar_t)towlower(ch);
+        for (size_t rank = 0; rank < bestRank; rank++)
+        {
+            if (stem != kNames[rank]) continue;
+            best = it->path();
+            bestRank = rank;
+            break;
+        }
+    }
+    return best;
+}
+
+inline bool ReadArtFile(const std::filesystem::path& path, std::vector<uint8_t>& image)
+{
+    image.clear();
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(path, ec);
+    if (ec || size == 0 || size > kMaxArtBytes) return false;
+    std::ifstream file(path, std::ios::binary);
+    image.resize((size_t)size);
+    if (file.read((char*)image.data(), (std::streamsize)size)) return true;
+    image.clear();
+    return false;
+}
+
+// Cache key of a picture: hex MD5 of its bytes
+inline std::string ArtKey(const std::vector<uint8_t>& image)
+{
+    static const char kHex[] = "0123456789abcdef";
+    Md5 md5;
+    md5.Update(image.data(), image.size());
+    uint8_t digest[16];
+    md5.Finish(digest);
+    std::string key(32, '0');
+    for (int i = 0; i < 16; i++)
+    {
+        key[2 * i] = kHex[digest[i] >> 4];
+        key[2 * i + 1] = kHex[digest[i] & 15];
+    }
+    return key;
+}
+
+#ifdef _WIN32
+// Decode with WIC and shrink with its Fant (area-averaging) scaler straight
+// into premultiplied BGRA, the layout Direct2D bitmaps take. Needs COM on
+// the calling thread.
+inline bool DecodeArtThumbnail(const std::vector<uint8_t>& image, uint32_t edge, ArtThumbnail& thumbnail)
+{
+    IWICImagingFactory* pFactory = nullptr;
+    IWICStream* pStream = nullptr;
+    IWICBitmapDecoder* pDecoder = nullptr;
+    IWICBitmapFrameDecode* pFrame = nullptr;
+    IWICBitmapScaler* pScaler = nullptr;
+    IWICFormatConverter* pConverter = nullptr;
+
+    HRESULT hr = CoCreateInstance(CLSID_WICImagingFactory, NULL, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&pFactory));
+    if (SUCCEEDED(hr)) hr = pFactory->CreateStream(&pStream);
+    if (SUCCEEDED(hr)) hr = pStream->InitializeFromMemory((BYTE*)image.data(), (DWORD)image.size());
+    if (SUCCEEDED(hr)) hr = pFactory->CreateDecoderFromStream(pStream, NULL, WICDecodeMetadataCacheOnDemand, &pDecoder);
+    if (SUCCEEDED(hr)) hr = pDecoder->GetFrame(0, &pFrame);
+    UINT width = 0, height = 0;
+    if (SUCCEEDED(hr)) hr = pFrame->GetSize(&width, &height);
+    if (SUCCEEDED(hr) && (width == 0 || height == 0)) hr = E_FAIL;
+    if (SUCCEEDED(hr))
+    {
+        FitArt(width, height, edge, thumbnail.width, thumbnail.height);
+        hr = pFactory->CreateBitmapScaler(&pScaler);
+    }
+    if (SUCCEEDED(hr)) hr = pScaler->Initialize(pFrame, thumbnail.width, thumbnail.height, WICBitmapInterpolationModeFant);
+    if (SUCCEEDED(hr)) hr = pFactory->CreateFormatConverter(&pConverter);
+    if (SUCCEEDED(hr)) hr = pConverter->Initialize(pScaler, GUID_WICPixelFormat32bppPBGRA, WICBitmapDitherTypeNone, NULL, 0.0, WICBitmapPaletteTypeCustom);
+    if (SUCCEEDED(hr))
+    {
+        thumbnail.pixels.resize((size_t)thumbnail.width * thumbnail.height * 4);
+        hr = pConverter->CopyPixels(NULL, thumbnail.width * 4, (UINT)thumbnail.pixels.size(), thumbnail.pixels.data());
+    }
+
+    if (pConverter) pConverter->Release();
+    if (pScaler) pScaler->Release();
+    if (pFrame) pFrame->Release();
+    if (pDecoder) pDecoder->Release();
+    if (pStream) pStream->Release();
+    if (pFactory) pFactory->Release();
+    return SUCCEEDED(hr);
+}
+#else
+// Only the Windows UI shows art; elsewhere pictures are found but not decoded
+inline bool DecodeArtThumbnail(const std::vector<uint8_t>&, uint32_t, ArtThumbnail&) { return false; }
+#endif
+
+// Thumbnail file: this header, then height rows of width * 4 bytes
+struct ArtFileHeader
+{
+    char magic[4];          // "WMAT"
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+};
+static_assert(sizeof(ArtFileHeader) == 16, "art file header must stay packed");
+
+const uint32_t kArtFileVersion = 1;
+
+inline bool LoadArtFile(const std::filesystem::path& path, ArtThumbnail& thumbnail)
+{
+    std::ifstream file(path, std::ios::binary);
+    ArtFileHeader header;
+    if (!file.read((char*)&header, sizeof(header))) return false;
+    if (memcmp(header.magic, "WMAT", 4) != 0 || header.version != kArtFileVersion) return false;
+    if (header.width == 0 || header.height == 0 || header.width > 4096 || header.height > 4096) return false;
+    thumbnail.width = header.width;
+    thumbnail.height = header.height;
+    thumbnail.pixels.resize((size_t)header.width * header.height * 4);
+    return (bool)file.read((char*)thumbnail.pixels.data(), (std::streamsize)thumbnail.pixels.size());
+}
+
+inline bool SaveArtFile(const std::filesystem::path& path, const ArtThumbnail& thumbnail)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    ArtFileHeader header;
+    memcpy(header.magic, "WMAT", 4);
+    header.version = kArtFileVersion;
+    header.width = thumbnail.width;
+    header.height = thumbnail.height;
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)thumbnail.pixels.data(), (std::streamsize)thumbnail.pixels.size());
+    return (bool)file;
+}
+
+struct AlbumArtSettings
+{
+    size_t memoryBytes = 32u << 20;             // thumbnails kept decoded in memory
+    uint64_t diskBytes = 128ull << 20;          // thumbnail files kept in the cache folder
+};
+
+// Per track and thumbnail size, counted the first time it is resolved
+struct AlbumArtStats
+{
+    uint64_t memoryHits = 0;        // another track with the same picture was in memory
+    uint64_t diskHits = 0;
+    uint64_t decodes = 0;
+    uint64_t failures = 0;          // picture found but not decodable
+    uint64_t noArt = 0;
+    double extractMilliseconds = 0.0;   // finding, reading and hashing pictures
+    double decodeMilliseconds = 0.0;
+    double maxDecodeMilliseconds = 0.0;
+    uint64_t memoryBytes = 0;       // current cache sizes
+    uint64_t diskBytes = 0;
+};
+
+class AlbumArtCache
+{
+public:
+    ~AlbumArtCache() { Stop(); }
+
+    // Thumbnail files go to 'folder' (none if empty). 'onReady' is called on
+    // the worker thread when the first requested track's art is ready.
+    void Start(const std::filesystem::path& folder, std::function<void()> onReady, const AlbumArtSettings& settings = AlbumArtSettings())
+    {
+        Stop();
+        m_folder = folder;
+        m_onReady = std::move(onReady);
+        m_settings = settings;
+        m_quit = false;
+        m_thread = std::thread(&AlbumArtCache::WorkerLoop, this);
+    }
+
+    void Stop()
+    {
+        if (!m_thread.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_wake.notify_all();
+        m_thread.join();
+    }
+
+    // Prepare the art of 'paths', the shown track first, at 'edge' pixels.
+    // Replaces the previous request.
+    void Request(const std::vector<std::wstring>& paths, uint32_t edge)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue = paths;
+        m_shown = paths.empty() ? std::wstring() : paths[0];
+        m_edge = edge;
+        m_wake.notify_one();
+    }
+
+    // The track's thumbnail at 'edge' pixels if it is ready, else nullptr.
+    // Never waits for the worker.
+    std::shared_ptr<const ArtThumbnail> Find(const std::wstring& path, uint32_t edge)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto known = m_trackKeys.find(path);
+        if (known == m_trackKeys.end() || known->second.empty()) return nullptr;
+        return FindInMemory(CacheName(known->second, edge));
+    }
+
+    AlbumArtStats Stats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
+    }
+
+    void LogReport() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const AlbumArtStats& stats = m_stats;
+        uint64_t withArt = stats.memoryHits + stats.diskHits + stats.decodes + stats.failures;
+        if (withArt + stats.noArt == 0) return;
+        LogMessage("Album art: %llu tracks with art, %.0f%% cache hits (%llu memory, %llu disk), %llu without art, %llu undecodable",
+            (unsigned long long)withArt, withArt ? 100.0 * (stats.memoryHits + stats.diskHits) / withArt : 0.0,
+            (unsigned long long)stats.memoryHits, (unsigned long long)stats.diskHits,
+            (unsigned long long)stats.noArt, (unsigned long long)stats.failures);
+        LogMessage("Album art: %llu decodes, %.1f ms average, %.1f ms worst; %.1f ms finding pictures; %.1f MB in memory, %.1f MB on disk",
+            (unsigned long long)stats.decodes, stats.decodes ? stats.decodeMilliseconds / stats.decodes : 0.0,
+            stats.maxDecodeMilliseconds, stats.extractMilliseconds,
+            stats.memoryBytes / (1024.0 * 1024.0), stats.diskBytes / (1024.0 * 1024.0));
+    }
+
+private:
+    struct MemoryEntry
+    {
+        std::shared_ptr<const ArtThumbnail> thumbnail;
+        std::list<std::string>::iterator position;     // in m_lru
+    };
+
+    struct DiskEntry
+    {
+        uint64_t bytes = 0;
+        uint64_t lastUse = 0;       // ticks of the file clock
+    };
+
+    static std::string CacheName(const std::string& key, uint32_t edge) { return key + "-" + std::to_string(edge); }
+
+    static uint64_t FileClockNow() { return (uint64_t)std::filesystem::file_time_type::clock::now().time_since_epoch().count(); }
+
+    std::shared_ptr<const ArtThumbnail> FindInMemory(const std::string& name)
+    {
+        auto entry = m_memory.find(name);
+        if (entry == m_memory.end()) return nullptr;
+        m_lru.splice(m_lru.begin(), m_lru, entry->second.position);
+        return entry->second.thumbnail;
+    }
+
+    void AddToMemory(const std::string& name, std::shared_ptr<const ArtThumbnail> thumbnail)
+    {
+        if (m_memory.count(name)) return;
+        m_lru.push_front(name);
+        m_memoryBytes += thumbnail->pixels.size();
+        m_memory[name] = MemoryEntry{ std::move(thumbnail), m_lru.begin() };
+        // The newest entry stays even if it alone is over the limit
+        while (m_memoryBytes > m_settings.memoryBytes && m_lru.size() > 1)
+        {
+            auto oldest = m_memory.find(m_lru.back());
+            m_memoryBytes -= oldest->second.thumbnail->pixels.size();
+            m_memory.erase(oldest);
+            m_lru.pop_back();
+        }
+    }
+
+    // Worker thread only, like everything below that touches the disk index
+    void IndexDiskCache()
+    {
+        if (m_folder.empty()) return;
+        std::error_code ec;
+        std::filesystem::create_directories(m_folder, ec);
+        for (std::filesystem::directory_iterator it(m_folder, ec), end; !ec && it != end; it.increment(ec))
+        {
+            if (it->path().extension() != L".art") continue;
+            std::error_code fileError;
+            DiskEntry entry;
+            entry.bytes = it->file_size(fileError);
+            entry.lastUse = (uint64_t)it->last_write_time(fileError).time_since_epoch().count();
+            if (fileError) continue;
+            m_disk[WideToUtf8(it->path().stem().wstring())] = entry;
+            m_diskBytes += entry.bytes;
+        }
+    }
+
+    std::filesystem::path DiskPath(const std::string& name) const { return m_folder / (name + ".art"); }
+
+    bool LoadFromDisk(const std::string& name, ArtThumbnail& thumbnail)
+    {
+        auto entry = m_disk.find(name);
+        if (entry == m_disk.end()) return false;
+        if (!LoadArtFile(DiskPath(name), thumbnail))
+        {
+            RemoveFromDisk(name);
+            return false;
+        }
+        // The write time carries the use order across runs
+        std::error_code ec;
+        std::filesystem::last_write_time(DiskPath(name), std::filesystem::file_time_type::clock::now(), ec);
+        entry->second.lastUse = FileClockNow();
+        return true;
+    }
+
+    void SaveToDisk(const std::string& name, const ArtThumbnail& thumbnail)
+    {
+        if (m_folder.empty() || m_disk.count(name)) return;
+        if (!SaveArtFile(DiskPath(name), thumbnail))
+        {
+            std::error_code ec;
+            std::filesystem::remove(DiskPath(name), ec);
+            return;
+        }
+        DiskEntry entry;
+        entry.bytes = sizeof(ArtFileHeader) + thumbnail.pixels.size();
+        entry.lastUse = FileClockNow();
+        m_disk[name] = entry;
+        m_diskBytes += entry.bytes;
+
+        while (m_diskBytes > m_settings.diskBytes && m_disk.size() > 1)
+        {
+            auto oldest = std::min_element(m_disk.begin(), m_disk.end(),
+                [](const auto& a, const auto& b) { return a.second.lastUse < b.second.lastUse; });
+            RemoveFromDisk(oldest->first);
+        }
+    }
+
+    void RemoveFromDisk(const std::string& name)
+    {
+        auto entry = m_disk.find(name);
+        if (entry == m_disk.end()) return;
+        std::error_code ec;
+        std::filesystem::remove(DiskPath(name), ec);
+        m_diskBytes -= entry->second.bytes;
+        m_disk.erase(entry);
+    }
+
+    // The track's picture: embedded, else the folder image (looked up once
+    // per folder). Returns false if there is none.
+    bool ExtractArt(const std::wstring& track, std::vector<uint8_t>& image)
+    {
+        if (ReadEmbeddedArt(track, image)) return true;
+
+        std::wstring folder = std::filesystem::path(track).parent_path().wstring();
+        auto known = m_folderArt.find(folder);
+        if (known == m_folderArt.end()) known = m_folderArt.emplace(folder, FindFolderArt(folder)).first;
+        return !known->second.empty() && ReadArtFile(known->second, image);
+    }
+
+    void WorkerLoop()
+    {
+#ifdef _WIN32
+        // Art should appear soon after a track change, but never at the cost of playback
+        SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+        HRESULT hrCom = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+#endif
+        IndexDiskCache();
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_stats.diskBytes = m_diskBytes;
+        while (!m_quit)
+        {
+            if (m_queue.empty())
+            {
+                m_wake.wait(lock);
+                continue;
+            }
+            std::wstring track = m_queue.front();
+            m_queue.erase(m_queue.begin());
+            uint32_t edge = m_edge;
+
+            // Known tracks whose thumbnail is still in memory need nothing
+            auto known = m_trackKeys.find(track);
+            bool resolved = known != m_trackKeys.end() && (known->second.empty() || m_memory.count(CacheName(known->second, edge)));
+            std::string key = known != m_trackKeys.end() ? known->second : std::string();
+            lock.unlock();
+            if (resolved)
+            {
+                lock.lock();
+                continue;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            std::shared_ptr<ArtThumbnail> thumbnail = std::make_shared<ArtThumbnail>();
+            std::vector<uint8_t> image;
+            double extractMilliseconds = 0.0;
+            double decodeMilliseconds = -1.0;
+            bool fromMemory = false;
+            bool fromDisk = !key.empty() && LoadFromDisk(CacheName(key, edge), *thumbnail);
+            if (!fromDisk)
+            {
+                key = ExtractArt(track, image) ? ArtKey(image) : std::string();
+                extractMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            }
+            std::string name = CacheName(key, edge);
+
+            // Tracks of the same album share the picture
+            if (!key.empty() && !fromDisk)
+            {
+                std::lock_guard<std::mutex> memoryLock(m_mutex);
+                fromMemory = m_memory.count(name) != 0;
+            }
+            if (!key.empty() && !fromDisk && !fromMemory)
+            {
+                fromDisk = LoadFromDisk(name, *thumbnail);
+                if (!fromDisk)
+                {
+                    auto decodeStart = std::chrono::steady_clock::now();
+                    bool decoded = DecodeArtThumbnail(image, edge, *thumbnail);
+                    decodeMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - decodeStart).count();
+                    if (decoded)
+                        SaveToDisk(name, *thumbnail);
+                    else
+                        thumbnail.reset();
+                }
+            }
+
+            lock.lock();
+            m_trackKeys[track] = thumbnail ? key : std::string();
+            m_stats.extractMilliseconds += extractMilliseconds;
+            if (key.empty())
+            {
+                m_stats.noArt++;
+            }
+            else if (!thumbnail)
+            {
+                m_stats.failures++;
+            }
+            else if (fromMemory)
+            {
+                m_stats.memoryHits++;
+            }
+            else if (fromDisk)
+            {
+                m_stats.diskHits++;
+                AddToMemory(name, thumbnail);
+            }
+            else
+            {
+                m_stats.decodes++;
+                m_stats.decodeMilliseconds += decodeMilliseconds;
+                m_stats.maxDecodeMilliseconds = std::max(m_stats.maxDecodeMilliseconds, decodeMilliseconds);
+                AddToMemory(name, thumbnail);
+            }
+            m_stats.memoryBytes = m_memoryBytes;
+            m_stats.diskBytes = m_diskBytes;
+            if (thumbnail && track == m_shown && edge == m_edge && m_onReady)
+            {
+                lock.unlock();
+                m_onReady();
+                lock.lock();
+            }
+        }
+#ifdef _WIN32
+        if (SUCCEEDED(hrCom)) CoUninitialize();
+#endif
+    }
+
+    AlbumArtSettings m_settings;
+    std::filesystem::path m_folder;
+    std::function<void()> m_onReady;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::thread m_thread;
+    bool m_quit = false;
+
+    // Shared with the UI thread, under m_mutex
+    std::vector<std::wstring> m_queue;
+    std::wstring m_shown;
+    uint32_t m_edge = 0;
+    std::unordered_map<std::wstring, std::string> m_trackKeys;      // empty = no usable art
+    std::unordered_map<std::string, MemoryEntry> m_memory;
+    std::list<std::string> m_lru;                                   // most recent first
+    size_t m_memoryBytes = 0;
+    AlbumArtStats m_stats;
+
+    // Worker thread only
+    std::unordered_map<std::wstring, std::filesystem::path> m_folderArt;   // empty = none
+    std::unordered_map<std::string, DiskEntry> m_disk;
+    uint64_t m_diskBytes = 0;
+};
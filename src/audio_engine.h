@@ -0,0 +1,635 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "audio_ops.h"
+#include "audio_sink.h"
+#include "audio_source.h"
+#include "dsp_chain.h"
+#include "log.h"
+#include "resampler.h"
+#include "rt_guard.h"
+#include "rt_memory.h"
+#include "time_stretch.h"
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Playback engine: a decoder thread pulls from an AudioSource, converts to
+// the sink's rate and channel count and hands fixed-size blocks to the audio
+// thread through a lock-free queue. Render() only touches pre-allocated
+// blocks from the engine's pool, so the audio callback never allocates,
+// locks or calls into the decoder. The DSP chain (EQ, limiter) runs on the
+// audio thread so parameter changes are heard within one device period.
+// Playback speed is applied on the decoder thread by a time-stretch stage
+// after the resampler.
+//
+// By default each engine runs its own decoder thread. Hosts that play many
+// streams at once (see zone_player.h) hand the engines a DecodeDriver
+// instead, which runs the same decode steps on a shared set of threads.
+
+// One block of decoded audio in flight between the decoder and audio threads
+struct AudioBlock
+{
+    uint64_t sourceFrame;   // source position of the first frame
+    double sourceStep;      // source frames per output frame (rate ratio times speed)
+    uint32_t frames;
+    float* samples;         // interleaved, sink channel count
+};
+
+struct AudioEngineStats
+{
+    uint64_t callbacks = 0;
+    uint64_t underruns = 0;
+};
+
+class AudioEngine;
+
+// Runs decode steps for engines on threads it owns. The engine asks for
+// service with Wake() after every control call; the driver is expected to
+// also poll NeedsService() while engines play, as the audio thread drains
+// the read-ahead without telling anyone.
+class DecodeDriver
+{
+public:
+    virtual ~DecodeDriver() {}
+    virtual void Attach(AudioEngine* engine) = 0;
+    // Once this returns the driver no longer calls into 'engine'
+    virtual void Detach(AudioEngine* engine) = 0;
+    virtual void Wake(AudioEngine* engine) = 0;
+};
+
+class AudioEngine : public AudioRenderer
+{
+public:
+    static const uint32_t kBlockFrames = 1024;
+    static const uint32_t kBlockCount = 32;          // ~0.7 s of read-ahead at 48 kHz
+    static const size_t kDecodeFrames = 4096;
+    static const uint32_t kMaxSourceChannels = 8;
+    static const uint32_t kMaxUpsampleRatio = 48;    // 8 kHz source into a 384 kHz sink
+
+    ~AudioEngine() { Shutdown(); }
+
+    // Size every buffer for 'sink' and start the decoder thread, or attach
+    // to 'driver' to be decoded on its threads
+    bool Configure(AudioSink* sink, DecodeDriver* driver = nullptr)
+    {
+        m_sink = sink;
+        m_driver = driver;
+        m_outputRate = sink->SampleRate();
+        m_outputChannels = sink->Channels();
+
+        size_t blockBytes = kBlockHeaderBytes + kBlockFrames * m_outputChannels * sizeof(float);
+        size_t resampledFrames = kDecodeFrames + Resampler::kTaps * kMaxUpsampleRatio + 2;
+        m_stretch.Configure(m_outputRate, m_outputChannels, resampledFrames);
+        size_t stretchedFrames = StretchedCapacity(resampledFrames);
+        size_t scratchBytes = (kDecodeFrames * kMaxSourceChannels + (kDecodeFrames + resampledFrames + stretchedFrames) * m_outputChannels) * sizeof(float);
+
+        if (!m_arena.Init(kBlockCount * (blockBytes + 64) + scratchBytes + 4096)) return false;
+        if (!m_pool.Init(m_arena, blockBytes, kBlockCount)) return false;
+        m_filled.Init(kBlockCount);
+        m_scratchMark = m_arena.Mark();
+        m_dsp.Configure(m_outputRate, m_outputChannels);
+
+        m_quit = false;
+        m_configured = true;
+        if (m_driver)
+            m_driver->Attach(this);
+        else
+            m_thread = std::thread(&AudioEngine::DecoderLoop, this);
+        return true;
+    }
+
+    void Shutdown()
+    {
+        if (!m_configured) return;
+        Pause();
+        {
+            std::lock_guard<GuardedMutex> lock(m_decodeMutex);
+            m_quit = true;
+        }
+        if (m_driver)
+        {
+            m_driver->Detach(this);
+        }
+        else
+        {
+            m_wake.notify_all();
+            m_thread.join();
+        }
+        m_source.reset();
+        m_configured = false;
+    }
+
+    // Replace the current source. Playback is left paused at the start.
+    bool Load(std::unique_ptr<AudioSource> source)
+    {
+        Pause();
+
+        std::lock_guard<GuardedMutex> lock(m_decodeMutex);
+        FlushBlocks();
+        m_source.reset();
+
+        const AudioFormat& format = source->Format();
+        if (format.channels == 0 || format.channels > kMaxSourceChannels || format.sampleRate == 0) return false;
+        if (m_outputRate > format.sampleRate * kMaxUpsampleRatio) return false;
+
+        // Upsampling multiplies frames; decode less per step so the output fits
+        m_decodeFrames = kDecodeFrames;
+        if (m_outputRate > format.sampleRate) m_decodeFrames = kDecodeFrames * format.sampleRate / m_outputRate;
+        m_resampledCapacity = (size_t)((uint64_t)(m_decodeFrames + Resampler::kTaps) * m_outputRate / format.sampleRate) + 2;
+        m_stretchedCapacity = StretchedCapacity(m_resampledCapacity);
+
+        m_arena.ResetTo(m_scratchMark);
+        m_decoded = m_arena.AllocateArray<float>(m_decodeFrames * format.channels);
+        m_remapped = m_arena.AllocateArray<float>(m_decodeFrames * m_outputChannels);
+        m_resampled = m_arena.AllocateArray<float>(m_resampledCapacity * m_outputChannels);
+        m_stretched = m_arena.AllocateArray<float>(m_stretchedCapacity * m_outputChannels);
+        if (!m_decoded || !m_remapped || !m_resampled || !m_stretched) return false;
+
+        m_resampler.Configure(format.sampleRate, m_outputRate, m_outputChannels, m_decodeFrames);
+        m_sourceRate = format.sampleRate;
+        m_sourceChannels = format.channels;
+        m_totalFrames = source->TotalFrames();
+        m_source = std::move(source);
+
+        ResetStream(0);
+        Wake();
+        return true;
+    }
+
+    void Unload()
+    {
+        Pause();
+        std::lock_guard<GuardedMutex> lock(m_decodeMutex);
+        FlushBlocks();
+        m_source.reset();
+        m_totalFrames = 0;
+        m_positionFrame = 0;
+    }
+
+    bool IsLoaded() const { return m_source != nullptr; }
+    bool IsPlaying() const { return m_playing.load(); }
+
+    void Play()
+    {
+        if (!m_source || m_playing) return;
+        {
+            std::lock_guard<GuardedMutex> lock(m_decodeMutex);
+            Prime(4);
+        }
+        m_playing = true;
+        Wake();
+        if (!m_sink->Start()) m_playing = false;
+    }
+
+    void Pause()
+    {
+        if (!m_playing) return;
+        m_sink->Stop();
+        m_playing = false;
+    }
+
+    // Jump to 'frame' (in source frames). Playback state is preserved.
+    void Seek(uint64_t frame)
+    {
+        if (!m_source) return;
+        // Where the source will land, so the position reported matches it
+        if (frame < m_source->StartFrame()) frame = m_source->StartFrame();
+        if (m_totalFrames && frame > m_totalFrames) frame = m_totalFrames;
+
+        bool wasPlaying = m_playing;
+        if (wasPlaying) m_sink->Stop();
+        {
+            std::lock_guard<GuardedMutex> lock(m_decodeMutex);
+            FlushBlocks();
+            m_source->Seek(frame);
+            ResetStream(frame);
+            if (wasPlaying) Prime(4);
+        }
+        Wake();
+        if (wasPlaying) m_sink->Start();
+    }
+
+    // Playback speed without a pitch change, 0.5x to 3x. The read-ahead is
+    // refilled from the current position so the change is heard at once.
+    void SetSpeed(double speed)
+    {
+        bool wasPlaying = m_playing;
+        if (wasPlaying) m_sink->Stop();
+        {
+            std::lock_guard<GuardedMutex> lock(m_decodeMutex);
+            uint64_t frame = m_positionFrame.load();
+            FlushBlocks();
+            m_stretch.SetSpeed(speed);
+            if (m_source)
+            {
+                m_source->Seek(frame);
+                ResetStream(frame);
+                if (wasPlaying) Prime(4);
+            }
+        }
+        Wake();
+        if (wasPlaying) m_sink->Start();
+    }
+
+    double Speed() const { return m_stretch.Speed(); }
+
+    void SetVolume(float volume)
+    {
+        if (volume < 0.0f) volume = 0.0f;
+        if (volume > 1.0f) volume = 1.0f;
+        m_volume.store(volume, std::memory_order_relaxed);
+    }
+
+    // Position and length in source frames
+    uint64_t PositionFrames() const
+    {
+        // The stretched clock can round a frame past the end
+        uint64_t position = m_positionFrame.load(std::memory_order_relaxed);
+        return m_totalFrames && position > m_totalFrames ? m_totalFrames : position;
+    }
+    uint64_t DurationFrames() const { return m_totalFrames; }
+    uint32_t SourceRate() const { return m_sourceRate; }
+
+    // Called on the decoder thread once the last block has been played
+    void SetEndCallback(std::function<void()> callback)
+    {
+        std::lock_guard<GuardedMutex> lock(m_decodeMutex);
+        m_onEnded = std::move(callback);
+    }
+
+    // EQ and limiter settings; safe to change from the control thread while playing
+    DspChain& Dsp() { return m_dsp; }
+
+    // Log the audio thread, real-time guard, DSP and time-stretch figures.
+    // The engine never logs them itself; the player calls this once per
+    // track, when the track is replaced or playback shuts down.
+    void LogReport()
+    {
+        AudioEngineStats stats = Stats();
+        LogMessage("Audio thread: %llu callbacks, %llu underruns", (unsigned long long)stats.callbacks, (unsigned long long)stats.underruns);
+        if (RealtimeGuardEnabled())
+        {
+            RealtimeGuardStats& guard = GetRealtimeGuardStats();
+            LogMessage("Real-time guard: %llu allocations, %llu frees, %llu blocking calls on the audio thread",
+                (unsigned long long)guard.allocations.load(), (unsigned long long)guard.frees.load(),
+                (unsigned long long)guard.blockingCalls.load());
+        }
+        m_dsp.LogReport();
+        m_stretch.LogReport();
+    }
+
+    // Driver threads: run a few decode steps and deliver the end-of-track
+    // callback when it is due. Returns true if there is more to do at once.
+    bool Service()
+    {
+        std::unique_lock<GuardedMutex> lock(m_decodeMutex);
+        if (m_quit) return false;
+        bool worked = Pump();
+        if (m_ended.load(std::memory_order_acquire) && !m_endNotified)
+        {
+            m_endNotified = true;
+            std::function<void()> callback = m_onEnded;
+            lock.unlock();
+            if (callback) callback();
+            return false;
+        }
+        return worked;
+    }
+
+    // Lock-free check for drivers polling playing engines: the read-ahead
+    // has room for a batch of blocks, or the end callback is due
+    bool NeedsService() const
+    {
+        if (m_ended.load(std::memory_order_acquire) && !m_endNotified.load(std::memory_order_relaxed)) return true;
+        return m_playing.load(std::memory_order_relaxed) && !m_sourceEnded.load(std::memory_order_acquire) &&
+               m_pool.Available() >= kBlockCount / 4;
+    }
+
+    AudioEngineStats Stats() const
+    {
+        AudioEngineStats stats;
+        stats.callbacks = m_callbacks.load(std::memory_order_relaxed);
+        stats.underruns = m_underruns.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    // Audio thread: copy queued blocks to 'out' with a volume ramp
+    void Render(float* out, size_t frames) override
+    {
+        m_callbacks.fetch_add(1, std::memory_order_relaxed);
+
+        const uint32_t channels = m_outputChannels;
+        float target = m_volume.load(std::memory_order_relaxed);
+        float gain = m_currentGain;
+        float step = (target - gain) / (float)frames;
+
+        size_t done = 0;
+        while (done < frames)
+        {
+            if (!m_current)
+            {
+                if (!m_filled.Pop(m_current)) break;
+                m_currentOffset = 0;
+            }
+
+            size_t n = m_current->frames - m_currentOffset;
+            if (n > frames - done) n = frames - done;
+
+            const float* src = m_current->samples + m_currentOffset * channels;
+            float* dst = out + done * channels;
+            for (size_t i = 0; i < n; i++)
+            {
+                for (uint32_t c = 0; c < channels; c++) dst[i * channels + c] = src[i * channels + c] * gain;
+                gain += step;
+            }
+
+            done += n;
+            m_currentOffset += (uint32_t)n;
+            m_positionFrame.store(m_current->sourceFrame + (uint64_t)(m_currentOffset * m_current->sourceStep), std::memory_order_relaxed);
+
+            if (m_currentOffset == m_current->frames)
+            {
+                m_pool.Release(m_current);
+                m_current = nullptr;
+            }
+        }
+
+        if (done < frames)
+        {
+            memset(out + done * channels, 0, (frames - done) * channels * sizeof(float));
+
+            // The decoder publishes the last block before flagging the end
+            if (m_sourceEnded.load(std::memory_order_acquire) && m_filled.Size() == 0)
+                m_ended.store(true, std::memory_order_release);
+            else
+                m_underruns.fetch_add(1, std::memory_order_relaxed);
+        }
+        m_currentGain = target;
+
+        m_dsp.Process(out, frames);
+    }
+
+private:
+    static const size_t kBlockHeaderBytes = 64;
+
+    void Wake()
+    {
+        if (m_driver)
+            m_driver->Wake(this);
+        else
+            m_wake.notify_one();
+    }
+
+    AudioBlock* AcquireBlock()
+    {
+        void* memory = m_pool.Acquire();
+        if (!memory) return nullptr;
+        AudioBlock* block = static_cast<AudioBlock*>(memory);
+        block->samples = reinterpret_cast<float*>(static_cast<uint8_t*>(memory) + kBlockHeaderBytes);
+        block->frames = 0;
+        block->sourceStep = m_sourceStep;
+        block->sourceFrame = m_segmentStart + (uint64_t)(m_segmentOutputFrames * m_sourceStep);
+        return block;
+    }
+
+    // Output buffer size for stretching 'inputFrames' plus the end-of-stream padding
+    size_t StretchedCapacity(size_t inputFrames) const
+    {
+        return m_stretch.MaxOutputFrames(inputFrames) + m_stretch.MaxOutputFrames(m_stretch.FlushFrames());
+    }
+
+    // Start a new stretch of output at source frame 'frame'. Caller holds m_decodeMutex.
+    void ResetStream(uint64_t frame)
+    {
+        m_resampler.Reset();
+        m_stretch.Reset();
+        m_sourceStep = m_stretch.Speed() * m_sourceRate / m_outputRate;
+        m_segmentStart = frame;
+        m_segmentOutputFrames = 0;
+        m_pendingCount = m_pendingOffset = 0;
+        m_tailQueued = false;
+        m_sourceEnded = false;
+        m_ended = false;
+        m_endNotified = false;
+        m_positionFrame = frame;
+    }
+
+    // Return every block to the pool. The sink is stopped and m_decodeMutex held.
+    void FlushBlocks()
+    {
+        if (m_current)
+        {
+            m_pool.Release(m_current);
+            m_current = nullptr;
+        }
+        AudioBlock* block = nullptr;
+        while (m_filled.Pop(block)) m_pool.Release(block);
+        if (m_fillBlock)
+        {
+            m_pool.Release(m_fillBlock);
+            m_fillBlock = nullptr;
+        }
+        m_pendingCount = m_pendingOffset = 0;
+        m_dsp.Reset();
+    }
+
+    // Decode until 'blocks' blocks are queued so playback starts without an underrun
+    void Prime(uint32_t blocks)
+    {
+        while (m_filled.Size() < blocks && Pump()) {}
+    }
+
+    // Decoder thread step; returns false when there is nothing to do right now.
+    // Caller holds m_decodeMutex.
+    bool Pump()
+    {
+        if (!m_source || m_sourceEnded) return false;
+
+        bool worked = false;
+        for (int step = 0; step < 4; step++)
+        {
+            // Move converted audio into blocks for the audio thread
+            while (m_pendingOffset < m_pendingCount)
+            {
+                if (!m_fillBlock)
+                {
+                    m_fillBlock = AcquireBlock();
+                    if (!m_fillBlock) return worked; // every block is queued: read-ahead is full
+                }
+
+                size_t n = kBlockFrames - m_fillBlock->frames;
+                if (n > m_pendingCount - m_pendingOffset) n = m_pendingCount - m_pendingOffset;
+                memcpy(m_fillBlock->samples + m_fillBlock->frames * m_outputChannels,
+                       m_pending + m_pendingOffset * m_outputChannels, n * m_outputChannels * sizeof(float));
+                m_fillBlock->frames += (uint32_t)n;
+                m_pendingOffset += n;
+                m_segmentOutputFrames += n;
+
+                if (m_fillBlock->frames == kBlockFrames)
+                {
+                    m_filled.Push(m_fillBlock);
+                    m_fillBlock = nullptr;
+                }
+                worked = true;
+            }
+
+            if (m_tailQueued)
+            {
+                // Everything is converted: hand over the partial block and finish
+                if (m_fillBlock && m_fillBlock->frames > 0)
+                    m_filled.Push(m_fillBlock);
+                else if (m_fillBlock)
+                    m_pool.Release(m_fillBlock);
+                m_fillBlock = nullptr;
+                m_sourceEnded.store(true, std::memory_order_release);
+                return true;
+            }
+
+            size_t frames = m_source->Read(m_decoded, m_decodeFrames);
+            const float* input = nullptr;
+            if (frames == 0)
+            {
+                // End of stream: push silence through the resampler to flush its tail
+                frames = Resampler::FlushFrames();
+                m_tailQueued = true;
+            }
+            else
+            {
+                RemapChannels(m_decoded, m_sourceChannels, m_remapped, m_outputChannels, frames);
+                input = m_remapped;
+            }
+
+            size_t used = 0;
+            m_pendingCount = m_resampler.Process(input, frames, m_resampled, m_resampledCapacity, used);
+            m_pending = m_resampled;
+            if (!m_stretch.IsPassthrough())
+            {
+                // Stretch the converted audio; at the end also push the
+                // stretcher's own padding so its last frames come out
+                size_t resampled = m_pendingCount;
+                m_pendingCount = m_stretch.Process(m_resampled, resampled, m_stretched, m_stretchedCapacity, used);
+                if (m_tailQueued)
+                {
+                    m_pendingCount += m_stretch.Process(nullptr, m_stretch.FlushFrames(), m_stretched + m_pendingCount * m_outputChannels,
+                                                        m_stretchedCapacity - m_pendingCount, used);
+                }
+                m_pending = m_stretched;
+            }
+            m_pendingOffset = 0;
+            worked = true;
+        }
+        return worked;
+    }
+
+    void DecoderLoop()
+    {
+#ifdef _WIN32
+        // Media Foundation sources are read from this thread
+        HRESULT hrCom = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+#endif
+        std::unique_lock<GuardedMutex> lock(m_decodeMutex);
+        while (!m_quit)
+        {
+            bool worked = Pump();
+
+            if (m_ended.load(std::memory_order_acquire) && !m_endNotified)
+            {
+                m_endNotified = true;
+                std::function<void()> callback = m_onEnded;
+                lock.unlock();
+                if (callback) callback();
+                lock.lock();
+                continue;
+            }
+
+            if (worked)
+            {
+                // Let control calls in between steps
+                lock.unlock();
+                std::this_thread::yield();
+                lock.lock();
+            }
+            else if (m_playing)
+            {
+                // Read-ahead is full; the audio thread drains a block every ~20 ms
+                m_wake.wait_for(lock, std::chrono::milliseconds(10));
+            }
+            else
+            {
+                // Paused: sleep until a control call needs the decoder
+                m_wake.wait(lock);
+            }
+        }
+        lock.unlock();
+#ifdef _WIN32
+        if (SUCCEEDED(hrCom)) CoUninitialize();
+#endif
+    }
+
+    AudioSink* m_sink = nullptr;
+    DecodeDriver* m_driver = nullptr;   // null: own decoder thread
+    bool m_configured = false;
+    uint32_t m_outputRate = 0;
+    uint32_t m_outputChannels = 0;
+
+    // Pre-allocated storage: block pool first, per-track scratch after m_scratchMark
+    Arena m_arena;
+    BufferPool m_pool;
+    SpscQueue<AudioBlock*> m_filled;
+    size_t m_scratchMark = 0;
+
+    // Decoder thread state, guarded by m_decodeMutex
+    GuardedMutex m_decodeMutex;
+    std::condition_variable_any m_wake;
+    std::thread m_thread;
+    bool m_quit = false;
+    std::unique_ptr<AudioSource> m_source;
+    Resampler m_resampler;
+    float* m_decoded = nullptr;
+    float* m_remapped = nullptr;
+    float* m_resampled = nullptr;
+    float* m_stretched = nullptr;
+    const float* m_pending = nullptr;  // m_resampled, or m_stretched when the speed is not 1x
+    TimeStretch m_stretch;
+    size_t m_decodeFrames = kDecodeFrames;
+    size_t m_resampledCapacity = 0;
+    size_t m_stretchedCapacity = 0;
+    size_t m_pendingCount = 0;
+    size_t m_pendingOffset = 0;
+    AudioBlock* m_fillBlock = nullptr;
+    uint64_t m_segmentStart = 0;
+    uint64_t m_segmentOutputFrames = 0;
+    double m_sourceStep = 1.0;
+    bool m_tailQueued = false;
+    std::function<void()> m_onEnded;
+
+    // Written while the sink is stopped, read by the audio thread
+    uint32_t m_sourceRate = 1;
+    uint32_t m_sourceChannels = 0;
+    uint64_t m_totalFrames = 0;
+
+    // Audio thread state
+    DspChain m_dsp;
+    AudioBlock* m_current = nullptr;
+    uint32_t m_currentOffset = 0;
+    float m_currentGain = 1.0f;
+
+    // Shared between threads
+    std::atomic<bool> m_playing{ false };
+    std::atomic<float> m_volume{ 1.0f };
+    std::atomic<uint64_t> m_positionFrame{ 0 };
+    std::atomic<bool> m_sourceEnded{ false };
+    std::atomic<bool> m_ended{ false };
+    std::atomic<bool> m_endNotified{ false };  // written under m_decodeMutex
+    std::atomic<uint64_t> m_callbacks{ 0 };
+    std::atomic<uint64_t> m_underruns{ 0 };
+};
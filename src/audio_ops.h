@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Small sample-level operations shared by the offline and real-time paths
+
+// Map 'frames' frames from 'inChannels' to 'outChannels'. Mono is spread to
+// every output, a mono target averages all inputs, anything else keeps the
+// leading channels and pads missing ones with silence.
+inline void RemapChannels(const float* in, uint32_t inChannels, float* out, uint32_t outChannels, size_t frames)
+{
+    for (size_t i = 0; i < frames; i++)
+    {
+        const float* src = in + i * inChannels;
+        float* dst = out + i * outChannels;
+
+        if (inChannels == 1)
+        {
+            for (uint32_t c = 0; c < outChannels; c++) dst[c] = src[0];
+        }
+        else if (outChannels == 1)
+        {
+            float sum = 0.0f;
+            for (uint32_t c = 0; c < inChannels; c++) sum += src[c];
+            dst[0] = sum / inChannels;
+        }
+        else
+        {
+            for (uint32_t c = 0; c < outChannels; c++) dst[c] = c < inChannels ? src[c] : 0.0f;
+        }
+    }
+}
+
+inline void ApplyGain(float* samples, size_t count, float gain)
+{
+    if (gain == 1.0f) return;
+    for (size_t i = 0; i < count; i++) samples[i] *= gain;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Something that produces output audio on demand. Render() is called from
+// the sink's real-time thread and must not allocate, lock or block.
+class AudioRenderer
+{
+public:
+    virtual ~AudioRenderer() {}
+    virtual void Render(float* out, size_t frames) = 0;
+};
+
+// An output device (or a stand-in for one) that pulls audio from an
+// AudioRenderer in interleaved float at its own rate and channel count.
+class AudioSink
+{
+public:
+    virtual ~AudioSink() {}
+
+    virtual uint32_t SampleRate() const = 0;
+    virtual uint32_t Channels() const = 0;
+
+    // Begin pulling audio from the renderer on the sink's own thread
+    virtual bool Start() = 0;
+
+    // Stop pulling audio; once this returns Render() is not running and
+    // will not be called again until the next Start()
+    virtual void Stop() = 0;
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+struct AudioFormat
+{
+    uint32_t sampleRate = 0;
+    uint32_t channels = 0;
+};
+
+// A decoded audio stream. Samples are delivered as interleaved 32-bit float
+// in the range -1.0 to 1.0, in the source's native rate and channel count.
+class AudioSource
+{
+public:
+    virtual ~AudioSource() {}
+
+    virtual const AudioFormat& Format() const = 0;
+
+    // Total length in frames, or 0 if unknown
+    virtual uint64_t TotalFrames() const = 0;
+
+    // Decode up to 'frames' frames into 'out'. Returns the number of frames
+    // written; 0 means end of stream (or an unrecoverable decode error).
+    virtual size_t Read(float* out, size_t frames) = 0;
+
+    // Reposition so that the next Read starts at 'frame'
+    virtual bool Seek(uint64_t frame) = 0;
+
+    // First frame a seek can land on; Seek() moves earlier targets up to it
+    virtual uint64_t StartFrame() const { return 0; }
+
+    // True if the next Read after Seek(frame) starts at exactly 'frame'.
+    // Decoders that seek by timestamp or key frame leave it false.
+    virtual bool SeeksExactly() const { return false; }
+};
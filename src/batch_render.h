@@ -0,0 +1,194 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "audio_ops.h"
+#include "decoders.h"
+#include "resampler.h"
+#include "wav_file.h"
+
+// Offline render of a playlist: decode -> resample -> gain -> .wav, many
+// tracks at once, faster than realtime and without an audio device.
+
+struct RenderSettings
+{
+    uint32_t sampleRate = 44100;
+    uint32_t channels = 2;
+    float gain = 1.0f;
+    bool writeFloat = false;     // 32-bit float output instead of 16-bit PCM
+    unsigned threads = 0;        // 0 = one worker per hardware thread
+    size_t blockFrames = 4096;   // decode block size; bounds memory per worker
+    const std::atomic<bool>* cancel = nullptr;
+};
+
+struct RenderStats
+{
+    size_t tracksRendered = 0;
+    size_t tracksFailed = 0;
+    double audioSeconds = 0.0;   // rendered audio duration
+    double wallSeconds = 0.0;    // elapsed time for the whole batch
+    uint64_t bytesRead = 0;      // size of the source files
+    uint64_t bytesWritten = 0;   // size of the output files
+
+    double RealtimeFactor() const { return wallSeconds > 0.0 ? audioSeconds / wallSeconds : 0.0; }
+    double MegabytesPerSecond() const { return wallSeconds > 0.0 ? (bytesRead + bytesWritten) / (1024.0 * 1024.0) / wallSeconds : 0.0; }
+};
+
+// Per-worker buffers, sized once so memory stays flat regardless of track length
+struct RenderScratch
+{
+    std::vector<float> decoded;
+    std::vector<float> remapped;
+    std::vector<float> resampled;
+    Resampler resampler;
+};
+
+// Render one track. Returns false if it could not be opened or written, or
+// the batch was canceled before it finished; no partial file is left then.
+inline bool RenderTrack(const std::filesystem::path& inputPath, const std::filesystem::path& outputPath,
+                        const RenderSettings& settings, RenderScratch& scratch, RenderStats& stats)
+{
+    std::unique_ptr<AudioSource> source = OpenAudioSource(inputPath);
+    if (!source) return false;
+
+    const AudioFormat& format = source->Format();
+    const size_t block = settings.blockFrames;
+
+    scratch.decoded.resize(block * format.channels);
+    scratch.remapped.resize(block * settings.channels);
+    // Enough room for one block after upsampling, plus the filter tail
+    size_t resampledCapacity = (size_t)((uint64_t)block * settings.sampleRate / format.sampleRate) + Resampler::kTaps + 1;
+    scratch.resampled.resize(resampledCapacity * settings.channels);
+    scratch.resampler.Configure(format.sampleRate, settings.sampleRate, settings.channels, block);
+
+    WavWriter writer;
+    if (!writer.Open(outputPath, settings.sampleRate, settings.channels, settings.writeFloat)) return false;
+    auto discard = [&]()
+    {
+        writer.Close();
+        std::error_code ec;
+        std::filesystem::remove(outputPath, ec);
+        return false;
+    };
+
+    uint64_t framesOut = 0;
+    bool flushing = false;
+    size_t flushLeft = Resampler::FlushFrames();
+
+    for (;;)
+    {
+        if (settings.cancel && settings.cancel->load()) return discard();
+        size_t frames = 0;
+        const float* input = nullptr;
+
+        if (!flushing)
+        {
+            frames = source->Read(scratch.decoded.data(), block);
+            if (frames == 0)
+            {
+                flushing = true;
+                continue;
+            }
+            RemapChannels(scratch.decoded.data(), format.channels, scratch.remapped.data(), settings.channels, frames);
+            input = scratch.remapped.data();
+        }
+        else
+        {
+            if (flushLeft == 0) break;
+            frames = flushLeft;
+        }
+
+        // Feed the whole block through the resampler
+        size_t offset = 0;
+        while (offset < frames)
+        {
+            size_t used = 0;
+            size_t produced = scratch.resampler.Process(input ? input + offset * settings.channels : nullptr, frames - offset,
+                                                        scratch.resampled.data(), resampledCapacity, used);
+            ApplyGain(scratch.resampled.data(), produced * settings.channels, settings.gain);
+            if (!writer.Write(scratch.resampled.data(), produced)) return discard();
+            framesOut += produced;
+            offset += used;
+            if (flushing) flushLeft -= used;
+            if (used == 0 && produced == 0) break;
+        }
+    }
+
+    writer.Close();
+
+    std::error_code ec;
+    stats.bytesRead += std::filesystem::file_size(inputPath, ec);
+    stats.bytesWritten += writer.BytesWritten();
+    stats.audioSeconds += (double)framesOut / settings.sampleRate;
+    return true;
+}
+
+// Render every track of 'playlist' into 'outputFolder' as NNNN_<name>.wav,
+// spreading tracks over a pool of worker threads
+inline RenderStats RenderPlaylist(const std::vector<std::wstring>& playlist, const std::filesystem::path& outputFolder,
+                                  const RenderSettings& settings)
+{
+    RenderStats total;
+    std::mutex totalMutex;
+    std::atomic<size_t> nextTrack(0);
+
+    unsigned workerCount = settings.threads ? settings.threads : std::thread::hardware_concurrency();
+    if (workerCount == 0) workerCount = 1;
+    if (workerCount > playlist.size()) workerCount = (unsigned)playlist.size();
+
+    auto start = std::chrono::steady_clock::now();
+
+    auto worker = [&]()
+    {
+#ifdef _WIN32
+        // Media Foundation decoders need COM on every thread that uses them
+        HRESULT hrCom = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+#endif
+        RenderScratch scratch;
+        RenderStats local;
+
+        for (;;)
+        {
+            if (settings.cancel && settings.cancel->load()) break;
+            size_t index = nextTrack.fetch_add(1);
+            if (index >= playlist.size()) break;
+
+            std::filesystem::path input(playlist[index]);
+            wchar_t prefix[16];
+            swprintf(prefix, 16, L"%04zu_", index + 1);
+            std::filesystem::path output = outputFolder / (prefix + input.stem().wstring() + L".wav");
+
+            if (RenderTrack(input, output, settings, scratch, local))
+                local.tracksRendered++;
+            else if (!(settings.cancel && settings.cancel->load()))
+                local.tracksFailed++;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(totalMutex);
+            total.tracksRendered += local.tracksRendered;
+            total.tracksFailed += local.tracksFailed;
+            total.audioSeconds += local.audioSeconds;
+            total.bytesRead += local.bytesRead;
+            total.bytesWritten += local.bytesWritten;
+        }
+
+#ifdef _WIN32
+        if (SUCCEEDED(hrCom)) CoUninitialize();
+#endif
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < workerCount; i++) workers.emplace_back(worker);
+    for (auto& t : workers) t.join();
+
+    total.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return total;
+}
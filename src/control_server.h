@@ -0,0 +1,495 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cwctype>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "control_socket.h"
+#include "log.h"
+#include "playlist_file.h"
+#include "utf8.h"
+#include "zone_player.h"
+#include "zone_scheduler.h"
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Remote control of one PlayerZone over the local control socket, for
+// players without a window. One command per line, one reply line each:
+//
+//   play | pause | next | prev      ok
+//   seek <seconds>                  ok
+//   volume <0..1>                   ok
+//   load <file.wmpl or track>       ok (loaded paused)
+//   status                          status ...
+//   subscribe [ms]                  status ..., then pushed status lines
+//   unsubscribe | quit              ok
+//
+// and "error <reason>" on failure. A status line reads
+// "status state=playing track=3/12 time=61.250/201.480 volume=0.80 path=<utf-8 path>".
+//
+// Subscriptions are batched: one thread serves every subscriber and sends
+// each at most one line per its interval, covering all changes since the
+// last. While playing the position moves, so a line goes out every
+// interval; while paused nothing is sent and the thread sleeps untimed.
+
+class ControlServer
+{
+public:
+    static const uint32_t kDefaultIntervalMs = 1000;
+    static const uint32_t kMinIntervalMs = 50;
+
+    ControlServer(ZoneHost& host, PlayerZone& zone) : m_host(host), m_zone(zone) {}
+    ~ControlServer() { Stop(); }
+
+    bool Start(const std::string& socketName)
+    {
+        if (!m_listener.Listen(socketName)) return false;
+        m_quit = false;
+        m_quitRequested = false;
+        m_zone.SetTrackChangedCallback([this]() { NotifyChanged(); });
+        m_acceptThread = std::thread(&ControlServer::AcceptLoop, this);
+        m_publishThread = std::thread(&ControlServer::PublishLoop, this);
+        return true;
+    }
+
+    void Stop()
+    {
+        if (!m_acceptThread.joinable()) return;
+        m_zone.SetTrackChangedCallback(nullptr);
+        m_listener.Shutdown();
+        m_acceptThread.join();
+
+        std::vector<std::shared_ptr<Client>> clients;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+            clients.swap(m_clients);
+        }
+        m_publishWake.notify_all();
+        m_publishThread.join();
+        for (auto& client : clients)
+        {
+            client->connection->Shutdown();
+            client->thread.join();
+        }
+        m_listener.Close();
+    }
+
+    // Blocks until a client sends "quit"
+    void WaitForQuit()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_quitWake.wait(lock, [&]() { return m_quitRequested; });
+    }
+
+    // The zone changed other than through a command
+    void NotifyChanged()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_generation++;
+        }
+        m_publishWake.notify_one();
+    }
+
+private:
+    struct Client
+    {
+        std::unique_ptr<ControlConnection> connection;
+        std::thread thread;
+        bool done = false;
+
+        // Subscription, guarded by m_mutex
+        uint32_t intervalMs = 0;                        // 0: not subscribed
+        uint64_t sentGeneration = 0;
+        std::chrono::steady_clock::time_point nextDue;
+    };
+
+    void AcceptLoop()
+    {
+        while (std::unique_ptr<ControlConnection> connection = m_listener.Accept())
+        {
+            auto client = std::make_shared<Client>();
+            client->connection = std::move(connection);
+
+            // Reap clients that have disconnected
+            std::vector<std::shared_ptr<Client>> finished;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto done = std::stable_partition(m_clients.begin(), m_clients.end(),
+                    [](const std::shared_ptr<Client>& c) { return !c->done; });
+                finished.assign(done, m_clients.end());
+                m_clients.erase(done, m_clients.end());
+                m_clients.push_back(client);
+                client->thread = std::thread(&ControlServer::ClientLoop, this, client.get());
+            }
+            for (auto& c : finished) c->thread.join();
+        }
+    }
+
+    void ClientLoop(Client* client)
+    {
+#ifdef _WIN32
+        // Play() and Pause() start and stop the WASAPI client from here
+        HRESULT hrCom = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+#endif
+        std::string line;
+        while (client->connection->ReadLine(line))
+        {
+            if (!client->connection->WriteLine(Execute(line, *client))) break;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            client->done = true;
+            client->intervalMs = 0;
+        }
+#ifdef _WIN32
+        if (SUCCEEDED(hrCom)) CoUninitialize();
+#endif
+    }
+
+    static std::string_view Trim(std::string_view text)
+    {
+        while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) text.remove_prefix(1);
+        while (!text.empty() && (text.back() == ' ' || text.back() == '\t')) text.remove_suffix(1);
+        return text;
+    }
+
+    static bool ParseNumber(std::string_view text, double& value)
+    {
+        std::string copy(text);
+        char* end = nullptr;
+        value = strtod(copy.c_str(), &end);
+        return !copy.empty() && end && *end == '\0' && std::isfinite(value) && value >= 0.0;
+    }
+
+    std::string Execute(std::string_view line, Client& client)
+    {
+        std::string_view text = Trim(line);
+        size_t space = text.find(' ');
+        std::string_view command = text.substr(0, space);
+        std::string_view argument = space == std::string_view::npos ? std::string_view() : Trim(text.substr(space + 1));
+
+        if (command == "play")
+        {
+            m_zone.Play();
+        }
+        else if (command == "pause")
+        {
+            m_zone.Pause();
+        }
+        else if (command == "next" || command == "prev")
+        {
+            if (!(command == "next" ? m_zone.Next() : m_zone.Previous())) return "error nothing playable";
+        }
+        else if (command == "seek")
+        {
+            double seconds = 0.0;
+            if (!ParseNumber(argument, seconds)) return "error usage: seek <seconds>";
+            ZoneStatus status = m_zone.Status();
+            if (!status.loaded) return "error nothing loaded";
+            m_zone.Seek((uint64_t)std::min(seconds * status.sourceRate, 1e18));   // the engine clamps to the end
+        }
+        else if (command == "volume")
+        {
+            double volume = 0.0;
+            if (!ParseNumber(argument, volume) || volume > 1.0) return "error usage: volume <0..1>";
+            m_zone.SetVolume((float)volume);
+        }
+        else if (command == "load")
+        {
+            std::string error = Load(argument);
+            if (!error.empty()) return "error " + error;
+        }
+        else if (command == "status")
+        {
+            return StatusLine();
+        }
+        else if (command == "subscribe")
+        {
+            double interval = kDefaultIntervalMs;
+            if (!argument.empty() && !ParseNumber(argument, interval)) return "error usage: subscribe [ms]";
+            // The reply is the first status line; pushes follow from there
+            std::string reply = StatusLine();
+            std::lock_guard<std::mutex> lock(m_mutex);
+            client.intervalMs = (uint32_t)std::min(std::max(interval, (double)kMinIntervalMs), 3600000.0);
+            client.sentGeneration = m_generation;
+            client.nextDue = std::chrono::steady_clock::now() + std::chrono::milliseconds(client.intervalMs);
+            m_publishWake.notify_one();
+            return reply;
+        }
+        else if (command == "unsubscribe")
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            client.intervalMs = 0;
+            return "ok";
+        }
+        else if (command == "quit")
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_quitRequested = true;
+            }
+            m_quitWake.notify_all();
+            return "ok";
+        }
+        else
+        {
+            return "error unknown command";
+        }
+
+        NotifyChanged();
+        return "ok";
+    }
+
+    // Returns an error message, empty on success
+    std::string Load(std::string_view argument)
+    {
+        if (argument.empty()) return "usage: load <file>";
+        std::filesystem::path path(Utf8ToWide(argument));
+        std::vector<std::wstring> entries;
+        std::wstring extension = path.extension().wstring();
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::towlower);
+        if (extension == L".wmpl")
+        {
+            if (!LoadPlaylistFile(path, entries)) return "cannot read playlist";
+        }
+        else
+        {
+            entries.push_back(path.wstring());
+        }
+        if (entries.empty()) return "empty playlist";
+
+        std::vector<uint32_t> tracks;
+        tracks.reserve(entries.size());
+        for (const std::wstring& entry : entries) tracks.push_back(m_host.AddTrack(entry));
+        bool loaded = m_zone.SetPlaylist(std::move(tracks));
+        NotifyChanged();
+        return loaded ? std::string() : "cannot open the first entry";
+    }
+
+    std::string StatusLine()
+    {
+        ZoneStatus status = m_zone.Status();
+        const char* state = status.playing ? "playing" : status.loaded ? "paused" : "stopped";
+        double rate = status.sourceRate ? (double)status.sourceRate : 1.0;
+        char text[192];
+        snprintf(text, sizeof(text), "status state=%s track=%zu/%zu time=%.3f/%.3f volume=%.2f path=",
+            state, status.loaded ? status.index + 1 : 0, status.count,
+            status.positionFrames / rate, status.durationFrames / rate, status.volume);
+        std::string line = text;
+        if (status.track != LibraryIndex::kNotFound) AppendUtf8(line, m_host.TrackPath(status.track));
+        return line;
+    }
+
+    void PublishLoop()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_quit)
+        {
+            // Read outside the zone lock: a racy answer only moves a line by one interval
+            bool playing = m_zone.Engine().IsPlaying();
+            auto now = std::chrono::steady_clock::now();
+            auto wakeAt = std::chrono::steady_clock::time_point::max();
+            std::vector<std::shared_ptr<Client>> due;
+            for (auto& client : m_clients)
+            {
+                if (client->intervalMs == 0) continue;
+                if (!playing && client->sentGeneration == m_generation) continue;
+                if (client->nextDue <= now)
+                {
+                    due.push_back(client);
+                    client->sentGeneration = m_generation;
+                    client->nextDue = now + std::chrono::milliseconds(client->intervalMs);
+                }
+                else
+                {
+                    wakeAt = std::min(wakeAt, client->nextDue);
+                }
+            }
+
+            if (!due.empty())
+            {
+                lock.unlock();
+                std::string line = StatusLine();
+                for (auto& client : due) client->connection->WriteLine(line);
+                lock.lock();
+            }
+            else if (wakeAt == std::chrono::steady_clock::time_point::max())
+            {
+                m_publishWake.wait(lock);
+            }
+            else
+            {
+                m_publishWake.wait_until(lock, wakeAt);
+            }
+        }
+    }
+
+    ZoneHost& m_host;
+    PlayerZone& m_zone;
+    ControlListener m_listener;
+    std::thread m_acceptThread;
+    std::thread m_publishThread;
+
+    std::mutex m_mutex;
+    std::condition_variable m_publishWake;
+    std::condition_variable m_quitWake;
+    std::vector<std::shared_ptr<Client>> m_clients;
+    uint64_t m_generation = 0;      // bumped on every change to the zone
+    bool m_quit = false;
+    bool m_quitRequested = false;
+};
+
+// Drive a zone through the control socket as a client would and count this
+// process's wakeups per second while paused (target: none) and while
+// playing, with a status subscription open throughout. The zone plays a
+// synthetic track into a NullSink. Returns false if a command failed or the
+// paused rate is above one per second. Wakeups are not sampled on Windows.
+inline bool BenchmarkHeadless(double seconds = 5.0)
+{
+    std::error_code ec;
+    std::filesystem::path folder = std::filesystem::temp_directory_path(ec) / "headless_benchmark";
+    std::filesystem::create_directories(folder, ec);
+    std::filesystem::path track = folder / "tone.wav";
+    if (!WriteSyntheticTrack(track, 44100, 60.0, 330.0))
+    {
+        LogMessage("Headless benchmark: cannot write %s", track.string().c_str());
+        return false;
+    }
+#ifdef _WIN32
+    std::string socketName = "AudioPlayerBenchmark";
+#else
+    std::string socketName = (folder / "control.sock").string();
+#endif
+
+    bool ok = true;
+    {
+        LibraryIndex library;
+        ZoneHost host(library);
+        host.Start(1);
+        NullSink sink(host.Scheduler());
+        PlayerZone zone(host);
+        sink.Open(&zone.Engine());
+        ControlServer server(host, zone);
+        if (!zone.Open(&sink) || !server.Start(socketName))
+        {
+            LogMessage("Headless benchmark: cannot start the zone or the control socket");
+            ok = false;
+        }
+
+        std::unique_ptr<ControlConnection> client = ok ? ControlConnection::Connect(socketName) : nullptr;
+        if (ok && !client)
+        {
+            LogMessage("Headless benchmark: cannot connect to %s", socketName.c_str());
+            ok = false;
+        }
+
+        // Pushed lines arrive between replies, so one thread reads everything
+        std::mutex mutex;
+        std::condition_variable replied;
+        std::vector<std::string> replies;
+        uint64_t statusLines = 0;
+        std::thread reader;
+        if (client)
+        {
+            reader = std::thread([&]()
+            {
+                std::string line;
+                while (client->ReadLine(line))
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (line.compare(0, 7, "status ") == 0) statusLines++;
+                    replies.push_back(line);
+                    replied.notify_all();
+                }
+            });
+        }
+        // Every reply but "status" is "ok" or "error ..."; lines in between are pushes
+        auto send = [&](const std::string& command) -> bool
+        {
+            if (!ok) return false;
+            std::unique_lock<std::mutex> lock(mutex);
+            size_t before = replies.size();
+            if (!client->WriteLine(command)) return ok = false;
+            bool expectStatus = command == "status" || command.compare(0, 9, "subscribe") == 0;
+            for (;;)
+            {
+                if (!replied.wait_for(lock, std::chrono::seconds(5), [&]() { return replies.size() > before; }))
+                {
+                    LogMessage("Headless benchmark: no reply to \"%s\"", command.c_str());
+                    return ok = false;
+                }
+                const std::string& reply = replies[before++];
+                bool isStatus = reply.compare(0, 7, "status ") == 0;
+                if (isStatus && !expectStatus) continue;
+                if (reply == "ok" || (isStatus && expectStatus)) return true;
+                LogMessage("Headless benchmark: \"%s\" failed: %s", command.c_str(), reply.c_str());
+                return ok = false;
+            }
+        };
+
+        auto measure = [&](double duration) -> double
+        {
+            ProcessUsage start = SampleProcessUsage();
+            auto wallStart = std::chrono::steady_clock::now();
+            std::this_thread::sleep_for(std::chrono::duration<double>(duration));
+            ProcessUsage end = SampleProcessUsage();
+            double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+            return wall > 0.0 ? (double)(end.wakeups - start.wakeups) / wall : 0.0;
+        };
+
+        send("load " + WideToUtf8(track.wstring()));
+        send("subscribe 250");
+        send("play");
+        double playing = ok ? measure(seconds) : 0.0;
+        send("pause");
+        // Let the paused status go out before counting
+        if (ok) std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        double paused = ok ? measure(seconds) : 0.0;
+        send("status");
+        uint64_t pushedAtEnd = 0;
+        {
+            // Less the replies to "subscribe" and "status"
+            std::lock_guard<std::mutex> lock(mutex);
+            pushedAtEnd = statusLines > 2 ? statusLines - 2 : 0;
+        }
+        send("quit");
+
+        if (client) client->Shutdown();
+        if (reader.joinable()) reader.join();
+        server.Stop();
+        zone.Close();
+        sink.Close();
+        host.Stop();
+
+        if (ok)
+        {
+#ifdef _WIN32
+            LogMessage("Headless: control socket and subscription working, %llu status lines pushed (wakeups are not sampled on Windows)",
+                (unsigned long long)pushedAtEnd);
+#else
+            LogMessage("Headless: %.1f wakeups/s paused (target 0), %.1f wakeups/s playing, %llu status lines pushed at 250 ms",
+                paused, playing, (unsigned long long)pushedAtEnd);
+            if (paused > 1.0) ok = false;
+#endif
+        }
+    }
+
+    std::filesystem::remove(track, ec);
+    std::filesystem::remove(folder, ec);
+    return ok;
+}
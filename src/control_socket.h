@@ -0,0 +1,397 @@
+#pragma once
+
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "log.h"
+#include "utf8.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// Local control channel: a named pipe (\\.\pipe\<name>) on Windows, a
+// Unix-domain socket (<name> is its path) elsewhere, carrying text lines in
+// both directions. Reads and accepts block without a timeout, so an idle
+// connection costs no wakeups; Shutdown() from another thread ends them.
+
+inline std::string DefaultControlSocketName()
+{
+#ifdef _WIN32
+    return "AudioPlayer";
+#else
+    const char* runtime = getenv("XDG_RUNTIME_DIR");
+    if (runtime && *runtime) return std::string(runtime) + "/audio-player.sock";
+    return "/tmp/audio-player-" + std::to_string(getuid()) + ".sock";
+#endif
+}
+
+#ifdef _WIN32
+inline std::wstring ControlPipePath(const std::string& name)
+{
+    return L"\\\\.\\pipe\\" + Utf8ToWide(name);
+}
+#endif
+
+class ControlConnection
+{
+public:
+    static const size_t kMaxLineBytes = 64 * 1024;
+
+#ifdef _WIN32
+    // Takes ownership of an overlapped pipe handle
+    explicit ControlConnection(HANDLE pipe) : m_pipe(pipe)
+    {
+        m_readEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+        m_writeEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+        m_shutdownEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    }
+#else
+    explicit ControlConnection(int socket) : m_socket(socket) {}
+#endif
+
+    ~ControlConnection() { Close(); }
+
+    ControlConnection(const ControlConnection&) = delete;
+    ControlConnection& operator=(const ControlConnection&) = delete;
+
+    // Client side: connect to a ControlListener, null if nobody listens
+    static std::unique_ptr<ControlConnection> Connect(const std::string& name)
+    {
+#ifdef _WIN32
+        std::wstring path = ControlPipePath(name);
+        for (int attempt = 0; attempt < 3; attempt++)
+        {
+            HANDLE pipe = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+            if (pipe != INVALID_HANDLE_VALUE) return std::make_unique<ControlConnection>(pipe);
+            // Every instance taken: the server makes a new one after each accept
+            if (GetLastError() != ERROR_PIPE_BUSY || !WaitNamedPipeW(path.c_str(), 2000)) break;
+        }
+        return nullptr;
+#else
+        sockaddr_un address;
+        if (!MakeAddress(name, address)) return nullptr;
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return nullptr;
+        if (connect(fd, (const sockaddr*)&address, sizeof(address)) != 0)
+        {
+            close(fd);
+            return nullptr;
+        }
+        return std::make_unique<ControlConnection>(fd);
+#endif
+    }
+
+    // Next line, without its "\n" or "\r\n". Blocks; false once the peer has
+    // gone, after Shutdown() or if a line runs past kMaxLineBytes. One
+    // reading thread at a time.
+    bool ReadLine(std::string& line)
+    {
+        for (;;)
+        {
+            size_t end = m_buffer.find('\n', m_scanned);
+            if (end != std::string::npos)
+            {
+                line.assign(m_buffer, 0, end);
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                m_buffer.erase(0, end + 1);
+                m_scanned = 0;
+                return true;
+            }
+            m_scanned = m_buffer.size();
+            if (m_buffer.size() > kMaxLineBytes) return false;
+
+            char chunk[4096];
+            size_t got = 0;
+            if (!ReadSome(chunk, sizeof(chunk), got) || got == 0) return false;
+            m_buffer.append(chunk, got);
+        }
+    }
+
+    // Any thread; concurrent lines do not interleave
+    bool WriteLine(std::string_view line)
+    {
+        std::string data;
+        data.reserve(line.size() + 1);
+        data.append(line);
+        data += '\n';
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        return WriteAll(data.data(), data.size());
+    }
+
+    // Any thread: end a blocked ReadLine() or WriteLine() and fail later ones
+    void Shutdown()
+    {
+        m_shutdown = true;
+#ifdef _WIN32
+        if (m_shutdownEvent) SetEvent(m_shutdownEvent);
+#else
+        if (m_socket >= 0) shutdown(m_socket, SHUT_RDWR);
+#endif
+    }
+
+private:
+    bool ReadSome(char* buffer, size_t size, size_t& got)
+    {
+        if (m_shutdown) return false;
+#ifdef _WIN32
+        DWORD transferred = 0;
+        if (!Transfer(false, buffer, (DWORD)size, transferred)) return false;
+        got = transferred;
+        return true;
+#else
+        for (;;)
+        {
+            ssize_t n = recv(m_socket, buffer, size, 0);
+            if (n >= 0)
+            {
+                got = (size_t)n;
+                return true;
+            }
+            if (errno != EINTR) return false;
+        }
+#endif
+    }
+
+    // Caller holds m_writeMutex
+    bool WriteAll(const char* data, size_t size)
+    {
+        while (size > 0)
+        {
+            if (m_shutdown) return false;
+#ifdef _WIN32
+            DWORD written = 0;
+            if (!Transfer(true, const_cast<char*>(data), (DWORD)size, written)) return false;
+            size_t n = written;
+#else
+            ssize_t n = send(m_socket, data, size, MSG_NOSIGNAL);
+            if (n < 0)
+            {
+                if (errno == EINTR) continue;
+                return false;
+            }
+#endif
+            data += n;
+            size -= (size_t)n;
+        }
+        return true;
+    }
+
+#ifdef _WIN32
+    // One overlapped read or write, waited for alongside the shutdown event
+    bool Transfer(bool write, char* buffer, DWORD size, DWORD& transferred)
+    {
+        OVERLAPPED overlapped = {};
+        overlapped.hEvent = write ? m_writeEvent : m_readEvent;
+        ResetEvent(overlapped.hEvent);
+        BOOL done = write ? WriteFile(m_pipe, buffer, size, NULL, &overlapped)
+                          : ReadFile(m_pipe, buffer, size, NULL, &overlapped);
+        if (!done && GetLastError() != ERROR_IO_PENDING) return false;
+
+        HANDLE waitHandles[2] = { overlapped.hEvent, m_shutdownEvent };
+        if (WaitForMultipleObjects(2, waitHandles, FALSE, INFINITE) != WAIT_OBJECT_0)
+        {
+            // The buffer must outlive the request, so wait for the cancel to land
+            CancelIoEx(m_pipe, &overlapped);
+            GetOverlappedResult(m_pipe, &overlapped, &transferred, TRUE);
+            return false;
+        }
+        return GetOverlappedResult(m_pipe, &overlapped, &transferred, FALSE) != FALSE;
+    }
+#else
+    static bool MakeAddress(const std::string& path, sockaddr_un& address)
+    {
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(address.sun_path)) return false;
+        memcpy(address.sun_path, path.data(), path.size());
+        return true;
+    }
+
+    friend class ControlListener;
+#endif
+
+    void Close()
+    {
+#ifdef _WIN32
+        if (m_pipe != INVALID_HANDLE_VALUE) CloseHandle(m_pipe);
+        if (m_readEvent) CloseHandle(m_readEvent);
+        if (m_writeEvent) CloseHandle(m_writeEvent);
+        if (m_shutdownEvent) CloseHandle(m_shutdownEvent);
+        m_pipe = INVALID_HANDLE_VALUE;
+        m_readEvent = m_writeEvent = m_shutdownEvent = NULL;
+#else
+        if (m_socket >= 0) close(m_socket);
+        m_socket = -1;
+#endif
+    }
+
+#ifdef _WIN32
+    HANDLE m_pipe = INVALID_HANDLE_VALUE;
+    HANDLE m_readEvent = NULL;
+    HANDLE m_writeEvent = NULL;
+    HANDLE m_shutdownEvent = NULL;
+#else
+    int m_socket = -1;
+#endif
+    std::atomic<bool> m_shutdown{ false };
+    std::mutex m_writeMutex;
+    std::string m_buffer;       // read but not yet returned
+    size_t m_scanned = 0;       // bytes of m_buffer known to hold no '\n'
+};
+
+class ControlListener
+{
+public:
+    ~ControlListener() { Close(); }
+
+    // Fails if the name is taken, including by another running player
+    bool Listen(const std::string& name)
+    {
+        Close();
+        m_shutdown = false;
+#ifdef _WIN32
+        m_path = ControlPipePath(name);
+        m_connectEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+        m_shutdownEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+        m_pending = CreateInstance(true);
+        if (m_pending == INVALID_HANDLE_VALUE)
+        {
+            LogMessage("Control: cannot create pipe %s (%lu)", name.c_str(), GetLastError());
+            Close();
+            return false;
+        }
+#else
+        sockaddr_un address;
+        if (!ControlConnection::MakeAddress(name, address))
+        {
+            LogMessage("Control: bad socket path %s", name.c_str());
+            return false;
+        }
+        // A socket file nobody answers on is left over from a crash
+        if (ControlConnection::Connect(name))
+        {
+            LogMessage("Control: %s is already in use", name.c_str());
+            return false;
+        }
+        unlink(name.c_str());
+
+        m_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (m_socket < 0 || bind(m_socket, (const sockaddr*)&address, sizeof(address)) != 0)
+        {
+            LogMessage("Control: cannot bind %s (%s)", name.c_str(), strerror(errno));
+            Close();
+            return false;
+        }
+        m_path = name;
+        chmod(name.c_str(), S_IRUSR | S_IWUSR);     // this user only
+        if (listen(m_socket, 8) != 0)
+        {
+            Close();
+            return false;
+        }
+#endif
+        return true;
+    }
+
+    // Blocks for the next client; null after Shutdown() or on failure
+    std::unique_ptr<ControlConnection> Accept()
+    {
+#ifdef _WIN32
+        if (m_shutdown) return nullptr;
+        if (m_pending == INVALID_HANDLE_VALUE) m_pending = CreateInstance(false);
+        if (m_pending == INVALID_HANDLE_VALUE) return nullptr;
+
+        OVERLAPPED overlapped = {};
+        overlapped.hEvent = m_connectEvent;
+        ResetEvent(m_connectEvent);
+        if (!ConnectNamedPipe(m_pending, &overlapped))
+        {
+            DWORD error = GetLastError();
+            if (error == ERROR_IO_PENDING)
+            {
+                HANDLE waitHandles[2] = { m_connectEvent, m_shutdownEvent };
+                DWORD unused = 0;
+                if (WaitForMultipleObjects(2, waitHandles, FALSE, INFINITE) != WAIT_OBJECT_0)
+                {
+                    CancelIoEx(m_pending, &overlapped);
+                    GetOverlappedResult(m_pending, &overlapped, &unused, TRUE);
+                    return nullptr;
+                }
+                if (!GetOverlappedResult(m_pending, &overlapped, &unused, FALSE)) return nullptr;
+            }
+            else if (error != ERROR_PIPE_CONNECTED)
+            {
+                return nullptr;
+            }
+        }
+        HANDLE pipe = m_pending;
+        m_pending = INVALID_HANDLE_VALUE;
+        return std::make_unique<ControlConnection>(pipe);
+#else
+        for (;;)
+        {
+            int fd = accept(m_socket, NULL, NULL);
+            if (fd >= 0) return std::make_unique<ControlConnection>(fd);
+            if (m_shutdown || errno != EINTR) return nullptr;
+        }
+#endif
+    }
+
+    // Any thread: end a blocked Accept()
+    void Shutdown()
+    {
+        m_shutdown = true;
+#ifdef _WIN32
+        if (m_shutdownEvent) SetEvent(m_shutdownEvent);
+#else
+        if (m_socket >= 0) shutdown(m_socket, SHUT_RDWR);
+#endif
+    }
+
+    // Once no thread is in Accept()
+    void Close()
+    {
+#ifdef _WIN32
+        if (m_pending != INVALID_HANDLE_VALUE) CloseHandle(m_pending);
+        if (m_connectEvent) CloseHandle(m_connectEvent);
+        if (m_shutdownEvent) CloseHandle(m_shutdownEvent);
+        m_pending = INVALID_HANDLE_VALUE;
+        m_connectEvent = m_shutdownEvent = NULL;
+#else
+        if (m_socket >= 0) close(m_socket);
+        m_socket = -1;
+        if (!m_path.empty()) unlink(m_path.c_str());
+#endif
+        m_path.clear();
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE CreateInstance(bool first)
+    {
+        DWORD openMode = PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | (first ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0);
+        return CreateNamedPipeW(m_path.c_str(), openMode, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+            PIPE_UNLIMITED_INSTANCES, 4096, 4096, 0, NULL);
+    }
+
+    std::wstring m_path;
+    HANDLE m_pending = INVALID_HANDLE_VALUE;    // instance waiting for the next client
+    HANDLE m_connectEvent = NULL;
+    HANDLE m_shutdownEvent = NULL;
+#else
+    std::string m_path;
+    int m_socket = -1;
+#endif
+    std::atomic<bool> m_shutdown{ false };
+};
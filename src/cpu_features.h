@@ -0,0 +1,101 @@
+#pragma once
+
+// Runtime CPU feature detection for picking SIMD kernels. SSE2 is the x86
+// baseline and NEON the ARM64 baseline; anything newer must be checked here
+// before the kernel that uses it is called.
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPU_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define CPU_ARM64 1
+#include <arm_neon.h>
+#endif
+
+// Kernels using instructions above the baseline are compiled per function
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE41
+#define TARGET_AVX2
+#endif
+
+struct CpuFeatures
+{
+    bool sse41 = false;
+    bool avx2 = false;
+    bool neon = false;
+};
+
+inline CpuFeatures DetectCpuFeatures()
+{
+    CpuFeatures features;
+#if defined(CPU_X86)
+    unsigned int regs1[4] = {}, regs7[4] = {};
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    for (int i = 0; i < 4; i++) regs1[i] = (unsigned int)info[i];
+    if (maxLeaf >= 7)
+    {
+        __cpuidex(info, 7, 0);
+        for (int i = 0; i < 4; i++) regs7[i] = (unsigned int)info[i];
+    }
+#else
+    unsigned int maxLeaf = __get_cpuid_max(0, nullptr);
+    __get_cpuid(1, &regs1[0], &regs1[1], &regs1[2], &regs1[3]);
+    if (maxLeaf >= 7) __get_cpuid_count(7, 0, &regs7[0], &regs7[1], &regs7[2], &regs7[3]);
+#endif
+    features.sse41 = (regs1[2] & (1u << 19)) != 0;
+
+    // AVX2 also needs the OS to save YMM registers (OSXSAVE + XCR0 bits 1-2)
+    bool osxsave = (regs1[2] & (1u << 27)) != 0;
+    if (osxsave)
+    {
+#ifdef _MSC_VER
+        unsigned long long xcr0 = _xgetbv(0);
+#else
+        unsigned int eax, edx;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        unsigned long long xcr0 = ((unsigned long long)edx << 32) | eax;
+#endif
+        features.avx2 = (xcr0 & 6) == 6 && (regs7[1] & (1u << 5)) != 0;
+    }
+#elif defined(CPU_ARM64)
+    features.neon = true;
+#endif
+    return features;
+}
+
+inline const CpuFeatures& GetCpuFeatures()
+{
+    static const CpuFeatures features = DetectCpuFeatures();
+    return features;
+}
+
+// Number of leading zero bits; undefined for x == 0
+#ifdef _MSC_VER
+#include <intrin.h>
+inline int CountLeadingZeros64(unsigned long long x)
+{
+    unsigned long index;
+#if defined(_M_X64) || defined(_M_ARM64)
+    _BitScanReverse64(&index, x);
+    return 63 - (int)index;
+#else
+    if (_BitScanReverse(&index, (unsigned long)(x >> 32))) return 31 - (int)index;
+    _BitScanReverse(&index, (unsigned long)x);
+    return 63 - (int)index;
+#endif
+}
+#else
+inline int CountLeadingZeros64(unsigned long long x) { return __builtin_clzll(x); }
+#endif
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "audio_source.h"
+
+// Decoded audio shared between players. Tracks are cut into chunks of
+// kChunkFrames source frames, keyed by library id and chunk number, and kept
+// in a byte-bounded LRU. Zones that play the same track (grouped rooms, a
+// shared radio playlist) decode each chunk once. Two zones that miss the same
+// chunk at the same moment may both decode it; only one copy is kept.
+
+struct DecodedCacheStats
+{
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t bytes = 0;
+};
+
+class DecodedAudioCache
+{
+public:
+    static const uint64_t kChunkFrames = 32768;
+
+    using Chunk = std::shared_ptr<const std::vector<float>>;
+
+    explicit DecodedAudioCache(size_t capacityBytes = 64u << 20) : m_capacityBytes(capacityBytes) {}
+
+    Chunk Find(uint32_t track, uint64_t chunk)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto entry = m_entries.find(Key(track, chunk));
+        if (entry == m_entries.end())
+        {
+            m_stats.misses++;
+            return nullptr;
+        }
+        m_stats.hits++;
+        m_lru.splice(m_lru.begin(), m_lru, entry->second.position);
+        return entry->second.samples;
+    }
+
+    // Returns the cached chunk, which is 'samples' unless another player
+    // got there first
+    Chunk Insert(uint32_t track, uint64_t chunk, Chunk samples)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        uint64_t key = Key(track, chunk);
+        auto existing = m_entries.find(key);
+        if (existing != m_entries.end()) return existing->second.samples;
+
+        m_lru.push_front(key);
+        m_stats.bytes += samples->size() * sizeof(float);
+        m_entries[key] = Entry{ samples, m_lru.begin() };
+        while (m_stats.bytes > m_capacityBytes && m_lru.size() > 1)
+        {
+            auto oldest = m_entries.find(m_lru.back());
+            m_stats.bytes -= oldest->second.samples->size() * sizeof(float);
+            m_entries.erase(oldest);
+            m_lru.pop_back();
+            m_stats.evictions++;
+        }
+        return samples;
+    }
+
+    DecodedCacheStats Stats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
+    }
+
+private:
+    struct Entry
+    {
+        Chunk samples;
+        std::list<uint64_t>::iterator position;    // in m_lru
+    };
+
+    static uint64_t Key(uint32_t track, uint64_t chunk) { return (uint64_t)track << 32 | (uint32_t)chunk; }
+
+    size_t m_capacityBytes;
+    mutable std::mutex m_mutex;
+    std::unordered_map<uint64_t, Entry> m_entries;
+    std::list<uint64_t> m_lru;                      // most recent first
+    DecodedCacheStats m_stats;
+};
+
+// Reads a track through the cache. The decoder is only asked for chunks no
+// player has decoded yet, and is kept positioned for the next chunk so a
+// lone player decodes sequentially as before. Chunks are filled by seeking
+// to their first frame, so the source must seek exactly (SeeksExactly());
+// frames before its StartFrame() are cached as silence and never played.
+// Chunks are keyed by track alone, so every player of a track must wrap
+// the same kind of source (trimmed the same way, or not at all).
+class CachedSource : public AudioSource
+{
+public:
+    CachedSource(std::unique_ptr<AudioSource> source, uint32_t track, DecodedAudioCache& cache)
+        : m_source(std::move(source)), m_track(track), m_cache(cache)
+    {
+    }
+
+    const AudioFormat& Format() const override { return m_source->Format(); }
+    uint64_t TotalFrames() const override { return m_source->TotalFrames(); }
+
+    size_t Read(float* out, size_t frames) override
+    {
+        const uint32_t channels = m_source->Format().channels;
+        size_t done = 0;
+        while (done < frames)
+        {
+            uint64_t chunk = m_position / DecodedAudioCache::kChunkFrames;
+            if (!m_chunk || m_chunkIndex != chunk)
+            {
+                m_chunk = m_cache.Find(m_track, chunk);
+                if (!m_chunk) m_chunk = DecodeChunk(chunk);
+                m_chunkIndex = chunk;
+                if (!m_chunk) break;
+            }
+
+            uint64_t offset = m_position - chunk * DecodedAudioCache::kChunkFrames;
+            uint64_t available = m_chunk->size() / channels;
+            if (offset >= available) break;     // short last chunk: end of stream
+            size_t n = (size_t)std::min<uint64_t>(available - offset, frames - done);
+            memcpy(out + done * channels, m_chunk->data() + offset * channels, n * channels * sizeof(float));
+            done += n;
+            m_position += n;
+        }
+        return done;
+    }
+
+    bool Seek(uint64_t frame) override
+    {
+        m_position = std::max(frame, m_source->StartFrame());
+        return true;
+    }
+
+    uint64_t StartFrame() const override { return m_source->StartFrame(); }
+    bool SeeksExactly() const override { return m_source->SeeksExactly(); }
+
+private:
+    DecodedAudioCache::Chunk DecodeChunk(uint64_t chunk)
+    {
+        // A source seeks no earlier than its StartFrame(): silence up to it
+        uint64_t start = chunk * DecodedAudioCache::kChunkFrames;
+        uint64_t first = std::max(start, m_source->StartFrame());
+        size_t frames = (size_t)std::min<uint64_t>(first - start, (uint64_t)DecodedAudioCache::kChunkFrames);
+        if (frames < DecodedAudioCache::kChunkFrames && m_decoderPosition != first)
+        {
+            if (!m_source->Seek(first)) return nullptr;
+            m_decoderPosition = first;
+        }
+
+        const uint32_t channels = m_source->Format().channels;
+        auto samples = std::make_shared<std::vector<float>>(DecodedAudioCache::kChunkFrames * channels);
+        size_t silence = frames;
+        while (frames < DecodedAudioCache::kChunkFrames)
+        {
+            size_t got = m_source->Read(samples->data() + frames * channels, (size_t)DecodedAudioCache::kChunkFrames - frames);
+            if (got == 0) break;
+            frames += got;
+        }
+        m_decoderPosition += frames - silence;
+        if (frames == silence) return nullptr;
+        samples->resize(frames * channels);
+        return m_cache.Insert(m_track, chunk, std::move(samples));
+    }
+
+    std::unique_ptr<AudioSource> m_source;
+    uint32_t m_track;
+    DecodedAudioCache& m_cache;
+    uint64_t m_position = 0;
+    uint64_t m_decoderPosition = 0;
+    DecodedAudioCache::Chunk m_chunk;
+    uint64_t m_chunkIndex = 0;
+};
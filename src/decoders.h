@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cwctype>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+#include "audio_source.h"
+#include "flac_source.h"
+#include "mp3_source.h"
+#include "wav_file.h"
+#ifdef _WIN32
+#include "mf_source.h"
+#endif
+
+// Case-insensitive extension check, 'ext' given in lower case with the dot
+inline bool HasExtension(const std::filesystem::path& path, const wchar_t* ext)
+{
+    std::wstring actual = path.extension().wstring();
+    for (auto& ch : actual) ch = (wchar_t)towlower(ch);
+    return actual == ext;
+}
+
+// Open a decoder for 'path', picking the implementation by file extension.
+// 'decodeThreads' is passed to decoders that can decode ahead in parallel
+// (see FlacSource and Mp3Source::SetDecodeThreads). Returns nullptr if the
+// file cannot be decoded.
+inline std::unique_ptr<AudioSource> OpenAudioSource(const std::filesystem::path& path, unsigned decodeThreads = 1)
+{
+    if (HasExtension(path, L".wav"))
+    {
+        auto source = std::make_unique<WavSource>();
+        if (source->Open(path)) return source;
+        // Fall through: compressed .wav payloads are left to Media Foundation
+    }
+
+    if (HasExtension(path, L".flac"))
+    {
+        auto source = std::make_unique<FlacSource>();
+        source->SetDecodeThreads(decodeThreads);
+        if (source->Open(path)) return source;
+        return nullptr;
+    }
+
+    if (HasExtension(path, L".mp3"))
+    {
+        auto source = std::make_unique<Mp3Source>();
+        source->SetDecodeThreads(decodeThreads);
+        if (source->Open(path)) return source;
+        // Fall through: Layer I/II and free-format streams are left to Media Foundation
+    }
+
+#ifdef _WIN32
+    auto source = std::make_unique<MfSource>();
+    if (SUCCEEDED(source->Open(path.c_str()))) return source;
+#endif
+    return nullptr;
+}
@@ -0,0 +1,612 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "cpu_features.h"
+#include "log.h"
+#include "rt_memory.h"
+
+// Output processing run on the audio thread: a parametric EQ followed by a
+// lookahead true-peak limiter. Parameters are changed from the control
+// thread through lock-free queues and atomics, and every stage times itself
+// so the chain can be held to a per-block CPU budget.
+
+// Biquad coefficients, normalized so a0 = 1
+struct BiquadCoefficients
+{
+    double b0 = 1.0, b1 = 0.0, b2 = 0.0, a1 = 0.0, a2 = 0.0;
+};
+
+enum class EqBandType
+{
+    Peaking,
+    LowShelf,
+    HighShelf
+};
+
+struct EqBand
+{
+    EqBandType type = EqBandType::Peaking;
+    double frequency = 1000.0;
+    double gainDb = 0.0;
+    double q = 0.707;
+    bool enabled = false;
+};
+
+// RBJ "Audio EQ Cookbook" designs
+inline BiquadCoefficients DesignEqBand(const EqBand& band, double sampleRate)
+{
+    BiquadCoefficients c;
+    if (!band.enabled) return c;
+
+    const double kPi = 3.14159265358979323846;
+    double frequency = std::min(std::max(band.frequency, 10.0), sampleRate * 0.49);
+    double q = std::max(band.q, 0.05);
+    double A = pow(10.0, band.gainDb / 40.0);
+    double w0 = 2.0 * kPi * frequency / sampleRate;
+    double cosw = cos(w0);
+    double alpha = sin(w0) / (2.0 * q);
+    double shelf = 2.0 * sqrt(A) * alpha;
+
+    double b0, b1, b2, a0, a1, a2;
+    switch (band.type)
+    {
+    case EqBandType::LowShelf:
+        b0 = A * ((A + 1) - (A - 1) * cosw + shelf);
+        b1 = 2 * A * ((A - 1) - (A + 1) * cosw);
+        b2 = A * ((A + 1) - (A - 1) * cosw - shelf);
+        a0 = (A + 1) + (A - 1) * cosw + shelf;
+        a1 = -2 * ((A - 1) + (A + 1) * cosw);
+        a2 = (A + 1) + (A - 1) * cosw - shelf;
+        break;
+    case EqBandType::HighShelf:
+        b0 = A * ((A + 1) + (A - 1) * cosw + shelf);
+        b1 = -2 * A * ((A - 1) + (A + 1) * cosw);
+        b2 = A * ((A + 1) + (A - 1) * cosw - shelf);
+        a0 = (A + 1) - (A - 1) * cosw + shelf;
+        a1 = 2 * ((A - 1) - (A + 1) * cosw);
+        a2 = (A + 1) - (A - 1) * cosw - shelf;
+        break;
+    default:
+        b0 = 1 + alpha * A;
+        b1 = -2 * cosw;
+        b2 = 1 - alpha * A;
+        a0 = 1 + alpha / A;
+        a1 = -2 * cosw;
+        a2 = 1 - alpha / A;
+        break;
+    }
+
+    c.b0 = b0 / a0;
+    c.b1 = b1 / a0;
+    c.b2 = b2 / a0;
+    c.a1 = a1 / a0;
+    c.a2 = a2 / a0;
+    return c;
+}
+
+// Cascade of biquad bands in double precision (low-frequency bands at
+// 192 kHz are too sensitive for float coefficients). Channels are processed
+// in pairs, one per SIMD lane. Coefficient changes glide toward the new
+// values in small steps so moving a band never clicks.
+class ParametricEq
+{
+public:
+    static const int kMaxBands = 10;
+    static const uint32_t kMaxChannels = 8;
+    static const size_t kSmoothingFrames = 32;   // coefficients step once per this many frames
+
+    // Control thread, audio stopped
+    void Configure(uint32_t sampleRate, uint32_t channels)
+    {
+        m_sampleRate = sampleRate;
+        m_stride = channels;
+        m_channels = std::min(channels, kMaxChannels);  // channels past the limit pass through
+        m_commands.Init(64);
+
+        // ~10 ms glide regardless of sample rate
+        m_smoothing = 1.0 - exp(-(double)kSmoothingFrames / (0.010 * sampleRate));
+
+        for (int i = 0; i < kMaxBands; i++)
+        {
+            m_state[i] = BandState();
+            m_state[i].target = DesignEqBand(m_bands[i], sampleRate);
+            m_state[i].current = m_state[i].target;
+            m_state[i].active = m_bands[i].enabled;
+        }
+    }
+
+    // Control thread; the audio thread picks the change up at its next block
+    bool SetBand(int index, const EqBand& band)
+    {
+        if (index < 0 || index >= kMaxBands) return false;
+        m_bands[index] = band;
+        Command command;
+        command.band = index;
+        command.enabled = band.enabled;
+        command.coefficients = DesignEqBand(band, m_sampleRate ? m_sampleRate : 48000);
+        return m_commands.Push(command);
+    }
+
+    const EqBand& Band(int index) const { return m_bands[index]; }
+
+    // Clear the filter memory; call with the audio thread stopped
+    void Reset()
+    {
+        for (auto& state : m_state)
+        {
+            memset(state.z1, 0, sizeof(state.z1));
+            memset(state.z2, 0, sizeof(state.z2));
+        }
+    }
+
+    // Audio thread
+    void Process(float* samples, size_t frames)
+    {
+        Command command;
+        while (m_commands.Pop(command))
+        {
+            BandState& state = m_state[command.band];
+            if (command.enabled && !state.active)
+            {
+                // Fade in from a pass-through filter with clean memory
+                state.current = BiquadCoefficients();
+                memset(state.z1, 0, sizeof(state.z1));
+                memset(state.z2, 0, sizeof(state.z2));
+                state.active = true;
+            }
+            state.target = command.coefficients;
+            state.enabled = command.enabled;
+            state.gliding = true;
+        }
+
+        for (size_t start = 0; start < frames; start += kSmoothingFrames)
+        {
+            size_t n = std::min(kSmoothingFrames, frames - start);
+            float* block = samples + start * m_stride;
+            for (auto& state : m_state)
+            {
+                if (!state.active) continue;
+                if (state.gliding) Glide(state);
+                ProcessBand(state, block, n);
+            }
+        }
+
+        // Keep decaying filter memory out of the denormal range
+        for (auto& state : m_state)
+        {
+            for (uint32_t c = 0; c < m_channels; c++)
+            {
+                if (fabs(state.z1[c]) < 1e-30) state.z1[c] = 0.0;
+                if (fabs(state.z2[c]) < 1e-30) state.z2[c] = 0.0;
+            }
+        }
+    }
+
+private:
+    struct Command
+    {
+        int band = 0;
+        bool enabled = false;
+        BiquadCoefficients coefficients;
+    };
+
+    struct BandState
+    {
+        BiquadCoefficients current;
+        BiquadCoefficients target;
+        bool enabled = false;   // requested state
+        bool active = false;    // still running (a disabled band glides to pass-through first)
+        bool gliding = false;
+        alignas(16) double z1[kMaxChannels] = {};
+        alignas(16) double z2[kMaxChannels] = {};
+    };
+
+    void Glide(BandState& state)
+    {
+        double largest = 0.0;
+        auto step = [&](double& current, double target)
+        {
+            current += (target - current) * m_smoothing;
+            largest = std::max(largest, fabs(target - current));
+        };
+        step(state.current.b0, state.target.b0);
+        step(state.current.b1, state.target.b1);
+        step(state.current.b2, state.target.b2);
+        step(state.current.a1, state.target.a1);
+        step(state.current.a2, state.target.a2);
+        if (largest < 1e-7)
+        {
+            state.current = state.target;
+            state.gliding = false;
+            if (!state.enabled) state.active = false;
+        }
+    }
+
+    // Transposed direct form II, one channel pair per SIMD register
+    void ProcessBand(BandState& state, float* samples, size_t frames)
+    {
+        const BiquadCoefficients& k = state.current;
+        const uint32_t channels = m_channels;
+        const uint32_t stride = m_stride;
+        uint32_t c = 0;
+
+#if defined(CPU_X86)
+        const __m128d b0 = _mm_set1_pd(k.b0), b1 = _mm_set1_pd(k.b1), b2 = _mm_set1_pd(k.b2);
+        const __m128d a1 = _mm_set1_pd(k.a1), a2 = _mm_set1_pd(k.a2);
+        for (; c + 2 <= channels; c += 2)
+        {
+            __m128d z1 = _mm_load_pd(&state.z1[c]);
+            __m128d z2 = _mm_load_pd(&state.z2[c]);
+            float* p = samples + c;
+            for (size_t i = 0; i < frames; i++, p += stride)
+            {
+                __m128d x = _mm_cvtps_pd(_mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(p))));
+                __m128d y = _mm_add_pd(_mm_mul_pd(b0, x), z1);
+                z1 = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(b1, x), _mm_mul_pd(a1, y)), z2);
+                z2 = _mm_sub_pd(_mm_mul_pd(b2, x), _mm_mul_pd(a2, y));
+                _mm_store_sd(reinterpret_cast<double*>(p), _mm_castps_pd(_mm_cvtpd_ps(y)));
+            }
+            _mm_store_pd(&state.z1[c], z1);
+            _mm_store_pd(&state.z2[c], z2);
+        }
+#elif defined(CPU_ARM64)
+        const float64x2_t b0 = vdupq_n_f64(k.b0), b1 = vdupq_n_f64(k.b1), b2 = vdupq_n_f64(k.b2);
+        const float64x2_t a1 = vdupq_n_f64(k.a1), a2 = vdupq_n_f64(k.a2);
+        for (; c + 2 <= channels; c += 2)
+        {
+            float64x2_t z1 = vld1q_f64(&state.z1[c]);
+            float64x2_t z2 = vld1q_f64(&state.z2[c]);
+            float* p = samples + c;
+            for (size_t i = 0; i < frames; i++, p += stride)
+            {
+                float64x2_t x = vcvt_f64_f32(vld1_f32(p));
+                float64x2_t y = vfmaq_f64(z1, b0, x);
+                z1 = vfmsq_f64(vfmaq_f64(z2, b1, x), a1, y);
+                z2 = vfmsq_f64(vmulq_f64(b2, x), a2, y);
+                vst1_f32(p, vcvt_f32_f64(y));
+            }
+            vst1q_f64(&state.z1[c], z1);
+            vst1q_f64(&state.z2[c], z2);
+        }
+#endif
+
+        // Odd channel (or no SIMD)
+        for (; c < channels; c++)
+        {
+            double z1 = state.z1[c], z2 = state.z2[c];
+            float* p = samples + c;
+            for (size_t i = 0; i < frames; i++, p += stride)
+            {
+                double x = *p;
+                double y = k.b0 * x + z1;
+                z1 = k.b1 * x - k.a1 * y + z2;
+                z2 = k.b2 * x - k.a2 * y;
+                *p = (float)y;
+            }
+            state.z1[c] = z1;
+            state.z2[c] = z2;
+        }
+    }
+
+    uint32_t m_sampleRate = 0;
+    uint32_t m_stride = 0;
+    uint32_t m_channels = 0;
+    double m_smoothing = 1.0;
+    EqBand m_bands[kMaxBands];          // control thread copy
+    BandState m_state[kMaxBands];       // audio thread
+    SpscQueue<Command> m_commands;
+};
+
+// Lookahead limiter on the 4x-oversampled (true) peak. The required gain
+// is held over the lookahead window and smoothed with a moving average of
+// the same length, so the gain has fully reached its target by the time the
+// delayed peak comes out.
+class TruePeakLimiter
+{
+public:
+    static const int kOversample = 4;
+    static const int kPhaseTaps = 12;   // taps per phase of the interpolation filter
+    static const int kDetectorDelay = kPhaseTaps / 2;
+
+    // Control thread, audio stopped
+    void Configure(uint32_t sampleRate, uint32_t channels, double lookaheadMs = 1.5, double releaseMs = 60.0)
+    {
+        m_channels = channels;
+        m_window = std::max<size_t>(2, (size_t)(lookaheadMs * 0.001 * sampleRate));
+        m_delayFrames = m_window - 1 + kDetectorDelay;
+        m_release = 1.0 - exp(-1.0 / (releaseMs * 0.001 * sampleRate));
+
+        DesignInterpolator();
+
+        m_history.assign((size_t)channels * kPhaseTaps * 2, 0.0f);
+        m_delay.assign(m_delayFrames * channels, 0.0f);
+        m_holdValues.assign(m_window + 1, 1.0f);
+        m_holdFrames.assign(m_window + 1, 0);
+        m_average.assign(m_window, 1.0);
+        Reset();
+    }
+
+    // Ceiling in dB true peak; safe to call from any thread
+    void SetCeiling(double dbTruePeak) { m_ceiling.store((float)pow(10.0, dbTruePeak / 20.0)); }
+
+    // Disabling lets the gain recover smoothly instead of jumping to unity
+    void SetEnabled(bool enabled) { m_enabled.store(enabled); }
+    bool Enabled() const { return m_enabled.load(); }
+
+    // Deepest gain reduction since the last call, in dB (0 = not limiting)
+    double TakeMaxReductionDb()
+    {
+        float gain = m_minGain.exchange(1.0f);
+        return gain < 1.0f ? -20.0 * log10(gain) : 0.0;
+    }
+
+    size_t LatencyFrames() const { return m_delayFrames; }
+
+    // Clear all signal history; call with the audio thread stopped
+    void Reset()
+    {
+        std::fill(m_history.begin(), m_history.end(), 0.0f);
+        std::fill(m_delay.begin(), m_delay.end(), 0.0f);
+        std::fill(m_average.begin(), m_average.end(), 1.0);
+        m_historyPos = 0;
+        m_delayPos = 0;
+        m_averagePos = 0;
+        m_averageSum = (double)m_window;
+        m_holdHead = m_holdTail = 0;
+        m_frame = 0;
+        m_envelope = 1.0;
+    }
+
+    // Audio thread
+    void Process(float* samples, size_t frames)
+    {
+        const float ceiling = m_ceiling.load(std::memory_order_relaxed);
+        const bool enabled = m_enabled.load(std::memory_order_relaxed);
+        const uint32_t channels = m_channels;
+        float minGain = 1.0f;
+
+        for (size_t i = 0; i < frames; i++)
+        {
+            float* frame = samples + i * channels;
+
+            // True peak of this frame (as of kDetectorDelay frames ago)
+            float peak = 0.0f;
+            for (uint32_t c = 0; c < channels; c++)
+            {
+                float* history = &m_history[(size_t)c * kPhaseTaps * 2];
+                history[m_historyPos] = frame[c];
+                history[m_historyPos + kPhaseTaps] = frame[c];
+                peak = std::max(peak, InterpolatedPeak(history + m_historyPos + 1));
+            }
+            m_historyPos = m_historyPos + 1 == kPhaseTaps ? 0 : m_historyPos + 1;
+
+            float required = enabled && peak > ceiling ? ceiling / peak : 1.0f;
+
+            // Minimum over the lookahead window (monotonic queue)
+            size_t capacity = m_holdValues.size();
+            while (m_holdHead != m_holdTail)
+            {
+                size_t last = m_holdTail == 0 ? capacity - 1 : m_holdTail - 1;
+                if (m_holdValues[last] < required) break;
+                m_holdTail = last;
+            }
+            m_holdValues[m_holdTail] = required;
+            m_holdFrames[m_holdTail] = m_frame;
+            m_holdTail = m_holdTail + 1 == capacity ? 0 : m_holdTail + 1;
+            if (m_holdFrames[m_holdHead] + m_window <= m_frame) m_holdHead = m_holdHead + 1 == capacity ? 0 : m_holdHead + 1;
+            double hold = m_holdValues[m_holdHead];
+            m_frame++;
+
+            // Instant attack, exponential release, then the lookahead average
+            m_envelope = hold < m_envelope ? hold : m_envelope + (hold - m_envelope) * m_release;
+            m_averageSum += m_envelope - m_average[m_averagePos];
+            m_average[m_averagePos] = m_envelope;
+            m_averagePos = m_averagePos + 1 == m_window ? 0 : m_averagePos + 1;
+            float gain = (float)std::min(1.0, m_averageSum / (double)m_window);
+            minGain = std::min(minGain, gain);
+
+            // Swap the frame with the delayed one and apply the gain
+            float* delayed = &m_delay[m_delayPos * channels];
+            for (uint32_t c = 0; c < channels; c++)
+            {
+                float input = frame[c];
+                frame[c] = delayed[c] * gain;
+                delayed[c] = input;
+            }
+            m_delayPos = m_delayPos + 1 == m_delayFrames ? 0 : m_delayPos + 1;
+        }
+
+        // Publish for the UI/log without a read-modify-write loop on every frame
+        float previous = m_minGain.load(std::memory_order_relaxed);
+        while (minGain < previous && !m_minGain.compare_exchange_weak(previous, minGain, std::memory_order_relaxed)) {}
+    }
+
+private:
+    // Windowed-sinc interpolator: phase p estimates the signal p/4 of a frame
+    // after x[n - kDetectorDelay]; phase 0 is the sample itself
+    void DesignInterpolator()
+    {
+        const double kPi = 3.14159265358979323846;
+        const double halfWidth = kPhaseTaps / 2 + 0.5;
+        for (int p = 0; p < kOversample; p++)
+        {
+            double sum = 0.0;
+            double taps[kPhaseTaps];
+            for (int k = 0; k < kPhaseTaps; k++)
+            {
+                double d = (double)(kDetectorDelay - k) - (double)p / kOversample;
+                double sinc = d == 0.0 ? 1.0 : sin(kPi * d) / (kPi * d);
+                double window = 0.42 + 0.5 * cos(kPi * d / halfWidth) + 0.08 * cos(2.0 * kPi * d / halfWidth);
+                taps[k] = sinc * window;
+                sum += taps[k];
+            }
+            for (int k = 0; k < kPhaseTaps; k++) m_taps[k][p] = (float)(taps[k] / sum);
+        }
+    }
+
+    // 'window' holds the last kPhaseTaps inputs, oldest first
+    float InterpolatedPeak(const float* window) const
+    {
+#if defined(CPU_X86)
+        __m128 acc = _mm_setzero_ps();
+        for (int k = 0; k < kPhaseTaps; k++)
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_load_ps(m_taps[k]), _mm_set1_ps(window[kPhaseTaps - 1 - k])));
+        acc = _mm_andnot_ps(_mm_set1_ps(-0.0f), acc);
+        acc = _mm_max_ps(acc, _mm_movehl_ps(acc, acc));
+        acc = _mm_max_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+        return _mm_cvtss_f32(acc);
+#elif defined(CPU_ARM64)
+        float32x4_t acc = vdupq_n_f32(0.0f);
+        for (int k = 0; k < kPhaseTaps; k++)
+            acc = vfmaq_n_f32(acc, vld1q_f32(m_taps[k]), window[kPhaseTaps - 1 - k]);
+        return vmaxvq_f32(vabsq_f32(acc));
+#else
+        float peak = 0.0f;
+        for (int p = 0; p < kOversample; p++)
+        {
+            float acc = 0.0f;
+            for (int k = 0; k < kPhaseTaps; k++) acc += m_taps[k][p] * window[kPhaseTaps - 1 - k];
+            peak = std::max(peak, fabsf(acc));
+        }
+        return peak;
+#endif
+    }
+
+    uint32_t m_channels = 0;
+    size_t m_window = 2;
+    size_t m_delayFrames = 1;
+    double m_release = 1.0;
+
+    alignas(16) float m_taps[kPhaseTaps][kOversample] = {};
+    std::vector<float> m_history;       // per channel, kPhaseTaps samples stored twice
+    size_t m_historyPos = 0;
+    std::vector<float> m_delay;
+    size_t m_delayPos = 0;
+
+    std::vector<float> m_holdValues;    // ring of candidates for the window minimum
+    std::vector<uint64_t> m_holdFrames;
+    size_t m_holdHead = 0;
+    size_t m_holdTail = 0;
+    uint64_t m_frame = 0;
+
+    double m_envelope = 1.0;
+    std::vector<double> m_average;
+    double m_averageSum = 0.0;
+    size_t m_averagePos = 0;
+
+    std::atomic<float> m_ceiling{ 0.891f };     // -1 dBTP
+    std::atomic<bool> m_enabled{ true };
+    std::atomic<float> m_minGain{ 1.0f };
+};
+
+struct DspStageStats
+{
+    std::atomic<uint64_t> blocks{ 0 };
+    std::atomic<uint64_t> totalNanoseconds{ 0 };
+    std::atomic<uint64_t> maxNanoseconds{ 0 };
+};
+
+// EQ -> limiter, timed per stage
+class DspChain
+{
+public:
+    enum Stage
+    {
+        kStageEq,
+        kStageLimiter,
+        kStageCount
+    };
+
+    // Control thread, audio stopped
+    void Configure(uint32_t sampleRate, uint32_t channels)
+    {
+        m_sampleRate = sampleRate;
+        m_eq.Configure(sampleRate, channels);
+        m_limiter.Configure(sampleRate, channels);
+    }
+
+    ParametricEq& Eq() { return m_eq; }
+    TruePeakLimiter& Limiter() { return m_limiter; }
+
+    // CPU budget for one Process() call of the whole chain
+    void SetBudget(double microseconds) { m_budgetNanoseconds.store((uint64_t)(microseconds * 1000.0)); }
+
+    // Call with the audio thread stopped
+    void Reset()
+    {
+        m_eq.Reset();
+        m_limiter.Reset();
+    }
+
+    // Audio thread
+    void Process(float* samples, size_t frames)
+    {
+        auto start = std::chrono::steady_clock::now();
+        m_eq.Process(samples, frames);
+        auto afterEq = std::chrono::steady_clock::now();
+        m_limiter.Process(samples, frames);
+        auto end = std::chrono::steady_clock::now();
+
+        uint64_t eqNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(afterEq - start).count();
+        uint64_t limiterNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(end - afterEq).count();
+        Record(m_stats[kStageEq], eqNs);
+        Record(m_stats[kStageLimiter], limiterNs);
+        if (eqNs + limiterNs > m_budgetNanoseconds.load(std::memory_order_relaxed))
+            m_overBudget.fetch_add(1, std::memory_order_relaxed);
+        m_frames.fetch_add(frames, std::memory_order_relaxed);
+    }
+
+    const DspStageStats& Stats(Stage stage) const { return m_stats[stage]; }
+    uint64_t OverBudgetBlocks() const { return m_overBudget.load(); }
+
+    // Log the figures gathered since the last report and start new ones
+    void LogReport()
+    {
+        static const char* kNames[kStageCount] = { "EQ", "Limiter" };
+        uint64_t blocks = m_stats[kStageEq].blocks.load();
+        if (blocks == 0) return;
+
+        double framesPerBlock = (double)m_frames.load() / blocks;
+        for (int i = 0; i < kStageCount; i++)
+        {
+            const DspStageStats& stats = m_stats[i];
+            LogMessage("DSP %s: %.1f us average, %.1f us worst per block", kNames[i],
+                stats.totalNanoseconds.load() / 1000.0 / blocks, stats.maxNanoseconds.load() / 1000.0);
+        }
+        LogMessage("DSP chain: %.0f frames per block at %u Hz, %llu of %llu blocks over the %.0f us budget, %.1f dB peak reduction",
+            framesPerBlock, m_sampleRate, (unsigned long long)m_overBudget.load(), (unsigned long long)blocks,
+            m_budgetNanoseconds.load() / 1000.0, m_limiter.TakeMaxReductionDb());
+
+        for (DspStageStats& stats : m_stats)
+        {
+            stats.blocks = 0;
+            stats.totalNanoseconds = 0;
+            stats.maxNanoseconds = 0;
+        }
+        m_frames = 0;
+        m_overBudget = 0;
+    }
+
+private:
+    static void Record(DspStageStats& stats, uint64_t nanoseconds)
+    {
+        stats.blocks.fetch_add(1, std::memory_order_relaxed);
+        stats.totalNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+        if (nanoseconds > stats.maxNanoseconds.load(std::memory_order_relaxed))
+            stats.maxNanoseconds.store(nanoseconds, std::memory_order_relaxed);
+    }
+
+    uint32_t m_sampleRate = 0;
+    ParametricEq m_eq;
+    TruePeakLimiter m_limiter;
+    DspStageStats m_stats[kStageCount];
+    std::atomic<uint64_t> m_frames{ 0 };
+    std::atomic<uint64_t> m_overBudget{ 0 };
+    std::atomic<uint64_t> m_budgetNanoseconds{ 500000 };   // 5% of a 10 ms device period
+};
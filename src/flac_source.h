@@ -0,0 +1,1095 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+#include "audio_source.h"
+#include "cpu_features.h"
+#include "log.h"
+#include "md5.h"
+#include "parallel.h"
+#include "sample_convert.h"
+
+// Native streaming FLAC decoder. Frames are decoded into per-channel 32-bit
+// integer buffers sized from STREAMINFO at Open(), so steady-state decoding
+// does not allocate.
+//
+// Frames are independently decodable, so a source can also decode ahead in
+// batches: the buffered stream is split at frame headers whose sample
+// numbers follow on from each other, the frames are decoded concurrently on
+// a WorkerPool, and they are handed out in stream order. Each frame must end
+// exactly where the next header starts and pass its CRC-16; anything else
+// (a false sync inside frame data, corruption) ends the batch there and the
+// sequential path takes over, resync included.
+
+struct FlacStreamInfo
+{
+    uint32_t minBlockSize = 0;
+    uint32_t maxBlockSize = 0;
+    uint32_t minFrameSize = 0;
+    uint32_t maxFrameSize = 0;
+    uint32_t sampleRate = 0;
+    uint32_t channels = 0;
+    uint32_t bitsPerSample = 0;
+    uint64_t totalSamples = 0;
+    uint8_t md5[16] = {};
+};
+
+struct FlacSeekPoint
+{
+    uint64_t sample;
+    uint64_t offset;   // relative to the first frame header
+};
+
+struct FlacFrameHeader
+{
+    uint32_t blockSize = 0;
+    uint32_t sampleRate = 0;
+    uint32_t channelAssignment = 0;
+    uint32_t channels = 0;
+    uint32_t bitsPerSample = 0;
+    uint64_t firstSample = 0;
+    size_t headerBytes = 0;
+};
+
+struct FlacCrcTables
+{
+    uint8_t crc8[256];
+    uint16_t crc16[256];
+
+    FlacCrcTables()
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            uint8_t c8 = (uint8_t)i;
+            for (int b = 0; b < 8; b++) c8 = (uint8_t)((c8 & 0x80) ? (c8 << 1) ^ 0x07 : c8 << 1);
+            crc8[i] = c8;
+
+            uint16_t c16 = (uint16_t)(i << 8);
+            for (int b = 0; b < 8; b++) c16 = (uint16_t)((c16 & 0x8000) ? (c16 << 1) ^ 0x8005 : c16 << 1);
+            crc16[i] = c16;
+        }
+    }
+};
+
+inline const FlacCrcTables& GetFlacCrcTables()
+{
+    static const FlacCrcTables tables;
+    return tables;
+}
+
+inline uint8_t FlacCrc8(const uint8_t* data, size_t size)
+{
+    const uint8_t* table = GetFlacCrcTables().crc8;
+    uint8_t crc = 0;
+    for (size_t i = 0; i < size; i++) crc = table[crc ^ data[i]];
+    return crc;
+}
+
+inline uint16_t FlacCrc16(const uint8_t* data, size_t size)
+{
+    const uint16_t* table = GetFlacCrcTables().crc16;
+    uint16_t crc = 0;
+    for (size_t i = 0; i < size; i++) crc = (uint16_t)((crc << 8) ^ table[(crc >> 8) ^ data[i]]);
+    return crc;
+}
+
+// MSB-first bit reader over an in-memory buffer. Reads past the end return
+// zero bits; callers check Overrun() once per frame instead of per read.
+class FlacBitReader
+{
+public:
+    FlacBitReader(const uint8_t* data, size_t size) : m_data(data), m_size(size) {}
+
+    uint32_t ReadBits(int n)
+    {
+        if (n == 0) return 0;
+        if (m_bits < n) Refill();
+        uint32_t v = (uint32_t)(m_cache >> (64 - n));
+        m_cache <<= n;
+        m_bits -= n;
+        return v;
+    }
+
+    int32_t ReadSigned(int n)
+    {
+        if (n == 0) return 0;
+        uint32_t v = ReadBits(n);
+        return (int32_t)(v << (32 - n)) >> (32 - n);
+    }
+
+    // Count zero bits up to and including the terminating one
+    uint32_t ReadUnary()
+    {
+        uint32_t zeros = 0;
+        for (;;)
+        {
+            if (m_bits == 0) Refill();
+            if (m_cache != 0)
+            {
+                int lz = CountLeadingZeros64(m_cache);
+                if (lz < m_bits)
+                {
+                    m_cache <<= lz + 1;
+                    m_bits -= lz + 1;
+                    return zeros + lz;
+                }
+            }
+            zeros += m_bits;
+            m_cache = 0;
+            m_bits = 0;
+            if (m_pos > m_size + 8) return zeros; // ran off the end of corrupt data
+        }
+    }
+
+    void AlignToByte() { ReadBits(m_bits & 7); }
+
+    size_t BitPosition() const { return m_pos * 8 - m_bits; }
+    bool Overrun() const { return BitPosition() > m_size * 8; }
+
+private:
+    void Refill()
+    {
+        while (m_bits <= 56)
+        {
+            uint64_t byte = m_pos < m_size ? m_data[m_pos] : 0;
+            m_cache |= byte << (56 - m_bits);
+            m_bits += 8;
+            m_pos++;
+        }
+    }
+
+    const uint8_t* m_data;
+    size_t m_size;
+    size_t m_pos = 0;
+    uint64_t m_cache = 0;
+    int m_bits = 0;
+};
+
+// Parse a frame header at 'data'. Fields coded as "from STREAMINFO" are
+// filled from 'info'. Returns false if this is not a valid header.
+inline bool ParseFlacFrameHeader(const uint8_t* data, size_t size, const FlacStreamInfo& info, FlacFrameHeader& header)
+{
+    if (size < 6) return false;
+    if (data[0] != 0xFF || (data[1] & 0xFE) != 0xF8) return false;
+    bool variableBlockSize = (data[1] & 1) != 0;
+
+    uint32_t blockSizeCode = data[2] >> 4;
+    uint32_t sampleRateCode = data[2] & 0x0F;
+    header.channelAssignment = data[3] >> 4;
+    uint32_t sampleSizeCode = (data[3] >> 1) & 7;
+    if ((data[3] & 1) != 0 || blockSizeCode == 0 || sampleRateCode == 15 || sampleSizeCode == 3) return false;
+    if (header.channelAssignment > 10) return false;
+
+    // UTF-8 style coded frame or sample number
+    size_t pos = 4;
+    uint64_t number = data[pos++];
+    int extra = 0;
+    if (number < 0x80)              extra = 0;
+    else if ((number & 0xE0) == 0xC0) { extra = 1; number &= 0x1F; }
+    else if ((number & 0xF0) == 0xE0) { extra = 2; number &= 0x0F; }
+    else if ((number & 0xF8) == 0xF0) { extra = 3; number &= 0x07; }
+    else if ((number & 0xFC) == 0xF8) { extra = 4; number &= 0x03; }
+    else if ((number & 0xFE) == 0xFC) { extra = 5; number &= 0x01; }
+    else if (number == 0xFE)          { extra = 6; number = 0; }
+    else return false;
+    if (pos + extra + 3 > size) return false;
+    for (int i = 0; i < extra; i++)
+    {
+        uint8_t b = data[pos++];
+        if ((b & 0xC0) != 0x80) return false;
+        number = (number << 6) | (b & 0x3F);
+    }
+
+    if (blockSizeCode == 1)       header.blockSize = 192;
+    else if (blockSizeCode <= 5)  header.blockSize = 576u << (blockSizeCode - 2);
+    else if (blockSizeCode == 6)  header.blockSize = data[pos++] + 1;
+    else if (blockSizeCode == 7)  { header.blockSize = ((data[pos] << 8) | data[pos + 1]) + 1; pos += 2; }
+    else                          header.blockSize = 256u << (blockSizeCode - 8);
+
+    static const uint32_t kSampleRates[12] = { 0, 88200, 176400, 192000, 8000, 16000, 22050, 24000, 32000, 44100, 48000, 96000 };
+    if (pos + 3 > size) return false;
+    if (sampleRateCode == 0)       header.sampleRate = info.sampleRate;
+    else if (sampleRateCode < 12)  header.sampleRate = kSampleRates[sampleRateCode];
+    else if (sampleRateCode == 12) header.sampleRate = data[pos++] * 1000;
+    else if (sampleRateCode == 13) { header.sampleRate = (data[pos] << 8) | data[pos + 1]; pos += 2; }
+    else                           { header.sampleRate = ((data[pos] << 8) | data[pos + 1]) * 10; pos += 2; }
+
+    static const uint32_t kSampleSizes[8] = { 0, 8, 12, 0, 16, 20, 24, 32 };
+    header.bitsPerSample = sampleSizeCode == 0 ? info.bitsPerSample : kSampleSizes[sampleSizeCode];
+    header.channels = header.channelAssignment < 8 ? header.channelAssignment + 1 : 2;
+
+    if (pos >= size || FlacCrc8(data, pos) != data[pos]) return false;
+    header.headerBytes = pos + 1;
+
+    // Fixed block size streams number frames, variable ones number samples
+    header.firstSample = variableBlockSize ? number : number * info.maxBlockSize;
+    return true;
+}
+
+// Restore an LPC-predicted signal in place: on entry samples[order..] hold
+// residuals, on exit they hold the signal.
+inline void RestoreLpcScalar(int32_t* samples, size_t count, const int32_t* coefs, int order, int shift, bool wide)
+{
+    if (wide)
+    {
+        for (size_t i = order; i < count; i++)
+        {
+            int64_t sum = 0;
+            for (int j = 0; j < order; j++) sum += (int64_t)coefs[j] * samples[i - 1 - j];
+            samples[i] += (int32_t)(sum >> shift);
+        }
+    }
+    else
+    {
+        for (size_t i = order; i < count; i++)
+        {
+            int32_t sum = 0;
+            for (int j = 0; j < order; j++) sum += coefs[j] * samples[i - 1 - j];
+            samples[i] += sum >> shift;
+        }
+    }
+}
+
+#if defined(CPU_X86)
+// 32-bit accumulation with the dot product vectorized over the coefficients.
+// 'reversed' holds the coefficients oldest-first, zero-padded to 'padded'.
+TARGET_SSE41 inline void RestoreLpcSse41(int32_t* samples, size_t count, const int32_t* reversed, int padded, int order, int shift)
+{
+    // Leading samples cannot reach back 'padded' frames; do them in scalar
+    size_t start = (size_t)padded < count ? (size_t)padded : count;
+    for (size_t i = order; i < start; i++)
+    {
+        int32_t sum = 0;
+        for (int j = 0; j < order; j++) sum += reversed[padded - 1 - j] * samples[i - 1 - j];
+        samples[i] += sum >> shift;
+    }
+
+    for (size_t i = start; i < count; i++)
+    {
+        const int32_t* history = samples + i - padded;
+        __m128i acc = _mm_setzero_si128();
+        for (int k = 0; k < padded; k += 4)
+        {
+            __m128i s = _mm_loadu_si128((const __m128i*)(history + k));
+            __m128i c = _mm_loadu_si128((const __m128i*)(reversed + k));
+            acc = _mm_add_epi32(acc, _mm_mullo_epi32(s, c));
+        }
+        acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+        acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+        samples[i] += _mm_cvtsi128_si32(acc) >> shift;
+    }
+}
+#elif defined(CPU_ARM64)
+inline void RestoreLpcNeon(int32_t* samples, size_t count, const int32_t* reversed, int padded, int order, int shift)
+{
+    size_t start = (size_t)padded < count ? (size_t)padded : count;
+    for (size_t i = order; i < start; i++)
+    {
+        int32_t sum = 0;
+        for (int j = 0; j < order; j++) sum += reversed[padded - 1 - j] * samples[i - 1 - j];
+        samples[i] += sum >> shift;
+    }
+
+    for (size_t i = start; i < count; i++)
+    {
+        const int32_t* history = samples + i - padded;
+        int32x4_t acc = vdupq_n_s32(0);
+        for (int k = 0; k < padded; k += 4)
+            acc = vmlaq_s32(acc, vld1q_s32(history + k), vld1q_s32(reversed + k));
+        samples[i] += vaddvq_s32(acc) >> shift;
+    }
+}
+#endif
+
+// Turn zigzag-coded unsigned residuals into signed values
+inline void UnfoldResiduals(int32_t* values, size_t count)
+{
+    size_t i = 0;
+#if defined(CPU_X86)
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i u = _mm_loadu_si128((const __m128i*)(values + i));
+        __m128i sign = _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(u, _mm_set1_epi32(1)));
+        _mm_storeu_si128((__m128i*)(values + i), _mm_xor_si128(_mm_srli_epi32(u, 1), sign));
+    }
+#elif defined(CPU_ARM64)
+    for (; i + 4 <= count; i += 4)
+    {
+        uint32x4_t u = vld1q_u32((const uint32_t*)(values + i));
+        int32x4_t sign = vnegq_s32(vreinterpretq_s32_u32(vandq_u32(u, vdupq_n_u32(1))));
+        vst1q_s32(values + i, veorq_s32(vreinterpretq_s32_u32(vshrq_n_u32(u, 1)), sign));
+    }
+#endif
+    for (; i < count; i++)
+    {
+        uint32_t u = (uint32_t)values[i];
+        values[i] = (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+    }
+}
+
+// Decodes complete frames from memory. Holds only scratch state, so one
+// instance per thread can decode independent frames of the same stream.
+class FlacFrameDecoder
+{
+public:
+    void Configure(const FlacStreamInfo& info)
+    {
+        m_info = info;
+        m_channelData.resize(info.channels);
+        for (auto& channel : m_channelData) channel.assign(info.maxBlockSize, 0);
+    }
+
+    // Decode the frame at 'data'. On success 'frameBytes' is its size and the
+    // samples are available through Channel().
+    bool DecodeFrame(const uint8_t* data, size_t size, FlacFrameHeader& header, size_t& frameBytes)
+    {
+        if (!ParseFlacFrameHeader(data, size, m_info, header)) return false;
+        if (header.blockSize > m_info.maxBlockSize || header.channels != m_info.channels) return false;
+        if (header.bitsPerSample != m_info.bitsPerSample) return false;
+
+        FlacBitReader reader(data + header.headerBytes, size - header.headerBytes);
+        for (uint32_t c = 0; c < header.channels; c++)
+        {
+            // The side channel carries one extra bit
+            uint32_t bps = header.bitsPerSample;
+            if ((header.channelAssignment == 8 && c == 1) || (header.channelAssignment == 9 && c == 0) ||
+                (header.channelAssignment == 10 && c == 1))
+                bps++;
+
+            if (!DecodeSubframe(reader, bps, header.blockSize, m_channelData[c].data())) return false;
+            if (reader.Overrun()) return false;
+        }
+
+        reader.AlignToByte();
+        size_t bodyBytes = reader.BitPosition() / 8;
+        frameBytes = header.headerBytes + bodyBytes + 2;
+        if (reader.Overrun() || frameBytes > size) return false;
+
+        uint16_t crc = (uint16_t)((data[frameBytes - 2] << 8) | data[frameBytes - 1]);
+        if (FlacCrc16(data, frameBytes - 2) != crc) return false;
+
+        Decorrelate(header);
+        return true;
+    }
+
+    const int32_t* Channel(uint32_t c) const { return m_channelData[c].data(); }
+
+private:
+    bool DecodeSubframe(FlacBitReader& reader, uint32_t bps, uint32_t blockSize, int32_t* out)
+    {
+        if (reader.ReadBits(1) != 0) return false;
+        uint32_t type = reader.ReadBits(6);
+
+        uint32_t wasted = 0;
+        if (reader.ReadBits(1))
+        {
+            wasted = reader.ReadUnary() + 1;
+            if (wasted >= bps) return false;
+            bps -= wasted;
+        }
+
+        if (type == 0)
+        {
+            int32_t value = reader.ReadSigned(bps);
+            for (uint32_t i = 0; i < blockSize; i++) out[i] = value;
+        }
+        else if (type == 1)
+        {
+            for (uint32_t i = 0; i < blockSize; i++) out[i] = reader.ReadSigned(bps);
+        }
+        else if (type >= 8 && type <= 12)
+        {
+            int order = (int)(type - 8);
+            if ((uint32_t)order > blockSize) return false;
+            for (int i = 0; i < order; i++) out[i] = reader.ReadSigned(bps);
+            if (!DecodeResidual(reader, blockSize, order, out)) return false;
+            RestoreFixed(out, blockSize, order);
+        }
+        else if (type >= 32)
+        {
+            int order = (int)(type - 31);
+            if ((uint32_t)order > blockSize) return false;
+            for (int i = 0; i < order; i++) out[i] = reader.ReadSigned(bps);
+
+            int precision = (int)reader.ReadBits(4) + 1;
+            if (precision == 16) return false;
+            int shift = reader.ReadSigned(5);
+            if (shift < 0) return false;
+
+            int32_t coefs[32];
+            for (int i = 0; i < order; i++) coefs[i] = reader.ReadSigned(precision);
+            if (!DecodeResidual(reader, blockSize, order, out)) return false;
+            RestoreLpc(out, blockSize, coefs, order, precision, shift, bps);
+        }
+        else
+        {
+            return false;
+        }
+
+        if (wasted)
+            for (uint32_t i = 0; i < blockSize; i++) out[i] = (int32_t)((uint32_t)out[i] << wasted);
+        return true;
+    }
+
+    bool DecodeResidual(FlacBitReader& reader, uint32_t blockSize, int order, int32_t* out)
+    {
+        uint32_t method = reader.ReadBits(2);
+        if (method > 1) return false;
+        int paramBits = method == 0 ? 4 : 5;
+        uint32_t escape = method == 0 ? 15 : 31;
+
+        uint32_t partitionOrder = reader.ReadBits(4);
+        uint32_t partitions = 1u << partitionOrder;
+        uint32_t partitionSize = blockSize >> partitionOrder;
+        if ((partitionSize << partitionOrder) != blockSize || partitionSize < (uint32_t)order) return false;
+
+        int32_t* dst = out + order;
+        for (uint32_t p = 0; p < partitions; p++)
+        {
+            uint32_t count = p == 0 ? partitionSize - order : partitionSize;
+            uint32_t param = reader.ReadBits(paramBits);
+
+            if (param == escape)
+            {
+                int rawBits = (int)reader.ReadBits(5);
+                for (uint32_t i = 0; i < count; i++) dst[i] = reader.ReadSigned(rawBits);
+            }
+            else
+            {
+                // Decode the zigzag-coded values first, then unfold them in bulk
+                for (uint32_t i = 0; i < count; i++)
+                {
+                    uint32_t high = reader.ReadUnary();
+                    dst[i] = (int32_t)((high << param) | reader.ReadBits((int)param));
+                }
+                UnfoldResiduals(dst, count);
+            }
+            dst += count;
+            if (reader.Overrun()) return false;
+        }
+        return true;
+    }
+
+    static void RestoreFixed(int32_t* s, uint32_t count, int order)
+    {
+        switch (order)
+        {
+        case 1:
+            for (uint32_t i = 1; i < count; i++) s[i] += s[i - 1];
+            break;
+        case 2:
+            for (uint32_t i = 2; i < count; i++) s[i] += 2 * s[i - 1] - s[i - 2];
+            break;
+        case 3:
+            for (uint32_t i = 3; i < count; i++) s[i] += 3 * s[i - 1] - 3 * s[i - 2] + s[i - 3];
+            break;
+        case 4:
+            for (uint32_t i = 4; i < count; i++) s[i] += 4 * s[i - 1] - 6 * s[i - 2] + 4 * s[i - 3] - s[i - 4];
+            break;
+        }
+    }
+
+    void RestoreLpc(int32_t* s, uint32_t count, const int32_t* coefs, int order, int precision, int shift, uint32_t bps)
+    {
+        // 32-bit accumulation is exact when the worst-case sum fits
+        int orderBits = 0;
+        while ((1 << orderBits) < order) orderBits++;
+        bool wide = (int)bps + precision + orderBits > 32;
+
+        if (!wide && order >= 4)
+        {
+#if defined(CPU_X86) || defined(CPU_ARM64)
+            int padded = (order + 3) & ~3;
+            int32_t reversed[32] = {};
+            for (int j = 0; j < order; j++) reversed[padded - 1 - j] = coefs[j];
+#endif
+#if defined(CPU_X86)
+            if (GetCpuFeatures().sse41)
+            {
+                RestoreLpcSse41(s, count, reversed, padded, order, shift);
+                return;
+            }
+#elif defined(CPU_ARM64)
+            RestoreLpcNeon(s, count, reversed, padded, order, shift);
+            return;
+#endif
+        }
+        RestoreLpcScalar(s, count, coefs, order, shift, wide);
+    }
+
+    void Decorrelate(const FlacFrameHeader& header)
+    {
+        if (header.channelAssignment < 8) return;
+
+        int32_t* a = m_channelData[0].data();
+        int32_t* b = m_channelData[1].data();
+        uint32_t n = header.blockSize;
+
+        switch (header.channelAssignment)
+        {
+        case 8: // left/side
+            for (uint32_t i = 0; i < n; i++) b[i] = a[i] - b[i];
+            break;
+        case 9: // side/right
+            for (uint32_t i = 0; i < n; i++) a[i] += b[i];
+            break;
+        case 10: // mid/side
+            for (uint32_t i = 0; i < n; i++)
+            {
+                int32_t side = b[i];
+                int32_t mid = (int32_t)((uint32_t)a[i] << 1) | (side & 1);
+                a[i] = (mid + side) >> 1;
+                b[i] = (mid - side) >> 1;
+            }
+            break;
+        }
+    }
+
+    FlacStreamInfo m_info;
+    std::vector<std::vector<int32_t>> m_channelData;
+};
+
+class FlacSource : public AudioSource
+{
+public:
+    // Worker threads for batch decoding, set before Open(). 1 decodes frame
+    // by frame on the caller's thread; 0 picks a count for streams above CD
+    // rate and stays sequential below it.
+    void SetDecodeThreads(unsigned threads) { m_decodeThreads = threads; }
+    unsigned DecodeThreads() const { return m_pool ? m_pool->Threads() : 1; }
+
+    bool Open(const std::filesystem::path& path)
+    {
+        m_file.open(path, std::ios::binary);
+        if (!m_file) return false;
+
+        m_file.seekg(0, std::ios::end);
+        m_fileSize = (uint64_t)m_file.tellg();
+        m_file.seekg(0, std::ios::beg);
+
+        if (!ReadMetadata()) return false;
+        if (m_info.channels == 0 || m_info.sampleRate == 0 || m_info.maxBlockSize < 16) return false;
+        if (m_info.bitsPerSample < 4 || m_info.bitsPerSample > 24) return false;
+
+        m_format.sampleRate = m_info.sampleRate;
+        m_format.channels = m_info.channels;
+        m_scale = 1.0f / (float)(1u << (m_info.bitsPerSample - 1));
+
+        // The buffer must always be able to hold one whole frame
+        uint64_t worstFrame = (uint64_t)m_info.maxBlockSize * m_info.channels * (m_info.bitsPerSample + 1) / 8 + 64;
+        m_maxFrameBytes = (size_t)(m_info.maxFrameSize > worstFrame ? m_info.maxFrameSize : worstFrame);
+        m_buffer.resize(m_maxFrameBytes + kReadAhead);
+
+        m_decoder.Configure(m_info);
+        m_current = &m_decoder;
+
+        unsigned threads = m_decodeThreads;
+        if (threads == 0)
+        {
+            bool heavy = (uint64_t)m_info.sampleRate * m_info.channels * m_info.bitsPerSample > 48000ull * 2 * 16;
+            threads = heavy ? std::thread::hardware_concurrency() : 1;
+            if (threads > kAutoDecodeThreads) threads = kAutoDecodeThreads;
+        }
+        if (threads > 1)
+        {
+            // A few frames per worker, within a bounded amount of decoded samples
+            size_t slots = kBatchSamples / ((size_t)m_info.maxBlockSize * m_info.channels);
+            if (slots < (size_t)threads * 2) slots = (size_t)threads * 2;
+            if (slots > kMaxBatchFrames) slots = kMaxBatchFrames;
+            m_batch.resize(slots);
+            for (auto& frame : m_batch) frame.decoder.Configure(m_info);
+            m_buffer.resize(m_maxFrameBytes * (slots + 1) + kReadAhead);
+            m_pool = std::make_unique<WorkerPool>(threads);
+        }
+
+        m_md5Active = true;
+        m_md5.Reset();
+        return Reposition(m_firstFrameOffset);
+    }
+
+    const AudioFormat& Format() const override { return m_format; }
+    uint64_t TotalFrames() const override { return m_info.totalSamples; }
+
+    const FlacStreamInfo& StreamInfo() const { return m_info; }
+    const std::vector<FlacSeekPoint>& SeekTable() const { return m_seekTable; }
+    uint64_t FirstFrameOffset() const { return m_firstFrameOffset; }
+    uint64_t FileSize() const { return m_fileSize; }
+
+    // True once a full decode from the start has matched the STREAMINFO MD5
+    bool Md5Verified() const { return m_md5Result == 1; }
+
+    size_t Read(float* out, size_t frames) override
+    {
+        size_t done = 0;
+        while (done < frames)
+        {
+            if (m_frameOffset == m_frameSamples)
+            {
+                if (!DecodeNextFrame()) break;
+                continue;
+            }
+
+            size_t chunk = m_frameSamples - m_frameOffset;
+            if (chunk > frames - done) chunk = frames - done;
+            ConvertFrame(out + done * m_format.channels, m_frameOffset, chunk);
+            m_frameOffset += (uint32_t)chunk;
+            done += chunk;
+        }
+        return done;
+    }
+
+    bool Seek(uint64_t frame) override
+    {
+        m_md5Active = false;
+        if (m_info.totalSamples && frame >= m_info.totalSamples)
+        {
+            m_frameSamples = m_frameOffset = 0;
+            m_endOfStream = true;
+            return true;
+        }
+
+        uint64_t offset = m_firstFrameOffset;
+        uint64_t firstSample = 0;
+
+        // Nearest seek point at or before the target
+        for (const auto& point : m_seekTable)
+        {
+            if (point.sample > frame) break;
+            offset = m_firstFrameOffset + point.offset;
+            firstSample = point.sample;
+        }
+
+        // Without a usable seek point, bisect on frame headers
+        if (frame - firstSample > (uint64_t)m_info.maxBlockSize * 16)
+            BisectForSample(frame, offset);
+
+        if (!Reposition(offset)) return false;
+
+        // Decode forward to the frame holding the target and skip into it
+        for (;;)
+        {
+            if (!DecodeNextFrame()) return false;
+            if (m_frameFirstSample + m_frameSamples > frame)
+            {
+                if (frame > m_frameFirstSample) m_frameOffset = (uint32_t)(frame - m_frameFirstSample);
+                return true;
+            }
+        }
+    }
+
+    bool SeeksExactly() const override { return true; }
+
+private:
+    bool ReadExact(void* dst, size_t size)
+    {
+        return (bool)m_file.read((char*)dst, size);
+    }
+
+    bool ReadMetadata()
+    {
+        uint8_t marker[10];
+        if (!ReadExact(marker, 4)) return false;
+
+        // Skip an ID3v2 tag some taggers put in front of the stream
+        if (memcmp(marker, "ID3", 3) == 0)
+        {
+            if (!ReadExact(marker + 4, 6)) return false;
+            uint32_t tagSize = ((marker[6] & 0x7F) << 21) | ((marker[7] & 0x7F) << 14) | ((marker[8] & 0x7F) << 7) | (marker[9] & 0x7F);
+            if (marker[5] & 0x10) tagSize += 10; // footer
+            m_file.seekg(tagSize, std::ios::cur);
+            if (!ReadExact(marker, 4)) return false;
+        }
+        if (memcmp(marker, "fLaC", 4) != 0) return false;
+
+        bool haveStreamInfo = false;
+        for (;;)
+        {
+            uint8_t blockHeader[4];
+            if (!ReadExact(blockHeader, 4)) return false;
+            bool last = (blockHeader[0] & 0x80) != 0;
+            uint32_t type = blockHeader[0] & 0x7F;
+            uint32_t length = (blockHeader[1] << 16) | (blockHeader[2] << 8) | blockHeader[3];
+
+            if (type == 0)
+            {
+                uint8_t b[34];
+                if (length < 34 || !ReadExact(b, 34)) return false;
+                m_file.seekg(length - 34, std::ios::cur);
+
+                m_info.minBlockSize = (b[0] << 8) | b[1];
+                m_info.maxBlockSize = (b[2] << 8) | b[3];
+                m_info.minFrameSize = (b[4] << 16) | (b[5] << 8) | b[6];
+                m_info.maxFrameSize = (b[7] << 16) | (b[8] << 8) | b[9];
+                m_info.sampleRate = (b[10] << 12) | (b[11] << 4) | (b[12] >> 4);
+                m_info.channels = ((b[12] >> 1) & 7) + 1;
+                m_info.bitsPerSample = (((b[12] & 1) << 4) | (b[13] >> 4)) + 1;
+                m_info.totalSamples = ((uint64_t)(b[13] & 0x0F) << 32) | ((uint32_t)b[14] << 24) | (b[15] << 16) | (b[16] << 8) | b[17];
+                memcpy(m_info.md5, b + 18, 16);
+                haveStreamInfo = true;
+            }
+            else if (type == 3)
+            {
+                for (uint32_t i = 0; i + 18 <= length; i += 18)
+                {
+                    uint8_t p[18];
+                    if (!ReadExact(p, 18)) return false;
+                    FlacSeekPoint point = { 0, 0 };
+                    for (int j = 0; j < 8; j++) point.sample = (point.sample << 8) | p[j];
+                    for (int j = 8; j < 16; j++) point.offset = (point.offset << 8) | p[j];
+                    if (point.sample != ~0ull) m_seekTable.push_back(point); // skip placeholders
+                }
+                m_file.seekg(length % 18, std::ios::cur);
+            }
+            else
+            {
+                m_file.seekg(length, std::ios::cur);
+            }
+
+            if (!m_file) return false;
+            if (last) break;
+        }
+
+        m_firstFrameOffset = (uint64_t)m_file.tellg();
+        return haveStreamInfo;
+    }
+
+    // Drop buffered data and continue reading from 'offset'
+    bool Reposition(uint64_t offset)
+    {
+        m_file.clear();
+        m_file.seekg((std::streamoff)offset, std::ios::beg);
+        m_bufferStart = m_bufferEnd = 0;
+        m_frameSamples = m_frameOffset = 0;
+        m_batchNext = m_batchCount = 0;
+        m_endOfStream = false;
+        m_fileEnd = false;
+        return (bool)m_file;
+    }
+
+    // Make sure at least 'wanted' bytes are buffered, unless the file ends first
+    void FillBuffer(size_t wanted)
+    {
+        if (m_fileEnd || m_bufferEnd - m_bufferStart >= wanted) return;
+
+        memmove(m_buffer.data(), m_buffer.data() + m_bufferStart, m_bufferEnd - m_bufferStart);
+        m_bufferEnd -= m_bufferStart;
+        m_bufferStart = 0;
+
+        m_file.read((char*)m_buffer.data() + m_bufferEnd, m_buffer.size() - m_bufferEnd);
+        m_bufferEnd += (size_t)m_file.gcount();
+        if (!m_file) m_fileEnd = true;
+    }
+
+    bool DecodeNextFrame()
+    {
+        m_frameSamples = m_frameOffset = 0;
+        if (m_pool && !m_endOfStream && (m_batchNext < m_batchCount || DecodeBatch()))
+        {
+            const BatchFrame& frame = m_batch[m_batchNext++];
+            m_current = &frame.decoder;
+            m_frameSamples = frame.header.blockSize;
+            m_frameFirstSample = frame.header.firstSample;
+            if (m_md5Active) UpdateMd5();
+            return true;
+        }
+
+        m_current = &m_decoder;
+        while (!m_endOfStream)
+        {
+            FillBuffer(m_maxFrameBytes);
+            size_t available = m_bufferEnd - m_bufferStart;
+            if (available < 6)
+            {
+                m_endOfStream = true;
+                break;
+            }
+
+            FlacFrameHeader header;
+            size_t frameBytes = 0;
+            if (m_decoder.DecodeFrame(m_buffer.data() + m_bufferStart, available, header, frameBytes))
+            {
+                m_bufferStart += frameBytes;
+                m_frameSamples = header.blockSize;
+                m_frameFirstSample = header.firstSample;
+                if (m_md5Active) UpdateMd5();
+                return true;
+            }
+
+            // Lost sync (corrupt frame or stray bytes): skip to the next sync code
+            m_bufferStart++;
+            while (m_bufferStart + 1 < m_bufferEnd &&
+                   !(m_buffer[m_bufferStart] == 0xFF && (m_buffer[m_bufferStart + 1] & 0xFE) == 0xF8))
+                m_bufferStart++;
+            m_md5Active = false;
+        }
+
+        FinishMd5();
+        return false;
+    }
+
+    // Split the buffered stream into consecutive frames and decode them on
+    // the pool. Returns false if not even the first frame could be decoded
+    // this way, leaving it to the sequential path.
+    bool DecodeBatch()
+    {
+        m_batchNext = m_batchCount = 0;
+        FillBuffer(m_buffer.size() / 2);
+
+        const uint8_t* data = m_buffer.data();
+        size_t end = m_bufferEnd;
+
+        // Frame boundaries: a header, then each following header whose first
+        // sample continues where the previous frame stopped
+        size_t starts[kMaxBatchFrames + 1];
+        size_t found = 0;
+        FlacFrameHeader header;
+        if (!ParseFlacFrameHeader(data + m_bufferStart, end - m_bufferStart, m_info, header)) return false;
+        starts[found++] = m_bufferStart;
+        while (found <= m_batch.size())
+        {
+            uint64_t nextSample = header.firstSample + header.blockSize;
+            size_t pos = starts[found - 1] + std::max<size_t>(m_info.minFrameSize, header.headerBytes + 3);
+            size_t limit = std::min(end, starts[found - 1] + m_maxFrameBytes + 1);
+            bool next = false;
+            for (; pos + 1 < limit; pos++)
+            {
+                const uint8_t* sync = (const uint8_t*)memchr(data + pos, 0xFF, limit - 1 - pos);
+                if (!sync) break;
+                pos = (size_t)(sync - data);
+                FlacFrameHeader candidate;
+                if ((sync[1] & 0xFE) == 0xF8 && ParseFlacFrameHeader(sync, end - pos, m_info, candidate) &&
+                    candidate.firstSample == nextSample)
+                {
+                    header = candidate;
+                    next = true;
+                    break;
+                }
+            }
+            if (!next) break;
+            starts[found++] = pos;
+        }
+
+        // The last frame has no known end unless it is the last of the file,
+        // which may still be followed by a tag
+        size_t frames = found - 1;
+        bool throughEnd = m_fileEnd && found <= m_batch.size();
+        if (throughEnd)
+        {
+            starts[found] = end;
+            frames = found;
+        }
+        if (frames == 0) return false;
+
+        m_pool->Run(frames, [&](size_t i)
+        {
+            BatchFrame& frame = m_batch[i];
+            size_t size = starts[i + 1] - starts[i];
+            frame.ok = frame.decoder.DecodeFrame(data + starts[i], size, frame.header, frame.bytes) &&
+                       (frame.bytes == size || (throughEnd && i + 1 == frames));
+        });
+
+        size_t good = 0;
+        while (good < frames && m_batch[good].ok) good++;
+        if (good == 0) return false;
+
+        // Samples now live in the batch decoders, so the bytes can go
+        m_bufferStart = starts[good - 1] + m_batch[good - 1].bytes;
+        m_batchCount = good;
+        return true;
+    }
+
+    // Locate a frame starting at or before 'target' by bisecting the file on frame headers
+    void BisectForSample(uint64_t target, uint64_t& offset)
+    {
+        uint64_t low = offset;
+        uint64_t high = m_fileSize;
+        std::vector<uint8_t> probe(m_maxFrameBytes + 32);
+
+        while (high - low > m_maxFrameBytes)
+        {
+            uint64_t mid = low + (high - low) / 2;
+            m_file.clear();
+            m_file.seekg((std::streamoff)mid, std::ios::beg);
+            m_file.read((char*)probe.data(), probe.size());
+            size_t got = (size_t)m_file.gcount();
+
+            // First valid frame header after 'mid'
+            bool found = false;
+            FlacFrameHeader header;
+            size_t i = 0;
+            for (; i + 16 < got; i++)
+            {
+                if (probe[i] == 0xFF && (probe[i + 1] & 0xFE) == 0xF8 &&
+                    ParseFlacFrameHeader(probe.data() + i, got - i, m_info, header) &&
+                    header.channels == m_info.channels && header.blockSize <= m_info.maxBlockSize)
+                {
+                    found = true;
+                    break;
+                }
+            }
+
+            if (found && header.firstSample <= target)
+                low = mid + i;
+            else
+                high = mid;
+        }
+        offset = low;
+    }
+
+    void ConvertFrame(float* out, size_t first, size_t count)
+    {
+        const int32_t* planes[8];   // FLAC has at most 8 channels
+        for (uint32_t c = 0; c < m_format.channels; c++) planes[c] = m_current->Channel(c) + first;
+        InterleaveToFloat(planes, m_format.channels, m_scale, out, count);
+    }
+
+    // The signature covers the samples as little-endian integers of the
+    // stream's byte width, interleaved
+    void UpdateMd5()
+    {
+        uint32_t bytes = (m_info.bitsPerSample + 7) / 8;
+        uint8_t packed[4096];
+        size_t used = 0;
+        for (uint32_t i = 0; i < m_frameSamples; i++)
+        {
+            for (uint32_t c = 0; c < m_info.channels; c++)
+            {
+                uint32_t v = (uint32_t)m_current->Channel(c)[i];
+                for (uint32_t b = 0; b < bytes; b++) packed[used++] = (uint8_t)(v >> (8 * b));
+                if (used + 4 > sizeof(packed))
+                {
+                    m_md5.Update(packed, used);
+                    used = 0;
+                }
+            }
+        }
+        m_md5.Update(packed, used);
+    }
+
+    void FinishMd5()
+    {
+        if (!m_md5Active) return;
+        m_md5Active = false;
+
+        static const uint8_t kUnset[16] = {};
+        if (memcmp(m_info.md5, kUnset, 16) == 0) return;
+
+        uint8_t digest[16];
+        m_md5.Finish(digest);
+        m_md5Result = memcmp(digest, m_info.md5, 16) == 0 ? 1 : -1;
+        if (m_md5Result < 0) LogMessage("FLAC: decoded audio does not match the STREAMINFO MD5");
+    }
+
+    static const size_t kReadAhead = 256 * 1024;
+    static const size_t kBatchSamples = 1 << 18;       // decoded samples held per batch
+    static const size_t kMaxBatchFrames = 64;
+    static const unsigned kAutoDecodeThreads = 4;
+
+    struct BatchFrame
+    {
+        FlacFrameDecoder decoder;
+        FlacFrameHeader header;
+        size_t bytes = 0;
+        bool ok = false;
+    };
+
+    std::ifstream m_file;
+    uint64_t m_fileSize = 0;
+    FlacStreamInfo m_info;
+    std::vector<FlacSeekPoint> m_seekTable;
+    uint64_t m_firstFrameOffset = 0;
+    AudioFormat m_format;
+    float m_scale = 1.0f;
+
+    FlacFrameDecoder m_decoder;
+    const FlacFrameDecoder* m_current = &m_decoder;   // holds the samples of the frame being read
+    std::vector<uint8_t> m_buffer;
+    size_t m_maxFrameBytes = 0;
+    size_t m_bufferStart = 0;
+    size_t m_bufferEnd = 0;
+    bool m_fileEnd = false;
+    bool m_endOfStream = false;
+
+    uint64_t m_frameFirstSample = 0;
+    uint32_t m_frameSamples = 0;
+    uint32_t m_frameOffset = 0;
+
+    unsigned m_decodeThreads = 1;
+    std::unique_ptr<WorkerPool> m_pool;
+    std::vector<BatchFrame> m_batch;
+    size_t m_batchNext = 0;
+    size_t m_batchCount = 0;
+
+    Md5 m_md5;
+    bool m_md5Active = false;
+    int m_md5Result = 0;
+};
+
+// Decode 'path' from start to end with 1, 2, 4, ... decode threads up to the
+// core count and log the sustained realtime factor of each (best of three
+// passes). Returns false if the file cannot be decoded or a thread count
+// yields different audio than the sequential decoder.
+inline bool BenchmarkFlacDecode(const std::filesystem::path& path)
+{
+    unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<unsigned> counts;
+    for (unsigned threads = 1; threads < cores; threads *= 2) counts.push_back(threads);
+    counts.push_back(cores);
+
+    std::vector<float> block(4096 * 8);
+    uint64_t referenceFrames = 0;
+    bool referenceVerified = false;
+    bool same = true;
+    for (unsigned threads : counts)
+    {
+        double best = 1e30;
+        double audioSeconds = 0.0;
+        for (int pass = 0; pass < 3; pass++)
+        {
+            FlacSource source;
+            source.SetDecodeThreads(threads);
+            auto start = std::chrono::steady_clock::now();
+            if (!source.Open(path))
+            {
+                LogMessage("FLAC decode benchmark: cannot open the file");
+                return false;
+            }
+
+            uint64_t frames = 0;
+            for (;;)
+            {
+                size_t got = source.Read(block.data(), 4096);
+                if (got == 0) break;
+                frames += got;
+            }
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            audioSeconds = (double)frames / source.Format().sampleRate;
+
+            // The in-stream MD5 covers every sample, so it doubles as the
+            // check that the batches were put back together in order
+            if (threads == 1 && pass == 0)
+            {
+                referenceFrames = frames;
+                referenceVerified = source.Md5Verified();
+            }
+            else if (frames != referenceFrames || source.Md5Verified() != referenceVerified)
+            {
+                same = false;
+            }
+        }
+
+        double realtime = audioSeconds / std::max(best, 1e-9);
+        LogMessage("FLAC decode, %u thread%s: %.0fx realtime, %.0fx per core", threads, threads == 1 ? "" : "s",
+                   realtime, realtime / threads);
+    }
+
+    if (!referenceVerified) LogMessage("FLAC decode benchmark: stream has no usable MD5, outputs compared by length only");
+    if (!same) LogMessage("FLAC decode benchmark: parallel decode differs from sequential decode");
+    return same && referenceFrames > 0;
+}
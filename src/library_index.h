@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+#include <cwctype>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "path_text.h"
+
+// Every track the player knows about, keyed by a normalized path so the same
+// file reached through different spellings ("C:\Music\a.mp3",
+// "c:/music/./A.mp3") is one entry with one id.
+//
+// Lookups go through an open-addressing table of 64-bit key hashes; the key
+// itself is only rebuilt from the stored path to confirm a hash match, so a
+// million-entry index costs one string per track.
+class LibraryIndex
+{
+public:
+    static const uint32_t kNotFound = 0xFFFFFFFF;
+
+    // Comparison key: "." and ".." folded, '/' separators and, on Windows
+    // where the file system is case-insensitive, lower case
+    static std::wstring NormalizeKey(std::wstring_view path)
+    {
+        return KeyFromNormalized(NormalizePathText(path));
+    }
+
+    // Same as NormalizeKey() for a path already passed through NormalizePathText()
+    static std::wstring KeyFromNormalized(std::wstring key)
+    {
+        for (auto& ch : key)
+        {
+            if (ch == L'\\') ch = L'/';
+#ifdef _WIN32
+            else if (ch >= L'A' && ch <= L'Z') ch = (wchar_t)(ch + (L'a' - L'A'));
+            else if (ch >= 0x80) ch = (wchar_t)towlower(ch);
+#endif
+        }
+        return key;
+    }
+
+    void Clear()
+    {
+        m_paths.clear();
+        m_hashes.clear();
+        m_slots.clear();
+    }
+
+    void Reserve(size_t count)
+    {
+        m_paths.reserve(count);
+        m_hashes.reserve(count);
+        if (m_slots.size() < count * 2) Rehash(count * 2);
+    }
+
+    // Returns the id of 'path', adding it if it is new
+    uint32_t Add(std::wstring_view path)
+    {
+        std::wstring normalized = NormalizePathText(path);
+        std::wstring key = KeyFromNormalized(normalized);
+        return Add(std::move(normalized), key);
+    }
+
+    // Same as above for a normalized path whose key is already known (stream
+    // URLs are stored as written, keyed with KeyFromNormalized())
+    uint32_t Add(std::wstring path, const std::wstring& key)
+    {
+        uint64_t hash = HashKey(key);
+        uint32_t id = Find(key, hash);
+        if (id != kNotFound) return id;
+
+        if ((m_paths.size() + 1) * 2 > m_slots.size()) Rehash(m_slots.empty() ? 1024 : m_slots.size() * 2);
+
+        id = (uint32_t)m_paths.size();
+        m_paths.push_back(std::move(path));
+        m_hashes.push_back(hash);
+        Insert(id, hash);
+        return id;
+    }
+
+    uint32_t Find(const std::wstring& key) const { return Find(key, HashKey(key)); }
+
+    const std::wstring& Path(uint32_t id) const { return m_paths[id]; }
+    size_t Count() const { return m_paths.size(); }
+
+private:
+    static uint64_t HashKey(std::wstring_view key)
+    {
+        // FNV-1a over the code units
+        uint64_t hash = 0xCBF29CE484222325ull;
+        for (wchar_t ch : key)
+        {
+            hash ^= (uint64_t)ch;
+            hash *= 0x100000001B3ull;
+        }
+        return hash;
+    }
+
+    uint32_t Find(const std::wstring& key, uint64_t hash) const
+    {
+        if (m_slots.empty()) return kNotFound;
+        size_t mask = m_slots.size() - 1;
+        for (size_t i = (size_t)hash & mask; m_slots[i] != 0; i = (i + 1) & mask)
+        {
+            uint32_t id = m_slots[i] - 1;
+            if (m_hashes[id] == hash && KeyFromNormalized(m_paths[id]) == key) return id;
+        }
+        return kNotFound;
+    }
+
+    void Insert(uint32_t id, uint64_t hash)
+    {
+        size_t mask = m_slots.size() - 1;
+        size_t i = (size_t)hash & mask;
+        while (m_slots[i] != 0) i = (i + 1) & mask;
+        m_slots[i] = id + 1;
+    }
+
+    void Rehash(size_t minimumSlots)
+    {
+        size_t size = 1024;
+        while (size < minimumSlots) size <<= 1;
+        m_slots.assign(size, 0);
+        for (uint32_t id = 0; id < (uint32_t)m_paths.size(); id++) Insert(id, m_hashes[id]);
+    }
+
+    std::vector<std::wstring> m_paths;
+    std::vector<uint64_t> m_hashes;
+    std::vector<uint32_t> m_slots;   // id + 1, 0 = empty
+};
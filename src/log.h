@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdarg>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Write a diagnostic line to the debugger output (Windows) or stderr
+inline void LogMessage(const char* format, ...)
+{
+    char buffer[1024];
+
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+
+#ifdef _WIN32
+    OutputDebugStringA(buffer);
+    OutputDebugStringA("\n");
+#else
+    fprintf(stderr, "%s\n", buffer);
+#endif
+}
@@ -1,8 +1,16 @@
 #ifndef UNICODE
 #define UNICODE
 #endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
 
 #define WM_PLAY_NEXT_TRACK (WM_USER + 1)
+#define WM_RENDER_FINISHED (WM_USER + 2)
+#define WM_METADATA_SCANNED (WM_USER + 3)
+#define WM_SILENCE_SCANNED (WM_USER + 4)
+#define WM_ANALYSIS_FINISHED (WM_USER + 5)
+#define WM_ALBUM_ART_READY (WM_USER + 6)
 
 // Headers and libraries
 #include <windows.h>
@@ -20,6 +28,33 @@
 #include <filesystem> // C++17
 #include <random>
 #include <shobjidl.h>
+#include <shlobj.h>
+#include <shellapi.h>
+#include <atomic>
+#include <chrono>
+
+// The player is a single translation unit, so it carries the real-time
+// guard's operator new/delete replacements (rt_guard.h)
+#define RT_GUARD_IMPLEMENTATION
+#include "log.h"
+#include "album_art.h"
+#include "audio_engine.h"
+#include "batch_render.h"
+#include "control_server.h"
+#include "decoders.h"
+#include "library_index.h"
+#include "metadata_store.h"
+#include "music_analysis.h"
+#include "playlist_file.h"
+#include "prefetcher.h"
+#include "render_check.h"
+#include "sample_convert.h"
+#include "session_file.h"
+#include "silence_scan.h"
+#include "smart_playlist.h"
+#include "tag_reader.h"
+#include "wasapi_output.h"
+#include "zone_player.h"
 
 #pragma comment(lib, "user32.lib")
 #pragma comment(lib, "d2d1.lib")
@@ -32,10 +67,21 @@
 #pragma comment(lib, "uuid.lib")
 #pragma comment(lib, "comdlg32.lib")
 #pragma comment(lib, "gdi32.lib")
+#pragma comment(lib, "shell32.lib")
+#pragma comment(lib, "windowscodecs.lib")
 
 // Globals
-std::vector<std::wstring> g_playlist;
-size_t g_currentTrackIndex = 0;
+LibraryIndex g_library; // every track seen in scanned folders and imported playlists
+MetadataStore g_metadata; // tags and play history by g_library id, for smart playlists
+std::wstring g_smartPlaylistQuery; // last query run, offered again in the prompt
+
+// Playback: the window hosts one zone, which holds the playlist (g_library
+// ids), the position, the volume and the engine. Only the UI thread steps
+// it, so tracks are opened there (OpenTrack()) and the library and metadata
+// store need no locks.
+ZoneHost g_host(g_library);
+PlayerZone g_zone(g_host);
+WasapiOutput g_audioOutput;
 
 HINSTANCE g_hInstance;
 HWND g_hWnd = NULL;
@@ -50,24 +96,63 @@ D2D1_RECT_F g_rcButtonNext;
 D2D1_RECT_F g_rcSliderProgress;
 D2D1_RECT_F g_rcSliderVolume;
 D2D1_RECT_F g_rcButtonOpenFile;
+D2D1_RECT_F g_rcAlbumArt;
 
-// Slider thumb positions
+// Progress thumb position while dragging or between timer updates
 float g_progressValue = 0.0f; // 0.0 to 1.0
-float g_volumeValue = 1.0f;   // 0.0 to 1.0
 bool g_isDraggingProgress = false;
 bool g_isDraggingVolume = false;
 
-// Media Foundation globals
-IMFMediaSession* g_pMediaSession = nullptr;
-IMFMediaSource* g_pMediaSource = nullptr;
+// Cover art, extracted and shrunk on the art cache's thread; the UI only
+// uploads finished thumbnails
+AlbumArtCache g_albumArt;
+ID2D1Bitmap* g_pArtBitmap = nullptr;
+std::wstring g_artBitmapTrack;         // track and size g_pArtBitmap was made for
+uint32_t g_artBitmapEdge = 0;
+uint32_t g_artEdge = 0;                // thumbnail size for the current layout
+
+int g_eqPreset = 0;            // index into kEqPresets
+int g_speedIndex = 2;          // index into kPlaybackSpeeds, 1x
+
+// Warms the next playlist entries so slow shares do not stall track changes
+TrackPrefetcher g_prefetcher;
 
-LONGLONG g_totalDuration = 0; // currently loaded song in 100ns units
-bool g_isPlaying = false;
 bool g_updateProgress = true;
 
+// Startup and session snapshot. Media Foundation and the audio device are
+// brought up after the first paint (or on first use) so the window is
+// interactive at once.
+std::chrono::steady_clock::time_point g_startupStart;
+bool g_firstPaintDone = false;
+bool g_mediaFoundationReady = false;
+bool g_audioReady = false;
+bool g_resumePending = false;          // restored track not opened yet
+LONGLONG g_resumePosition = 0;         // where to start it, 100ns units
+LONGLONG g_resumeDuration = 0;         // its length when the session was saved
+bool g_sessionPlaylistDirty = true;    // playlist changed since the last snapshot
+uint64_t g_sessionPlaylistEntries = 0;
+uint64_t g_sessionPlaylistBytes = 0;
+
+// Offline export
+std::thread g_renderThread;
+std::atomic<bool> g_cancelRender(false);
+
+// Background tag reading for the metadata store
+std::thread g_tagScanThread;
+std::atomic<bool> g_cancelTagScan(false);
+bool g_tagScanPending = false;         // playlist changed while a scan was running
+
+// Background silence scan; with trimming on, tracks play only their audible range
+std::thread g_silenceScanThread;
+std::atomic<bool> g_cancelSilenceScan(false);
+bool g_silenceScanPending = false;
+bool g_trimSilence = false;
+
+// Background tempo and key analysis for the mixing order
+std::thread g_analysisThread;
+std::atomic<bool> g_cancelAnalysis(false);
+
 // Forward declarations
-class MediaSessionCallback;
-MediaSessionCallback* g_pCallBack = nullptr;
 // Graphic functions
 HRESULT CreateGraphicsResources(HWND hwnd);
 void DiscardGraphicsResources();
@@ -75,27 +160,68 @@ void OnPaint(HWND hwnd);
 void Resize(HWND hwnd);
 void CalculateLayout(float width, float height);
 void UpdateProgressBar(HWND hwnd);
+void DrawAlbumArt();
+void RequestAlbumArt();
 // Mouse/Input events
 void OnLButtonDown(HWND hwnd, WPARAM wParam, LPARAM lParam);
 void OnMouseMove(HWND hwnd, WPARAM wParam, LPARAM lParam);
 void OnLButtonUp();
 HRESULT OpenFolderDialog(HWND hwnd, std::wstring& folderPath);
-void BuildPlaylistFromFolder(const std::wstring& folderPath);
-// Media Session Initialization
+void OpenFolder(HWND hwnd);
+std::vector<uint32_t> BuildPlaylistFromFolder(const std::wstring& folderPath);
+HRESULT ShowPlaylistDialog(HWND hwnd, bool save, std::wstring& filePath);
+void OpenPlaylist(HWND hwnd);
+void SavePlaylist(HWND hwnd);
+void ReplacePlaylist(HWND hwnd, std::vector<uint32_t> tracks);
+std::vector<uint32_t> PlaylistTracks(const std::vector<std::wstring>& paths);
+std::vector<std::wstring> PlaylistPaths();
+std::vector<std::wstring> UpcomingTracks(size_t first, size_t count);
+// Library metadata and smart playlists
+struct ScannedTags;
+void ScanPlaylistTags(HWND hwnd);
+void OnTagsScanned(HWND hwnd, ScannedTags* pBatch, bool done);
+struct ScannedRanges;
+void ScanPlaylistSilence(HWND hwnd);
+void OnSilenceScanned(HWND hwnd, ScannedRanges* pBatch, bool done);
+void ToggleSilenceTrim(HWND hwnd);
+struct AnalyzedFeatures;
+void OrderPlaylistForMixing(HWND hwnd);
+void OnAnalysisFinished(HWND hwnd, AnalyzedFeatures* pResult);
+void ApplyMixingOrder();
+bool ShowQueryPrompt(HWND hwnd, std::wstring& query);
+void OpenSmartPlaylist(HWND hwnd);
+void ApplyEqPreset(int index);
+void CycleEqPreset();
+void ApplyPlaybackSpeed(int index);
+void StepPlaybackSpeed(int direction);
+// Startup and session
+void LogStartupPhase(const char* phase);
+std::filesystem::path SessionFolder();
+void SaveSession();
+void RestoreSession();
+bool ResumeSession();
+// Audio initialization
 HRESULT InitMediaFoundation();
+HRESULT EnsureMediaFoundation();
 void CleanupMediaFoundation();
-HRESULT InitializeMediaSession(const wchar_t* filePath);
-HRESULT CreatePlaybackTopology(IMFMediaSource* pMediaSource, IMFMediaSession* pMediaSession, IMFTopology** ppTopology);
-HRESULT AddSourceNode(IMFTopology* pTopology, IMFMediaSource* pMediaSource, IMFPresentationDescriptor* pPresentationDescriptor, IMFStreamDescriptor* pStreamDescriptor, IMFTopologyNode** ppNode);
-HRESULT AddOutputNode(IMFTopology* pTopology, IMFActivate* pActivate, IMFTopologyNode** ppNode);
+HRESULT InitAudioOutput();
+HRESULT EnsureAudioOutput();
+void PrefetchUpcomingTracks();
+void CleanupAudioOutput();
+std::unique_ptr<AudioSource> OpenTrack(uint32_t track);
+bool TrackChanged(bool loaded);
 // Playback handling
 void PlayAudio();
 void PauseAudio();
+void TogglePlayback(HWND hwnd);
 HRESULT GetCurrentPlaybackTime(LONGLONG* p_currentTime);
+LONGLONG TrackDuration();
 void SeekToTime(LONGLONG newTime100ns);
 void SeekBySeconds(LONGLONG offsetSeconds);
-HRESULT Backwards();
-HRESULT Forwards();
+void StepTrack(HWND hwnd, int direction);
+// Offline export
+void StartPlaylistExport(HWND hwnd);
+void OnRenderFinished(HWND hwnd, RenderStats* pStats);
 
 LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
 
@@ -121,104 +247,188 @@ RECT ConvertRectFToRect(const D2D1_RECT_F& rectF)
 
 void SetMusicVolume(float volumeLevel)
 {
-    if (g_pMediaSession)
-    {
-        IMFSimpleAudioVolume* pAudioVolume = nullptr;
+    // Clamped to 0.0 - 1.0 by the zone, applied with a short ramp on the audio thread
+    g_zone.SetVolume(volumeLevel);
+}
 
-        // Get the IMFSimpleAudioVolume interface from the Media Session
-        HRESULT hr = MFGetService(
-            g_pMediaSession,           // Pointer to the Media Session
-            MR_POLICY_VOLUME_SERVICE,  // Service identifier
-            IID_PPV_ARGS(&pAudioVolume) // Interface ID and pointer
-        );
+struct EqPreset
+{
+    const char* name;
+    double lowShelfDb;  // 100 Hz
+    double midDb;       // 1 kHz peak
+    double highShelfDb; // 8 kHz
+};
+const EqPreset kEqPresets[] =
+{
+    { "Flat",      0.0, 0.0, 0.0 },
+    { "Bass",      6.0, 0.0, 0.0 },
+    { "Treble",    0.0, 0.0, 5.0 },
+    { "Loudness",  5.0, -2.0, 4.0 },
+};
+const int kEqPresetCount = (int)(sizeof(kEqPresets) / sizeof(kEqPresets[0]));
 
-        if (SUCCEEDED(hr))
-        {
-            // Clamp the volume level between 0.0 and 1.0
-            if (volumeLevel < 0.0f) volumeLevel = 0.0f;
-            if (volumeLevel > 1.0f) volumeLevel = 1.0f;
+const double kPlaybackSpeeds[] = { 0.5, 0.75, 1.0, 1.25, 1.5, 1.75, 2.0, 2.5, 3.0 };
+const int kPlaybackSpeedCount = (int)(sizeof(kPlaybackSpeeds) / sizeof(kPlaybackSpeeds[0]));
 
-            // Set the volume level
-            hr = pAudioVolume->SetMasterVolume(volumeLevel);
-            if (FAILED(hr))
-            {
-                MessageBox(NULL, L"Failed to set volume.", L"Error", MB_ICONERROR);
-            }
-        }
-        else
-        {
-            MessageBox(NULL, L"Failed to get audio volume service.", L"Error", MB_ICONERROR);
-        }
+// Switch to the next EQ preset
+void CycleEqPreset()
+{
+    ApplyEqPreset((g_eqPreset + 1) % kEqPresetCount);
+}
 
-        // Release the audio volume interface
-        SafeRelease(&pAudioVolume);
-    }
+// The engine glides to the new curve. Before the audio output is up only the
+// index is kept; EnsureAudioOutput() applies it.
+void ApplyEqPreset(int index)
+{
+    if (index < 0 || index >= kEqPresetCount) return;
+    g_eqPreset = index;
+    if (!g_audioReady) return;
+    const EqPreset& preset = kEqPresets[g_eqPreset];
+
+    EqBand low, mid, high;
+    low.type = EqBandType::LowShelf;
+    low.frequency = 100.0;
+    low.gainDb = preset.lowShelfDb;
+    low.enabled = preset.lowShelfDb != 0.0;
+    mid.frequency = 1000.0;
+    mid.gainDb = preset.midDb;
+    mid.q = 0.9;
+    mid.enabled = preset.midDb != 0.0;
+    high.type = EqBandType::HighShelf;
+    high.frequency = 8000.0;
+    high.gainDb = preset.highShelfDb;
+    high.enabled = preset.highShelfDb != 0.0;
+
+    ParametricEq& eq = g_zone.Engine().Dsp().Eq();
+    eq.SetBand(0, low);
+    eq.SetBand(1, mid);
+    eq.SetBand(2, high);
+    LogMessage("EQ preset: %s", preset.name);
 }
 
-class MediaSessionCallback : public IMFAsyncCallback
+// Move one step through the speed list; pitch is preserved by the engine's time-stretch
+void StepPlaybackSpeed(int direction)
 {
-public:
-    STDMETHODIMP QueryInterface(REFIID riid, void** ppv)
-    {
-        if (ppv == nullptr) return E_POINTER;
-        if (riid == IID_IUnknown || riid == IID_IMFAsyncCallback)
-        {
-            *ppv = static_cast<IMFAsyncCallback*>(this);
-            AddRef();
-            return S_OK;
-        }
-        *ppv = nullptr;
-        return E_NOINTERFACE;
-    }
+    ApplyPlaybackSpeed(g_speedIndex + direction);
+}
 
-    STDMETHODIMP_(ULONG) AddRef() { return InterlockedIncrement(&m_refCount); }
-    STDMETHODIMP_(ULONG) Release()
-    {
-        ULONG count = InterlockedDecrement(&m_refCount);
-        if (count == 0) delete this;
-        return count;
-    }
+void ApplyPlaybackSpeed(int index)
+{
+    if (index < 0 || index >= kPlaybackSpeedCount) return;
+    g_speedIndex = index;
+    if (!g_audioReady) return;
 
-    STDMETHODIMP GetParameters(DWORD*, DWORD*) { return E_NOTIMPL; }
+    g_zone.Engine().SetSpeed(kPlaybackSpeeds[g_speedIndex]);
+    LogMessage("Playback speed: %.2fx", kPlaybackSpeeds[g_speedIndex]);
+}
 
-    STDMETHODIMP Invoke(IMFAsyncResult* pResult)
+// Milliseconds since WinMain started, for the cold-start phases
+void LogStartupPhase(const char* phase)
+{
+    LogMessage("Startup: %s at %.1f ms", phase,
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - g_startupStart).count());
+}
+
+// %LOCALAPPDATA%\AudioPlayer, empty if it cannot be determined
+std::filesystem::path SessionFolder()
+{
+    PWSTR pszFolder = nullptr;
+    std::filesystem::path folder;
+    if (SUCCEEDED(SHGetKnownFolderPath(FOLDERID_LocalAppData, 0, NULL, &pszFolder)))
+        folder = std::filesystem::path(pszFolder) / L"AudioPlayer";
+    if (pszFolder)
+        CoTaskMemFree(pszFolder);
+    return folder;
+}
+
+// Snapshot the playlist position, volume and settings. The playlist file is
+// only rewritten when the playlist has changed.
+void SaveSession()
+{
+    std::filesystem::path folder = SessionFolder();
+    if (folder.empty()) return;
+    std::error_code ec;
+    std::filesystem::create_directories(folder, ec);
+
+    auto start = std::chrono::steady_clock::now();
+    if (g_sessionPlaylistDirty)
     {
-        IMFMediaEvent* pEvent = nullptr;
-        MediaEventType eventType = MEUnknown;
-    
-        if (g_pMediaSession)
-        {
-            HRESULT hr = g_pMediaSession->EndGetEvent(pResult, &pEvent);
-            if (SUCCEEDED(hr))
-            {
-                pEvent->GetType(&eventType);
-    
-                switch (eventType)
-                {
-                    case MESessionEnded:
-                        // Reset the UI state
-                        g_progressValue = 0.0f;
-                        InvalidateRect(NULL, NULL, FALSE);
-                        // Play next song
-                        PostMessage(g_hWnd, WM_PLAY_NEXT_TRACK, 0, 0);
-                        break;
-                    
-                    case MEError:
-                        MessageBox(NULL, L"An error occurred during playback.", L"Error", MB_ICONERROR);
-                        break;
-                }
-    
-                // Continue listening for events
-                g_pMediaSession->BeginGetEvent(this, NULL);
-            }
-            SafeRelease(&pEvent);
-        }
-        return S_OK;
+        std::filesystem::path playlistPath = folder / L"session.wmpl";
+        std::vector<std::wstring> playlist = PlaylistPaths();
+        if (!SavePlaylistFile(playlistPath, playlist)) return;
+        g_sessionPlaylistEntries = playlist.size();
+        g_sessionPlaylistBytes = std::filesystem::file_size(playlistPath, ec);
+        if (ec) return;
+        g_sessionPlaylistDirty = false;
     }
 
-private:
-    LONG m_refCount = 1;
-};
+    ZoneStatus status = g_zone.Status();
+    SessionState state;
+    state.trackIndex = status.index;
+    state.position100ns = g_resumePosition;
+    if (!g_resumePending) GetCurrentPlaybackTime(&state.position100ns);
+    state.duration100ns = TrackDuration();
+    state.volume = status.volume;
+    state.eqPreset = g_eqPreset;
+    state.speedIndex = g_speedIndex;
+    state.trimSilence = g_trimSilence;
+    state.playlistEntries = g_sessionPlaylistEntries;
+    state.playlistBytes = g_sessionPlaylistBytes;
+    if (!SaveSessionState(folder / L"session.dat", state)) return;
+
+    LogMessage("Session saved in %.1f ms", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+}
+
+// Bring back the last session's playlist and position without opening the
+// track or scanning folders; the first Play opens it and seeks
+void RestoreSession()
+{
+    std::filesystem::path folder = SessionFolder();
+    if (folder.empty()) return;
+
+    SessionState state;
+    if (!LoadSessionState(folder / L"session.dat", state)) return;
+
+    std::filesystem::path playlistPath = folder / L"session.wmpl";
+    std::error_code ec;
+    uint64_t playlistBytes = std::filesystem::file_size(playlistPath, ec);
+    if (ec || playlistBytes != state.playlistBytes) return;
+
+    std::vector<std::wstring> playlist;
+    if (!LoadPlaylistFile(playlistPath, playlist) || playlist.size() != state.playlistEntries) return;
+
+    // The zone is not open yet; the first Play loads the track
+    bool resume = state.trackIndex < playlist.size();
+    g_zone.SetPlaylist(PlaylistTracks(playlist), resume ? (size_t)state.trackIndex : 0, false);
+    g_sessionPlaylistEntries = state.playlistEntries;
+    g_sessionPlaylistBytes = state.playlistBytes;
+    g_sessionPlaylistDirty = false;
+
+    SetMusicVolume(state.volume);
+    ApplyEqPreset(state.eqPreset);
+    ApplyPlaybackSpeed(state.speedIndex);
+    g_trimSilence = state.trimSilence;
+
+    if (!resume) return;
+    g_resumeDuration = state.duration100ns;
+    g_resumePosition = state.position100ns;
+    g_resumePending = true;
+    if (g_resumeDuration > 0)
+        g_progressValue = (float)((double)g_resumePosition / (double)g_resumeDuration);
+    if (g_progressValue > 1.0f) g_progressValue = 1.0f;
+
+    // Warm the track to resume along with the ones after it
+    g_prefetcher.SetUpcoming(UpcomingTracks(0, 4));
+}
+
+// Open the restored track and seek to where the last session stopped
+bool ResumeSession()
+{
+    LONGLONG position = g_resumePosition;
+    if (FAILED(EnsureAudioOutput()) || !TrackChanged(g_zone.Load())) return false;
+    SeekToTime(position);
+    return true;
+}
 
 // Graphic functions
 HRESULT CreateGraphicsResources(HWND hwnd)
@@ -249,6 +459,8 @@ HRESULT CreateGraphicsResources(HWND hwnd)
 
 void DiscardGraphicsResources()
 {
+    SafeRelease(&g_pArtBitmap);
+    g_artBitmapTrack.clear();
     SafeRelease(&g_pBrush);
     SafeRelease(&g_pRenderTarget);
 }
@@ -264,12 +476,15 @@ void OnPaint(HWND hwnd)
         g_pRenderTarget->BeginDraw();
         g_pRenderTarget->Clear(D2D1::ColorF(0.13, 0.13, 0.13, 1.0));
 
+        DrawAlbumArt();
+        ZoneStatus status = g_zone.Status();
+
         // === Draw Buttons ===
         g_pBrush->SetColor(D2D1::ColorF(D2D1::ColorF::Gray));
         g_pRenderTarget->FillRectangle(g_rcButtonPrev, g_pBrush);
         g_pRenderTarget->FillRectangle(g_rcButtonNext, g_pBrush);
         g_pRenderTarget->FillRectangle(g_rcButtonOpenFile, g_pBrush);
-        if (g_isPlaying)
+        if (status.playing)
         {
             g_pBrush->SetColor(D2D1::ColorF(D2D1::ColorF::Red));
             g_pRenderTarget->FillRectangle(g_rcButtonPlay, g_pBrush);
@@ -295,7 +510,7 @@ void OnPaint(HWND hwnd)
         g_pRenderTarget->FillRectangle(g_rcSliderVolume, g_pBrush);
 
         // Volume Thumb
-        float volumeX = g_rcSliderVolume.left + g_volumeValue * (g_rcSliderVolume.right - g_rcSliderVolume.left);
+        float volumeX = g_rcSliderVolume.left + status.volume * (g_rcSliderVolume.right - g_rcSliderVolume.left);
         D2D1_RECT_F thumbVolume = D2D1::RectF(volumeX - 5, g_rcSliderVolume.top - 5, volumeX + 5, g_rcSliderVolume.bottom + 5);
         g_pBrush->SetColor(D2D1::ColorF(D2D1::ColorF::Green));
         g_pRenderTarget->FillRectangle(thumbVolume, g_pBrush);
@@ -306,6 +521,12 @@ void OnPaint(HWND hwnd)
         }
 
         EndPaint(hwnd, &ps);
+
+        if (!g_firstPaintDone)
+        {
+            g_firstPaintDone = true;
+            LogStartupPhase("first paint, window ready");
+        }
     }
 }
 
@@ -325,6 +546,14 @@ void Resize(HWND hwnd)
 
         CalculateLayout(width, height);
 
+        // A new thumbnail size only when the art crosses a size step
+        uint32_t artEdge = ArtThumbnailEdge(g_rcAlbumArt.right - g_rcAlbumArt.left);
+        if (artEdge != g_artEdge)
+        {
+            g_artEdge = artEdge;
+            RequestAlbumArt();
+        }
+
         InvalidateRect(hwnd, NULL, FALSE);
     }
 }
@@ -339,11 +568,66 @@ void CalculateLayout(float width, float height)
     g_rcSliderVolume   = D2D1::RectF(width * 0.70f, height * 0.85f, width * 0.95f, height * 0.90f);
 
     g_rcButtonOpenFile = D2D1::RectF(width * 0.55f, height * 0.85f, width * 0.65f, height * 0.95f);
+
+    // Square cover art centred in the space above the progress slider
+    float artSide = std::min(width * 0.90f, height * 0.65f);
+    g_rcAlbumArt = D2D1::RectF((width - artSide) * 0.5f, height * 0.05f, (width + artSide) * 0.5f, height * 0.05f + artSide);
+}
+
+// The current track's art, once its thumbnail is ready. The last one stays
+// up while a thumbnail of a new size is made.
+void DrawAlbumArt()
+{
+    uint32_t current = g_zone.CurrentTrack();
+    if (current == LibraryIndex::kNotFound) return;
+    const std::wstring& track = g_library.Path(current);
+    if (track != g_artBitmapTrack || g_artBitmapEdge != g_artEdge)
+    {
+        std::shared_ptr<const ArtThumbnail> thumbnail = g_albumArt.Find(track, g_artEdge);
+        if (thumbnail)
+        {
+            SafeRelease(&g_pArtBitmap);
+            D2D1_BITMAP_PROPERTIES properties = D2D1::BitmapProperties(
+                D2D1::PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_PREMULTIPLIED));
+            if (SUCCEEDED(g_pRenderTarget->CreateBitmap(D2D1::SizeU(thumbnail->width, thumbnail->height),
+                    thumbnail->pixels.data(), thumbnail->width * 4, properties, &g_pArtBitmap)))
+            {
+                g_artBitmapTrack = track;
+                g_artBitmapEdge = g_artEdge;
+            }
+        }
+        else if (track != g_artBitmapTrack)
+        {
+            SafeRelease(&g_pArtBitmap);
+            g_artBitmapTrack.clear();
+        }
+    }
+    if (!g_pArtBitmap) return;
+
+    // Keep the picture's aspect ratio inside the square
+    D2D1_SIZE_U pixels = g_pArtBitmap->GetPixelSize();
+    float side = g_rcAlbumArt.right - g_rcAlbumArt.left;
+    float scale = side / (float)std::max(pixels.width, pixels.height);
+    float drawWidth = pixels.width * scale, drawHeight = pixels.height * scale;
+    float left = g_rcAlbumArt.left + (side - drawWidth) * 0.5f;
+    float top = g_rcAlbumArt.top + (side - drawHeight) * 0.5f;
+    g_pRenderTarget->DrawBitmap(g_pArtBitmap, D2D1::RectF(left, top, left + drawWidth, top + drawHeight),
+        1.0f, D2D1_BITMAP_INTERPOLATION_MODE_LINEAR);
+}
+
+// The current track's art at the size the layout shows it, then the next
+// few tracks' so track changes find theirs ready
+void RequestAlbumArt()
+{
+    if (g_artEdge == 0) return;
+    std::vector<std::wstring> paths = UpcomingTracks(0, 4);
+    if (!paths.empty()) g_albumArt.Request(paths, g_artEdge);
 }
 
 void UpdateProgressBar(HWND hwnd)
 {
-    if (!g_pMediaSession || !g_pMediaSource) return;
+    LONGLONG duration = TrackDuration();
+    if (duration <= 0) return;
 
     // Get the current playback time
     LONGLONG currentTime = 0;
@@ -351,7 +635,7 @@ void UpdateProgressBar(HWND hwnd)
     if (FAILED(hr)) return;
 
     // Update the progress value (0.0 to 1.0)
-    g_progressValue = (double)currentTime / (double)g_totalDuration;
+    g_progressValue = (double)currentTime / (double)duration;
     if (g_progressValue < 0.0) g_progressValue = 0.0;
     if (g_progressValue > 1.0) g_progressValue = 1.0;
 
@@ -368,35 +652,17 @@ void OnLButtonDown(HWND hwnd, WPARAM wParam, LPARAM lParam)
 
     // Check buttons
     if (PtInRect(&ConvertRectFToRect(g_rcButtonPlay), pt)) {
-        // Check if a file has been selected
-        if (g_playlist.empty()) {
-            MessageBox(hwnd, L"No folder selected.", L"Info", MB_OK);
-            return;
-        }
-        
-        if (!g_isPlaying)
-        {
-            g_isPlaying = true;
-            PlayAudio();
-        }
-        else
-        {
-            g_isPlaying = false;
-            PauseAudio();
-        }
-        InvalidateRect(hwnd, NULL, FALSE);
+        TogglePlayback(hwnd);
     }
     else if (PtInRect(&ConvertRectFToRect(g_rcButtonPrev), pt)) {
-        if (FAILED(Backwards())) MessageBox(hwnd, L"Failed backwards", L"Error", MB_ICONERROR);
-        InvalidateRect(hwnd, NULL, FALSE);
+        StepTrack(hwnd, -1);
     }
     else if (PtInRect(&ConvertRectFToRect(g_rcButtonNext), pt)) {
-        if (FAILED(Forwards())) MessageBox(hwnd, L"Failed forwards", L"Error", MB_ICONERROR);
-        InvalidateRect(hwnd, NULL, FALSE);
+        StepTrack(hwnd, 1);
     }    
     // Check if clicked on progress bar
     else if (PtInRect(&ConvertRectFToRect(g_rcSliderProgress), pt)) {
-        if (!g_isPlaying) return;
+        if (!g_zone.Status().playing) return;
         g_updateProgress = false;
         g_isDraggingProgress = true;
 
@@ -420,23 +686,12 @@ void OnLButtonDown(HWND hwnd, WPARAM wParam, LPARAM lParam)
         if (movePoint.x < g_rcSliderVolume.left) movePoint.x = g_rcSliderVolume.left;
         if (movePoint.x > g_rcSliderVolume.right) movePoint.x = g_rcSliderVolume.right;
 
-        g_volumeValue = (movePoint.x - g_rcSliderVolume.left) / sliderWidth;
-
-        SetMusicVolume(g_volumeValue);
+        SetMusicVolume((movePoint.x - g_rcSliderVolume.left) / sliderWidth);
 
         InvalidateRect(hwnd, NULL, FALSE);
     }
     else if (PtInRect(&ConvertRectFToRect(g_rcButtonOpenFile), pt)) {
-        // Get folder path
-        std::wstring folderPath;
-        HRESULT hr = OpenFolderDialog(hwnd, folderPath);
-        if (FAILED(hr)) return;
-        // Build playlist and load first song for playing
-        BuildPlaylistFromFolder(folderPath);
-        hr = InitializeMediaSession(g_playlist[g_currentTrackIndex].c_str());
-        if (FAILED(hr)) return;
-
-        InvalidateRect(hwnd, NULL, FALSE);
+        OpenFolder(hwnd);
     }
 }
 
@@ -463,9 +718,7 @@ void OnMouseMove(HWND hwnd, WPARAM wParam, LPARAM lParam)
             if (movePoint.x < g_rcSliderVolume.left) movePoint.x = g_rcSliderVolume.left;
             if (movePoint.x > g_rcSliderVolume.right) movePoint.x = g_rcSliderVolume.right;
 
-            g_volumeValue = (movePoint.x - g_rcSliderVolume.left) / sliderWidth;
-
-            SetMusicVolume(g_volumeValue);
+            SetMusicVolume((movePoint.x - g_rcSliderVolume.left) / sliderWidth);
 
             InvalidateRect(hwnd, NULL, FALSE);
         }
@@ -477,7 +730,7 @@ void OnLButtonUp()
     ReleaseCapture();
     if (g_isDraggingProgress)
     {
-        SeekToTime((LONGLONG)(g_progressValue * g_totalDuration));
+        SeekToTime((LONGLONG)(g_progressValue * TrackDuration()));
     }
     g_updateProgress = true;
     g_isDraggingProgress = false;
@@ -522,9 +775,24 @@ done:
     return hr;
 }
 
-void BuildPlaylistFromFolder(const std::wstring& folderPath)
+// Pick a folder and play its audio files, shuffled
+void OpenFolder(HWND hwnd)
+{
+    std::wstring folderPath;
+    if (FAILED(OpenFolderDialog(hwnd, folderPath))) return;
+
+    std::vector<uint32_t> playlist = BuildPlaylistFromFolder(folderPath);
+    if (playlist.empty())
+    {
+        MessageBox(hwnd, L"No audio files in the folder.", L"Info", MB_OK);
+        return;
+    }
+    ReplacePlaylist(hwnd, std::move(playlist));
+}
+
+std::vector<uint32_t> BuildPlaylistFromFolder(const std::wstring& folderPath)
 {
-    g_playlist.clear();
+    std::vector<uint32_t> playlist;
     for (const auto& entry : std::filesystem::directory_iterator(folderPath))
     {
         if (!entry.is_regular_file()) continue;
@@ -532,249 +800,683 @@ void BuildPlaylistFromFolder(const std::wstring& folderPath)
         std::wstring path = entry.path().wstring();
         std::wstring ext = entry.path().extension().wstring();
 
-        if (_wcsicmp(ext.c_str(), L".mp3") == 0 || _wcsicmp(ext.c_str(), L".wav") == 0)
+        if (_wcsicmp(ext.c_str(), L".mp3") == 0 || _wcsicmp(ext.c_str(), L".wav") == 0 ||
+            _wcsicmp(ext.c_str(), L".flac") == 0)
         {
-            g_playlist.push_back(path);
+            playlist.push_back(g_library.Add(path));
         }
     }
 
     // Shuffle the playlist
     std::random_device rd;
     std::mt19937 g(rd());
-    std::shuffle(g_playlist.begin(), g_playlist.end(), g);
-    g_currentTrackIndex = 0;
+    std::shuffle(playlist.begin(), playlist.end(), g);
+    return playlist;
 }
 
-// Media Session Initialization
-HRESULT InitMediaFoundation()
+HRESULT ShowPlaylistDialog(HWND hwnd, bool save, std::wstring& filePath)
 {
-    return MFStartup(MF_VERSION);
-}
+    IFileDialog* pFileDialog = nullptr;
+    IShellItem* pItem = nullptr;
+    PWSTR pszFilePath = nullptr;
+    HRESULT hr = S_OK;
 
-void CleanupMediaFoundation()
-{
-    SafeRelease(&g_pMediaSession);
-    SafeRelease(&g_pMediaSource);
-    SafeRelease(&g_pCallBack);
-    MFShutdown();
+    const COMDLG_FILTERSPEC openTypes[] =
+    {
+        { L"Playlists", L"*.wmpl;*.m3u;*.m3u8;*.pls" },
+    };
+    const COMDLG_FILTERSPEC saveTypes[] =
+    {
+        { L"Playlist", L"*.wmpl" },
+        { L"M3U8 playlist", L"*.m3u8" },
+        { L"PLS playlist", L"*.pls" },
+    };
+
+    hr = CoCreateInstance(save ? CLSID_FileSaveDialog : CLSID_FileOpenDialog, NULL, CLSCTX_ALL, IID_PPV_ARGS(&pFileDialog));
+    if (FAILED(hr)) goto done;
+
+    if (save)
+        hr = pFileDialog->SetFileTypes(ARRAYSIZE(saveTypes), saveTypes);
+    else
+        hr = pFileDialog->SetFileTypes(ARRAYSIZE(openTypes), openTypes);
+    if (FAILED(hr)) goto done;
+
+    hr = pFileDialog->SetDefaultExtension(L"wmpl");
+    if (FAILED(hr)) goto done;
+
+    hr = pFileDialog->Show(hwnd);
+    if (FAILED(hr)) goto done;
+
+    hr = pFileDialog->GetResult(&pItem);
+    if (FAILED(hr)) goto done;
+
+    hr = pItem->GetDisplayName(SIGDN_FILESYSPATH, &pszFilePath);
+    if (FAILED(hr)) goto done;
+
+    filePath = pszFilePath;
+
+done:
+    if (pszFilePath)
+        CoTaskMemFree(pszFilePath);
+
+    SafeRelease(&pItem);
+    SafeRelease(&pFileDialog);
+
+    return hr;
 }
 
-HRESULT InitializeMediaSession(const wchar_t* filePath)
+void OpenPlaylist(HWND hwnd)
 {
-    // Clean up previous session and source
-    if (g_pMediaSession)
+    std::wstring filePath;
+    if (FAILED(ShowPlaylistDialog(hwnd, false, filePath))) return;
+
+    std::vector<std::wstring> playlist;
+    auto start = std::chrono::steady_clock::now();
+    if (HasExtension(filePath, L".wmpl"))
     {
-        g_pMediaSession->Close();  // Optional: initiate async close
-        SafeRelease(&g_pMediaSession);
+        if (!LoadPlaylistFile(filePath, playlist))
+        {
+            MessageBox(hwnd, L"Failed to load playlist", L"Error", MB_ICONERROR);
+            return;
+        }
+        LogMessage("Loaded %zu playlist entries in %.1f ms", playlist.size(),
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
     }
-    if (g_pMediaSource)
+    else
     {
-        SafeRelease(&g_pMediaSource);
+        PlaylistImportStats stats;
+        if (!ImportPlaylistText(filePath, g_library, playlist, &stats))
+        {
+            MessageBox(hwnd, L"Failed to import playlist", L"Error", MB_ICONERROR);
+            return;
+        }
+        LogMessage("Imported %zu playlist entries (%zu duplicates dropped) in %.1f ms",
+            stats.entries, stats.duplicates, stats.seconds * 1000.0);
     }
-    if (g_pCallBack)
+
+    if (playlist.empty())
     {
-        SafeRelease(&g_pCallBack);
+        MessageBox(hwnd, L"The playlist is empty.", L"Info", MB_OK);
+        return;
     }
 
-    HRESULT hr = S_OK;
-    IMFSourceResolver* pSourceResolver = nullptr;
-    IUnknown* pSource = nullptr;
-    IMFTopology* pTopology = nullptr;
-
-    // Create the MediaSession
-    hr = MFCreateMediaSession(NULL, &g_pMediaSession);
-    if (FAILED(hr)) {
-        MessageBox(NULL, L"Failed to create MediaSession", L"Error", MB_ICONERROR);
-        goto done;
-    }
+    ReplacePlaylist(hwnd, PlaylistTracks(playlist));
+}
 
-    // Register for Media Session events
-    g_pCallBack = new MediaSessionCallback();
-    hr = g_pMediaSession->BeginGetEvent(g_pCallBack, NULL);
-    if (FAILED(hr)) {
-        MessageBox(NULL, L"Failed to register for Media Session events", L"Error", MB_ICONERROR);
-        goto done;
+void SavePlaylist(HWND hwnd)
+{
+    std::vector<std::wstring> playlist = PlaylistPaths();
+    if (playlist.empty())
+    {
+        MessageBox(hwnd, L"No folder selected.", L"Info", MB_OK);
+        return;
     }
 
-    // Create the Source Resolver
-    hr = MFCreateSourceResolver(&pSourceResolver);
-    if (FAILED(hr)) {
-        MessageBox(NULL, L"Failed to create Source Resolver", L"Error", MB_ICONERROR);
-        goto done;
+    std::wstring filePath;
+    if (FAILED(ShowPlaylistDialog(hwnd, true, filePath))) return;
+
+    auto start = std::chrono::steady_clock::now();
+    bool saved = HasExtension(filePath, L".wmpl") ? SavePlaylistFile(filePath, playlist)
+                                                 : ExportPlaylistText(filePath, playlist);
+    if (!saved)
+    {
+        MessageBox(hwnd, L"Failed to save playlist", L"Error", MB_ICONERROR);
+        return;
     }
+    LogMessage("Saved %zu playlist entries in %.1f ms", playlist.size(),
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+}
 
-    // Use the Source Resolver to create a Media Source
-    MF_OBJECT_TYPE objectType;
-    hr = pSourceResolver->CreateObjectFromURL(
-        filePath,                      // URL of the audio file
-        MF_RESOLUTION_MEDIASOURCE,     // Create a Media Source
-        NULL,                          // Optional property store
-        &objectType,                   // Receives the object type
-        &pSource                       // Receives the Media Source
-    );
-    if (FAILED(hr)) {
-        MessageBox(NULL, L"Failed to create Media Source", L"Error", MB_ICONERROR);
-        goto done;
+// Replace the playlist and load its first song, paused
+void ReplacePlaylist(HWND hwnd, std::vector<uint32_t> tracks)
+{
+    g_sessionPlaylistDirty = true;
+    if (SUCCEEDED(EnsureAudioOutput()))
+        TrackChanged(g_zone.SetPlaylist(std::move(tracks)));
+    else
+        g_zone.SetPlaylist(std::move(tracks), 0, false);
+    ScanPlaylistTags(hwnd);
+    InvalidateRect(hwnd, NULL, FALSE);
+}
+
+// Library ids of playlist entries, adding paths the library has not seen
+std::vector<uint32_t> PlaylistTracks(const std::vector<std::wstring>& paths)
+{
+    std::vector<uint32_t> tracks;
+    tracks.reserve(paths.size());
+    for (const auto& path : paths) tracks.push_back(g_library.Add(path));
+    return tracks;
+}
+
+// The zone's playlist as file paths, for saving and exporting
+std::vector<std::wstring> PlaylistPaths()
+{
+    std::vector<std::wstring> paths;
+    for (uint32_t track : g_zone.Playlist()) paths.push_back(g_library.Path(track));
+    return paths;
+}
+
+// Paths of 'count' playlist entries, starting 'first' entries after the
+// current one and wrapping around
+std::vector<std::wstring> UpcomingTracks(size_t first, size_t count)
+{
+    std::vector<uint32_t> playlist = g_zone.Playlist();
+    size_t current = g_zone.CurrentIndex();
+    std::vector<std::wstring> paths;
+    for (size_t i = first; i < first + count && i < playlist.size(); i++)
+        paths.push_back(g_library.Path(playlist[(current + i) % playlist.size()]));
+    return paths;
+}
+
+// Library metadata and smart playlists
+
+// Tags read on the scan thread, handed to the UI thread in batches
+struct ScannedTags
+{
+    std::vector<uint32_t> ids;
+    std::vector<TrackTags> tags;
+};
+
+// Read the tags of playlist entries the metadata store does not have yet.
+// One scan runs at a time; entries added meanwhile are picked up when it
+// finishes.
+void ScanPlaylistTags(HWND hwnd)
+{
+    if (g_tagScanThread.joinable())
+    {
+        g_tagScanPending = true;
+        return;
     }
+    g_tagScanPending = false;
 
-    // Get the IMFMediaSource interface
-    hr = pSource->QueryInterface(IID_PPV_ARGS(&g_pMediaSource));
-    if (FAILED(hr)) {
-        MessageBox(NULL, L"Failed to query Media Source", L"Error", MB_ICONERROR);
-        goto done;
+    std::vector<std::pair<uint32_t, std::wstring>> tracks;
+    for (uint32_t id : g_zone.Playlist())
+    {
+        if (!g_metadata.IsTagged(id)) tracks.emplace_back(id, g_library.Path(id));
+    }
+    g_metadata.Resize(g_library.Count());
+    if (tracks.empty())
+    {
+        ScanPlaylistSilence(hwnd);
+        return;
     }
 
-    // Create the topology
-    hr = CreatePlaybackTopology(g_pMediaSource, g_pMediaSession, &pTopology);
-    if (FAILED(hr)) {
-        MessageBox(NULL, L"Failed to create playback topology", L"Error", MB_ICONERROR);
-        goto done;
+    g_cancelTagScan = false;
+    g_tagScanThread = std::thread([hwnd, tracks]()
+    {
+        // Header reads only, but keep them behind playback and prefetch I/O
+        SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+        auto start = std::chrono::steady_clock::now();
+        const size_t kBatchSize = 256;
+        ScannedTags* pBatch = new ScannedTags();
+        size_t scanned = 0;
+        for (size_t i = 0; i < tracks.size() && !g_cancelTagScan; i++)
+        {
+            TrackTags tags;
+            if (!ReadTrackTags(tracks[i].second, tags)) continue;
+            pBatch->ids.push_back(tracks[i].first);
+            pBatch->tags.push_back(std::move(tags));
+            scanned++;
+            if (pBatch->ids.size() == kBatchSize)
+            {
+                if (!PostMessage(hwnd, WM_METADATA_SCANNED, 0, (LPARAM)pBatch)) delete pBatch;
+                pBatch = new ScannedTags();
+            }
+        }
+        LogMessage("Read tags of %zu of %zu tracks in %.1f ms", scanned, tracks.size(),
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+        // wParam 1 marks the last batch
+        if (!PostMessage(hwnd, WM_METADATA_SCANNED, 1, (LPARAM)pBatch)) delete pBatch;
+    });
+}
+
+void OnTagsScanned(HWND hwnd, ScannedTags* pBatch, bool done)
+{
+    for (size_t i = 0; i < pBatch->ids.size(); i++)
+        g_metadata.Set(pBatch->ids[i], pBatch->tags[i]);
+    delete pBatch;
+    if (!done) return;
+
+    if (g_tagScanThread.joinable()) g_tagScanThread.join();
+    g_metadata.RebuildZoneMaps();
+    if (g_tagScanPending)
+        ScanPlaylistTags(hwnd);
+    else
+        ScanPlaylistSilence(hwnd);
+}
+
+// Audible ranges found on the silence scan thread, in ms
+struct ScannedRanges
+{
+    std::vector<uint32_t> ids;
+    std::vector<std::pair<uint32_t, uint32_t>> ranges;
+};
+
+// With trimming on, find the audible range of playlist entries that have not
+// been scanned yet. Runs after the tag scan, one scan at a time like it.
+void ScanPlaylistSilence(HWND hwnd)
+{
+    if (!g_trimSilence) return;
+    if (g_silenceScanThread.joinable())
+    {
+        g_silenceScanPending = true;
+        return;
     }
+    g_silenceScanPending = false;
 
-    // Set the topology on the MediaSession
-    hr = g_pMediaSession->SetTopology(0, pTopology);
-    if (FAILED(hr)) {
-        MessageBox(NULL, L"Failed to set topology on MediaSession", L"Error", MB_ICONERROR);
-        goto done;
+    std::vector<std::pair<uint32_t, std::wstring>> tracks;
+    for (uint32_t id : g_zone.Playlist())
+    {
+        if (!g_metadata.HasAudibleRange(id)) tracks.emplace_back(id, g_library.Path(id));
     }
+    if (tracks.empty()) return;
 
-done:
-    SafeRelease(&pSourceResolver);
-    SafeRelease(&pSource);
-    SafeRelease(&pTopology);
-    return hr;
+    // Scanned tracks the native decoders cannot open go through Media Foundation
+    if (FAILED(EnsureMediaFoundation())) return;
+
+    g_cancelSilenceScan = false;
+    g_silenceScanThread = std::thread([hwnd, tracks]()
+    {
+        // Decoding, so stay well behind playback
+        SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+        HRESULT hrCom = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+        auto start = std::chrono::steady_clock::now();
+        const size_t kBatchSize = 32;
+        ScannedRanges* pBatch = new ScannedRanges();
+        uint64_t totalFrames = 0, decodedFrames = 0;
+        for (size_t i = 0; i < tracks.size() && !g_cancelSilenceScan; i++)
+        {
+            // Tracks that cannot be scanned, or are silent throughout, play in full
+            std::pair<uint32_t, uint32_t> range(0, kAudioEndUnknown);
+            std::unique_ptr<AudioSource> source = OpenAudioSource(tracks[i].second);
+            AudibleRange audible;
+            uint64_t decoded = 0;
+            if (source && ScanAudibleRange(*source, kSilenceThreshold, audible, &decoded) && audible.end > audible.start)
+            {
+                uint64_t rate = source->Format().sampleRate;
+                range.first = (uint32_t)(audible.start * 1000 / rate);
+                range.second = (uint32_t)std::min<uint64_t>((audible.end * 1000 + rate - 1) / rate, kAudioEndUnknown - 1);
+                totalFrames += std::max(source->TotalFrames(), audible.end);
+                decodedFrames += decoded;
+            }
+            pBatch->ids.push_back(tracks[i].first);
+            pBatch->ranges.push_back(range);
+            if (pBatch->ids.size() == kBatchSize)
+            {
+                if (!PostMessage(hwnd, WM_SILENCE_SCANNED, 0, (LPARAM)pBatch)) delete pBatch;
+                pBatch = new ScannedRanges();
+            }
+        }
+        LogMessage("Scanned silence of %zu tracks in %.1f ms, decoding %.1f%% of their audio", tracks.size(),
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(),
+            totalFrames ? 100.0 * decodedFrames / totalFrames : 0.0);
+
+        // wParam 1 marks the last batch
+        if (!PostMessage(hwnd, WM_SILENCE_SCANNED, 1, (LPARAM)pBatch)) delete pBatch;
+        if (SUCCEEDED(hrCom)) CoUninitialize();
+    });
 }
 
-HRESULT CreatePlaybackTopology(IMFMediaSource* pMediaSource, IMFMediaSession* pMediaSession, IMFTopology** ppTopology)
+void OnSilenceScanned(HWND hwnd, ScannedRanges* pBatch, bool done)
 {
-    HRESULT hr = S_OK;
-    IMFTopology* pTopology = nullptr;
-    IMFPresentationDescriptor* pPresentationDescriptor = nullptr;
-    IMFStreamDescriptor* pStreamDescriptor = nullptr;
-    IMFActivate* pAudioRendererActivate = nullptr;
-    IMFTopologyNode* pSourceNode = nullptr;
-    IMFTopologyNode* pOutputNode = nullptr;
-    BOOL streamSelected = FALSE;
-
-    // Create a new topology
-    hr = MFCreateTopology(&pTopology);
-    if (FAILED(hr)) goto done;
+    for (size_t i = 0; i < pBatch->ids.size(); i++)
+        g_metadata.SetAudibleRange(pBatch->ids[i], pBatch->ranges[i].first, pBatch->ranges[i].second);
+    delete pBatch;
+    if (!done) return;
 
-    // Get the presentation descriptor for the media source
-    hr = pMediaSource->CreatePresentationDescriptor(&pPresentationDescriptor);
-    if (FAILED(hr)) goto done;
-    else 
-    {   // Get the total duration of the loaded media
-        pPresentationDescriptor->GetUINT64(MF_PD_DURATION, (UINT64*)&g_totalDuration);
+    if (g_silenceScanThread.joinable()) g_silenceScanThread.join();
+    if (g_silenceScanPending) ScanPlaylistSilence(hwnd);
+}
+
+// Trimming applies from the next track loaded
+void ToggleSilenceTrim(HWND hwnd)
+{
+    g_trimSilence = !g_trimSilence;
+    LogMessage("Silence trimming %s", g_trimSilence ? "on" : "off");
+    ScanPlaylistSilence(hwnd);
+}
+
+// Tempo and key found on the analysis thread
+struct AnalyzedFeatures
+{
+    std::vector<uint32_t> ids;
+    std::vector<TrackFeatures> features;
+    AnalysisStats stats;
+};
+
+// Reorder the playlist so neighbours are close in key and tempo. Entries
+// not analysed yet are analysed first on a background job, after which the
+// order is applied.
+void OrderPlaylistForMixing(HWND hwnd)
+{
+    if (g_analysisThread.joinable()) return;
+
+    std::vector<std::pair<uint32_t, std::wstring>> tracks;
+    for (uint32_t id : g_zone.Playlist())
+    {
+        if (!g_metadata.HasFeatures(id)) tracks.emplace_back(id, g_library.Path(id));
+    }
+    if (tracks.empty())
+    {
+        ApplyMixingOrder();
+        InvalidateRect(hwnd, NULL, FALSE);
+        return;
     }
 
-    // Get the first audio stream
-    hr = pPresentationDescriptor->GetStreamDescriptorByIndex(0, &streamSelected, &pStreamDescriptor);
-    if (FAILED(hr)) goto done;
+    // The analysis workers decode with Media Foundation where needed too
+    if (FAILED(EnsureMediaFoundation())) return;
 
-    if (streamSelected)
-    {   
-        // Create the audio renderer activation object
-        hr = MFCreateAudioRendererActivate(&pAudioRendererActivate);
-        if (FAILED(hr)) goto done;
+    g_cancelAnalysis = false;
+    g_analysisThread = std::thread([hwnd, tracks]()
+    {
+        // Leave a core to playback
+        unsigned threads = std::thread::hardware_concurrency();
+        threads = threads > 1 ? threads - 1 : 1;
+
+        AnalyzedFeatures* pResult = new AnalyzedFeatures();
+        // Background workers with COM initialized, so Media Foundation can decode
+        pResult->stats = AnalyzeTracks(tracks.size(), [&](size_t i)
+        {
+            return OpenAudioSource(tracks[i].second);
+        }, pResult->features, threads, &g_cancelAnalysis, true);
+        for (const auto& track : tracks) pResult->ids.push_back(track.first);
 
-        // Add a source node for the media source
-        hr = AddSourceNode(pTopology, pMediaSource, pPresentationDescriptor, pStreamDescriptor, &pSourceNode);
-        if (FAILED(hr)) goto done;
+        if (!PostMessage(hwnd, WM_ANALYSIS_FINISHED, 0, (LPARAM)pResult)) delete pResult;
+    });
+}
 
-        // Add an output node for the audio renderer
-        hr = AddOutputNode(pTopology, pAudioRendererActivate, &pOutputNode);
-        if (FAILED(hr)) goto done;
+void OnAnalysisFinished(HWND hwnd, AnalyzedFeatures* pResult)
+{
+    if (g_analysisThread.joinable()) g_analysisThread.join();
 
-        hr = pSourceNode->ConnectOutput(0, pOutputNode, 0);
-        if (FAILED(hr)) goto done;
+    // Tracks that could not be analysed stay unknown and are tried again next time
+    for (size_t i = 0; i < pResult->ids.size(); i++)
+    {
+        const TrackFeatures& features = pResult->features[i];
+        uint32_t bpmTenths = (uint32_t)(features.bpm * 10.0f + 0.5f);
+        uint32_t keyCode = features.key >= 0 ? (uint32_t)features.key + 1 : 0;
+        if (bpmTenths || keyCode) g_metadata.SetFeatures(pResult->ids[i], bpmTenths, keyCode);
     }
-    else
+    const AnalysisStats& stats = pResult->stats;
+    LogMessage("Analysed tempo and key of %zu tracks (%zu failed) in %.1f s, %.0fx realtime",
+        stats.tracksAnalyzed, stats.tracksFailed, stats.wallSeconds,
+        stats.wallSeconds > 0.0 ? stats.audioSeconds / stats.wallSeconds : 0.0);
+    delete pResult;
+
+    ApplyMixingOrder();
+    InvalidateRect(hwnd, NULL, FALSE);
+}
+
+// The current track keeps playing; only its index moves
+void ApplyMixingOrder()
+{
+    std::vector<uint32_t> playlist = g_zone.Playlist();
+    if (playlist.empty()) return;
+
+    std::vector<TrackFeatures> features(playlist.size());
+    for (size_t i = 0; i < playlist.size(); i++)
     {
-        MessageBox(NULL, L"No valid audio stream found in the file.", L"Error", MB_ICONERROR);
-        goto done; 
+        uint32_t id = playlist[i];
+        if (!g_metadata.HasFeatures(id)) continue;
+        uint32_t bpmTenths = g_metadata.Value(id, MetadataColumn::Bpm);
+        uint32_t keyCode = g_metadata.Value(id, MetadataColumn::Key);
+        features[i].bpm = bpmTenths / 10.0f;
+        features[i].key = (int)keyCode - 1;
     }
 
-    *ppTopology = pTopology;
-    (*ppTopology)->AddRef();
+    std::vector<size_t> order = OrderForMixing(features);
+    std::vector<uint32_t> ordered;
+    ordered.reserve(order.size());
+    size_t current = g_zone.CurrentIndex();
+    size_t currentIndex = 0;
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        if (order[i] == current) currentIndex = i;
+        ordered.push_back(playlist[order[i]]);
+    }
+    g_zone.SetPlaylist(ordered, currentIndex, false);
+    g_sessionPlaylistDirty = true;
+    PrefetchUpcomingTracks();
+    RequestAlbumArt();
 
-done:
-    SafeRelease(&pTopology);
-    SafeRelease(&pPresentationDescriptor);
-    SafeRelease(&pStreamDescriptor);
-    SafeRelease(&pAudioRendererActivate);
-    return hr;
+    for (size_t i = 0; i < ordered.size() && i < 8; i++)
+    {
+        const TrackFeatures& track = features[order[i]];
+        LogMessage("Mix %zu: %.1f BPM, %s, %s", i + 1, track.bpm, KeyName(track.key).c_str(),
+            WideToUtf8(std::filesystem::path(g_library.Path(ordered[i])).filename().wstring()).c_str());
+    }
 }
 
-HRESULT AddSourceNode(IMFTopology* pTopology, IMFMediaSource* pMediaSource, IMFPresentationDescriptor* pPresentationDescriptor, IMFStreamDescriptor* pStreamDescriptor, IMFTopologyNode** ppNode)
+// One-line text prompt over the main window: Enter accepts, Esc or closing
+// the prompt cancels
+bool ShowQueryPrompt(HWND hwnd, std::wstring& query)
 {
-    HRESULT hr = S_OK;
-    IMFTopologyNode* pNode = nullptr;
+    LPCWSTR promptClass = L"AudioPlayerQueryPrompt";
+    WNDCLASS wc = { };
+    if (!GetClassInfo(g_hInstance, promptClass, &wc))
+    {
+        wc.lpfnWndProc   = DefWindowProc;
+        wc.hInstance     = g_hInstance;
+        wc.hCursor       = LoadCursor(NULL, IDC_ARROW);
+        wc.hbrBackground = (HBRUSH)(COLOR_WINDOW + 1);
+        wc.lpszClassName = promptClass;
+        RegisterClass(&wc);
+    }
 
-    // Create the source node
-    hr = MFCreateTopologyNode(MF_TOPOLOGY_SOURCESTREAM_NODE, &pNode);
-    if (FAILED(hr)) goto done;
+    RECT rc;
+    GetWindowRect(hwnd, &rc);
+    HWND prompt = CreateWindowEx(WS_EX_DLGMODALFRAME, promptClass, L"Smart playlist query",
+        WS_POPUP | WS_CAPTION | WS_SYSMENU, rc.left + 40, rc.top + 80, 640, 100, hwnd, NULL, g_hInstance, NULL);
+    if (!prompt) return false;
+    HWND edit = CreateWindowEx(WS_EX_CLIENTEDGE, L"EDIT", query.c_str(), WS_CHILD | WS_VISIBLE | ES_AUTOHSCROLL,
+        10, 15, 605, 26, prompt, NULL, g_hInstance, NULL);
+
+    EnableWindow(hwnd, FALSE);
+    ShowWindow(prompt, SW_SHOW);
+    SetFocus(edit);
+    SendMessage(edit, EM_SETSEL, 0, -1);
+
+    bool accepted = false;
+    MSG msg;
+    while (IsWindow(prompt))
+    {
+        BOOL result = GetMessage(&msg, NULL, 0, 0);
+        if (result == 0)
+        {
+            PostQuitMessage((int)msg.wParam);
+            break;
+        }
+        if (result == -1) break;
 
-    // Set the attributes on the source node
-    hr = pNode->SetUnknown(MF_TOPONODE_SOURCE, pMediaSource);
-    if (FAILED(hr)) goto done;
+        if (msg.message == WM_KEYDOWN && (msg.wParam == VK_RETURN || msg.wParam == VK_ESCAPE))
+        {
+            accepted = msg.wParam == VK_RETURN;
+            std::vector<wchar_t> text(GetWindowTextLength(edit) + 1);
+            GetWindowText(edit, text.data(), (int)text.size());
+            if (accepted) query = text.data();
+            break;
+        }
+        TranslateMessage(&msg);
+        DispatchMessage(&msg);
+    }
 
-    hr = pNode->SetUnknown(MF_TOPONODE_PRESENTATION_DESCRIPTOR, pPresentationDescriptor);
-    if (FAILED(hr)) goto done;
+    // Re-enable the owner first so it gets the focus back
+    EnableWindow(hwnd, TRUE);
+    if (IsWindow(prompt)) DestroyWindow(prompt);
+    return accepted;
+}
 
-    hr = pNode->SetUnknown(MF_TOPONODE_STREAM_DESCRIPTOR, pStreamDescriptor);
-    if (FAILED(hr)) goto done;
+// Replace the playlist with the library tracks matching a query
+void OpenSmartPlaylist(HWND hwnd)
+{
+    std::wstring query = g_smartPlaylistQuery;
+    if (!ShowQueryPrompt(hwnd, query)) return;
+    g_smartPlaylistQuery = query;
+
+    auto start = std::chrono::steady_clock::now();
+    SmartPlaylistQuery compiled;
+    std::wstring error;
+    if (!compiled.Compile(query, g_metadata, UnixTimeNow(), error))
+    {
+        MessageBox(hwnd, error.c_str(), L"Smart playlist", MB_ICONERROR);
+        return;
+    }
+    std::vector<uint32_t> rows = compiled.Run(g_metadata);
+    LogMessage("Smart playlist: %zu of %zu tracks in %.2f ms", rows.size(), g_metadata.Rows(),
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
 
-    // Add the node to the topology
-    hr = pTopology->AddNode(pNode);
-    if (FAILED(hr)) goto done;
+    if (rows.empty())
+    {
+        MessageBox(hwnd, L"No tracks match the query.", L"Info", MB_OK);
+        return;
+    }
 
-    // Return the created node
-    *ppNode = pNode;
-    (*ppNode)->AddRef();
+    // Rows are library ids
+    ReplacePlaylist(hwnd, std::move(rows));
+}
 
-done:
-    SafeRelease(&pNode);
-    return hr;
+// Audio initialization
+HRESULT InitMediaFoundation()
+{
+    return MFStartup(MF_VERSION);
 }
 
-HRESULT AddOutputNode(IMFTopology* pTopology, IMFActivate* pActivate, IMFTopologyNode** ppNode)
+// On first need: WAV, FLAC and MP3 decode natively, anything else (and
+// Layer I/II or free-format MP3) through Media Foundation
+HRESULT EnsureMediaFoundation()
 {
-    HRESULT hr = S_OK;
-    IMFTopologyNode* pNode = nullptr;
+    if (g_mediaFoundationReady) return S_OK;
+    HRESULT hr = InitMediaFoundation();
+    if (FAILED(hr)) return hr;
+    g_mediaFoundationReady = true;
+    LogStartupPhase("Media Foundation ready");
+    return S_OK;
+}
 
-    // Create the output node
-    hr = MFCreateTopologyNode(MF_TOPOLOGY_OUTPUT_NODE, &pNode);
-    if (FAILED(hr)) goto done;
+void CleanupMediaFoundation()
+{
+    if (!g_mediaFoundationReady) return;
+    MFShutdown();
+    g_mediaFoundationReady = false;
+}
 
-    // Set the activation object on the output node
-    hr = pNode->SetObject(pActivate);
-    if (FAILED(hr)) goto done;
+HRESULT InitAudioOutput()
+{
+    HRESULT hr = g_audioOutput.Open(&g_zone.Engine());
+    if (FAILED(hr)) return hr;
+
+    g_host.Start(1);
+    g_zone.SetTrackOpener(OpenTrack);
+    g_zone.SetTrackReports(true);
+    // Runs on a decode thread; the UI thread moves the zone on
+    g_zone.SetTrackEndedCallback([]() { PostMessage(g_hWnd, WM_PLAY_NEXT_TRACK, 0, 0); });
+    if (!g_zone.Open(&g_audioOutput)) return E_OUTOFMEMORY;
+    return S_OK;
+}
 
-    // Add the node to the topology
-    hr = pTopology->AddNode(pNode);
-    if (FAILED(hr)) goto done;
+// Media Foundation, the output device and the zone, on first need
+HRESULT EnsureAudioOutput()
+{
+    if (g_audioReady) return S_OK;
 
-    // Return the created node
-    *ppNode = pNode;
-    (*ppNode)->AddRef();
+    HRESULT hr = EnsureMediaFoundation();
+    if (FAILED(hr))
+    {
+        MessageBox(NULL, L"Media Foundation initialization failed", L"Error", MB_ICONERROR);
+        return hr;
+    }
 
-done:
-    SafeRelease(&pNode);
-    return hr;
+    // Open the output device and start the playback engine
+    hr = InitAudioOutput();
+    if (FAILED(hr))
+    {
+        g_audioOutput.Close();
+        g_host.Stop();
+        MessageBox(NULL, L"Audio output initialization failed", L"Error", MB_ICONERROR);
+        return hr;
+    }
+    g_audioReady = true;
+
+    // Settings chosen (or restored) before the engine existed
+    ApplyEqPreset(g_eqPreset);
+    if (kPlaybackSpeeds[g_speedIndex] != 1.0) ApplyPlaybackSpeed(g_speedIndex);
+    LogStartupPhase("audio output ready");
+    return S_OK;
+}
+
+// Hand the entries after the current one, in play order, to the prefetcher
+void PrefetchUpcomingTracks()
+{
+    g_prefetcher.SetUpcoming(UpcomingTracks(1, 3));
+}
+
+void CleanupAudioOutput()
+{
+    if (!g_audioReady) return;
+    g_audioReady = false;
+    g_zone.Close();
+    g_audioOutput.Close();
+    g_host.Stop();
+}
+
+// The zone's track opener. Runs with the zone locked, so it must not call
+// into g_zone; TrackChanged() does the rest once the zone has loaded it.
+std::unique_ptr<AudioSource> OpenTrack(uint32_t track)
+{
+    const std::wstring& path = g_library.Path(track);
+
+    // Time to first byte: opening the file through to the decoder's first read
+    PrefetchState prefetchState = g_prefetcher.State(path);
+    auto openStart = std::chrono::steady_clock::now();
+    // Let heavy (hi-res, multichannel) streams decode ahead on several cores
+    std::unique_ptr<AudioSource> source = OpenAudioSource(path, 0);
+    double openMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - openStart).count();
+    g_prefetcher.RecordOpen(prefetchState, openMilliseconds);
+    LogMessage("Opened track in %.1f ms (%s)", openMilliseconds,
+        prefetchState == PrefetchState::Warm ? "prefetched" : prefetchState == PrefetchState::Partial ? "partly prefetched" : "cold");
+    if (!source) return nullptr;
+
+    // Skip the leading and trailing silence found by the background scan;
+    // the zone seeks to the trimmed start
+    if (g_trimSilence && g_metadata.HasAudibleRange(track))
+    {
+        uint64_t rate = source->Format().sampleRate;
+        uint32_t endMs = g_metadata.Value(track, MetadataColumn::AudioEnd);
+        uint64_t endFrame = endMs == kAudioEndUnknown ? 0 : (uint64_t)endMs * rate / 1000;
+        uint64_t startFrame = (uint64_t)g_metadata.Value(track, MetadataColumn::AudioStart) * rate / 1000;
+        source = std::make_unique<TrimmedSource>(std::move(source), startFrame, endFrame);
+    }
+    return source;
+}
+
+// After the zone has loaded a new entry, or failed to
+bool TrackChanged(bool loaded)
+{
+    g_resumePending = false;
+    PrefetchUpcomingTracks();
+    RequestAlbumArt();
+    if (!loaded)
+    {
+        MessageBox(NULL, L"Failed to open audio file", L"Error", MB_ICONERROR);
+        return false;
+    }
+
+    // Play history for "played in N days" queries
+    g_metadata.MarkPlayed(g_zone.CurrentTrack(), UnixTimeNow());
+    return true;
 }
 
 // Playback handling
 void PlayAudio()
 {
-    if (g_pMediaSession)
-    {
-        PROPVARIANT varStart;
-        PropVariantInit(&varStart);
-        HRESULT hr = g_pMediaSession->Start(&GUID_NULL, &varStart);
-        PropVariantClear(&varStart);
+    // First play after a restored session opens the track where it stopped
+    if (!g_zone.Status().loaded && g_resumePending && !ResumeSession()) return;
 
-        if (FAILED(hr)) {
+    if (g_zone.Status().loaded)
+    {
+        g_zone.Play();
+        if (!g_zone.Status().playing) {
             MessageBox(NULL, L"play pressed failed", L"Error", MB_ICONERROR);
         }
     }
@@ -782,63 +1484,67 @@ void PlayAudio()
 
 void PauseAudio()
 {
-    if (g_pMediaSession)
+    g_zone.Pause();
+}
+
+void TogglePlayback(HWND hwnd)
+{
+    ZoneStatus status = g_zone.Status();
+    if (status.count == 0)
     {
-        g_pMediaSession->Pause();
+        MessageBox(hwnd, L"No folder selected.", L"Info", MB_OK);
+        return;
     }
+
+    if (status.playing)
+        PauseAudio();
+    else
+        PlayAudio();
+    InvalidateRect(hwnd, NULL, FALSE);
 }
 
 HRESULT GetCurrentPlaybackTime(LONGLONG* p_currentTime)
 {
-    if (!g_pMediaSession)
-        return 0;
-
-    IMFClock* pClock = nullptr;
-    LONGLONG currentTime = 0, systemTime = 0;
-
-    HRESULT hr = g_pMediaSession->GetClock(&pClock);
-    if(FAILED(hr)) goto done;
+    ZoneStatus status = g_zone.Status();
+    if (!status.loaded || status.sourceRate == 0)
+        return E_FAIL;
 
-    hr = pClock->GetCorrelatedTime(0, &currentTime, &systemTime);
-    if(FAILED(hr)) goto done;
+    *p_currentTime = (LONGLONG)(status.positionFrames * 10000000 / status.sourceRate);
+    return S_OK;
+}
 
-    *p_currentTime = currentTime;
+// Length of the current track in 100ns units, 0 when none is loaded
+LONGLONG TrackDuration()
+{
+    if (g_resumePending) return g_resumeDuration;
 
-done:
-    SafeRelease(&pClock);
-    return hr;
+    ZoneStatus status = g_zone.Status();
+    if (!status.loaded || status.sourceRate == 0) return 0;
+    return (LONGLONG)(status.durationFrames * 10000000 / status.sourceRate);
 }
 
 void SeekToTime(LONGLONG newTime100ns)
 {
-    if (!g_pMediaSession || !g_pMediaSource) return;
-
-    IMFPresentationDescriptor* pPD = nullptr;
-    UINT64 totalDuration = 0;
-
+    ZoneStatus status = g_zone.Status();
+    if (!status.loaded && !g_resumePending) return;
 
+    LONGLONG duration = TrackDuration();
     if (newTime100ns < 0) newTime100ns = 0;
-    if (newTime100ns > g_totalDuration)
-        newTime100ns = g_totalDuration;
-
-    PROPVARIANT varStart;
-    PropVariantInit(&varStart);
-    varStart.vt = VT_I8;
-    varStart.hVal.QuadPart = newTime100ns;
+    if (newTime100ns > duration)
+        newTime100ns = duration;
 
-    HRESULT hr = g_pMediaSession->Start(&GUID_NULL, &varStart);
-    if (FAILED(hr)) {
-        MessageBox(NULL, L"Seek failed", L"Error", MB_ICONERROR);
+    // Restored track not opened yet: move where it will resume
+    if (g_resumePending)
+    {
+        g_resumePosition = newTime100ns;
+        return;
     }
 
-    PropVariantClear(&varStart);
-    SafeRelease(&pPD);
+    g_zone.Seek((uint64_t)newTime100ns * status.sourceRate / 10000000);
 }
 
 void SeekBySeconds(LONGLONG offsetSeconds)
 {
-    if (!g_pMediaSession || !g_pMediaSource) return;
-
     LONGLONG currentTime = 0;
     HRESULT hr = GetCurrentPlaybackTime(&currentTime);
     if (FAILED(hr)) return;
@@ -846,42 +1552,71 @@ void SeekBySeconds(LONGLONG offsetSeconds)
     SeekToTime(currentTime + offsetSeconds * 10000000);
 }
 
-HRESULT Backwards()
+// Previous (-1) or next (1) playlist entry, then play it
+void StepTrack(HWND hwnd, int direction)
 {
-    HRESULT hr = S_OK;
-    if (!g_playlist.empty()) {
-        g_currentTrackIndex = (g_currentTrackIndex == 0) ? g_playlist.size() - 1 : g_currentTrackIndex - 1;
+    if (g_zone.Status().count == 0) return;
+    if (FAILED(EnsureAudioOutput())) return;
 
-        hr = InitializeMediaSession(g_playlist[g_currentTrackIndex].c_str());
-        if(FAILED(hr))
-        {
-            g_isPlaying = false;
-            return hr;
-        }
+    bool loaded = direction < 0 ? g_zone.Previous() : g_zone.Next();
+    if (TrackChanged(loaded)) PlayAudio();
+    InvalidateRect(hwnd, NULL, FALSE);
+}
 
-        g_isPlaying = true;
-        PlayAudio();
+// Offline export
+void StartPlaylistExport(HWND hwnd)
+{
+    ZoneStatus status = g_zone.Status();
+    if (status.count == 0)
+    {
+        MessageBox(hwnd, L"No folder selected.", L"Info", MB_OK);
+        return;
     }
-    return hr;
+    if (g_renderThread.joinable())
+    {
+        MessageBox(hwnd, L"An export is already running.", L"Info", MB_OK);
+        return;
+    }
+
+    std::wstring outputFolder;
+    if (FAILED(OpenFolderDialog(hwnd, outputFolder))) return;
+
+    // Media Foundation decodes formats the native decoders do not handle
+    if (FAILED(EnsureMediaFoundation()))
+    {
+        MessageBox(hwnd, L"Media Foundation initialization failed", L"Error", MB_ICONERROR);
+        return;
+    }
+
+    RenderSettings settings;
+    settings.gain = status.volume;
+    settings.cancel = &g_cancelRender;
+    g_cancelRender = false;
+
+    // Render from a copy so the playlist can change while the export runs
+    std::vector<std::wstring> playlist = PlaylistPaths();
+    g_renderThread = std::thread([hwnd, playlist, outputFolder, settings]()
+    {
+        RenderStats* pStats = new RenderStats(RenderPlaylist(playlist, outputFolder, settings));
+        if (!PostMessage(hwnd, WM_RENDER_FINISHED, 0, (LPARAM)pStats)) delete pStats;
+    });
 }
 
-HRESULT Forwards()
+void OnRenderFinished(HWND hwnd, RenderStats* pStats)
 {
-    HRESULT hr = S_OK;
-    if (!g_playlist.empty()) {
-        g_currentTrackIndex = (g_currentTrackIndex + 1) % g_playlist.size();
+    if (g_renderThread.joinable()) g_renderThread.join();
 
-        hr = InitializeMediaSession(g_playlist[g_currentTrackIndex].c_str());
-        if(FAILED(hr))
-        {
-            g_isPlaying = false;
-            return hr;
-        }
+    LogMessage("Export: %zu tracks, %zu failed, %.1f s audio in %.2f s (%.1fx realtime, %.1f MB/s)",
+        pStats->tracksRendered, pStats->tracksFailed, pStats->audioSeconds, pStats->wallSeconds,
+        pStats->RealtimeFactor(), pStats->MegabytesPerSecond());
 
-        g_isPlaying = true;
-        PlayAudio();
-    }
-    return hr;
+    wchar_t message[256];
+    swprintf(message, 256, L"Exported %zu tracks (%zu failed)\n%.1f s of audio in %.2f s\n%.1fx realtime, %.1f MB/s",
+        pStats->tracksRendered, pStats->tracksFailed, pStats->audioSeconds, pStats->wallSeconds,
+        pStats->RealtimeFactor(), pStats->MegabytesPerSecond());
+    MessageBox(hwnd, message, L"Export finished", MB_OK);
+
+    delete pStats;
 }
 
 // Window Procedure
@@ -903,15 +1638,24 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
             return -1;
         }
 
-        // Initialize Media Foundation
-        if (FAILED(InitMediaFoundation()))
+        LogStartupPhase("Direct2D ready");
+
+        // Last session's playlist and position; the track opens on first play
+        g_prefetcher.Start();
         {
-            MessageBox(hwnd, L"Media Foundation initialization failed", L"Error", MB_ICONERROR);
-            return -1;
+            std::filesystem::path folder = SessionFolder();
+            g_albumArt.Start(folder.empty() ? folder : folder / L"art", [hwnd]() { PostMessage(hwnd, WM_ALBUM_ART_READY, 0, 0); });
         }
+        RestoreSession();
+        LogStartupPhase("session restored");
 
         // Set a timer to update the progress bar every 100ms
         SetTimer(hwnd, 1, 100, NULL);
+        // Media Foundation and the audio device come up once the first frame is
+        // on screen (timers fire only when no paint is pending)
+        SetTimer(hwnd, 2, USER_TIMER_MINIMUM, NULL);
+        // Snapshot the session every 15 seconds
+        SetTimer(hwnd, 3, 15000, NULL);
 
         // Setup initial button positions
         Resize(hwnd);
@@ -944,69 +1688,74 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
         switch (wParam)
         {
         case VK_SPACE: // Spacebar to play/pause
-            if (g_playlist.empty()) 
-            {
-                MessageBox(hwnd, L"No folder selected.", L"Info", MB_OK);
-            }
-            else
-            {
-                if (!g_isPlaying)
-                {
-                    g_isPlaying = true;
-                    PlayAudio();
-                }
-                else
-                {
-                    g_isPlaying = false;
-                    PauseAudio();
-                }
-            }
-            InvalidateRect(hwnd, NULL, FALSE);
+            TogglePlayback(hwnd);
             break;
     
         case VK_LEFT:
             if (ctrlDown) {
-                if (FAILED(Backwards())) break;
-            } else if (g_isPlaying) {
+                StepTrack(hwnd, -1);
+            } else if (g_zone.Status().playing) {
                 SeekBySeconds(-5);
             }
             break;
         
         case VK_RIGHT:
             if (ctrlDown) {
-                if (FAILED(Forwards())) break;
-            } else if (g_isPlaying) {
+                StepTrack(hwnd, 1);
+            } else if (g_zone.Status().playing) {
                 SeekBySeconds(5);
             }
             break;
     
         case VK_UP: // Up arrow to increase volume
-            g_volumeValue += 0.1f;
-            if (g_volumeValue > 1.0f) g_volumeValue = 1.0f;
-            SetMusicVolume(g_volumeValue);
+            SetMusicVolume(g_zone.Status().volume + 0.1f);
             InvalidateRect(hwnd, NULL, FALSE);
             break;
     
         case VK_DOWN: // Down arrow to decrease volume
-            g_volumeValue -= 0.1f;
-            if (g_volumeValue < 0.0f) g_volumeValue = 0.0f;
-            SetMusicVolume(g_volumeValue);
+            SetMusicVolume(g_zone.Status().volume - 0.1f);
             InvalidateRect(hwnd, NULL, FALSE);
             break;
 
         case 'O': // 'O' key to open the file dialog
-        {
-            // Get folder path
-            std::wstring folderPath;
-            if (FAILED(OpenFolderDialog(hwnd, folderPath))) break;
+            OpenFolder(hwnd);
+            break;
 
-            // Build playlist and load first song for playing
-            BuildPlaylistFromFolder(folderPath);
-            if (FAILED(InitializeMediaSession(g_playlist[g_currentTrackIndex].c_str()))) break;
+        case 'P': // 'P' key to open a saved or M3U/PLS playlist
+            OpenPlaylist(hwnd);
+            break;
 
-            InvalidateRect(hwnd, NULL, FALSE);
+        case 'S': // 'S' key to save the playlist
+            SavePlaylist(hwnd);
+            break;
+
+        case 'E': // 'E' key to export the playlist to .wav files
+            StartPlaylistExport(hwnd);
+            break;
+
+        case 'Q': // 'Q' key to cycle the EQ presets
+            CycleEqPreset();
+            break;
+
+        case 'F': // 'F' key to build a smart playlist from a query
+            OpenSmartPlaylist(hwnd);
+            break;
+
+        case 'T': // 'T' key to toggle silence trimming
+            ToggleSilenceTrim(hwnd);
+            break;
+
+        case 'M': // 'M' key to order the playlist for mixing by key and tempo
+            OrderPlaylistForMixing(hwnd);
+            break;
+
+        case VK_OEM_4: // '[' key to slow playback down
+            StepPlaybackSpeed(-1);
+            break;
+
+        case VK_OEM_6: // ']' key to speed playback up
+            StepPlaybackSpeed(1);
             break;
-        }
         
         default:
             break;
@@ -1015,18 +1764,64 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
     }
 
     case WM_TIMER:
-        if (wParam == 1 && g_isPlaying && g_updateProgress)
+        if (wParam == 1 && g_updateProgress && g_zone.Status().playing)
             UpdateProgressBar(hwnd);
+        else if (wParam == 2)
+        {
+            KillTimer(hwnd, 2);
+            EnsureAudioOutput();
+            ScanPlaylistTags(hwnd);
+        }
+        else if (wParam == 3)
+            SaveSession();
         break;
 
     case WM_PLAY_NEXT_TRACK:
-        if (FAILED(Forwards())) break;
+        // Reset the UI state and play the next song
+        g_progressValue = 0.0f;
+        StepTrack(hwnd, 1);
+        break;
+
+    case WM_RENDER_FINISHED:
+        OnRenderFinished(hwnd, (RenderStats*)lParam);
+        break;
+
+    case WM_METADATA_SCANNED:
+        OnTagsScanned(hwnd, (ScannedTags*)lParam, wParam != 0);
+        break;
+
+    case WM_SILENCE_SCANNED:
+        OnSilenceScanned(hwnd, (ScannedRanges*)lParam, wParam != 0);
+        break;
+
+    case WM_ANALYSIS_FINISHED:
+        OnAnalysisFinished(hwnd, (AnalyzedFeatures*)lParam);
+        break;
+
+    case WM_ALBUM_ART_READY:
         InvalidateRect(hwnd, NULL, FALSE);
         break;
     
 
     case WM_DESTROY:
         KillTimer(hwnd, 1);
+        KillTimer(hwnd, 2);
+        KillTimer(hwnd, 3);
+        SaveSession();
+        // Stop any export before Media Foundation goes away
+        g_cancelRender = true;
+        if (g_renderThread.joinable()) g_renderThread.join();
+        g_cancelTagScan = true;
+        if (g_tagScanThread.joinable()) g_tagScanThread.join();
+        g_cancelSilenceScan = true;
+        if (g_silenceScanThread.joinable()) g_silenceScanThread.join();
+        g_cancelAnalysis = true;
+        if (g_analysisThread.joinable()) g_analysisThread.join();
+        g_prefetcher.Stop();
+        g_prefetcher.LogReport();
+        g_albumArt.Stop();
+        g_albumArt.LogReport();
+        CleanupAudioOutput();
         CleanupMediaFoundation();
         DiscardGraphicsResources();
         SafeRelease(&g_pD2DFactory);
@@ -1039,15 +1834,129 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
     return 0;
 }
 
+// Playback without a window, render target or timer: one zone on the
+// default device, driven through the control socket until a client sends
+// "quit". Threads only wake for audio, decoding and clients, so a paused
+// player stays asleep.
+int RunHeadless(const std::string& socketName)
+{
+    HRESULT hr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+    if (FAILED(hr)) return 1;
+    int result = 1;
+    if (SUCCEEDED(EnsureMediaFoundation()))
+    {
+        ZoneHost host(g_library);
+        host.Start(1);
+        PlayerZone zone(host);
+        WasapiOutput output;
+        ControlServer server(host, zone);
+        if (FAILED(output.Open(&zone.Engine())) || !zone.Open(&output))
+        {
+            LogMessage("Headless: audio output initialization failed");
+        }
+        else if (server.Start(socketName))
+        {
+            LogMessage("Headless: listening on %s", socketName.c_str());
+            server.WaitForQuit();
+            result = 0;
+        }
+        server.Stop();
+        zone.Close();
+        output.Close();
+        host.Stop();
+        CleanupMediaFoundation();
+    }
+    CoUninitialize();
+    return result;
+}
+
 // WinMain
-int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int nCmdShow)
+int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR lpCmdLine, int nCmdShow)
 {
+    g_startupStart = std::chrono::steady_clock::now();
+    g_hInstance = hInstance;
+
+    // Query engine timings over a synthetic million-track library, no window
+    if (strstr(lpCmdLine, "--benchmark-queries"))
+    {
+        BenchmarkSmartPlaylists(1000000);
+        return 0;
+    }
+    // Sample-format kernels against the scalar reference, and their speed
+    if (strstr(lpCmdLine, "--benchmark-conversion"))
+        return BenchmarkSampleConversion() ? 0 : 1;
+    // Tempo and key accuracy and speed on a synthetic corpus
+    if (strstr(lpCmdLine, "--benchmark-analysis"))
+        return BenchmarkMusicAnalysis() ? 0 : 1;
+    // CPU, memory and threads for 1, 8 and 64 zones playing into null sinks
+    if (strstr(lpCmdLine, "--benchmark-zones"))
+        return BenchmarkZones() ? 0 : 1;
+    // Scripted render against the golden checksums, and its throughput:
+    // --check-render [--write-golden <render_golden.h>]
+    if (strstr(lpCmdLine, "--check-render"))
+    {
+        int argc = 0;
+        LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+        std::filesystem::path goldenPath;
+        for (int i = 1; argv && i + 1 < argc; i++)
+        {
+            if (wcscmp(argv[i], L"--write-golden") == 0) goldenPath = argv[i + 1];
+        }
+        if (argv) LocalFree(argv);
+        return (int)CheckRender(goldenPath);
+    }
+    // Wakeups per second of a headless zone, paused and playing
+    if (strstr(lpCmdLine, "--benchmark-headless"))
+        return BenchmarkHeadless() ? 0 : 1;
+    // No window: --headless [--socket <name>], controlled through the socket
+    if (strstr(lpCmdLine, "--headless"))
+    {
+        int argc = 0;
+        LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+        std::string socketName = DefaultControlSocketName();
+        for (int i = 1; argv && i + 1 < argc; i++)
+        {
+            if (wcscmp(argv[i], L"--socket") == 0) socketName = WideToUtf8(argv[i + 1]);
+        }
+        if (argv) LocalFree(argv);
+        return RunHeadless(socketName);
+    }
+    // FLAC decode-ahead speed per thread count: --benchmark-decode <file.flac>
+    if (strstr(lpCmdLine, "--benchmark-decode"))
+    {
+        int argc = 0;
+        LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+        bool ok = false;
+        for (int i = 1; argv && i + 1 < argc; i++)
+        {
+            if (wcscmp(argv[i], L"--benchmark-decode") == 0) ok = BenchmarkFlacDecode(argv[i + 1]);
+        }
+        if (argv) LocalFree(argv);
+        return ok ? 0 : 1;
+    }
+    // Native MP3 decoder speed (--benchmark-mp3 <file.mp3>) and accuracy
+    // against a reference decode (--check-mp3 <file.mp3> <reference.wav>)
+    if (strstr(lpCmdLine, "--benchmark-mp3") || strstr(lpCmdLine, "--check-mp3"))
+    {
+        int argc = 0;
+        LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+        bool ok = false;
+        for (int i = 1; argv && i + 1 < argc; i++)
+        {
+            if (wcscmp(argv[i], L"--benchmark-mp3") == 0) ok = BenchmarkMp3Decode(argv[i + 1]);
+            if (wcscmp(argv[i], L"--check-mp3") == 0 && i + 2 < argc) ok = CheckMp3Conformance(argv[i + 1], argv[i + 2]);
+        }
+        if (argv) LocalFree(argv);
+        return ok ? 0 : 1;
+    }
+
     HRESULT hr = CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
     if (FAILED(hr))
     {
         MessageBox(NULL, L"COM Initialization failed", L"Error", MB_ICONERROR);
         return -1;
     }
+    LogStartupPhase("COM ready");
 
     LPCWSTR wndClass = L"AudioPlayerWindowClass";
 
@@ -1077,6 +1986,8 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int nCmdShow)
         NULL
     );
 
+    LogStartupPhase("window created");
+
     ShowWindow(g_hWnd, nCmdShow);
     UpdateWindow(g_hWnd);
 
@@ -0,0 +1,262 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cwctype>
+#include <string>
+#include <string_view>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "tag_reader.h"
+
+// Track metadata laid out for scanning: one packed uint32 array per column,
+// rows aligned with the LibraryIndex ids. Text columns hold codes into a
+// per-column dictionary, so a predicate on artist or genre is resolved
+// against the (small) set of distinct strings once and then becomes an
+// integer test over the rows. Every block of kBlockRows rows keeps the
+// min/max of each column, which lets a query skip blocks that cannot match.
+
+enum class MetadataColumn
+{
+    Title,
+    Artist,
+    Album,
+    Genre,
+    Duration,       // ms
+    Year,
+    PlayCount,
+    LastPlayed,     // unix seconds, 0 = never
+    AudioStart,     // ms, first audible sample
+    AudioEnd,       // ms, past the last audible sample; 0 = not analyzed
+    Bpm,            // tenths of a beat per minute, 0 = not analyzed
+    Key,            // 1 + key as in music_analysis.h, 0 = not analyzed
+    Count
+};
+
+const size_t kMetadataColumnCount = (size_t)MetadataColumn::Count;
+const size_t kMetadataTextColumns = 4;   // Title..Genre are dictionary codes
+const size_t kMetadataTagColumns = 6;    // Title..Year come from the tags, the rest is kept across Set()
+const uint32_t kAudioEndUnknown = 0xFFFFFFFF; // analyzed, but play to the end of the file
+
+// Distinct strings of one text column. Code 0 is the empty string; lookups
+// ignore case, and the first spelling seen is the one displayed.
+class StringDictionary
+{
+public:
+    StringDictionary() { Clear(); }
+
+    static std::wstring Fold(std::wstring_view text)
+    {
+        std::wstring folded(text);
+        for (auto& ch : folded)
+        {
+            if (ch >= L'A' && ch <= L'Z') ch = (wchar_t)(ch + (L'a' - L'A'));
+            else if (ch >= 0x80) ch = (wchar_t)towlower(ch);
+        }
+        return folded;
+    }
+
+    void Clear()
+    {
+        m_text.assign(1, std::wstring());
+        m_folded.assign(1, std::wstring());
+        m_hashes.assign(1, 0);
+        m_slots.assign(256, 0);
+    }
+
+    uint32_t Intern(std::wstring_view text)
+    {
+        if (text.empty()) return 0;
+        std::wstring folded = Fold(text);
+        uint64_t hash = Hash(folded);
+        size_t mask = m_slots.size() - 1;
+        size_t i = (size_t)hash & mask;
+        for (; m_slots[i] != 0; i = (i + 1) & mask)
+        {
+            uint32_t code = m_slots[i];
+            if (m_hashes[code] == hash && m_folded[code] == folded) return code;
+        }
+
+        uint32_t code = (uint32_t)m_text.size();
+        m_text.emplace_back(text);
+        m_folded.push_back(std::move(folded));
+        m_hashes.push_back(hash);
+        if (m_text.size() * 2 > m_slots.size())
+            Rehash(m_slots.size() * 2);
+        else
+            m_slots[i] = code;
+        return code;
+    }
+
+    size_t Count() const { return m_text.size(); }
+    const std::wstring& Text(uint32_t code) const { return m_text[code]; }
+    const std::wstring& Folded(uint32_t code) const { return m_folded[code]; }
+
+private:
+    static uint64_t Hash(std::wstring_view text)
+    {
+        // FNV-1a over the code units
+        uint64_t hash = 0xCBF29CE484222325ull;
+        for (wchar_t ch : text)
+        {
+            hash ^= (uint64_t)ch;
+            hash *= 0x100000001B3ull;
+        }
+        return hash;
+    }
+
+    void Rehash(size_t slots)
+    {
+        m_slots.assign(slots, 0);
+        size_t mask = slots - 1;
+        for (uint32_t code = 1; code < m_text.size(); code++)
+        {
+            size_t i = (size_t)m_hashes[code] & mask;
+            while (m_slots[i] != 0) i = (i + 1) & mask;
+            m_slots[i] = code;
+        }
+    }
+
+    std::vector<std::wstring> m_text;
+    std::vector<std::wstring> m_folded;
+    std::vector<uint64_t> m_hashes;
+    std::vector<uint32_t> m_slots;     // code, 0 = free
+};
+
+class MetadataStore
+{
+public:
+    static const size_t kBlockRows = 4096;
+    static const size_t kBlockWords = kBlockRows / 64;
+
+    struct Zone
+    {
+        uint32_t min = 0xFFFFFFFF;     // min > max: no tagged rows in the block
+        uint32_t max = 0;
+    };
+
+    void Clear()
+    {
+        for (auto& column : m_columns) column.clear();
+        for (auto& zones : m_zones) zones.clear();
+        for (auto& strings : m_strings) strings.Clear();
+        m_tagged.clear();
+        m_rows = 0;
+    }
+
+    // Columns are padded to whole blocks; new rows are untagged
+    void Resize(size_t rows)
+    {
+        if (rows <= m_rows) return;
+        size_t blocks = (rows + kBlockRows - 1) / kBlockRows;
+        for (auto& column : m_columns) column.resize(blocks * kBlockRows, 0);
+        for (auto& zones : m_zones) zones.resize(blocks);
+        m_tagged.resize(blocks * kBlockWords, 0);
+        m_rows = rows;
+    }
+
+    void Set(uint32_t row, const TrackTags& tags)
+    {
+        Resize((size_t)row + 1);
+        const std::wstring* text[kMetadataTextColumns] = { &tags.title, &tags.artist, &tags.album, &tags.genre };
+        for (size_t c = 0; c < kMetadataTextColumns; c++) Store(row, (MetadataColumn)c, m_strings[c].Intern(*text[c]));
+        Store(row, MetadataColumn::Duration, tags.durationMs);
+        Store(row, MetadataColumn::Year, tags.year);
+        for (size_t c = kMetadataTagColumns; c < kMetadataColumnCount; c++) Store(row, (MetadataColumn)c, m_columns[c][row]);
+        m_tagged[row / 64] |= 1ull << (row % 64);
+    }
+
+    // Audible part of the track from a silence scan (see silence_scan.h)
+    void SetAudibleRange(uint32_t row, uint32_t startMs, uint32_t endMs)
+    {
+        Resize((size_t)row + 1);
+        Store(row, MetadataColumn::AudioStart, startMs);
+        Store(row, MetadataColumn::AudioEnd, endMs);
+    }
+
+    bool HasAudibleRange(uint32_t row) const { return row < m_rows && Value(row, MetadataColumn::AudioEnd) != 0; }
+
+    // Tempo and key from a feature analysis (see music_analysis.h)
+    void SetFeatures(uint32_t row, uint32_t bpmTenths, uint32_t keyCode)
+    {
+        Resize((size_t)row + 1);
+        Store(row, MetadataColumn::Bpm, bpmTenths);
+        Store(row, MetadataColumn::Key, keyCode);
+    }
+
+    bool HasFeatures(uint32_t row) const { return row < m_rows && (Value(row, MetadataColumn::Bpm) != 0 || Value(row, MetadataColumn::Key) != 0); }
+
+    void MarkPlayed(uint32_t row, uint32_t unixSeconds)
+    {
+        Resize((size_t)row + 1);
+        Store(row, MetadataColumn::PlayCount, m_columns[(size_t)MetadataColumn::PlayCount][row] + 1);
+        Store(row, MetadataColumn::LastPlayed, unixSeconds);
+    }
+
+    // Set() only widens the block ranges; this recomputes them exactly
+    // after a batch of updates
+    void RebuildZoneMaps()
+    {
+        for (size_t c = 0; c < kMetadataColumnCount; c++)
+        {
+            const uint32_t* values = m_columns[c].data();
+            for (size_t block = 0; block < m_zones[c].size(); block++)
+            {
+                Zone zone;
+                for (size_t w = 0; w < kBlockWords; w++)
+                {
+                    uint64_t bits = m_tagged[block * kBlockWords + w];
+                    const uint32_t* word = values + (block * kBlockWords + w) * 64;
+                    while (bits)
+                    {
+                        uint32_t value = word[CountTrailingZeros(bits)];
+                        zone.min = std::min(zone.min, value);
+                        zone.max = std::max(zone.max, value);
+                        bits &= bits - 1;
+                    }
+                }
+                m_zones[c][block] = zone;
+            }
+        }
+    }
+
+    bool IsTagged(uint32_t row) const { return row < m_rows && (m_tagged[row / 64] >> (row % 64)) & 1; }
+    uint32_t Value(uint32_t row, MetadataColumn column) const { return m_columns[(size_t)column][row]; }
+    const std::wstring& Text(uint32_t row, MetadataColumn column) const { return m_strings[(size_t)column].Text(Value(row, column)); }
+
+    size_t Rows() const { return m_rows; }
+    size_t Blocks() const { return m_tagged.size() / kBlockWords; }
+    const uint32_t* Column(MetadataColumn column) const { return m_columns[(size_t)column].data(); }
+    const Zone& BlockZone(MetadataColumn column, size_t block) const { return m_zones[(size_t)column][block]; }
+    const uint64_t* TaggedBits() const { return m_tagged.data(); }
+    const StringDictionary& Strings(MetadataColumn column) const { return m_strings[(size_t)column]; }
+
+    static int CountTrailingZeros(uint64_t bits)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward64(&index, bits);
+        return (int)index;
+#else
+        return __builtin_ctzll(bits);
+#endif
+    }
+
+private:
+    void Store(uint32_t row, MetadataColumn column, uint32_t value)
+    {
+        m_columns[(size_t)column][row] = value;
+        Zone& zone = m_zones[(size_t)column][row / kBlockRows];
+        zone.min = std::min(zone.min, value);
+        zone.max = std::max(zone.max, value);
+    }
+
+    std::vector<uint32_t> m_columns[kMetadataColumnCount];
+    std::vector<Zone> m_zones[kMetadataColumnCount];
+    StringDictionary m_strings[kMetadataTextColumns];
+    std::vector<uint64_t> m_tagged;    // one bit per row with tags read
+    size_t m_rows = 0;
+};
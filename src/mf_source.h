@@ -0,0 +1,181 @@
+#pragma once
+
+#include <windows.h>
+#include <mfapi.h>
+#include <mfidl.h>
+#include <mfreadwrite.h>
+#include <propvarutil.h>
+#include <cstring>
+#include <vector>
+
+#include "audio_source.h"
+
+#pragma comment(lib, "propsys.lib")
+
+// Decodes any format Media Foundation understands (MP3, AAC, WMA...) through
+// an IMFSourceReader that converts to 32-bit float. MFStartup must already
+// have been called and the calling thread must have COM initialized.
+class MfSource : public AudioSource
+{
+public:
+    ~MfSource() { SafeReleaseReader(); }
+
+    HRESULT Open(const wchar_t* filePath)
+    {
+        HRESULT hr = S_OK;
+        IMFMediaType* pPartialType = nullptr;
+        IMFMediaType* pOutputType = nullptr;
+        PROPVARIANT varDuration;
+        PropVariantInit(&varDuration);
+
+        hr = MFCreateSourceReaderFromURL(filePath, NULL, &m_pReader);
+        if (FAILED(hr)) goto done;
+
+        // Only decode the first audio stream
+        hr = m_pReader->SetStreamSelection((DWORD)MF_SOURCE_READER_ALL_STREAMS, FALSE);
+        if (FAILED(hr)) goto done;
+        hr = m_pReader->SetStreamSelection((DWORD)MF_SOURCE_READER_FIRST_AUDIO_STREAM, TRUE);
+        if (FAILED(hr)) goto done;
+
+        // Ask the decoder for float PCM at the native rate and channel count
+        hr = MFCreateMediaType(&pPartialType);
+        if (FAILED(hr)) goto done;
+        hr = pPartialType->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Audio);
+        if (FAILED(hr)) goto done;
+        hr = pPartialType->SetGUID(MF_MT_SUBTYPE, MFAudioFormat_Float);
+        if (FAILED(hr)) goto done;
+        hr = m_pReader->SetCurrentMediaType((DWORD)MF_SOURCE_READER_FIRST_AUDIO_STREAM, NULL, pPartialType);
+        if (FAILED(hr)) goto done;
+
+        hr = m_pReader->GetCurrentMediaType((DWORD)MF_SOURCE_READER_FIRST_AUDIO_STREAM, &pOutputType);
+        if (FAILED(hr)) goto done;
+        hr = pOutputType->GetUINT32(MF_MT_AUDIO_SAMPLES_PER_SECOND, &m_format.sampleRate);
+        if (FAILED(hr)) goto done;
+        hr = pOutputType->GetUINT32(MF_MT_AUDIO_NUM_CHANNELS, &m_format.channels);
+        if (FAILED(hr)) goto done;
+
+        // Duration is optional; streams without one report 0 frames
+        if (SUCCEEDED(m_pReader->GetPresentationAttribute((DWORD)MF_SOURCE_READER_MEDIASOURCE, MF_PD_DURATION, &varDuration)))
+        {
+            m_totalFrames = varDuration.uhVal.QuadPart * m_format.sampleRate / 10000000;
+        }
+
+    done:
+        PropVariantClear(&varDuration);
+        if (pPartialType) pPartialType->Release();
+        if (pOutputType) pOutputType->Release();
+        return hr;
+    }
+
+    const AudioFormat& Format() const override { return m_format; }
+    uint64_t TotalFrames() const override { return m_totalFrames; }
+
+    size_t Read(float* out, size_t frames) override
+    {
+        size_t done = 0;
+        while (done < frames)
+        {
+            if (m_pendingPos == m_pending.size())
+            {
+                if (m_endOfStream || !ReadNextSample()) break;
+                continue;
+            }
+
+            size_t available = (m_pending.size() - m_pendingPos) / m_format.channels;
+            size_t chunk = frames - done < available ? frames - done : available;
+            memcpy(out + done * m_format.channels, &m_pending[m_pendingPos], chunk * m_format.channels * sizeof(float));
+            m_pendingPos += chunk * m_format.channels;
+            done += chunk;
+        }
+        return done;
+    }
+
+    bool Seek(uint64_t frame) override
+    {
+        PROPVARIANT varPosition;
+        HRESULT hr = InitPropVariantFromInt64((LONGLONG)(frame * 10000000 / m_format.sampleRate), &varPosition);
+        if (SUCCEEDED(hr))
+        {
+            hr = m_pReader->SetCurrentPosition(GUID_NULL, varPosition);
+            PropVariantClear(&varPosition);
+        }
+        if (FAILED(hr)) return false;
+
+        // The reader lands on a preceding key frame; trim up to the target
+        m_pending.clear();
+        m_pendingPos = 0;
+        m_endOfStream = false;
+        m_seekTarget = frame;
+        m_trimAfterSeek = true;
+        return true;
+    }
+
+private:
+    bool ReadNextSample()
+    {
+        DWORD flags = 0;
+        LONGLONG timestamp = 0;
+        IMFSample* pSample = nullptr;
+        IMFMediaBuffer* pBuffer = nullptr;
+        BYTE* pData = nullptr;
+        DWORD length = 0;
+
+        HRESULT hr = m_pReader->ReadSample((DWORD)MF_SOURCE_READER_FIRST_AUDIO_STREAM, 0, NULL, &flags, &timestamp, &pSample);
+        if (FAILED(hr) || (flags & MF_SOURCE_READERF_ENDOFSTREAM))
+        {
+            m_endOfStream = true;
+            if (pSample) pSample->Release();
+            return false;
+        }
+        if (!pSample) return true; // stream tick or format change, try again
+
+        m_pending.clear();
+        m_pendingPos = 0;
+
+        hr = pSample->ConvertToContiguousBuffer(&pBuffer);
+        if (SUCCEEDED(hr)) hr = pBuffer->Lock(&pData, NULL, &length);
+        if (SUCCEEDED(hr))
+        {
+            m_pending.assign((const float*)pData, (const float*)(pData + length));
+            pBuffer->Unlock();
+        }
+
+        if (m_trimAfterSeek)
+        {
+            m_trimAfterSeek = false;
+            uint64_t sampleFrame = (uint64_t)timestamp * m_format.sampleRate / 10000000;
+            if (m_seekTarget > sampleFrame)
+            {
+                size_t skip = (size_t)(m_seekTarget - sampleFrame) * m_format.channels;
+                m_pendingPos = skip < m_pending.size() ? skip : m_pending.size();
+                if (skip > m_pending.size())
+                {
+                    // Still short of the target; keep trimming on the next sample
+                    m_trimAfterSeek = true;
+                }
+            }
+        }
+
+        if (pBuffer) pBuffer->Release();
+        pSample->Release();
+        return SUCCEEDED(hr);
+    }
+
+    void SafeReleaseReader()
+    {
+        if (m_pReader)
+        {
+            m_pReader->Release();
+            m_pReader = nullptr;
+        }
+    }
+
+    IMFSourceReader* m_pReader = nullptr;
+    AudioFormat m_format;
+    uint64_t m_totalFrames = 0;
+    std::vector<float> m_pending;
+    size_t m_pendingPos = 0;
+    bool m_endOfStream = false;
+    bool m_trimAfterSeek = false;
+    uint64_t m_seekTarget = 0;
+};
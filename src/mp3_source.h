@@ -0,0 +1,2113 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "audio_source.h"
+#include "cpu_features.h"
+#include "log.h"
+#include "md5.h"
+#include "parallel.h"
+#include "wav_file.h"
+
+// Native streaming MP3 (MPEG-1/2/2.5 Layer III) decoder. Per granule and
+// channel: Huffman-coded spectrum and scalefactors from the main data (which
+// may start in earlier frames: the bit reservoir), requantization, joint
+// stereo, short-block reordering, alias reduction, IMDCT with overlap-add and
+// the 32-band polyphase synthesis filterbank. The IMDCT (window folded into
+// one 18x36 matrix per block type) and the synthesis (a 32-point DCT plus the
+// 512-tap window) are all multiply-adds over contiguous rows, done with
+// SSE2/AVX2/NEON kernels.
+//
+// Mp3Source indexes frame offsets as it goes, so seeks are sample accurate:
+// it restarts a few frames before the target to refill the reservoir and the
+// overlap. Encoder delay and padding from a LAME/Info tag are trimmed, which
+// makes gapless albums play gapless. Layer I/II and free-format streams are
+// not handled; Open() fails and the caller falls back to another decoder.
+//
+// A source can also decode ahead in batches on a WorkerPool. Frames are not
+// independent, so the batch is split into one run of consecutive frames per
+// worker, and each run after the first starts its own decoder a few frames
+// early, by the same rule as a seek; those frames only rebuild the state and
+// are decoded twice. The first run continues the decoder that finished the
+// previous batch. The output is the same, sample for sample, as decoding
+// frame by frame.
+
+struct Mp3FrameHeader
+{
+    bool lsf = false;              // MPEG-2/2.5: one granule per frame, 576 samples
+    uint32_t versionBits = 0;      // 0 = 2.5, 2 = 2, 3 = 1
+    uint32_t rateIndex = 0;        // 0..8: 44.1, 48, 32 kHz, then the MPEG-2 and 2.5 rates
+    uint32_t sampleRate = 0;
+    uint32_t bitrate = 0;          // kbps
+    uint32_t mode = 0;             // 0 stereo, 1 joint stereo, 2 dual channel, 3 mono
+    uint32_t modeExtension = 0;    // joint stereo: bit 0 intensity, bit 1 M/S
+    uint32_t channels = 0;
+    bool crc = false;
+    uint32_t samples = 0;          // per channel
+    size_t frameBytes = 0;
+    size_t sideInfoBytes = 0;
+
+    // Byte offset of the main data pointer's side info, past header and CRC
+    size_t SideInfoOffset() const { return crc ? 6 : 4; }
+    size_t MainDataBytes() const { return frameBytes - SideInfoOffset() - sideInfoBytes; }
+};
+
+// Parse a Layer III frame header at 'data'. Returns false for anything else,
+// including Layer I/II and free-format frames.
+inline bool ParseMp3FrameHeader(const uint8_t* data, size_t size, Mp3FrameHeader& header)
+{
+    static const uint16_t kBitrates[2][15] =
+    {
+        { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 },   // MPEG-1
+        { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },       // MPEG-2 and 2.5
+    };
+    static const uint32_t kSampleRates[9] = { 44100, 48000, 32000, 22050, 24000, 16000, 11025, 12000, 8000 };
+
+    if (size < 4 || data[0] != 0xFF || (data[1] & 0xE0) != 0xE0) return false;
+    uint32_t versionBits = (data[1] >> 3) & 3;
+    uint32_t layerBits = (data[1] >> 1) & 3;
+    uint32_t bitrateIndex = data[2] >> 4;
+    uint32_t rateBits = (data[2] >> 2) & 3;
+    if (versionBits == 1 || layerBits != 1 || bitrateIndex == 0 || bitrateIndex == 15 || rateBits == 3) return false;
+
+    header.versionBits = versionBits;
+    header.lsf = versionBits != 3;
+    header.rateIndex = rateBits + (versionBits == 3 ? 0 : versionBits == 2 ? 3 : 6);
+    header.sampleRate = kSampleRates[header.rateIndex];
+    header.bitrate = kBitrates[header.lsf ? 1 : 0][bitrateIndex];
+    header.crc = (data[1] & 1) == 0;
+    header.mode = data[3] >> 6;
+    header.modeExtension = (data[3] >> 4) & 3;
+    header.channels = header.mode == 3 ? 1 : 2;
+    header.samples = header.lsf ? 576 : 1152;
+    bool padding = ((data[2] >> 1) & 1) != 0;
+    header.frameBytes = (size_t)(header.lsf ? 72 : 144) * header.bitrate * 1000 / header.sampleRate + (padding ? 1 : 0);
+    header.sideInfoBytes = header.lsf ? (header.channels == 1 ? 9 : 17) : (header.channels == 1 ? 17 : 32);
+    return header.frameBytes > header.SideInfoOffset() + header.sideInfoBytes;
+}
+
+// Huffman code tables of ISO/IEC 11172-3 Annex B, in x * size + y order
+// (table A: by the v w x y bits of the quadruple). Lengths exclude the sign
+// bits. Tables 16 and 24 serve 16..23 and 24..31 with different linbits.
+
+const uint16_t kMp3HuffmanCodes1[] =
+{
+    1, 1,
+    1, 0
+};
+
+const uint8_t kMp3HuffmanLengths1[] =
+{
+    1, 3,
+    2, 3
+};
+
+const uint16_t kMp3HuffmanCodes2[] =
+{
+    1, 2, 1,
+    3, 1, 1,
+    3, 2, 0
+};
+
+const uint8_t kMp3HuffmanLengths2[] =
+{
+    1, 3, 6,
+    3, 3, 5,
+    5, 5, 6
+};
+
+const uint16_t kMp3HuffmanCodes3[] =
+{
+    3, 2, 1,
+    1, 1, 1,
+    3, 2, 0
+};
+
+const uint8_t kMp3HuffmanLengths3[] =
+{
+    2, 2, 6,
+    3, 2, 5,
+    5, 5, 6
+};
+
+const uint16_t kMp3HuffmanCodes5[] =
+{
+    1, 2, 6, 5,
+    3, 1, 4, 4,
+    7, 5, 7, 1,
+    6, 1, 1, 0
+};
+
+const uint8_t kMp3HuffmanLengths5[] =
+{
+    1, 3, 6, 7,
+    3, 3, 6, 7,
+    6, 6, 7, 8,
+    7, 6, 7, 8
+};
+
+const uint16_t kMp3HuffmanCodes6[] =
+{
+    7, 3, 5, 1,
+    6, 2, 3, 2,
+    5, 4, 4, 1,
+    3, 3, 2, 0
+};
+
+const uint8_t kMp3HuffmanLengths6[] =
+{
+    3, 3, 5, 7,
+    3, 2, 4, 5,
+    4, 4, 5, 6,
+    6, 5, 6, 7
+};
+
+const uint16_t kMp3HuffmanCodes7[] =
+{
+    1, 2, 10, 19, 16, 10,
+    3, 3, 7, 10, 5, 3,
+    11, 4, 13, 17, 8, 4,
+    12, 11, 18, 15, 11, 2,
+    7, 6, 9, 14, 3, 1,
+    6, 4, 5, 3, 2, 0
+};
+
+const uint8_t kMp3HuffmanLengths7[] =
+{
+    1, 3, 6, 8, 8, 9,
+    3, 4, 6, 7, 7, 8,
+    6, 5, 7, 8, 8, 9,
+    7, 7, 8, 9, 9, 9,
+    7, 7, 8, 9, 9, 10,
+    8, 8, 9, 10, 10, 10
+};
+
+const uint16_t kMp3HuffmanCodes8[] =
+{
+    3, 4, 6, 18, 12, 5,
+    5, 1, 2, 16, 9, 3,
+    7, 3, 5, 14, 7, 3,
+    19, 17, 15, 13, 10, 4,
+    13, 5, 8, 11, 5, 1,
+    12, 4, 4, 1, 1, 0
+};
+
+const uint8_t kMp3HuffmanLengths8[] =
+{
+    2, 3, 6, 8, 8, 9,
+    3, 2, 4, 8, 8, 8,
+    6, 4, 6, 8, 8, 9,
+    8, 8, 8, 9, 9, 10,
+    8, 7, 8, 9, 10, 10,
+    9, 8, 9, 9, 11, 11
+};
+
+const uint16_t kMp3HuffmanCodes9[] =
+{
+    7, 5, 9, 14, 15, 7,
+    6, 4, 5, 5, 6, 7,
+    7, 6, 8, 8, 8, 5,
+    15, 6, 9, 10, 5, 1,
+    11, 7, 9, 6, 4, 1,
+    14, 4, 6, 2, 6, 0
+};
+
+const uint8_t kMp3HuffmanLengths9[] =
+{
+    3, 3, 5, 6, 8, 9,
+    3, 3, 4, 5, 6, 8,
+    4, 4, 5, 6, 7, 8,
+    6, 5, 6, 7, 7, 8,
+    7, 6, 7, 7, 8, 9,
+    8, 7, 8, 8, 9, 9
+};
+
+const uint16_t kMp3HuffmanCodes10[] =
+{
+    1, 2, 10, 23, 35, 30, 12, 17,
+    3, 3, 8, 12, 18, 21, 12, 7,
+    11, 9, 15, 21, 32, 40, 19, 6,
+    14, 13, 22, 34, 46, 23, 18, 7,
+    20, 19, 33, 47, 27, 22, 9, 3,
+    31, 22, 41, 26, 21, 20, 5, 3,
+    14, 13, 10, 11, 16, 6, 5, 1,
+    9, 8, 7, 8, 4, 4, 2, 0
+};
+
+const uint8_t kMp3HuffmanLengths10[] =
+{
+    1, 3, 6, 8, 9, 9, 9, 10,
+    3, 4, 6, 7, 8, 9, 8, 8,
+    6, 6, 7, 8, 9, 10, 9, 9,
+    7, 7, 8, 9, 10, 10, 9, 10,
+    8, 8, 9, 10, 10, 10, 10, 10,
+    9, 9, 10, 10, 11, 11, 10, 11,
+    8, 8, 9, 10, 10, 10, 11, 11,
+    9, 8, 9, 10, 10, 11, 11, 11
+};
+
+const uint16_t kMp3HuffmanCodes11[] =
+{
+    3, 4, 10, 24, 34, 33, 21, 15,
+    5, 3, 4, 10, 32, 17, 11, 10,
+    11, 7, 13, 18, 30, 31, 20, 5,
+    25, 11, 19, 59, 27, 18, 12, 5,
+    35, 33, 31, 58, 30, 16, 7, 5,
+    28, 26, 32, 19, 17, 15, 8, 14,
+    14, 12, 9, 13, 14, 9, 4, 1,
+    11, 4, 6, 6, 6, 3, 2, 0
+};
+
+const uint8_t kMp3HuffmanLengths11[] =
+{
+    2, 3, 5, 7, 8, 9, 8, 9,
+    3, 3, 4, 6, 8, 8, 7, 8,
+    5, 5, 6, 7, 8, 9, 8, 8,
+    7, 6, 7, 9, 8, 10, 8, 9,
+    8, 8, 8, 9, 9, 10, 9, 10,
+    8, 8, 9, 10, 10, 11, 10, 11,
+    8, 7, 7, 8, 9, 10, 10, 10,
+    8, 7, 8, 9, 10, 10, 10, 10
+};
+
+const uint16_t kMp3HuffmanCodes12[] =
+{
+    9, 6, 16, 33, 41, 39, 38, 26,
+    7, 5, 6, 9, 23, 16, 26, 11,
+    17, 7, 11, 14, 21, 30, 10, 7,
+    17, 10, 15, 12, 18, 28, 14, 5,
+    32, 13, 22, 19, 18, 16, 9, 5,
+    40, 17, 31, 29, 17, 13, 4, 2,
+    27, 12, 11, 15, 10, 7, 4, 1,
+    27, 12, 8, 12, 6, 3, 1, 0
+};
+
+const uint8_t kMp3HuffmanLengths12[] =
+{
+    4, 3, 5, 7, 8, 9, 9, 9,
+    3, 3, 4, 5, 7, 7, 8, 8,
+    5, 4, 5, 6, 7, 8, 7, 8,
+    6, 5, 6, 6, 7, 8, 8, 8,
+    7, 6, 7, 7, 8, 8, 8, 9,
+    8, 7, 8, 8, 8, 9, 8, 9,
+    8, 7, 7, 8, 8, 9, 9, 10,
+    9, 8, 8, 9, 9, 9, 9, 10
+};
+
+const uint16_t kMp3HuffmanCodes13[] =
+{
+    1, 5, 14, 21, 34, 51, 46, 71, 42, 52, 68, 52, 67, 44, 43, 19,
+    3, 4, 12, 19, 31, 26, 44, 33, 31, 24, 32, 24, 31, 35, 22, 14,
+    15, 13, 23, 36, 59, 49, 77, 65, 29, 40, 30, 40, 27, 33, 42, 16,
+    22, 20, 37, 61, 56, 79, 73, 64, 43, 76, 56, 37, 26, 31, 25, 14,
+    35, 16, 60, 57, 97, 75, 114, 91, 54, 73, 55, 41, 48, 53, 23, 24,
+    58, 27, 50, 96, 76, 70, 93, 84, 77, 58, 79, 29, 74, 49, 41, 17,
+    47, 45, 78, 74, 115, 94, 90, 79, 69, 83, 71, 50, 59, 38, 36, 15,
+    72, 34, 56, 95, 92, 85, 91, 90, 86, 73, 77, 65, 51, 44, 43, 42,
+    43, 20, 30, 44, 55, 78, 72, 87, 78, 61, 46, 54, 37, 30, 20, 16,
+    53, 25, 41, 37, 44, 59, 54, 81, 66, 76, 57, 54, 37, 18, 39, 11,
+    35, 33, 31, 57, 42, 82, 72, 80, 47, 58, 55, 21, 22, 26, 38, 22,
+    53, 25, 23, 38, 70, 60, 51, 36, 55, 26, 34, 23, 27, 14, 9, 7,
+    34, 32, 28, 39, 49, 75, 30, 52, 48, 40, 52, 28, 18, 17, 9, 5,
+    45, 21, 34, 64, 56, 50, 49, 45, 31, 19, 12, 15, 10, 7, 6, 3,
+    48, 23, 20, 39, 36, 35, 53, 21, 16, 23, 13, 10, 6, 1, 4, 2,
+    16, 15, 17, 27, 25, 20, 29, 11, 17, 12, 16, 8, 1, 1, 0, 1
+};
+
+const uint8_t kMp3HuffmanLengths13[] =
+{
+    1, 4, 6, 7, 8, 9, 9, 10, 9, 10, 11, 11, 12, 12, 13, 13,
+    3, 4, 6, 7, 8, 8, 9, 9, 9, 9, 10, 10, 11, 12, 12, 12,
+    6, 6, 7, 8, 9, 9, 10, 10, 9, 10, 10, 11, 11, 12, 13, 13,
+    7, 7, 8, 9, 9, 10, 10, 10, 10, 11, 11, 11, 11, 12, 13, 13,
+    8, 7, 9, 9, 10, 10, 11, 11, 10, 11, 11, 12, 12, 13, 13, 14,
+    9, 8, 9, 10, 10, 10, 11, 11, 11, 11, 12, 11, 13, 13, 14, 14,
+    9, 9, 10, 10, 11, 11, 11, 11, 11, 12, 12, 12, 13, 13, 14, 14,
+    10, 9, 10, 11, 11, 11, 12, 12, 12, 12, 13, 13, 13, 14, 16, 16,
+    9, 8, 9, 10, 10, 11, 11, 12, 12, 12, 12, 13, 13, 14, 15, 15,
+    10, 9, 10, 10, 11, 11, 11, 13, 12, 13, 13, 14, 14, 14, 16, 15,
+    10, 10, 10, 11, 11, 12, 12, 13, 12, 13, 14, 13, 14, 15, 16, 17,
+    11, 10, 10, 11, 12, 12, 12, 12, 13, 13, 13, 14, 15, 15, 15, 16,
+    11, 11, 11, 12, 12, 13, 12, 13, 14, 14, 15, 15, 15, 16, 16, 16,
+    12, 11, 12, 13, 13, 13, 14, 14, 14, 14, 14, 15, 16, 15, 16, 16,
+    13, 12, 12, 13, 13, 13, 15, 14, 14, 17, 15, 15, 15, 17, 16, 16,
+    12, 12, 13, 14, 14, 14, 15, 14, 15, 15, 16, 16, 19, 18, 19, 16
+};
+
+const uint16_t kMp3HuffmanCodes15[] =
+{
+    7, 12, 18, 53, 47, 76, 124, 108, 89, 123, 108, 119, 107, 81, 122, 63,
+    13, 5, 16, 27, 46, 36, 61, 51, 42, 70, 52, 83, 65, 41, 59, 36,
+    19, 17, 15, 24, 41, 34, 59, 48, 40, 64, 50, 78, 62, 80, 56, 33,
+    29, 28, 25, 43, 39, 63, 55, 93, 76, 59, 93, 72, 54, 75, 50, 29,
+    52, 22, 42, 40, 67, 57, 95, 79, 72, 57, 89, 69, 49, 66, 46, 27,
+    77, 37, 35, 66, 58, 52, 91, 74, 62, 48, 79, 63, 90, 62, 40, 38,
+    125, 32, 60, 56, 50, 92, 78, 65, 55, 87, 71, 51, 73, 51, 70, 30,
+    109, 53, 49, 94, 88, 75, 66, 122, 91, 73, 56, 42, 64, 44, 21, 25,
+    90, 43, 41, 77, 73, 63, 56, 92, 77, 66, 47, 67, 48, 53, 36, 20,
+    71, 34, 67, 60, 58, 49, 88, 76, 67, 106, 71, 54, 38, 39, 23, 15,
+    109, 53, 51, 47, 90, 82, 58, 57, 48, 72, 57, 41, 23, 27, 62, 9,
+    86, 42, 40, 37, 70, 64, 52, 43, 70, 55, 42, 25, 29, 18, 11, 11,
+    118, 68, 30, 55, 50, 46, 74, 65, 49, 39, 24, 16, 22, 13, 14, 7,
+    91, 44, 39, 38, 34, 63, 52, 45, 31, 52, 28, 19, 14, 8, 9, 3,
+    123, 60, 58, 53, 47, 43, 32, 22, 37, 24, 17, 12, 15, 10, 2, 1,
+    71, 37, 34, 30, 28, 20, 17, 26, 21, 16, 10, 6, 8, 6, 2, 0
+};
+
+const uint8_t kMp3HuffmanLengths15[] =
+{
+    3, 4, 5, 7, 7, 8, 9, 9, 9, 10, 10, 11, 11, 11, 12, 13,
+    4, 3, 5, 6, 7, 7, 8, 8, 8, 9, 9, 10, 10, 10, 11, 11,
+    5, 5, 5, 6, 7, 7, 8, 8, 8, 9, 9, 10, 10, 11, 11, 11,
+    6, 6, 6, 7, 7, 8, 8, 9, 9, 9, 10, 10, 10, 11, 11, 11,
+    7, 6, 7, 7, 8, 8, 9, 9, 9, 9, 10, 10, 10, 11, 11, 11,
+    8, 7, 7, 8, 8, 8, 9, 9, 9, 9, 10, 10, 11, 11, 11, 12,
+    9, 7, 8, 8, 8, 9, 9, 9, 9, 10, 10, 10, 11, 11, 12, 12,
+    9, 8, 8, 9, 9, 9, 9, 10, 10, 10, 10, 10, 11, 11, 11, 12,
+    9, 8, 8, 9, 9, 9, 9, 10, 10, 10, 10, 11, 11, 12, 12, 12,
+    9, 8, 9, 9, 9, 9, 10, 10, 10, 11, 11, 11, 11, 12, 12, 12,
+    10, 9, 9, 9, 10, 10, 10, 10, 10, 11, 11, 11, 11, 12, 13, 12,
+    10, 9, 9, 9, 10, 10, 10, 10, 11, 11, 11, 11, 12, 12, 12, 13,
+    11, 10, 9, 10, 10, 10, 11, 11, 11, 11, 11, 11, 12, 12, 13, 13,
+    11, 10, 10, 10, 10, 11, 11, 11, 11, 12, 12, 12, 12, 12, 13, 13,
+    12, 11, 11, 11, 11, 11, 11, 11, 12, 12, 12, 12, 13, 13, 12, 13,
+    12, 11, 11, 11, 11, 11, 11, 12, 12, 12, 12, 12, 13, 13, 13, 13
+};
+
+const uint16_t kMp3HuffmanCodes16[] =
+{
+    1, 5, 14, 44, 74, 63, 110, 93, 172, 149, 138, 242, 225, 195, 376, 17,
+    3, 4, 12, 20, 35, 62, 53, 47, 83, 75, 68, 119, 201, 107, 207, 9,
+    15, 13, 23, 38, 67, 58, 103, 90, 161, 72, 127, 117, 110, 209, 206, 16,
+    45, 21, 39, 69, 64, 114, 99, 87, 158, 140, 252, 212, 199, 387, 365, 26,
+    75, 36, 68, 65, 115, 101, 179, 164, 155, 264, 246, 226, 395, 382, 362, 9,
+    66, 30, 59, 56, 102, 185, 173, 265, 142, 253, 232, 400, 388, 378, 445, 16,
+    111, 54, 52, 100, 184, 178, 160, 133, 257, 244, 228, 217, 385, 366, 715, 10,
+    98, 48, 91, 88, 165, 157, 148, 261, 248, 407, 397, 372, 380, 889, 884, 8,
+    85, 84, 81, 159, 156, 143, 260, 249, 427, 401, 392, 383, 727, 713, 708, 7,
+    154, 76, 73, 141, 131, 256, 245, 426, 406, 394, 384, 735, 359, 710, 352, 11,
+    139, 129, 67, 125, 247, 233, 229, 219, 393, 743, 737, 720, 885, 882, 439, 4,
+    243, 120, 118, 115, 227, 223, 396, 746, 742, 736, 721, 712, 706, 223, 436, 6,
+    202, 224, 222, 218, 216, 389, 386, 381, 364, 888, 443, 707, 440, 437, 1728, 4,
+    747, 211, 210, 208, 370, 379, 734, 723, 714, 1735, 883, 877, 876, 3459, 865, 2,
+    377, 369, 102, 187, 726, 722, 358, 711, 709, 866, 1734, 871, 3458, 870, 434, 0,
+    12, 10, 7, 11, 10, 17, 11, 9, 13, 12, 10, 7, 5, 3, 1, 3
+};
+
+const uint8_t kMp3HuffmanLengths16[] =
+{
+    1, 4, 6, 8, 9, 9, 10, 10, 11, 11, 11, 12, 12, 12, 13, 9,
+    3, 4, 6, 7, 8, 9, 9, 9, 10, 10, 10, 11, 12, 11, 12, 8,
+    6, 6, 7, 8, 9, 9, 10, 10, 11, 10, 11, 11, 11, 12, 12, 9,
+    8, 7, 8, 9, 9, 10, 10, 10, 11, 11, 12, 12, 12, 13, 13, 10,
+    9, 8, 9, 9, 10, 10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 9,
+    9, 8, 9, 9, 10, 11, 11, 12, 11, 12, 12, 13, 13, 13, 14, 10,
+    10, 9, 9, 10, 11, 11, 11, 11, 12, 12, 12, 12, 13, 13, 14, 10,
+    10, 9, 10, 10, 11, 11, 11, 12, 12, 13, 13, 13, 13, 15, 15, 10,
+    10, 10, 10, 11, 11, 11, 12, 12, 13, 13, 13, 13, 14, 14, 14, 10,
+    11, 10, 10, 11, 11, 12, 12, 13, 13, 13, 13, 14, 13, 14, 13, 11,
+    11, 11, 10, 11, 12, 12, 12, 12, 13, 14, 14, 14, 15, 15, 14, 10,
+    12, 11, 11, 11, 12, 12, 13, 14, 14, 14, 14, 14, 14, 13, 14, 11,
+    12, 12, 12, 12, 12, 13, 13, 13, 13, 15, 14, 14, 14, 14, 16, 11,
+    14, 12, 12, 12, 13, 13, 14, 14, 14, 16, 15, 15, 15, 17, 15, 11,
+    13, 13, 11, 12, 14, 14, 13, 14, 14, 15, 16, 15, 17, 15, 14, 11,
+    9, 8, 8, 9, 9, 10, 10, 10, 11, 11, 11, 11, 11, 11, 11, 8
+};
+
+const uint16_t kMp3HuffmanCodes24[] =
+{
+    15, 13, 46, 80, 146, 262, 248, 434, 426, 669, 653, 649, 621, 517, 1032, 88,
+    14, 12, 21, 38, 71, 130, 122, 216, 209, 198, 327, 345, 319, 297, 279, 42,
+    47, 22, 41, 74, 68, 128, 120, 221, 207, 194, 182, 340, 315, 295, 541, 18,
+    81, 39, 75, 70, 134, 125, 116, 220, 204, 190, 178, 325, 311, 293, 271, 16,
+    147, 72, 69, 135, 127, 118, 112, 210, 200, 188, 352, 323, 306, 285, 540, 14,
+    263, 66, 129, 126, 119, 114, 214, 202, 192, 180, 341, 317, 301, 281, 262, 12,
+    249, 123, 121, 117, 113, 215, 206, 195, 185, 347, 330, 308, 291, 272, 520, 10,
+    435, 115, 111, 109, 211, 203, 196, 187, 353, 332, 313, 298, 283, 531, 381, 17,
+    427, 212, 208, 205, 201, 193, 186, 177, 169, 320, 303, 286, 268, 514, 377, 16,
+    335, 199, 197, 191, 189, 181, 174, 333, 321, 305, 289, 275, 521, 379, 371, 11,
+    668, 184, 183, 179, 175, 344, 331, 314, 304, 290, 277, 530, 383, 373, 366, 10,
+    652, 346, 171, 168, 164, 318, 309, 299, 287, 276, 263, 513, 375, 368, 362, 6,
+    648, 322, 316, 312, 307, 302, 292, 284, 269, 261, 512, 376, 370, 364, 359, 4,
+    620, 300, 296, 294, 288, 282, 273, 266, 515, 380, 374, 369, 365, 361, 357, 2,
+    1033, 280, 278, 274, 267, 264, 259, 382, 378, 372, 367, 363, 360, 358, 356, 0,
+    43, 20, 19, 17, 15, 13, 11, 9, 7, 6, 4, 7, 5, 3, 1, 3
+};
+
+const uint8_t kMp3HuffmanLengths24[] =
+{
+    4, 4, 6, 7, 8, 9, 9, 10, 10, 11, 11, 11, 11, 11, 12, 9,
+    4, 4, 5, 6, 7, 8, 8, 9, 9, 9, 10, 10, 10, 10, 10, 8,
+    6, 5, 6, 7, 7, 8, 8, 9, 9, 9, 9, 10, 10, 10, 11, 7,
+    7, 6, 7, 7, 8, 8, 8, 9, 9, 9, 9, 10, 10, 10, 10, 7,
+    8, 7, 7, 8, 8, 8, 8, 9, 9, 9, 10, 10, 10, 10, 11, 7,
+    9, 7, 8, 8, 8, 8, 9, 9, 9, 9, 10, 10, 10, 10, 10, 7,
+    9, 8, 8, 8, 8, 9, 9, 9, 9, 10, 10, 10, 10, 10, 11, 7,
+    10, 8, 8, 8, 9, 9, 9, 9, 10, 10, 10, 10, 10, 11, 11, 8,
+    10, 9, 9, 9, 9, 9, 9, 9, 9, 10, 10, 10, 10, 11, 11, 8,
+    10, 9, 9, 9, 9, 9, 9, 10, 10, 10, 10, 10, 11, 11, 11, 8,
+    11, 9, 9, 9, 9, 10, 10, 10, 10, 10, 10, 11, 11, 11, 11, 8,
+    11, 10, 9, 9, 9, 10, 10, 10, 10, 10, 10, 11, 11, 11, 11, 8,
+    11, 10, 10, 10, 10, 10, 10, 10, 10, 10, 11, 11, 11, 11, 11, 8,
+    11, 10, 10, 10, 10, 10, 10, 10, 11, 11, 11, 11, 11, 11, 11, 8,
+    12, 10, 10, 10, 10, 10, 10, 11, 11, 11, 11, 11, 11, 11, 11, 8,
+    8, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 8, 8, 8, 8, 4
+};
+
+const uint16_t kMp3HuffmanCodesA[] =
+{
+    1, 5, 4, 5, 6, 5, 4, 4, 7, 3, 6, 0, 7, 2, 3, 1
+};
+
+const uint8_t kMp3HuffmanLengthsA[] =
+{
+    1, 4, 4, 5, 4, 6, 5, 6, 4, 5, 5, 6, 5, 6, 6, 6
+};
+
+struct Mp3HuffmanSpec
+{
+    const uint16_t* codes;
+    const uint8_t* lengths;
+    uint32_t size;       // values per dimension; 0 = unused table
+    uint32_t linbits;
+};
+
+const Mp3HuffmanSpec kMp3HuffmanSpecs[32] =
+{
+    { nullptr, nullptr, 0, 0 },
+    { kMp3HuffmanCodes1, kMp3HuffmanLengths1, 2, 0 },
+    { kMp3HuffmanCodes2, kMp3HuffmanLengths2, 3, 0 },
+    { kMp3HuffmanCodes3, kMp3HuffmanLengths3, 3, 0 },
+    { nullptr, nullptr, 0, 0 },
+    { kMp3HuffmanCodes5, kMp3HuffmanLengths5, 4, 0 },
+    { kMp3HuffmanCodes6, kMp3HuffmanLengths6, 4, 0 },
+    { kMp3HuffmanCodes7, kMp3HuffmanLengths7, 6, 0 },
+    { kMp3HuffmanCodes8, kMp3HuffmanLengths8, 6, 0 },
+    { kMp3HuffmanCodes9, kMp3HuffmanLengths9, 6, 0 },
+    { kMp3HuffmanCodes10, kMp3HuffmanLengths10, 8, 0 },
+    { kMp3HuffmanCodes11, kMp3HuffmanLengths11, 8, 0 },
+    { kMp3HuffmanCodes12, kMp3HuffmanLengths12, 8, 0 },
+    { kMp3HuffmanCodes13, kMp3HuffmanLengths13, 16, 0 },
+    { nullptr, nullptr, 0, 0 },
+    { kMp3HuffmanCodes15, kMp3HuffmanLengths15, 16, 0 },
+    { kMp3HuffmanCodes16, kMp3HuffmanLengths16, 16, 1 },
+    { kMp3HuffmanCodes16, kMp3HuffmanLengths16, 16, 2 },
+    { kMp3HuffmanCodes16, kMp3HuffmanLengths16, 16, 3 },
+    { kMp3HuffmanCodes16, kMp3HuffmanLengths16, 16, 4 },
+    { kMp3HuffmanCodes16, kMp3HuffmanLengths16, 16, 6 },
+    { kMp3HuffmanCodes16, kMp3HuffmanLengths16, 16, 8 },
+    { kMp3HuffmanCodes16, kMp3HuffmanLengths16, 16, 10 },
+    { kMp3HuffmanCodes16, kMp3HuffmanLengths16, 16, 13 },
+    { kMp3HuffmanCodes24, kMp3HuffmanLengths24, 16, 4 },
+    { kMp3HuffmanCodes24, kMp3HuffmanLengths24, 16, 5 },
+    { kMp3HuffmanCodes24, kMp3HuffmanLengths24, 16, 6 },
+    { kMp3HuffmanCodes24, kMp3HuffmanLengths24, 16, 7 },
+    { kMp3HuffmanCodes24, kMp3HuffmanLengths24, 16, 8 },
+    { kMp3HuffmanCodes24, kMp3HuffmanLengths24, 16, 9 },
+    { kMp3HuffmanCodes24, kMp3HuffmanLengths24, 16, 11 },
+    { kMp3HuffmanCodes24, kMp3HuffmanLengths24, 16, 13 },
+};
+
+// Scalefactor band edges in lines, per rate index (see Mp3FrameHeader)
+const uint16_t kMp3LongBands[9][23] =
+{
+    { 0, 4, 8, 12, 16, 20, 24, 30, 36, 44, 52, 62, 74, 90, 110, 134, 162, 196, 238, 288, 342, 418, 576 },
+    { 0, 4, 8, 12, 16, 20, 24, 30, 36, 42, 50, 60, 72, 88, 106, 128, 156, 190, 230, 276, 330, 384, 576 },
+    { 0, 4, 8, 12, 16, 20, 24, 30, 36, 44, 54, 66, 82, 102, 126, 156, 194, 240, 296, 364, 448, 550, 576 },
+    { 0, 6, 12, 18, 24, 30, 36, 44, 54, 66, 80, 96, 116, 140, 168, 200, 238, 284, 336, 396, 464, 522, 576 },
+    { 0, 6, 12, 18, 24, 30, 36, 44, 54, 66, 80, 96, 114, 136, 162, 194, 232, 278, 332, 394, 464, 540, 576 },
+    { 0, 6, 12, 18, 24, 30, 36, 44, 54, 66, 80, 96, 116, 140, 168, 200, 238, 284, 336, 396, 464, 522, 576 },
+    { 0, 6, 12, 18, 24, 30, 36, 44, 54, 66, 80, 96, 116, 140, 168, 200, 238, 284, 336, 396, 464, 522, 576 },
+    { 0, 6, 12, 18, 24, 30, 36, 44, 54, 66, 80, 96, 116, 140, 168, 200, 238, 284, 336, 396, 464, 522, 576 },
+    { 0, 12, 24, 36, 48, 60, 72, 88, 108, 132, 160, 192, 232, 280, 336, 400, 476, 566, 568, 570, 572, 574, 576 },
+};
+
+const uint16_t kMp3ShortBands[9][14] =
+{
+    { 0, 4, 8, 12, 16, 22, 30, 40, 52, 66, 84, 106, 136, 192 },
+    { 0, 4, 8, 12, 16, 22, 28, 38, 50, 64, 80, 100, 126, 192 },
+    { 0, 4, 8, 12, 16, 22, 30, 42, 58, 78, 104, 138, 180, 192 },
+    { 0, 4, 8, 12, 18, 24, 32, 42, 56, 74, 100, 132, 174, 192 },
+    { 0, 4, 8, 12, 18, 26, 36, 48, 62, 80, 104, 136, 180, 192 },
+    { 0, 4, 8, 12, 18, 26, 36, 48, 62, 80, 104, 134, 174, 192 },
+    { 0, 4, 8, 12, 18, 26, 36, 48, 62, 80, 104, 134, 174, 192 },
+    { 0, 4, 8, 12, 18, 26, 36, 48, 62, 80, 104, 134, 174, 192 },
+    { 0, 8, 16, 24, 36, 52, 72, 96, 124, 160, 162, 164, 166, 192 },
+};
+
+const uint8_t kMp3Pretab[22] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 3, 3, 3, 2, 0 };
+
+// First half (and middle tap) of the synthesis window in units of 2^-16; the
+// second half mirrors it, and the sign alternates every 64 taps
+const int32_t kMp3SynthesisWindow[257] =
+{
+    0, -1, -1, -1, -1, -1, -1, -2, -2, -2, -2, -3,
+    -3, -4, -4, -5, -5, -6, -7, -7, -8, -9, -10, -11,
+    -13, -14, -16, -17, -19, -21, -24, -26, -29, -31, -35, -38,
+    -41, -45, -49, -53, -58, -63, -68, -73, -79, -85, -91, -97,
+    -104, -111, -117, -125, -132, -139, -147, -154, -161, -169, -176, -183,
+    -190, -196, -202, -208, -213, -218, -222, -225, -227, -228, -228, -227,
+    -224, -221, -215, -208, -200, -189, -177, -163, -146, -127, -106, -83,
+    -57, -29, 2, 36, 72, 111, 153, 197, 244, 294, 347, 401,
+    459, 519, 581, 645, 711, 779, 848, 919, 991, 1064, 1137, 1210,
+    1283, 1356, 1428, 1498, 1567, 1634, 1698, 1759, 1817, 1870, 1919, 1962,
+    2001, 2032, 2057, 2075, 2085, 2087, 2080, 2063, 2037, 2000, 1952, 1893,
+    1822, 1739, 1644, 1535, 1414, 1280, 1131, 970, 794, 605, 402, 185,
+    -45, -288, -545, -814, -1095, -1388, -1692, -2006, -2330, -2663, -3004, -3351,
+    -3705, -4063, -4425, -4788, -5153, -5517, -5879, -6237, -6589, -6935, -7271, -7597,
+    -7910, -8209, -8491, -8755, -8998, -9219, -9416, -9585, -9727, -9838, -9916, -9959,
+    -9966, -9935, -9863, -9750, -9592, -9389, -9139, -8840, -8492, -8092, -7640, -7134,
+    -6574, -5959, -5288, -4561, -3776, -2935, -2037, -1082, -70, 998, 2122, 3300,
+    4533, 5818, 7154, 8540, 9975, 11455, 12980, 14548, 16155, 17799, 19478, 21189,
+    22929, 24694, 26482, 28289, 30112, 31947, 33791, 35640, 37489, 39336, 41176, 43006,
+    44821, 46617, 48390, 50137, 51853, 53534, 55178, 56778, 58333, 59838, 61289, 62684,
+    64019, 65290, 66494, 67629, 68692, 69679, 70590, 71420, 72169, 72835, 73415, 73908,
+    74313, 74630, 74856, 74992, 75038
+};
+
+// Lookup tables derived once from the above
+struct Mp3Tables
+{
+    // Two-level Huffman decoding: 'rootBits' bits index the root, entries
+    // with length 0 link to a subtable indexed by 'symbol' more bits
+    struct HuffmanEntry
+    {
+        uint8_t symbol;     // x << 4 | y, or the quadruple's v w x y bits
+        uint8_t length;     // total code length; 0 = link
+        uint16_t next;      // link: subtable offset from the table's root
+    };
+    static const int kRootBits = 8;
+
+    std::vector<HuffmanEntry> huffman;
+    uint32_t huffmanRoot[32] = {};      // by table_select; quadruple table A at 0
+    float pow43[8207];                  // |x|^(4/3) up to 15 + 2^13 - 1
+    float antialiasCs[8];
+    float antialiasCa[8];
+    float imdct[4][18][36];             // per block type, window included; short: input 3k + w
+    float dct[32][32];                  // cos((2k + 1) m pi / 64), by k then m
+    float window[512];
+
+    Mp3Tables()
+    {
+        // Table A (quadruples) shares slot 0, which is never looked up for pairs
+        huffmanRoot[0] = AddHuffmanTable(kMp3HuffmanCodesA, kMp3HuffmanLengthsA, 0);
+        for (int t = 1; t < 32; t++)
+        {
+            const Mp3HuffmanSpec& spec = kMp3HuffmanSpecs[t];
+            if (!spec.size) continue;
+            bool shared = t > 16 && t != 24 && spec.codes == kMp3HuffmanSpecs[t - 1].codes;
+            huffmanRoot[t] = shared ? huffmanRoot[t - 1] : AddHuffmanTable(spec.codes, spec.lengths, spec.size);
+        }
+
+        for (int i = 0; i < 8207; i++) pow43[i] = (float)pow((double)i, 4.0 / 3.0);
+
+        static const double kAliasCoefficients[8] = { -0.6, -0.535, -0.33, -0.185, -0.095, -0.041, -0.0142, -0.0037 };
+        for (int i = 0; i < 8; i++)
+        {
+            double c = kAliasCoefficients[i];
+            antialiasCs[i] = (float)(1.0 / sqrt(1.0 + c * c));
+            antialiasCa[i] = (float)(c / sqrt(1.0 + c * c));
+        }
+
+        const double pi = 3.14159265358979323846;
+        double windows[4][36];
+        for (int i = 0; i < 36; i++)
+        {
+            double longWindow = sin(pi / 36 * (i + 0.5));
+            windows[0][i] = longWindow;
+            windows[1][i] = i < 18 ? longWindow : i < 24 ? 1.0 : i < 30 ? sin(pi / 12 * (i - 18 + 0.5)) : 0.0;
+            windows[3][i] = i < 6 ? 0.0 : i < 12 ? sin(pi / 12 * (i - 6 + 0.5)) : i < 18 ? 1.0 : longWindow;
+        }
+        memset(imdct, 0, sizeof(imdct));
+        for (int type = 0; type < 4; type++)
+        {
+            if (type == 2) continue;
+            for (int k = 0; k < 18; k++)
+                for (int i = 0; i < 36; i++)
+                    imdct[type][k][i] = (float)(windows[type][i] * cos(pi / 72 * (2 * i + 19) * (2 * k + 1)));
+        }
+        // Three 12-point IMDCTs at offsets 6, 12 and 18 of the 36 outputs
+        for (int w = 0; w < 3; w++)
+            for (int k = 0; k < 6; k++)
+                for (int i = 0; i < 12; i++)
+                    imdct[2][3 * k + w][6 + 6 * w + i] = (float)(sin(pi / 12 * (i + 0.5)) * cos(pi / 24 * (2 * i + 7) * (2 * k + 1)));
+
+        for (int k = 0; k < 32; k++)
+            for (int m = 0; m < 32; m++)
+                dct[k][m] = (float)cos((2 * k + 1) * m * pi / 64);
+
+        for (int i = 0; i < 512; i++)
+        {
+            int32_t tap = kMp3SynthesisWindow[i <= 256 ? i : 512 - i];
+            window[i] = (float)((i / 64) % 2 == 0 ? tap : -tap) / 65536.0f;
+        }
+    }
+
+    // 'size' values per dimension for pairs, 0 for the quadruple table
+    uint32_t AddHuffmanTable(const uint16_t* codes, const uint8_t* lengths, uint32_t size)
+    {
+        uint32_t count = size ? size * size : 16;
+        uint32_t root = (uint32_t)huffman.size();
+        huffman.resize(root + (1u << kRootBits), HuffmanEntry{ 0, 0, 0 });
+
+        // Subtable size per root prefix: enough bits for its longest code
+        uint8_t subBits[1 << kRootBits] = {};
+        for (uint32_t i = 0; i < count; i++)
+        {
+            if (lengths[i] <= kRootBits) continue;
+            uint32_t prefix = codes[i] >> (lengths[i] - kRootBits);
+            subBits[prefix] = std::max<uint8_t>(subBits[prefix], (uint8_t)(lengths[i] - kRootBits));
+        }
+        for (uint32_t prefix = 0; prefix < (1u << kRootBits); prefix++)
+        {
+            if (!subBits[prefix]) continue;
+            HuffmanEntry& link = huffman[root + prefix];
+            link.symbol = subBits[prefix];
+            link.next = (uint16_t)(huffman.size() - root);
+            huffman.resize(huffman.size() + (1u << subBits[prefix]), HuffmanEntry{ 0, 0, 0 });
+        }
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint8_t symbol = size ? (uint8_t)(((i / size) << 4) | (i % size)) : (uint8_t)i;
+            int length = lengths[i];
+            if (length <= kRootBits)
+            {
+                uint32_t first = (uint32_t)codes[i] << (kRootBits - length);
+                for (uint32_t j = 0; j < (1u << (kRootBits - length)); j++)
+                    huffman[root + first + j] = HuffmanEntry{ symbol, (uint8_t)length, 0 };
+            }
+            else
+            {
+                uint32_t prefix = codes[i] >> (length - kRootBits);
+                const HuffmanEntry link = huffman[root + prefix];
+                int rest = length - kRootBits;
+                uint32_t first = ((uint32_t)codes[i] & ((1u << rest) - 1)) << (link.symbol - rest);
+                for (uint32_t j = 0; j < (1u << (link.symbol - rest)); j++)
+                    huffman[root + link.next + first + j] = HuffmanEntry{ symbol, (uint8_t)length, 0 };
+            }
+        }
+        return root;
+    }
+};
+
+inline const Mp3Tables& GetMp3Tables()
+{
+    static const Mp3Tables tables;
+    return tables;
+}
+
+// acc[i] += a[i] * b[i] and acc[i] += a[i] * s over 'count' floats, a
+// multiple of 4. The scalar versions are the reference for the SIMD ones.
+inline void Mp3MultiplyAddScalar(float* acc, const float* a, const float* b, size_t count)
+{
+    for (size_t i = 0; i < count; i++) acc[i] += a[i] * b[i];
+}
+
+inline void Mp3ScaleAddScalar(float* acc, const float* a, float s, size_t count)
+{
+    for (size_t i = 0; i < count; i++) acc[i] += a[i] * s;
+}
+
+#if defined(CPU_X86)
+
+inline void Mp3MultiplyAddSse2(float* acc, const float* a, const float* b, size_t count)
+{
+    for (size_t i = 0; i < count; i += 4)
+        _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i))));
+}
+
+inline void Mp3ScaleAddSse2(float* acc, const float* a, float s, size_t count)
+{
+    __m128 scale = _mm_set1_ps(s);
+    for (size_t i = 0; i < count; i += 4)
+        _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_mul_ps(_mm_loadu_ps(a + i), scale)));
+}
+
+TARGET_AVX2 inline void Mp3MultiplyAddAvx2(float* acc, const float* a, const float* b, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+        _mm256_storeu_ps(acc + i, _mm256_add_ps(_mm256_loadu_ps(acc + i), _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i))));
+    if (i < count) Mp3MultiplyAddSse2(acc + i, a + i, b + i, count - i);
+}
+
+TARGET_AVX2 inline void Mp3ScaleAddAvx2(float* acc, const float* a, float s, size_t count)
+{
+    __m256 scale = _mm256_set1_ps(s);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+        _mm256_storeu_ps(acc + i, _mm256_add_ps(_mm256_loadu_ps(acc + i), _mm256_mul_ps(_mm256_loadu_ps(a + i), scale)));
+    if (i < count) Mp3ScaleAddSse2(acc + i, a + i, s, count - i);
+}
+
+#elif defined(CPU_ARM64)
+
+inline void Mp3MultiplyAddNeon(float* acc, const float* a, const float* b, size_t count)
+{
+    for (size_t i = 0; i < count; i += 4)
+        vst1q_f32(acc + i, vfmaq_f32(vld1q_f32(acc + i), vld1q_f32(a + i), vld1q_f32(b + i)));
+}
+
+inline void Mp3ScaleAddNeon(float* acc, const float* a, float s, size_t count)
+{
+    for (size_t i = 0; i < count; i += 4)
+        vst1q_f32(acc + i, vfmaq_n_f32(vld1q_f32(acc + i), vld1q_f32(a + i), s));
+}
+
+#endif
+
+inline void Mp3MultiplyAdd(float* acc, const float* a, const float* b, size_t count)
+{
+#if defined(CPU_X86)
+    if (GetCpuFeatures().avx2) Mp3MultiplyAddAvx2(acc, a, b, count);
+    else Mp3MultiplyAddSse2(acc, a, b, count);
+#elif defined(CPU_ARM64)
+    Mp3MultiplyAddNeon(acc, a, b, count);
+#else
+    Mp3MultiplyAddScalar(acc, a, b, count);
+#endif
+}
+
+inline void Mp3ScaleAdd(float* acc, const float* a, float s, size_t count)
+{
+#if defined(CPU_X86)
+    if (GetCpuFeatures().avx2) Mp3ScaleAddAvx2(acc, a, s, count);
+    else Mp3ScaleAddSse2(acc, a, s, count);
+#elif defined(CPU_ARM64)
+    Mp3ScaleAddNeon(acc, a, s, count);
+#else
+    Mp3ScaleAddScalar(acc, a, s, count);
+#endif
+}
+
+// MSB-first bit reader with an explicit position. Peeks load four bytes, so
+// the buffer must stay readable a few bytes past 'size'; callers pad it.
+class Mp3BitReader
+{
+public:
+    Mp3BitReader(const uint8_t* data, size_t size) : m_data(data), m_size(size) {}
+
+    uint32_t Peek(int n) const     // n <= 25
+    {
+        const uint8_t* p = m_data + (m_pos >> 3);
+        uint32_t v = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+        return (v << (m_pos & 7)) >> (32 - n);
+    }
+
+    uint32_t Read(int n)
+    {
+        if (n == 0) return 0;
+        uint32_t v = Peek(n);
+        m_pos += n;
+        return v;
+    }
+
+    void Skip(size_t n) { m_pos += n; }
+    size_t Position() const { return m_pos; }
+    void SetPosition(size_t pos) { m_pos = pos; }
+    size_t SizeBits() const { return m_size * 8; }
+
+private:
+    const uint8_t* m_data;
+    size_t m_size;
+    size_t m_pos = 0;
+};
+
+// Decodes a stream frame by frame. Holds the state that carries across
+// frames: the bit reservoir, the IMDCT overlap and the synthesis history.
+class Mp3FrameDecoder
+{
+public:
+    Mp3FrameDecoder() : m_tables(GetMp3Tables()) { Reset(); }
+
+    // Forget the stream position, e.g. before decoding from a seek point
+    void Reset()
+    {
+        memset(m_overlap, 0, sizeof(m_overlap));
+        memset(m_synthesis, 0, sizeof(m_synthesis));
+        m_synthesisPos[0] = m_synthesisPos[1] = 0;
+        m_reservoirBytes = 0;
+    }
+
+    // Decode one frame ('header' parsed from 'frame') into header.samples
+    // interleaved frames of header.channels channels. Returns false, with
+    // silence in 'out', if the frame's main data reaches back past the
+    // reservoir (the first frames after a seek) or is corrupt.
+    bool DecodeFrame(const uint8_t* frame, const Mp3FrameHeader& header, float* out)
+    {
+        Mp3BitReader side(frame + header.SideInfoOffset(), header.sideInfoBytes);
+        bool sideOk = ReadSideInfo(side, header);
+
+        // Append this frame's main data behind what is left of earlier frames
+        size_t mainBytes = header.MainDataBytes();
+        if (m_reservoirBytes + mainBytes + kPadding > sizeof(m_reservoir)) m_reservoirBytes = 0;
+        size_t previous = m_reservoirBytes;
+        memcpy(m_reservoir + previous, frame + header.SideInfoOffset() + header.sideInfoBytes, mainBytes);
+        m_reservoirBytes += mainBytes;
+        memset(m_reservoir + m_reservoirBytes, 0, kPadding);
+
+        bool ok = sideOk && m_mainDataBegin <= previous;
+        if (ok)
+        {
+            size_t start = previous - m_mainDataBegin;
+            Mp3BitReader bits(m_reservoir + start, m_reservoirBytes - start);
+            int granules = header.lsf ? 1 : 2;
+            for (int gr = 0; gr < granules && ok; gr++)
+            {
+                for (uint32_t ch = 0; ch < header.channels && ok; ch++)
+                    ok = DecodeChannel(bits, header, gr, ch);
+                if (!ok) break;
+                if (header.mode == 1 && header.channels == 2) JointStereo(header, gr);
+                for (uint32_t ch = 0; ch < header.channels; ch++)
+                {
+                    Hybrid(header, m_granule[gr][ch], ch);
+                    Synthesize(ch, out + (size_t)gr * 576 * header.channels + ch, header.channels);
+                }
+            }
+        }
+        if (!ok) memset(out, 0, sizeof(float) * header.samples * header.channels);
+
+        // Keep the tail a later frame can point back into
+        size_t keep = header.lsf ? 255 : 511;
+        if (m_reservoirBytes > keep)
+        {
+            memmove(m_reservoir, m_reservoir + m_reservoirBytes - keep, keep);
+            m_reservoirBytes = keep;
+        }
+        return ok;
+    }
+
+private:
+    struct Granule
+    {
+        uint32_t part23Length = 0;
+        uint32_t bigValues = 0;
+        uint32_t globalGain = 0;
+        uint32_t scalefacCompress = 0;
+        uint32_t blockType = 0;        // 0 normal, 1 start, 2 short, 3 stop
+        bool mixedBlock = false;
+        uint32_t tableSelect[3] = {};
+        uint32_t subblockGain[3] = {};
+        uint32_t region1Start = 0;     // lines
+        uint32_t region2Start = 0;
+        bool preflag = false;
+        uint32_t scalefacScale = 0;
+        uint32_t count1Table = 0;
+    };
+
+    // Scalefactors of one granule and channel. Short blocks index by
+    // band * 3 + window. 'maxLong'/'maxShort' hold the largest value each
+    // band could code, which MPEG-2 intensity stereo treats as "no position".
+    struct Scalefactors
+    {
+        uint8_t longBands[22];
+        uint8_t shortBands[39];
+        uint8_t maxLong[22];
+        uint8_t maxShort[39];
+    };
+
+    static const size_t kPadding = 16;
+
+    bool ReadSideInfo(Mp3BitReader& bits, const Mp3FrameHeader& header)
+    {
+        const uint16_t* longBands = kMp3LongBands[header.rateIndex];
+        const uint16_t* shortBands = kMp3ShortBands[header.rateIndex];
+        uint32_t channels = header.channels;
+
+        m_mainDataBegin = bits.Read(header.lsf ? 8 : 9);
+        bits.Skip(header.lsf ? (channels == 1 ? 1 : 2) : (channels == 1 ? 5 : 3));
+        if (!header.lsf)
+            for (uint32_t ch = 0; ch < channels; ch++) m_scfsi[ch] = bits.Read(4);
+
+        int granules = header.lsf ? 1 : 2;
+        for (int gr = 0; gr < granules; gr++)
+        {
+            for (uint32_t ch = 0; ch < channels; ch++)
+            {
+                Granule& g = m_granule[gr][ch];
+                g.part23Length = bits.Read(12);
+                g.bigValues = bits.Read(9);
+                g.globalGain = bits.Read(8);
+                g.scalefacCompress = bits.Read(header.lsf ? 9 : 4);
+                if (g.bigValues > 288) return false;
+
+                if (bits.Read(1))
+                {
+                    g.blockType = bits.Read(2);
+                    g.mixedBlock = bits.Read(1) != 0;
+                    g.tableSelect[0] = bits.Read(5);
+                    g.tableSelect[1] = bits.Read(5);
+                    g.tableSelect[2] = 0;
+                    for (int w = 0; w < 3; w++) g.subblockGain[w] = bits.Read(3);
+                    if (g.blockType == 0) return false;
+                    // Implicit region counts: 8 (short) or 7 (long) bands, then the rest
+                    g.region1Start = g.blockType == 2 ? 3u * shortBands[3] : longBands[8];
+                    g.region2Start = 576;
+                }
+                else
+                {
+                    g.blockType = 0;
+                    g.mixedBlock = false;
+                    for (int r = 0; r < 3; r++) g.tableSelect[r] = bits.Read(5);
+                    g.subblockGain[0] = g.subblockGain[1] = g.subblockGain[2] = 0;
+                    uint32_t region0Count = bits.Read(4);
+                    uint32_t region1Count = bits.Read(3);
+                    g.region1Start = longBands[std::min<uint32_t>(region0Count + 1, 22)];
+                    g.region2Start = longBands[std::min<uint32_t>(region0Count + region1Count + 2, 22)];
+                }
+                g.preflag = header.lsf ? false : bits.Read(1) != 0;
+                g.scalefacScale = bits.Read(1);
+                g.count1Table = bits.Read(1);
+            }
+        }
+        return true;
+    }
+
+    bool DecodeChannel(Mp3BitReader& bits, const Mp3FrameHeader& header, int gr, uint32_t ch)
+    {
+        Granule& g = m_granule[gr][ch];
+        size_t part2Start = bits.Position();
+        size_t end = part2Start + g.part23Length;
+        if (end > bits.SizeBits()) return false;
+
+        Scalefactors& scf = m_scalefactors[ch];
+        if (header.lsf)
+            ReadLsfScalefactors(bits, header, g, ch, scf);
+        else
+            ReadScalefactors(bits, g, gr, ch, scf);
+        if (bits.Position() > end) return false;
+
+        int32_t values[576 + 4];
+        size_t nonzero = ReadSpectrum(bits, g, end, values);
+        bits.SetPosition(end);
+
+        Requantize(header, g, scf, values, nonzero, m_spectrum[ch]);
+        m_nonzero[ch] = nonzero;
+        return true;
+    }
+
+    void ReadScalefactors(Mp3BitReader& bits, const Granule& g, int gr, uint32_t ch, Scalefactors& scf)
+    {
+        static const uint8_t kSlen[2][16] =
+        {
+            { 0, 0, 0, 0, 3, 1, 1, 1, 2, 2, 2, 3, 3, 3, 4, 4 },
+            { 0, 1, 2, 3, 0, 1, 2, 3, 1, 2, 3, 1, 2, 3, 2, 3 },
+        };
+        int slen1 = kSlen[0][g.scalefacCompress];
+        int slen2 = kSlen[1][g.scalefacCompress];
+
+        if (g.blockType == 2)
+        {
+            int firstShort = 0;
+            if (g.mixedBlock)
+            {
+                for (int sfb = 0; sfb < 8; sfb++) scf.longBands[sfb] = (uint8_t)bits.Read(slen1);
+                firstShort = 3;
+            }
+            for (int sfb = firstShort; sfb < 12; sfb++)
+                for (int w = 0; w < 3; w++) scf.shortBands[sfb * 3 + w] = (uint8_t)bits.Read(sfb < 6 ? slen1 : slen2);
+            scf.shortBands[36] = scf.shortBands[37] = scf.shortBands[38] = 0;
+        }
+        else
+        {
+            // Granule 1 may reuse granule 0's values band group by band group
+            static const int kGroups[5] = { 0, 6, 11, 16, 21 };
+            for (int group = 0; group < 4; group++)
+            {
+                if (gr == 1 && (m_scfsi[ch] >> (3 - group)) & 1) continue;
+                for (int sfb = kGroups[group]; sfb < kGroups[group + 1]; sfb++)
+                    scf.longBands[sfb] = (uint8_t)bits.Read(group < 2 ? slen1 : slen2);
+            }
+            scf.longBands[21] = 0;
+        }
+    }
+
+    void ReadLsfScalefactors(Mp3BitReader& bits, const Mp3FrameHeader& header, Granule& g, uint32_t ch, Scalefactors& scf)
+    {
+        static const uint8_t kBandCounts[6][3][4] =
+        {
+            { { 6, 5, 5, 5 }, { 9, 9, 9, 9 }, { 6, 9, 9, 9 } },
+            { { 6, 5, 7, 3 }, { 9, 9, 12, 6 }, { 6, 9, 12, 6 } },
+            { { 11, 10, 0, 0 }, { 18, 18, 0, 0 }, { 15, 18, 0, 0 } },
+            { { 7, 7, 7, 0 }, { 12, 12, 12, 0 }, { 6, 15, 12, 0 } },
+            { { 6, 6, 6, 3 }, { 12, 9, 9, 6 }, { 6, 12, 9, 6 } },
+            { { 8, 8, 5, 0 }, { 15, 12, 9, 0 }, { 6, 18, 9, 0 } },
+        };
+
+        uint32_t sfc = g.scalefacCompress;
+        uint32_t slen[4] = {};
+        int row;
+        if (ch == 1 && (header.modeExtension & 1))
+        {
+            // Intensity-coded right channel: positions instead of scalefactors
+            uint32_t s = sfc >> 1;
+            if (s < 180)      { row = 3; slen[0] = s / 36; slen[1] = (s % 36) / 6; slen[2] = s % 6; }
+            else if (s < 244) { row = 4; s -= 180; slen[0] = (s & 63) >> 4; slen[1] = (s & 15) >> 2; slen[2] = s & 3; }
+            else              { row = 5; s -= 244; slen[0] = s / 3; slen[1] = s % 3; }
+        }
+        else if (sfc < 400)   { row = 0; slen[0] = (sfc >> 4) / 5; slen[1] = (sfc >> 4) % 5; slen[2] = (sfc & 15) >> 2; slen[3] = sfc & 3; }
+        else if (sfc < 500)   { row = 1; sfc -= 400; slen[0] = (sfc >> 2) / 5; slen[1] = (sfc >> 2) % 5; slen[2] = sfc & 3; }
+        else                  { row = 2; sfc -= 500; slen[0] = sfc / 3; slen[1] = sfc % 3; g.preflag = true; }
+
+        // Read the values group by group, then lay them out by band
+        uint8_t values[39], limits[39];
+        size_t count = 0;
+        int blockIndex = g.blockType == 2 ? (g.mixedBlock ? 2 : 1) : 0;
+        for (int group = 0; group < 4; group++)
+        {
+            for (int i = 0; i < kBandCounts[row][blockIndex][group]; i++)
+            {
+                values[count] = (uint8_t)bits.Read((int)slen[group]);
+                limits[count++] = (uint8_t)((1u << slen[group]) - 1);
+            }
+        }
+
+        size_t next = 0;
+        if (g.blockType != 2)
+        {
+            for (int sfb = 0; sfb < 21; sfb++, next++)
+            {
+                scf.longBands[sfb] = values[next];
+                scf.maxLong[sfb] = limits[next];
+            }
+            scf.longBands[21] = 0;
+            scf.maxLong[21] = scf.maxLong[20];
+            return;
+        }
+
+        int firstShort = 0;
+        if (g.mixedBlock)
+        {
+            for (int sfb = 0; sfb < 6; sfb++, next++)
+            {
+                scf.longBands[sfb] = values[next];
+                scf.maxLong[sfb] = limits[next];
+            }
+            firstShort = 3;
+        }
+        for (int i = firstShort * 3; i < 36; i++, next++)
+        {
+            scf.shortBands[i] = values[next];
+            scf.maxShort[i] = limits[next];
+        }
+        for (int w = 0; w < 3; w++)
+        {
+            scf.shortBands[36 + w] = 0;
+            scf.maxShort[36 + w] = scf.maxShort[33 + w];
+        }
+    }
+
+    // Huffman-decode the big-value and count1 regions into 'values'. Returns
+    // the number of lines that may be nonzero.
+    size_t ReadSpectrum(Mp3BitReader& bits, const Granule& g, size_t end, int32_t* values)
+    {
+        const Mp3Tables::HuffmanEntry* entries = m_tables.huffman.data();
+        size_t i = 0;
+        size_t bigEnd = std::min<size_t>(g.bigValues * 2, 576);
+        size_t regionEnd[3] = { std::min<size_t>(g.region1Start, bigEnd), std::min<size_t>(g.region2Start, bigEnd), bigEnd };
+
+        for (int region = 0; region < 3; region++)
+        {
+            const Mp3HuffmanSpec& spec = kMp3HuffmanSpecs[g.tableSelect[region]];
+            if (!spec.size)
+            {
+                for (; i < regionEnd[region]; i++) values[i] = 0;
+                continue;
+            }
+            const Mp3Tables::HuffmanEntry* table = entries + m_tables.huffmanRoot[g.tableSelect[region]];
+            int linbits = (int)spec.linbits;
+            for (; i < regionEnd[region]; i += 2)
+            {
+                Mp3Tables::HuffmanEntry e = table[bits.Peek(Mp3Tables::kRootBits)];
+                if (e.length == 0)
+                    e = table[e.next + (bits.Peek(Mp3Tables::kRootBits + e.symbol) & ((1u << e.symbol) - 1))];
+                bits.Skip(e.length);
+
+                int32_t x = e.symbol >> 4;
+                int32_t y = e.symbol & 15;
+                if (x == 15 && linbits) x += (int32_t)bits.Read(linbits);
+                if (x && bits.Read(1)) x = -x;
+                if (y == 15 && linbits) y += (int32_t)bits.Read(linbits);
+                if (y && bits.Read(1)) y = -y;
+                values[i] = x;
+                values[i + 1] = y;
+                if (bits.Position() > end)
+                {
+                    // Corrupt: more big values than bits
+                    for (i = 0; i < 576; i++) values[i] = 0;
+                    return 0;
+                }
+            }
+        }
+
+        // Quadruples of -1/0/1 until the part2_3 bits run out; one that
+        // overruns them is a stuffing artifact and is dropped
+        const Mp3Tables::HuffmanEntry* quad = entries + m_tables.huffmanRoot[0];
+        while (i + 4 <= 576 && bits.Position() < end)
+        {
+            uint32_t symbol;
+            if (g.count1Table)
+            {
+                symbol = bits.Read(4) ^ 15;
+            }
+            else
+            {
+                Mp3Tables::HuffmanEntry e = quad[bits.Peek(Mp3Tables::kRootBits)];
+                bits.Skip(e.length);
+                symbol = e.symbol;
+            }
+            for (int k = 0; k < 4; k++)
+            {
+                int32_t v = (symbol >> (3 - k)) & 1;
+                if (v && bits.Read(1)) v = -1;
+                values[i + k] = v;
+            }
+            if (bits.Position() > end)
+            {
+                values[i] = values[i + 1] = values[i + 2] = values[i + 3] = 0;
+                break;
+            }
+            i += 4;
+        }
+        size_t nonzero = i;
+        for (; i < 576; i++) values[i] = 0;
+        return nonzero;
+    }
+
+    void Requantize(const Mp3FrameHeader& header, const Granule& g, const Scalefactors& scf,
+                    const int32_t* values, size_t nonzero, float* xr)
+    {
+        const uint16_t* longBands = kMp3LongBands[header.rateIndex];
+        const uint16_t* shortBands = kMp3ShortBands[header.rateIndex];
+        const float* pow43 = m_tables.pow43;
+        double globalScale = 0.25 * ((double)g.globalGain - 210.0);
+        double scfShift = g.scalefacScale ? 1.0 : 0.5;
+
+        auto apply = [&](size_t start, size_t stop, double exponent)
+        {
+            float gain = (float)exp2(exponent);
+            for (size_t i = start; i < stop; i++)
+            {
+                int32_t v = values[i];
+                xr[i] = v >= 0 ? pow43[v] * gain : -pow43[-v] * gain;
+            }
+        };
+
+        size_t line = 0;
+        if (g.blockType != 2 || g.mixedBlock)
+        {
+            int longEnd = g.blockType == 2 ? (header.lsf ? 6 : 8) : 22;
+            for (int sfb = 0; sfb < longEnd && line < nonzero; sfb++)
+            {
+                size_t stop = std::min<size_t>(longBands[sfb + 1], nonzero);
+                int sf = scf.longBands[sfb] + (g.preflag ? kMp3Pretab[sfb] : 0);
+                apply(line, stop, globalScale - scfShift * sf);
+                line = stop;
+            }
+        }
+        if (g.blockType == 2)
+        {
+            for (int sfb = g.mixedBlock ? 3 : 0; sfb < 13 && line < nonzero; sfb++)
+            {
+                size_t width = shortBands[sfb + 1] - shortBands[sfb];
+                for (int w = 0; w < 3 && line < nonzero; w++)
+                {
+                    size_t stop = std::min(line + width, nonzero);
+                    apply(line, stop, globalScale - 2.0 * g.subblockGain[w] - scfShift * scf.shortBands[sfb * 3 + w]);
+                    line = stop;
+                }
+            }
+        }
+        for (size_t i = line; i < 576; i++) xr[i] = 0.0f;
+    }
+
+    // M/S and intensity stereo on the requantized spectra, band by band
+    void JointStereo(const Mp3FrameHeader& header, int gr)
+    {
+        const Granule& g = m_granule[gr][1];
+        float* left = m_spectrum[0];
+        float* right = m_spectrum[1];
+        bool ms = (header.modeExtension & 2) != 0;
+        bool intensity = (header.modeExtension & 1) != 0;
+        size_t nonzero = std::max(m_nonzero[0], m_nonzero[1]);
+
+        auto midSide = [&](size_t start, size_t stop)
+        {
+            const float scale = 0.70710678f;
+            for (size_t i = start; i < stop; i++)
+            {
+                float m = left[i], s = right[i];
+                left[i] = (m + s) * scale;
+                right[i] = (m - s) * scale;
+            }
+        };
+
+        if (!intensity)
+        {
+            if (ms) midSide(0, nonzero);
+            m_nonzero[0] = m_nonzero[1] = nonzero;
+            return;
+        }
+
+        // Each band above the last nonzero right-channel line is intensity
+        // coded unless its position is the "illegal" one; the top band
+        // takes the position of the band below it
+        const uint16_t* longBands = kMp3LongBands[header.rateIndex];
+        const uint16_t* shortBands = kMp3ShortBands[header.rateIndex];
+        const Scalefactors& scf = m_scalefactors[1];
+        uint32_t intensityScale = g.scalefacCompress & 1;
+
+        auto band = [&](size_t start, size_t stop, bool coded, uint32_t position, uint32_t illegal)
+        {
+            if (!coded || position == illegal)
+            {
+                if (ms) midSide(start, stop);
+                return;
+            }
+            float kl, kr;
+            IntensityRatios(header.lsf, position, intensityScale, kl, kr);
+            for (size_t i = start; i < stop; i++)
+            {
+                float v = left[i];
+                left[i] = v * kl;
+                right[i] = v * kr;
+            }
+        };
+
+        if (g.blockType != 2)
+        {
+            size_t last = m_nonzero[1];
+            while (last > 0 && right[last - 1] == 0.0f) last--;
+            for (int sfb = 0; sfb < 22; sfb++)
+            {
+                size_t start = longBands[sfb], stop = longBands[sfb + 1];
+                int source = sfb == 21 ? 20 : sfb;
+                uint32_t illegal = header.lsf ? scf.maxLong[source] : 7;
+                band(start, stop, start >= last, scf.longBands[source], illegal);
+            }
+        }
+        else
+        {
+            // Short bands lie window after window within each band
+            int firstShort = g.mixedBlock ? 3 : 0;
+            size_t shortStart = g.mixedBlock ? 3u * shortBands[3] : 0;
+            bool anyShortNonzero = false;
+            int lastBand[3] = { -1, -1, -1 };
+            size_t line = shortStart;
+            for (int sfb = firstShort; sfb < 13; sfb++)
+            {
+                size_t width = shortBands[sfb + 1] - shortBands[sfb];
+                for (int w = 0; w < 3; w++, line += width)
+                {
+                    for (size_t i = line; i < line + width; i++)
+                    {
+                        if (right[i] != 0.0f)
+                        {
+                            lastBand[w] = sfb;
+                            anyShortNonzero = true;
+                            break;
+                        }
+                    }
+                }
+            }
+
+            if (g.mixedBlock)
+            {
+                // The long part counts only if nothing is coded above it
+                const int longEnd = header.lsf ? 6 : 8;
+                size_t last = shortStart;
+                while (last > 0 && right[last - 1] == 0.0f) last--;
+                for (int sfb = 0; sfb < longEnd; sfb++)
+                {
+                    size_t start = longBands[sfb], stop = longBands[sfb + 1];
+                    uint32_t illegal = header.lsf ? scf.maxLong[sfb] : 7;
+                    band(start, stop, !anyShortNonzero && start >= last, scf.longBands[sfb], illegal);
+                }
+            }
+
+            line = shortStart;
+            for (int sfb = firstShort; sfb < 13; sfb++)
+            {
+                size_t width = shortBands[sfb + 1] - shortBands[sfb];
+                int source = sfb == 12 ? 11 : sfb;
+                for (int w = 0; w < 3; w++, line += width)
+                {
+                    uint32_t illegal = header.lsf ? scf.maxShort[source * 3 + w] : 7;
+                    band(line, line + width, sfb > lastBand[w], scf.shortBands[source * 3 + w], illegal);
+                }
+            }
+        }
+        m_nonzero[0] = m_nonzero[1] = 576;
+    }
+
+    static void IntensityRatios(bool lsf, uint32_t position, uint32_t intensityScale, float& kl, float& kr)
+    {
+        if (!lsf)
+        {
+            // tan(position * pi / 12) split as k / (1 + k) and 1 / (1 + k)
+            double k = tan(position * 3.14159265358979323846 / 12.0);
+            kl = (float)(k / (1.0 + k));
+            kr = (float)(1.0 / (1.0 + k));
+            return;
+        }
+        double base = intensityScale ? 0.70710678118654752 : 0.84089641525371454;   // 2^-1/2 or 2^-1/4
+        kl = kr = 1.0f;
+        if (position == 0) return;
+        if (position & 1) kl = (float)pow(base, (position + 1) / 2);
+        else kr = (float)pow(base, position / 2);
+    }
+
+    // Reorder, alias reduction, IMDCT with overlap-add and frequency
+    // inversion; leaves 18 time slots of 32 subband samples in m_slots
+    void Hybrid(const Mp3FrameHeader& header, const Granule& g, uint32_t ch)
+    {
+        float* xr = m_spectrum[ch];
+        size_t nonzero = m_nonzero[ch];
+
+        if (g.blockType == 2)
+        {
+            // Bitstream order is band, window, line; the short IMDCT wants
+            // each subband's lines as line * 3 + window
+            const uint16_t* shortBands = kMp3ShortBands[header.rateIndex];
+            int firstShort = g.mixedBlock ? 3 : 0;
+            size_t line = 3u * shortBands[firstShort];
+            float reordered[576];
+            for (int sfb = firstShort; sfb < 13; sfb++)
+            {
+                size_t start = shortBands[sfb];
+                size_t width = shortBands[sfb + 1] - start;
+                for (int w = 0; w < 3; w++)
+                    for (size_t j = 0; j < width; j++) reordered[3 * (start + j) + w] = xr[line++];
+            }
+            size_t first = 3u * shortBands[firstShort];
+            memcpy(xr + first, reordered + first, sizeof(float) * (576 - first));
+            nonzero = 576;
+        }
+
+        // Butterflies across subband boundaries; short subbands have none
+        size_t subbands = std::min<size_t>((nonzero + 17) / 18, 32);
+        size_t boundaries = g.blockType != 2 ? std::min<size_t>(subbands + 1, 32) : g.mixedBlock ? 2 : 0;
+        for (size_t sb = 1; sb < boundaries; sb++)
+        {
+            for (int i = 0; i < 8; i++)
+            {
+                float lo = xr[18 * sb - 1 - i];
+                float hi = xr[18 * sb + i];
+                xr[18 * sb - 1 - i] = lo * m_tables.antialiasCs[i] - hi * m_tables.antialiasCa[i];
+                xr[18 * sb + i] = hi * m_tables.antialiasCs[i] + lo * m_tables.antialiasCa[i];
+            }
+        }
+        if (boundaries > subbands) subbands = boundaries;
+
+        for (size_t sb = 0; sb < 32; sb++)
+        {
+            float* overlap = m_overlap[ch][sb];
+            float out[36];
+            memset(out, 0, sizeof(out));
+            if (sb < subbands)
+            {
+                uint32_t type = g.mixedBlock && sb < 2 ? 0 : g.blockType;
+                const float* in = xr + 18 * sb;
+                for (int k = 0; k < 18; k++)
+                    if (in[k] != 0.0f) Mp3ScaleAdd(out, m_tables.imdct[type][k], in[k], 36);
+            }
+            for (int t = 0; t < 18; t++)
+            {
+                float v = out[t] + overlap[t];
+                m_slots[t][sb] = (sb & t & 1) ? -v : v;
+                overlap[t] = out[18 + t];
+            }
+        }
+    }
+
+    // Polyphase synthesis of the 18 slots into 'out', every 'stride' floats
+    void Synthesize(uint32_t ch, float* out, size_t stride)
+    {
+        for (int t = 0; t < 18; t++)
+        {
+            // 32-point DCT of the slot; the 64 V values follow by symmetry
+            float x[32];
+            memset(x, 0, sizeof(x));
+            const float* s = m_slots[t];
+            for (int k = 0; k < 32; k++)
+                if (s[k] != 0.0f) Mp3ScaleAdd(x, m_tables.dct[k], s[k], 32);
+
+            m_synthesisPos[ch] = (m_synthesisPos[ch] + 15) & 15;
+            float* v = m_synthesis[ch][m_synthesisPos[ch]];
+            for (int i = 0; i < 16; i++) v[i] = x[16 + i];
+            v[16] = 0.0f;
+            for (int i = 17; i < 48; i++) v[i] = -x[48 - i];
+            for (int i = 48; i < 64; i++) v[i] = -x[i - 48];
+
+            // out[j] = sum over the 16 newest V vectors of alternating halves times the window
+            float pcm[32];
+            memset(pcm, 0, sizeof(pcm));
+            for (int age = 0; age < 16; age++)
+            {
+                const float* slot = m_synthesis[ch][(m_synthesisPos[ch] + age) & 15];
+                Mp3MultiplyAdd(pcm, slot + ((age & 1) ? 32 : 0), m_tables.window + 32 * age, 32);
+            }
+            for (int j = 0; j < 32; j++) out[(t * 32 + j) * stride] = pcm[j];
+        }
+    }
+
+    const Mp3Tables& m_tables;
+    Granule m_granule[2][2];
+    Scalefactors m_scalefactors[2] = {};
+    uint32_t m_scfsi[2] = {};
+    uint32_t m_mainDataBegin = 0;
+
+    float m_spectrum[2][576];
+    size_t m_nonzero[2] = {};
+    float m_slots[18][32];
+    float m_overlap[2][32][18];
+    float m_synthesis[2][16][64];
+    unsigned m_synthesisPos[2];
+
+    uint8_t m_reservoir[4096 + kPadding];
+    size_t m_reservoirBytes = 0;
+};
+
+// Gapless information from a Xing/Info (or VBRI) header frame
+struct Mp3StreamInfo
+{
+    uint32_t frames = 0;            // audio frames, 0 = unknown
+    uint32_t encoderDelay = 0;      // samples, from the LAME tag
+    uint32_t encoderPadding = 0;
+    bool haveGapless = false;
+};
+
+// True if the frame at 'frame' is a Xing/Info or VBRI header rather than audio
+inline bool ParseMp3InfoFrame(const uint8_t* frame, const Mp3FrameHeader& header, Mp3StreamInfo& info)
+{
+    size_t xing = header.SideInfoOffset() + header.sideInfoBytes;
+    if (xing + 8 <= header.frameBytes && (memcmp(frame + xing, "Xing", 4) == 0 || memcmp(frame + xing, "Info", 4) == 0))
+    {
+        const uint8_t* p = frame + xing + 4;
+        uint32_t flags = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+        size_t pos = xing + 8;
+        if ((flags & 1) && pos + 4 <= header.frameBytes)
+            info.frames = ((uint32_t)frame[pos] << 24) | ((uint32_t)frame[pos + 1] << 16) | ((uint32_t)frame[pos + 2] << 8) | frame[pos + 3];
+        pos += (flags & 1 ? 4 : 0) + (flags & 2 ? 4 : 0) + (flags & 4 ? 100 : 0) + (flags & 8 ? 4 : 0);
+
+        // LAME extension: delay and padding are 12 bits each at offset 21
+        const uint8_t* lame = frame + pos;
+        if (pos + 24 <= header.frameBytes &&
+            (memcmp(lame, "LAME", 4) == 0 || memcmp(lame, "Lavc", 4) == 0 || memcmp(lame, "Lavf", 4) == 0))
+        {
+            info.encoderDelay = ((uint32_t)lame[21] << 4) | (lame[22] >> 4);
+            info.encoderPadding = ((uint32_t)(lame[22] & 15) << 8) | lame[23];
+            info.haveGapless = true;
+        }
+        return true;
+    }
+
+    // Fraunhofer's VBRI sits at a fixed place after the side info of a stereo MPEG-1 frame
+    size_t vbri = 4 + 32;
+    if (vbri + 18 <= header.frameBytes && memcmp(frame + vbri, "VBRI", 4) == 0)
+    {
+        const uint8_t* p = frame + vbri + 14;
+        info.frames = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+        return true;
+    }
+    return false;
+}
+
+class Mp3Source : public AudioSource
+{
+public:
+    // Trim the encoder delay and padding named by a LAME tag (the default).
+    // Off, the output is the raw decoder output, as reference decoders give it.
+    void SetGapless(bool gapless) { m_gapless = gapless; }
+
+    // Worker threads for batch decoding, set before Open(). 1 decodes frame
+    // by frame on the caller's thread. 0 picks a count as FlacSource does,
+    // for streams above CD rate, which no MP3 stream is: it stays sequential.
+    void SetDecodeThreads(unsigned threads) { m_decodeThreads = threads; }
+    unsigned DecodeThreads() const { return m_pool ? m_pool->Threads() : 1; }
+
+    bool Open(const std::filesystem::path& path)
+    {
+        m_file.open(path, std::ios::binary);
+        if (!m_file) return false;
+
+        m_file.seekg(0, std::ios::end);
+        m_fileSize = (uint64_t)m_file.tellg();
+        m_file.seekg(0, std::ios::beg);
+        m_audioEnd = m_fileSize;
+
+        // Skip an ID3v2 tag in front; an ID3v1 tag at the end is not audio
+        uint8_t tag[10];
+        uint64_t start = 0;
+        if (ReadExact(tag, 10) && memcmp(tag, "ID3", 3) == 0)
+        {
+            start = 10 + (((uint64_t)(tag[6] & 0x7F) << 21) | ((tag[7] & 0x7F) << 14) | ((tag[8] & 0x7F) << 7) | (tag[9] & 0x7F));
+            if (tag[5] & 0x10) start += 10; // footer
+        }
+        if (m_fileSize >= 128)
+        {
+            m_file.clear();
+            m_file.seekg((std::streamoff)(m_fileSize - 128), std::ios::beg);
+            if (ReadExact(tag, 3) && memcmp(tag, "TAG", 3) == 0) m_audioEnd = m_fileSize - 128;
+        }
+
+        m_buffer.resize(kMaxFrameBytes * 2 + kReadAhead + 16);
+        if (!Reposition(start) || !FindFrame(true)) return false;
+
+        const uint8_t* first = m_buffer.data() + m_bufferStart;
+        m_stream = m_header;
+        m_format.sampleRate = m_stream.sampleRate;
+        m_format.channels = m_stream.channels;
+        m_pcm.resize((size_t)m_stream.samples * m_stream.channels);
+
+        unsigned threads = m_decodeThreads ? m_decodeThreads : 1;
+        if (threads > kMaxWorkers) threads = kMaxWorkers;
+        m_decoders.resize(threads);
+        m_carry = 0;
+        if (threads > 1)
+        {
+            size_t slots = (size_t)threads * kFramesPerWorker;
+            m_batch.resize(slots);
+            m_batchPcm.resize(slots * m_pcm.size());
+            m_batchBytes.resize(slots * kMaxFrameBytes + kFramePadding);
+            m_warmupPcm.resize(threads * m_pcm.size());
+            m_pool = std::make_unique<WorkerPool>(threads);
+        }
+
+        m_firstFrameOffset = BufferOffset();
+        if (ParseMp3InfoFrame(first, m_stream, m_info)) m_firstFrameOffset += m_stream.frameBytes;
+
+        // Decoder output runs 529 samples behind the encoder's input
+        if (m_gapless && m_info.haveGapless && m_info.frames)
+        {
+            m_skip = m_info.encoderDelay + 529;
+            uint64_t coded = (uint64_t)m_info.frames * m_stream.samples;
+            uint64_t trim = (uint64_t)m_info.encoderDelay + m_info.encoderPadding;
+            m_end = coded > trim ? coded - trim + m_skip : m_skip;
+        }
+        else
+        {
+            m_skip = 0;
+            m_end = (uint64_t)m_info.frames * m_stream.samples;
+        }
+
+        m_frameOffsets.clear();
+        m_frameOffsets.push_back(m_firstFrameOffset);
+        m_decoders[m_carry].Reset();
+        return Reposition(m_firstFrameOffset);
+    }
+
+    const AudioFormat& Format() const override { return m_format; }
+
+    // Exact with a Xing/Info frame count, else estimated from the first frame's bitrate
+    uint64_t TotalFrames() const override
+    {
+        if (m_end) return m_end - m_skip;
+        uint64_t bytes = m_audioEnd > m_firstFrameOffset ? m_audioEnd - m_firstFrameOffset : 0;
+        return bytes * 8 * m_stream.sampleRate / ((uint64_t)m_stream.bitrate * 1000);
+    }
+
+    const Mp3StreamInfo& StreamInfo() const { return m_info; }
+    uint64_t FramesDecoded() const { return m_framesDecoded; }
+    uint64_t FramesDropped() const { return m_framesDropped; }
+
+    size_t Read(float* out, size_t frames) override
+    {
+        size_t done = 0;
+        while (done < frames)
+        {
+            if (m_frameOffset == m_frameSamples)
+            {
+                if (!DecodeNextFrame()) break;
+                continue;
+            }
+
+            size_t chunk = m_frameSamples - m_frameOffset;
+            if (chunk > frames - done) chunk = frames - done;
+            memcpy(out + done * m_format.channels, m_framePcm + (size_t)m_frameOffset * m_format.channels,
+                   sizeof(float) * chunk * m_format.channels);
+            m_frameOffset += (uint32_t)chunk;
+            done += chunk;
+        }
+        return done;
+    }
+
+    bool Seek(uint64_t frame) override
+    {
+        uint64_t target = frame + m_skip;
+        if (m_end && target >= m_end)
+        {
+            m_frameSamples = m_frameOffset = 0;
+            m_endOfStream = true;
+            return true;
+        }
+
+        // Restart early enough that the target frame's main data and the
+        // filterbank state are rebuilt: the 18 slots of history before the
+        // target (one frame, or two of MPEG-2's single granules), plus as
+        // many frames as the reservoir can reach back across
+        uint64_t targetFrame = target / m_stream.samples;
+        if (!IndexFrames(targetFrame)) targetFrame = m_frameOffsets.size() - 1;
+        uint64_t history = m_stream.lsf ? 2 : 1;
+        uint64_t first = targetFrame > history ? targetFrame - history : 0;
+        for (size_t bytes = 0; first > 0 && bytes < ReservoirReach(); first--)
+            bytes += (size_t)(m_frameOffsets[first] - m_frameOffsets[first - 1]) - m_stream.SideInfoOffset() - m_stream.sideInfoBytes;
+
+        m_decoders[m_carry].Reset();
+        if (!Reposition(m_frameOffsets[first])) return false;
+        m_frameNumber = first;
+        return DecodeNextFrame(target);
+    }
+
+    bool SeeksExactly() const override { return true; }
+
+private:
+    static const size_t kMaxFrameBytes = 1441 + 4;     // 320 kbps at 32 kHz, plus the next header
+    static const size_t kReadAhead = 64 * 1024;
+    static const size_t kFramePadding = 16;
+    static const size_t kFramesPerWorker = 32;
+    static const unsigned kMaxWorkers = 16;
+
+    struct BatchFrame
+    {
+        Mp3FrameHeader header;
+        uint64_t number = 0;
+        size_t offset = 0;      // in m_batchBytes
+        bool ok = false;
+    };
+
+    // Main data bytes a frame can point back across
+    size_t ReservoirReach() const { return m_stream.lsf ? 255 : 511; }
+
+    bool ReadExact(void* dst, size_t size)
+    {
+        return (bool)m_file.read((char*)dst, size);
+    }
+
+    uint64_t BufferOffset() const { return m_bufferFileOffset + m_bufferStart; }
+
+    // Drop buffered data and continue reading from 'offset'
+    bool Reposition(uint64_t offset)
+    {
+        m_file.clear();
+        m_file.seekg((std::streamoff)offset, std::ios::beg);
+        m_bufferFileOffset = offset;
+        m_bufferStart = m_bufferEnd = 0;
+        m_frameSamples = m_frameOffset = 0;
+        m_batchNext = m_batchCount = 0;
+        m_endOfStream = false;
+        m_fileEnd = false;
+        return (bool)m_file;
+    }
+
+    // Make sure at least 'wanted' bytes are buffered, unless the audio ends first
+    void FillBuffer(size_t wanted)
+    {
+        if (m_fileEnd || m_bufferEnd - m_bufferStart >= wanted) return;
+
+        memmove(m_buffer.data(), m_buffer.data() + m_bufferStart, m_bufferEnd - m_bufferStart);
+        m_bufferFileOffset += m_bufferStart;
+        m_bufferEnd -= m_bufferStart;
+        m_bufferStart = 0;
+
+        uint64_t left = m_audioEnd > m_bufferFileOffset + m_bufferEnd ? m_audioEnd - (m_bufferFileOffset + m_bufferEnd) : 0;
+        size_t room = m_buffer.size() - 16 - m_bufferEnd;
+        size_t toRead = (size_t)std::min<uint64_t>(room, left);
+        m_file.read((char*)m_buffer.data() + m_bufferEnd, toRead);
+        m_bufferEnd += (size_t)m_file.gcount();
+        if (!m_file || toRead == left) m_fileEnd = true;
+        memset(m_buffer.data() + m_bufferEnd, 0, 16);
+    }
+
+    // Is there a frame of this stream at 'p', with 'size' bytes buffered?
+    bool MatchesStream(const uint8_t* p, size_t size, Mp3FrameHeader& header) const
+    {
+        return ParseMp3FrameHeader(p, size, header) && header.versionBits == m_stream.versionBits &&
+               header.rateIndex == m_stream.rateIndex && header.channels == m_stream.channels;
+    }
+
+    // Advance m_bufferStart to the next frame header and parse it into m_header.
+    // A header right where the previous frame ended is trusted; after stray
+    // bytes, and on the first search that pins down the stream, the next
+    // frame's header must line up too (or the audio end right after it).
+    bool FindFrame(bool first)
+    {
+        bool inSequence = !first;
+        for (;;)
+        {
+            FillBuffer(kMaxFrameBytes);
+            size_t available = m_bufferEnd - m_bufferStart;
+            if (available < 4) return false;
+
+            const uint8_t* p = m_buffer.data() + m_bufferStart;
+            Mp3FrameHeader header, next;
+            bool ok = first ? ParseMp3FrameHeader(p, available, header) : MatchesStream(p, available, header);
+            if (ok && header.frameBytes <= available)
+            {
+                if (first) m_stream = header;
+                bool last = m_fileEnd && header.frameBytes + 4 > available;
+                ok = inSequence || last || MatchesStream(p + header.frameBytes, available - header.frameBytes, next);
+            }
+            else if (ok)
+            {
+                // Truncated last frame
+                ok = false;
+                if (m_fileEnd) return false;
+            }
+            if (ok)
+            {
+                m_header = header;
+                return true;
+            }
+
+            // Stray bytes: skip to the next sync
+            inSequence = false;
+            m_bufferStart++;
+            while (m_bufferStart + 1 < m_bufferEnd &&
+                   !(m_buffer[m_bufferStart] == 0xFF && (m_buffer[m_bufferStart + 1] & 0xE0) == 0xE0))
+                m_bufferStart++;
+        }
+    }
+
+    // Decode the next frame and work out which of its samples are played.
+    // While seeking, frames entirely before 'target' are not kept.
+    bool DecodeNextFrame(uint64_t target = 0)
+    {
+        m_frameSamples = m_frameOffset = 0;
+        while (!m_endOfStream)
+        {
+            uint64_t number = 0;
+            if (m_pool)
+            {
+                if (m_batchNext == m_batchCount && !DecodeBatch())
+                {
+                    m_endOfStream = true;
+                    break;
+                }
+                number = m_batch[m_batchNext].number;
+                m_framePcm = m_batchPcm.data() + m_batchNext * m_pcm.size();
+                m_batchNext++;
+            }
+            else
+            {
+                if (!FindFrame(false))
+                {
+                    m_endOfStream = true;
+                    break;
+                }
+
+                number = m_frameNumber++;
+                if (number == m_frameOffsets.size()) m_frameOffsets.push_back(BufferOffset());
+                if (!m_decoders[m_carry].DecodeFrame(m_buffer.data() + m_bufferStart, m_header, m_pcm.data())) m_framesDropped++;
+                m_framesDecoded++;
+                m_bufferStart += m_header.frameBytes;
+                m_framePcm = m_pcm.data();
+            }
+
+            // Clip to what is played: past the encoder delay, before the padding
+            uint64_t firstSample = number * m_stream.samples;
+            uint64_t begin = std::max(firstSample, std::max(m_skip, target));
+            uint64_t end = firstSample + m_stream.samples;
+            if (m_end && end > m_end) end = m_end;
+            if (m_end && firstSample >= m_end)
+            {
+                m_endOfStream = true;
+                break;
+            }
+            if (begin >= end) continue;
+
+            m_frameFirstSample = firstSample;
+            m_frameOffset = (uint32_t)(begin - firstSample);
+            m_frameSamples = (uint32_t)(end - firstSample);
+            return true;
+        }
+        return false;
+    }
+
+    // Copy the next frames out of the read buffer and decode them on the
+    // pool, one run of frames per worker. Returns false at the end of the
+    // stream.
+    bool DecodeBatch()
+    {
+        m_batchNext = m_batchCount = 0;
+        size_t bytes = 0;
+        while (m_batchCount < m_batch.size() && FindFrame(false))
+        {
+            BatchFrame& frame = m_batch[m_batchCount++];
+            frame.header = m_header;
+            frame.number = m_frameNumber++;
+            frame.offset = bytes;
+            if (frame.number == m_frameOffsets.size()) m_frameOffsets.push_back(BufferOffset());
+            memcpy(m_batchBytes.data() + bytes, m_buffer.data() + m_bufferStart, m_header.frameBytes);
+            bytes += m_header.frameBytes;
+            m_bufferStart += m_header.frameBytes;
+
+            // Nothing after the padding is played
+            if (m_end && (frame.number + 1) * m_stream.samples >= m_end) break;
+        }
+        if (m_batchCount == 0) return false;
+        memset(m_batchBytes.data() + bytes, 0, kFramePadding);
+
+        // Runs of equal length, except that a run only starts where its
+        // warm-up frames lie inside the batch; otherwise the run before it
+        // takes its frames too
+        size_t workers = m_decoders.size();
+        size_t length = (m_batchCount + workers - 1) / workers;
+        size_t begins[kMaxWorkers + 1];
+        size_t warmups[kMaxWorkers];
+        size_t runs = 0;
+        begins[runs] = warmups[runs] = 0;
+        runs++;
+        for (size_t begin = length; begin < m_batchCount && runs < workers; begin += length)
+        {
+            size_t warmup = 0;
+            if (!WarmupStart(begin, warmup)) continue;
+            begins[runs] = begin;
+            warmups[runs] = warmup;
+            runs++;
+        }
+        begins[runs] = m_batchCount;
+
+        m_pool->Run(runs, [&](size_t run)
+        {
+            Mp3FrameDecoder& decoder = m_decoders[(m_carry + run) % workers];
+            if (run > 0)
+            {
+                float* scratch = m_warmupPcm.data() + run * m_pcm.size();
+                decoder.Reset();
+                for (size_t i = warmups[run]; i < begins[run]; i++)
+                    decoder.DecodeFrame(m_batchBytes.data() + m_batch[i].offset, m_batch[i].header, scratch);
+            }
+            for (size_t i = begins[run]; i < begins[run + 1]; i++)
+            {
+                BatchFrame& frame = m_batch[i];
+                frame.ok = decoder.DecodeFrame(m_batchBytes.data() + frame.offset, frame.header,
+                                               m_batchPcm.data() + i * m_pcm.size());
+            }
+        });
+
+        // The decoder of the last run carries on with the next batch
+        m_carry = (m_carry + runs - 1) % workers;
+        for (size_t i = 0; i < m_batchCount; i++)
+            if (!m_batch[i].ok) m_framesDropped++;
+        m_framesDecoded += m_batchCount;
+        return true;
+    }
+
+    // First batch frame to decode before batch frame 'frame' so that it comes
+    // out as in a continuous decode: the rule Seek() uses. False if that
+    // reaches back before the batch.
+    bool WarmupStart(size_t frame, size_t& first) const
+    {
+        size_t history = m_stream.lsf ? 2 : 1;
+        if (frame < history) return false;
+        first = frame - history;
+        for (size_t bytes = 0; bytes < ReservoirReach(); first--)
+        {
+            if (first == 0) return false;
+            bytes += m_batch[first - 1].header.MainDataBytes();
+        }
+        return true;
+    }
+
+    // Extend the frame index through 'frame' by walking headers. Returns
+    // false if the stream ends first.
+    bool IndexFrames(uint64_t frame)
+    {
+        if (frame < m_frameOffsets.size()) return true;
+        if (!Reposition(m_frameOffsets.back()) || !FindFrame(false)) return false;
+        while (m_frameOffsets.size() <= frame)
+        {
+            m_bufferStart += m_header.frameBytes;
+            if (!FindFrame(false)) return false;
+            m_frameOffsets.push_back(BufferOffset());
+        }
+        return true;
+    }
+
+    std::ifstream m_file;
+    uint64_t m_fileSize = 0;
+    uint64_t m_audioEnd = 0;
+    uint64_t m_firstFrameOffset = 0;
+    AudioFormat m_format = {};
+    Mp3FrameHeader m_stream;       // first frame, which the others must match
+    Mp3FrameHeader m_header;       // current frame
+    Mp3StreamInfo m_info;
+    bool m_gapless = true;
+
+    std::vector<uint8_t> m_buffer;
+    uint64_t m_bufferFileOffset = 0;
+    size_t m_bufferStart = 0;
+    size_t m_bufferEnd = 0;
+    bool m_fileEnd = false;
+    bool m_endOfStream = false;
+
+    std::vector<Mp3FrameDecoder> m_decoders;   // one per decode thread
+    size_t m_carry = 0;                         // the decoder that holds the stream position
+    std::vector<float> m_pcm;
+    const float* m_framePcm = nullptr;          // the samples of the frame being read
+    std::vector<uint64_t> m_frameOffsets;   // by audio frame number
+    uint64_t m_frameNumber = 0;
+    uint64_t m_frameFirstSample = 0;        // stream samples, before trimming
+    uint32_t m_frameSamples = 0;
+    uint32_t m_frameOffset = 0;
+    uint64_t m_skip = 0;                    // stream samples not played at the start
+    uint64_t m_end = 0;                     // stream sample where playback stops, 0 = end of file
+    uint64_t m_framesDecoded = 0;
+    uint64_t m_framesDropped = 0;
+
+    unsigned m_decodeThreads = 1;
+    std::unique_ptr<WorkerPool> m_pool;
+    std::vector<BatchFrame> m_batch;
+    std::vector<float> m_batchPcm;
+    std::vector<uint8_t> m_batchBytes;
+    std::vector<float> m_warmupPcm;
+    size_t m_batchNext = 0;
+    size_t m_batchCount = 0;
+};
+
+// Decode 'path' from start to end with 1, 2, 4, ... decode threads up to the
+// core count and log the realtime factor of each (best of three passes).
+// Run with --benchmark-mp3 <file>; works on any platform the decoder builds
+// on. Returns false if the file cannot be decoded or a thread count yields
+// different audio than the sequential decoder.
+inline bool BenchmarkMp3Decode(const std::filesystem::path& path)
+{
+    unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<unsigned> counts;
+    for (unsigned threads = 1; threads < cores; threads *= 2) counts.push_back(threads);
+    counts.push_back(cores);
+
+#if defined(CPU_X86)
+    const char* kernels = GetCpuFeatures().avx2 ? "AVX2" : "SSE2";
+#elif defined(CPU_ARM64)
+    const char* kernels = "NEON";
+#else
+    const char* kernels = "scalar";
+#endif
+
+    std::vector<float> block(4096 * 2);
+    uint8_t reference[16] = {};
+    uint64_t referenceFrames = 0;
+    bool same = true;
+    for (unsigned threads : counts)
+    {
+        double best = 1e30;
+        double audioSeconds = 0.0;
+        for (int pass = 0; pass < 3; pass++)
+        {
+            Mp3Source source;
+            source.SetDecodeThreads(threads);
+            auto start = std::chrono::steady_clock::now();
+            if (!source.Open(path))
+            {
+                LogMessage("MP3 decode benchmark: cannot open the file");
+                return false;
+            }
+
+            // Digest of the output, to compare the thread counts with
+            Md5 md5;
+            uint64_t frames = 0;
+            for (;;)
+            {
+                size_t got = source.Read(block.data(), 4096);
+                if (got == 0) break;
+                md5.Update(block.data(), got * source.Format().channels * sizeof(float));
+                frames += got;
+            }
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            audioSeconds = (double)frames / source.Format().sampleRate;
+
+            uint8_t digest[16];
+            md5.Finish(digest);
+            if (threads == 1 && pass == 0)
+            {
+                memcpy(reference, digest, 16);
+                referenceFrames = frames;
+                if (source.FramesDropped() > 1)
+                    LogMessage("MP3 decode benchmark: %llu of %llu frames could not be decoded",
+                               (unsigned long long)source.FramesDropped(), (unsigned long long)source.FramesDecoded());
+            }
+            else if (frames != referenceFrames || memcmp(digest, reference, 16) != 0)
+            {
+                same = false;
+            }
+        }
+
+        double realtime = audioSeconds / std::max(best, 1e-9);
+        LogMessage("MP3 decode, %u thread%s: %.1f s of audio in %.3f s, %.0fx realtime (%s)", threads,
+                   threads == 1 ? "" : "s", audioSeconds, best, realtime, kernels);
+    }
+
+    if (!same) LogMessage("MP3 decode benchmark: parallel decode differs from sequential decode");
+    return same && referenceFrames > 0;
+}
+
+// Compare the decoder's raw output with a reference decoding (a WAV file,
+// e.g. the ISO/IEC 11172-4 compliance outputs) by the criteria of that
+// standard: RMS error below 2^-15 / sqrt(12) with no sample off by more than
+// 2^-14 is "full accuracy", RMS below 2^-11 / sqrt(12) "limited accuracy".
+// Run with --check-mp3 <file.mp3> <reference.wav>.
+inline bool CheckMp3Conformance(const std::filesystem::path& mp3Path, const std::filesystem::path& referencePath)
+{
+    Mp3Source source;
+    source.SetGapless(false);
+    WavSource reference;
+    if (!source.Open(mp3Path) || !reference.Open(referencePath))
+    {
+        LogMessage("MP3 conformance: cannot open the stream or the reference");
+        return false;
+    }
+    if (source.Format().channels != reference.Format().channels)
+    {
+        LogMessage("MP3 conformance: the stream has %u channels, the reference %u",
+                   source.Format().channels, reference.Format().channels);
+        return false;
+    }
+
+    const size_t kBlock = 4096;
+    uint32_t channels = source.Format().channels;
+    std::vector<float> decoded(kBlock * channels), expected(kBlock * channels);
+    double sumSquares = 0.0;
+    double maxError = 0.0;
+    uint64_t compared = 0;
+    uint64_t decodedFrames = 0;
+    uint64_t referenceFrames = 0;
+    for (;;)
+    {
+        size_t got = source.Read(decoded.data(), kBlock);
+        size_t want = reference.Read(expected.data(), kBlock);
+        decodedFrames += got;
+        referenceFrames += want;
+        size_t samples = std::min(got, want) * channels;
+        for (size_t i = 0; i < samples; i++)
+        {
+            double error = (double)decoded[i] - (double)expected[i];
+            sumSquares += error * error;
+            maxError = std::max(maxError, std::fabs(error));
+        }
+        compared += samples;
+        if (got == 0 || want == 0) break;
+    }
+    // Drain whichever is longer, for the length report
+    while (size_t got = source.Read(decoded.data(), kBlock)) decodedFrames += got;
+    while (size_t got = reference.Read(expected.data(), kBlock)) referenceFrames += got;
+
+    double rms = compared ? sqrt(sumSquares / (double)compared) : 0.0;
+    bool full = compared > 0 && rms < ldexp(1.0, -15) / sqrt(12.0) && maxError <= ldexp(1.0, -14);
+    bool limited = compared > 0 && rms < ldexp(1.0, -11) / sqrt(12.0);
+    LogMessage("MP3 conformance: %llu frames decoded, %llu in the reference; RMS error %.3g, max %.3g: %s",
+               (unsigned long long)decodedFrames, (unsigned long long)referenceFrames, rms, maxError,
+               full ? "full accuracy" : limited ? "limited accuracy" : "NOT compliant");
+    return limited;
+}
@@ -0,0 +1,634 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "audio_source.h"
+#include "log.h"
+
+// Tempo and key estimation for ordering a playlist by energy and harmonic
+// compatibility.
+//
+// A track is downmixed and decimated to about 11 kHz, and at most
+// kMaxSeconds of it (the middle, for long tracks) is analysed:
+//  - tempo: spectral flux (rectified rise in log magnitude) every ~12 ms
+//    gives an onset-strength envelope, whose autocorrelation is scored at
+//    each candidate tempo together with its multiples, weighted towards
+//    120 BPM so half or double tempo only wins with clear evidence;
+//  - key: FFT magnitudes folded into a 12-bin chroma profile, correlated
+//    with the Krumhansl-Kessler major and minor profiles in all 12 keys.
+// Each analysis worker owns a FeatureAnalyzer whose buffers are sized once,
+// so memory does not grow with track length or library size.
+
+// Keys are 0-11 for C..B major and 12-23 for C..B minor
+struct TrackFeatures
+{
+    float bpm = 0.0f;       // 0 = unknown
+    int key = -1;           // -1 = unknown
+};
+
+// Camelot wheel position: 1-12, with 'minor' set for the A (minor) ring.
+// Neighbours on the wheel (same number, or one step with the same letter)
+// mix without a key clash.
+inline int CamelotNumber(int key, bool& minor)
+{
+    minor = key >= 12;
+    int tonic = key % 12;
+    int major = minor ? (tonic + 3) % 12 : tonic;     // relative major
+    return (major * 7 % 12 + 7) % 12 + 1;
+}
+
+// Steps around the wheel between two keys; 0 = same key, 1 = compatible
+inline int KeyDistance(int a, int b)
+{
+    if (a < 0 || b < 0) return 6;
+    bool minorA, minorB;
+    int numberA = CamelotNumber(a, minorA);
+    int numberB = CamelotNumber(b, minorB);
+    int d = std::abs(numberA - numberB);
+    d = std::min(d, 12 - d);
+    return d + (minorA != minorB ? 1 : 0);
+}
+
+// "8A", "11B"
+inline std::string KeyName(int key)
+{
+    if (key < 0) return "?";
+    bool minor;
+    int number = CamelotNumber(key, minor);
+    return std::to_string(number) + (minor ? "A" : "B");
+}
+
+// Radix-2 complex FFT of a fixed size, real and imaginary parts kept apart
+class Fft
+{
+public:
+    void Init(size_t size)
+    {
+        m_size = size;
+        m_cos.resize(size / 2);
+        m_sin.resize(size / 2);
+        for (size_t i = 0; i < size / 2; i++)
+        {
+            m_cos[i] = (float)cos(2.0 * 3.14159265358979323846 * i / size);
+            m_sin[i] = (float)-sin(2.0 * 3.14159265358979323846 * i / size);
+        }
+        m_reverse.resize(size);
+        int bits = 0;
+        while ((size_t(1) << bits) < size) bits++;
+        for (size_t i = 0; i < size; i++)
+        {
+            size_t r = 0;
+            for (int b = 0; b < bits; b++) r |= ((i >> b) & 1) << (bits - 1 - b);
+            m_reverse[i] = (uint32_t)r;
+        }
+        m_re.resize(size);
+        m_im.resize(size);
+    }
+
+    // |X[k]| for k in [0, size/2) of the real input times 'window'
+    void Magnitudes(const float* input, const float* window, float* out)
+    {
+        float* re = m_re.data();
+        float* im = m_im.data();
+        for (size_t i = 0; i < m_size; i++)
+        {
+            re[m_reverse[i]] = input[i] * window[i];
+            im[i] = 0.0f;
+        }
+        for (size_t half = 1; half < m_size; half *= 2)
+        {
+            size_t stride = m_size / (half * 2);
+            for (size_t start = 0; start < m_size; start += half * 2)
+            {
+                for (size_t k = 0; k < half; k++)
+                {
+                    size_t a = start + k, b = a + half;
+                    float wr = m_cos[k * stride], wi = m_sin[k * stride];
+                    float tr = wr * re[b] - wi * im[b];
+                    float ti = wr * im[b] + wi * re[b];
+                    re[b] = re[a] - tr;
+                    im[b] = im[a] - ti;
+                    re[a] += tr;
+                    im[a] += ti;
+                }
+            }
+        }
+        for (size_t k = 0; k < m_size / 2; k++) out[k] = sqrtf(re[k] * re[k] + im[k] * im[k]);
+    }
+
+private:
+    size_t m_size = 0;
+    std::vector<float> m_cos;
+    std::vector<float> m_sin;
+    std::vector<uint32_t> m_reverse;
+    std::vector<float> m_re;
+    std::vector<float> m_im;
+};
+
+class FeatureAnalyzer
+{
+public:
+    static const uint32_t kTargetRate = 11025;
+    static const uint32_t kMaxSeconds = 120;
+    static const size_t kOnsetFft = 1024;
+    static const size_t kOnsetHop = 128;
+    static const size_t kChromaFft = 4096;
+    static const size_t kChromaHop = 2048;
+    static const size_t kReadFrames = 4096;
+
+    FeatureAnalyzer()
+    {
+        m_onsetFft.Init(kOnsetFft);
+        m_chromaFft.Init(kChromaFft);
+        m_onsetWindow.resize(kOnsetFft);
+        m_chromaWindow.resize(kChromaFft);
+        for (size_t i = 0; i < kOnsetFft; i++) m_onsetWindow[i] = 0.5f - 0.5f * cosf(2.0f * 3.14159265f * i / kOnsetFft);
+        for (size_t i = 0; i < kChromaFft; i++) m_chromaWindow[i] = 0.5f - 0.5f * cosf(2.0f * 3.14159265f * i / kChromaFft);
+        m_magnitudes.resize(kChromaFft / 2);
+        m_previousLog.resize(kOnsetFft / 2);
+        // Decimation keeps at least kTargetRate * 0.9 from rates up to 384 kHz
+        m_mono.reserve((size_t)(kMaxSeconds + 1) * kTargetRate * 11 / 10 + kChromaFft);
+        m_envelope.reserve(m_mono.capacity() / kOnsetHop + 1);
+    }
+
+    // Decoded audio frames of the last Analyze() call
+    uint64_t FramesDecoded() const { return m_framesDecoded; }
+
+    bool Analyze(AudioSource& source, TrackFeatures& features)
+    {
+        features = TrackFeatures();
+        m_framesDecoded = 0;
+        const AudioFormat& format = source.Format();
+        if (format.channels == 0 || format.sampleRate < 8000) return false;
+
+        uint32_t factor = std::max<uint32_t>(1, (format.sampleRate + kTargetRate / 2) / kTargetRate);
+        double rate = (double)format.sampleRate / factor;
+        size_t maxSamples = std::min(m_mono.capacity(), (size_t)(kMaxSeconds * rate));
+
+        // Long tracks: the middle is the most representative stretch
+        uint64_t total = source.TotalFrames();
+        uint64_t span = (uint64_t)maxSamples * factor;
+        if (total > span + format.sampleRate * 10ull) source.Seek((total - span) / 2);
+
+        // Downmix and decimate by averaging 'factor' frames
+        m_mono.clear();
+        m_decoded.resize(kReadFrames * format.channels);
+        float sum = 0.0f;
+        uint32_t pending = 0;
+        float gain = 1.0f / (factor * format.channels);
+        while (m_mono.size() < maxSamples)
+        {
+            size_t got = source.Read(m_decoded.data(), kReadFrames);
+            if (got == 0) break;
+            m_framesDecoded += got;
+            const float* p = m_decoded.data();
+            for (size_t i = 0; i < got && m_mono.size() < maxSamples; i++)
+            {
+                for (uint32_t c = 0; c < format.channels; c++) sum += *p++;
+                if (++pending == factor)
+                {
+                    m_mono.push_back(sum * gain);
+                    sum = 0.0f;
+                    pending = 0;
+                }
+            }
+        }
+        if (m_mono.size() < kChromaFft * 4) return false;
+
+        features.bpm = EstimateTempo(rate);
+        features.key = EstimateKey(rate);
+        return features.bpm > 0.0f || features.key >= 0;
+    }
+
+private:
+    float EstimateTempo(double rate)
+    {
+        // Onset strength: rectified rise of log magnitude, below ~4 kHz
+        m_envelope.clear();
+        size_t bins = std::min(kOnsetFft / 2, (size_t)(4000.0 * kOnsetFft / rate));
+        std::fill(m_previousLog.begin(), m_previousLog.end(), 0.0f);
+        for (size_t start = 0; start + kOnsetFft <= m_mono.size(); start += kOnsetHop)
+        {
+            m_onsetFft.Magnitudes(m_mono.data() + start, m_onsetWindow.data(), m_magnitudes.data());
+            float flux = 0.0f;
+            for (size_t k = 1; k < bins; k++)
+            {
+                float value = logf(1.0f + 100.0f * m_magnitudes[k]);
+                if (start > 0) flux += std::max(0.0f, value - m_previousLog[k]);
+                m_previousLog[k] = value;
+            }
+            m_envelope.push_back(flux);
+        }
+
+        // Remove the slowly varying level (about one second) so loudness
+        // changes do not show up as tempo
+        size_t n = m_envelope.size();
+        double frameRate = rate / kOnsetHop;
+        size_t radius = (size_t)(frameRate / 2);
+        m_detrended.assign(n, 0.0f);
+        double running = 0.0;
+        size_t lo = 0, hi = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            while (hi < n && hi <= i + radius) running += m_envelope[hi++];
+            while (lo + radius < i) running -= m_envelope[lo++];
+            m_detrended[i] = std::max(0.0f, m_envelope[i] - (float)(running / (hi - lo)));
+        }
+
+        // Autocorrelation over every lag a candidate tempo or its multiples can reach
+        const double kMinBpm = 60.0, kMaxBpm = 200.0;
+        const int kMultiples = 4;
+        size_t maxLag = (size_t)(60.0 * frameRate / kMinBpm * kMultiples) + 2;
+        if (n < maxLag * 2) return 0.0f;
+        m_autocorrelation.assign(maxLag + 1, 0.0f);
+        for (size_t lag = 1; lag <= maxLag; lag++)
+        {
+            double acc = 0.0;
+            for (size_t i = 0; i + lag < n; i++) acc += (double)m_detrended[i] * m_detrended[i + lag];
+            m_autocorrelation[lag] = (float)(acc / (n - lag));
+        }
+        auto at = [&](double lag)
+        {
+            size_t i = (size_t)lag;
+            float frac = (float)(lag - i);
+            return m_autocorrelation[i] + frac * (m_autocorrelation[i + 1] - m_autocorrelation[i]);
+        };
+
+        // Candidate tempi 0.1 BPM apart: a beat period is backed up by the
+        // bars it implies, and a log-normal prior around 120 BPM settles
+        // octave ties
+        double bestScore = 0.0, bestBpm = 0.0;
+        for (double bpm = kMinBpm; bpm <= kMaxBpm; bpm += 0.1)
+        {
+            double lag = 60.0 * frameRate / bpm;
+            double score = 0.0;
+            for (int m = 1; m <= kMultiples; m++) score += at(lag * m) / m;
+            double octaves = log2(bpm / 120.0);
+            score *= exp(-0.5 * octaves * octaves);
+            if (score > bestScore)
+            {
+                bestScore = score;
+                bestBpm = bpm;
+            }
+        }
+
+        // A pulse as strong at half the period means the beat is twice as
+        // fast, and what won was every other beat
+        double bestLag = 60.0 * frameRate / bestBpm;
+        if (bestBpm * 2 <= kMaxBpm && at(bestLag / 2) >= 0.8f * at(bestLag)) bestBpm *= 2;
+        return (float)bestBpm;
+    }
+
+    int EstimateKey(double rate)
+    {
+        // Pitch class of each bin from C2 to about C7
+        size_t firstBin = (size_t)ceil(65.0 * kChromaFft / rate);
+        size_t lastBin = std::min(kChromaFft / 2, (size_t)(2100.0 * kChromaFft / rate) + 1);
+        m_pitchClasses.clear();
+        for (size_t k = firstBin; k < lastBin; k++)
+        {
+            double midi = 69.0 + 12.0 * log2(k * rate / kChromaFft / 440.0);
+            m_pitchClasses.push_back((uint8_t)((int)floor(midi + 0.5) % 12));
+        }
+
+        double chroma[12] = {};
+        for (size_t start = 0; start + kChromaFft <= m_mono.size(); start += kChromaHop)
+        {
+            m_chromaFft.Magnitudes(m_mono.data() + start, m_chromaWindow.data(), m_magnitudes.data());
+            for (size_t k = firstBin; k < lastBin; k++) chroma[m_pitchClasses[k - firstBin]] += m_magnitudes[k];
+        }
+
+        static const double kMajor[12] = { 6.35, 2.23, 3.48, 2.33, 4.38, 4.09, 2.52, 5.19, 2.39, 3.66, 2.29, 2.88 };
+        static const double kMinor[12] = { 6.33, 2.68, 3.52, 5.38, 2.60, 3.53, 2.54, 4.75, 3.98, 2.69, 3.34, 3.17 };
+        double bestScore = -2.0;
+        int bestKey = -1;
+        for (int key = 0; key < 24; key++)
+        {
+            const double* profile = key < 12 ? kMajor : kMinor;
+            int tonic = key % 12;
+            double score = Correlation(chroma, profile, tonic);
+            if (score > bestScore)
+            {
+                bestScore = score;
+                bestKey = key;
+            }
+        }
+        return bestScore > 0.0 ? bestKey : -1;
+    }
+
+    // Pearson correlation of 'chroma' with 'profile' rotated to 'tonic'
+    static double Correlation(const double* chroma, const double* profile, int tonic)
+    {
+        double meanA = 0.0, meanB = 0.0;
+        for (int i = 0; i < 12; i++)
+        {
+            meanA += chroma[i];
+            meanB += profile[i];
+        }
+        meanA /= 12.0;
+        meanB /= 12.0;
+        double ab = 0.0, aa = 0.0, bb = 0.0;
+        for (int i = 0; i < 12; i++)
+        {
+            double a = chroma[(i + tonic) % 12] - meanA;
+            double b = profile[i] - meanB;
+            ab += a * b;
+            aa += a * a;
+            bb += b * b;
+        }
+        return aa > 0.0 ? ab / sqrt(aa * bb) : -1.0;
+    }
+
+    Fft m_onsetFft;
+    Fft m_chromaFft;
+    std::vector<float> m_onsetWindow;
+    std::vector<float> m_chromaWindow;
+    std::vector<float> m_decoded;
+    std::vector<float> m_mono;
+    std::vector<float> m_magnitudes;
+    std::vector<float> m_previousLog;
+    std::vector<float> m_envelope;
+    std::vector<float> m_detrended;
+    std::vector<float> m_autocorrelation;
+    std::vector<uint8_t> m_pitchClasses;
+    uint64_t m_framesDecoded = 0;
+};
+
+struct AnalysisStats
+{
+    size_t tracksAnalyzed = 0;
+    size_t tracksFailed = 0;
+    double audioSeconds = 0.0;   // decoded audio
+    double wallSeconds = 0.0;
+};
+
+// Analyse 'count' tracks opened by 'open(index)' on 'threads' workers (0 =
+// one per hardware thread); the calling thread is one of them. Results land
+// in 'results' by index; failed tracks keep the unknown values. Each worker
+// initializes COM, so 'open' may use Media Foundation, and with
+// 'background' runs in background mode (Windows) to stay behind playback.
+inline AnalysisStats AnalyzeTracks(size_t count, const std::function<std::unique_ptr<AudioSource>(size_t)>& open,
+                                   std::vector<TrackFeatures>& results, unsigned threads = 0,
+                                   const std::atomic<bool>* cancel = nullptr, bool background = false)
+{
+    results.assign(count, TrackFeatures());
+    AnalysisStats total;
+    std::mutex totalMutex;
+    std::atomic<size_t> nextTrack(0);
+
+    unsigned workerCount = threads ? threads : std::thread::hardware_concurrency();
+    if (workerCount == 0) workerCount = 1;
+    if (workerCount > count) workerCount = (unsigned)std::max<size_t>(count, 1);
+
+    auto start = std::chrono::steady_clock::now();
+    auto worker = [&]()
+    {
+#ifdef _WIN32
+        // Media Foundation decoders need COM on every thread that uses them
+        HRESULT hrCom = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+        if (background) SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+#else
+        (void)background;
+#endif
+        FeatureAnalyzer analyzer;
+        AnalysisStats local;
+        for (;;)
+        {
+            if (cancel && cancel->load()) break;
+            size_t index = nextTrack.fetch_add(1);
+            if (index >= count) break;
+
+            std::unique_ptr<AudioSource> source = open(index);
+            if (source && analyzer.Analyze(*source, results[index]))
+                local.tracksAnalyzed++;
+            else
+                local.tracksFailed++;
+            if (source) local.audioSeconds += (double)analyzer.FramesDecoded() / source->Format().sampleRate;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(totalMutex);
+            total.tracksAnalyzed += local.tracksAnalyzed;
+            total.tracksFailed += local.tracksFailed;
+            total.audioSeconds += local.audioSeconds;
+        }
+#ifdef _WIN32
+        // The calling thread goes on after its share
+        if (background) SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_END);
+        if (SUCCEEDED(hrCom)) CoUninitialize();
+#endif
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < workerCount; i++) workers.emplace_back(worker);
+    worker();
+    for (auto& t : workers) t.join();
+
+    total.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return total;
+}
+
+// Playback order for mixing: start from the slowest analysed track and keep
+// taking the track that is closest in key and tempo, preferring a rising
+// tempo so the energy builds. Tracks without features follow in their
+// original order.
+inline std::vector<size_t> OrderForMixing(const std::vector<TrackFeatures>& tracks)
+{
+    std::vector<size_t> order;
+    std::vector<size_t> remaining;
+    std::vector<size_t> unknown;
+    for (size_t i = 0; i < tracks.size(); i++)
+        (tracks[i].bpm > 0.0f ? remaining : unknown).push_back(i);
+
+    if (!remaining.empty())
+    {
+        auto slowest = std::min_element(remaining.begin(), remaining.end(),
+                                        [&](size_t a, size_t b) { return tracks[a].bpm < tracks[b].bpm; });
+        order.push_back(*slowest);
+        remaining.erase(slowest);
+    }
+    while (!remaining.empty())
+    {
+        const TrackFeatures& current = tracks[order.back()];
+        size_t best = 0;
+        double bestCost = 1e30;
+        for (size_t i = 0; i < remaining.size(); i++)
+        {
+            const TrackFeatures& next = tracks[remaining[i]];
+            // Tempo change in semitone-like steps (6% each); half and
+            // double time count as a small change
+            double ratio = next.bpm / current.bpm;
+            double steps = fabs(log2(ratio)) * 12.0;
+            steps = std::min(steps, fabs(fabs(log2(ratio)) - 1.0) * 12.0 + 2.0);
+            double cost = steps + 3.0 * KeyDistance(current.key, next.key);
+            if (ratio < 0.97) cost += 4.0;
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                best = i;
+            }
+        }
+        order.push_back(remaining[best]);
+        remaining.erase(remaining.begin() + best);
+    }
+    order.insert(order.end(), unknown.begin(), unknown.end());
+    return order;
+}
+
+// Test material with a known answer: a drum pattern at 'bpm' (kick on the
+// beat, hi-hat off the beat) under I-IV-V-I (or i-iv-v-i) chords in 'key',
+// generated on the fly from a sine table.
+class SyntheticTrackSource : public AudioSource
+{
+public:
+    SyntheticTrackSource(float bpm, int key, double seconds, uint32_t seed)
+        : m_key(key), m_random(seed)
+    {
+        m_format.sampleRate = 44100;
+        m_format.channels = 2;
+        m_total = (uint64_t)(seconds * m_format.sampleRate);
+        m_beatFrames = 60.0 * m_format.sampleRate / bpm;
+        for (size_t i = 0; i < kTableSize; i++) m_sine[i] = (float)sin(2 * 3.14159265358979323846 * i / kTableSize);
+    }
+
+    const AudioFormat& Format() const override { return m_format; }
+    uint64_t TotalFrames() const override { return m_total; }
+
+    size_t Read(float* out, size_t frames) override
+    {
+        static const int kMajorChords[4][3] = { { 0, 4, 7 }, { 5, 9, 12 }, { 7, 11, 14 }, { 0, 4, 7 } };
+        static const int kMinorChords[4][3] = { { 0, 3, 7 }, { 5, 8, 12 }, { 7, 10, 14 }, { 0, 3, 7 } };
+        const double rate = m_format.sampleRate;
+        const auto& chords = m_key < 12 ? kMajorChords : kMinorChords;
+        const float kickDecay = (float)exp(-25.0 / rate);
+        const float hatDecay = (float)exp(-60.0 / rate);
+        std::uniform_real_distribution<float> noise(-1.0f, 1.0f);
+
+        size_t n = (size_t)std::min<uint64_t>(frames, m_total - m_position);
+        for (size_t i = 0; i < n; i++, m_position++)
+        {
+            // Kick on each beat, hi-hat half way between; chords change every bar
+            double beats = m_position / m_beatFrames;
+            uint64_t halfBeat = (uint64_t)(beats * 2);
+            if (m_position == 0 || halfBeat != m_halfBeat)
+            {
+                m_halfBeat = halfBeat;
+                if (halfBeat % 2 == 0)
+                {
+                    m_kick = 1.0f;
+                    m_kickPhase = 0.0;
+                }
+                else
+                {
+                    m_hat = 1.0f;
+                }
+                const int* chord = chords[(halfBeat / 8) % 4];
+                int tonic = m_key % 12;
+                for (int v = 0; v < 3; v++) m_step[v] = 261.63 * pow(2.0, (tonic + chord[v]) / 12.0) / rate;
+                m_step[3] = 65.41 * pow(2.0, (tonic + chord[0]) / 12.0) / rate;
+            }
+
+            float pad = 0.0f;
+            for (int v = 0; v < 3; v++)
+            {
+                m_phase[v] += m_step[v];
+                m_phase[v] -= floor(m_phase[v]);
+                for (int h = 1; h <= 3; h++) pad += Sine(m_phase[v] * h) / (float)(h * h);
+            }
+            m_phase[3] += m_step[3];
+            m_phase[3] -= floor(m_phase[3]);
+            m_kickPhase += 55.0 / rate;
+
+            float sample = 0.08f * pad + 0.15f * Sine(m_phase[3]) + 0.5f * Sine(m_kickPhase) * m_kick +
+                           0.15f * noise(m_random) * m_hat + 0.01f * noise(m_random);
+            m_kick *= kickDecay;
+            m_hat *= hatDecay;
+            out[i * 2] = sample;
+            out[i * 2 + 1] = sample;
+        }
+        return n;
+    }
+
+    bool Seek(uint64_t frame) override
+    {
+        m_position = std::min(frame, m_total);
+        m_halfBeat = ~0ull;
+        m_kick = m_hat = 0.0f;
+        return true;
+    }
+
+    bool SeeksExactly() const override { return true; }
+
+private:
+    static const size_t kTableSize = 4096;
+
+    float Sine(double phase) const { return m_sine[(size_t)(phase * kTableSize) & (kTableSize - 1)]; }
+
+    AudioFormat m_format;
+    int m_key;
+    double m_beatFrames = 1.0;
+    uint64_t m_total = 0;
+    uint64_t m_position = 0;
+    uint64_t m_halfBeat = ~0ull;
+    double m_phase[4] = {};
+    double m_step[4] = {};
+    double m_kickPhase = 0.0;
+    float m_kick = 0.0f;
+    float m_hat = 0.0f;
+    float m_sine[kTableSize];
+    std::mt19937 m_random;
+};
+
+// Accuracy and throughput over a synthetic corpus on every core. Tempo
+// counts as right within 2%, as an octave error at half or double; key as
+// exact, or as a wheel neighbour (relative or fifth). Returns false if fewer
+// than 90% of tempi are right.
+inline bool BenchmarkMusicAnalysis(size_t tracks = 64, double seconds = 60.0)
+{
+    std::mt19937 random(7);
+    std::vector<float> bpms(tracks);
+    std::vector<int> keys(tracks);
+    for (size_t i = 0; i < tracks; i++)
+    {
+        bpms[i] = std::uniform_real_distribution<float>(70.0f, 180.0f)(random);
+        keys[i] = (int)(random() % 24);
+    }
+
+    std::vector<TrackFeatures> results;
+    AnalysisStats stats = AnalyzeTracks(tracks, [&](size_t i)
+    {
+        return std::unique_ptr<AudioSource>(new SyntheticTrackSource(bpms[i], keys[i], seconds, (uint32_t)i));
+    }, results);
+
+    size_t tempoRight = 0, tempoOctave = 0, keyExact = 0, keyNear = 0;
+    for (size_t i = 0; i < tracks; i++)
+    {
+        float bpm = results[i].bpm;
+        if (fabs(bpm - bpms[i]) <= bpms[i] * 0.02f) tempoRight++;
+        else if (fabs(bpm - 2 * bpms[i]) <= bpms[i] * 0.04f || fabs(bpm - bpms[i] / 2) <= bpms[i] * 0.01f) tempoOctave++;
+        int distance = KeyDistance(results[i].key, keys[i]);
+        if (distance == 0) keyExact++;
+        else if (distance == 1) keyNear++;
+    }
+
+    unsigned cores = std::max(std::thread::hardware_concurrency(), 1u);
+    LogMessage("Analysis: %zu tracks on %u threads, %.1f s audio in %.2f s (%.0fx realtime, %.1f tracks/s)",
+        tracks, cores, stats.audioSeconds, stats.wallSeconds, stats.audioSeconds / stats.wallSeconds, tracks / stats.wallSeconds);
+    LogMessage("Tempo: %zu right, %zu octave errors, %zu wrong", tempoRight, tempoOctave, tracks - tempoRight - tempoOctave);
+    LogMessage("Key: %zu exact, %zu neighbouring, %zu wrong", keyExact, keyNear, tracks - keyExact - keyNear);
+    return tempoRight * 10 >= tracks * 9;
+}
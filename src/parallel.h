@@ -0,0 +1,149 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Number of worker threads to use for 'items' units of work, at least 'grain'
+// items per thread
+inline unsigned WorkerCountFor(size_t items, size_t grain, unsigned maxThreads = 0)
+{
+    unsigned workers = maxThreads ? maxThreads : std::thread::hardware_concurrency();
+    if (workers == 0) workers = 1;
+    size_t useful = grain ? (items + grain - 1) / grain : items;
+    if (useful < workers) workers = (unsigned)std::max<size_t>(useful, 1);
+    return workers;
+}
+
+// Call fn(begin, end) over [0, count) in chunks of 'grain', spread over
+// worker threads. Small inputs run on the calling thread.
+template <class Fn> void ParallelFor(size_t count, size_t grain, Fn fn)
+{
+    if (grain == 0) grain = 1;
+    unsigned workerCount = WorkerCountFor(count, grain);
+    if (workerCount <= 1)
+    {
+        if (count) fn((size_t)0, count);
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]()
+    {
+        for (;;)
+        {
+            size_t begin = next.fetch_add(grain);
+            if (begin >= count) break;
+            fn(begin, std::min(begin + grain, count));
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < workerCount; i++) workers.emplace_back(worker);
+    worker();
+    for (auto& t : workers) t.join();
+}
+
+// Long-lived worker threads for work that is handed out many times a second
+// (a decode batch, say), where starting threads per call as ParallelFor does
+// would cost more than the work itself. Run() calls fn(index) for every index
+// in [0, count), with the calling thread taking a share, and returns once all
+// of them are done. One Run() at a time per pool.
+class WorkerPool
+{
+public:
+    // 'threads' counts the caller too, 0 = one per core
+    explicit WorkerPool(unsigned threads = 0)
+    {
+        if (threads == 0) threads = std::max(std::thread::hardware_concurrency(), 1u);
+        for (unsigned i = 1; i < threads; i++) m_threads.emplace_back(&WorkerPool::WorkerLoop, this);
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_wake.notify_all();
+        for (auto& t : m_threads) t.join();
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    unsigned Threads() const { return (unsigned)m_threads.size() + 1; }
+
+    template <class Fn> void Run(size_t count, Fn fn)
+    {
+        if (m_threads.empty() || count <= 1)
+        {
+            for (size_t i = 0; i < count; i++) fn(i);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_call = [](void* context, size_t index) { (*(Fn*)context)(index); };
+            m_context = &fn;
+            m_count = count;
+            m_next = 0;
+            m_pending = m_threads.size();
+            m_generation++;
+        }
+        m_wake.notify_all();
+        Work();
+
+        // Every worker must be done with this job before its state is reused
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle.wait(lock, [this]() { return m_pending == 0; });
+    }
+
+private:
+    void Work()
+    {
+        for (;;)
+        {
+            size_t index = m_next.fetch_add(1);
+            if (index >= m_count) break;
+            m_call(m_context, index);
+        }
+    }
+
+    void WorkerLoop()
+    {
+        uint64_t seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [&]() { return m_quit || m_generation != seen; });
+                if (m_quit) return;
+                seen = m_generation;
+            }
+            Work();
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (--m_pending == 0) m_idle.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_idle;
+    bool m_quit = false;
+    uint64_t m_generation = 0;
+    size_t m_pending = 0;
+
+    void (*m_call)(void*, size_t) = nullptr;
+    void* m_context = nullptr;
+    size_t m_count = 0;
+    std::atomic<size_t> m_next{ 0 };
+};
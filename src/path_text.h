@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cwctype>
+#include <string>
+#include <string_view>
+
+// Lexical path handling on plain strings. std::filesystem::path does the same
+// job but allocates per component, which dominates when a playlist or library
+// scan touches a million paths.
+
+#ifdef _WIN32
+const wchar_t kPathSeparator = L'\\';
+#else
+const wchar_t kPathSeparator = L'/';
+#endif
+
+inline bool IsPathSeparator(wchar_t ch)
+{
+#ifdef _WIN32
+    return ch == L'\\' || ch == L'/';
+#else
+    return ch == L'/';
+#endif
+}
+
+// Length of the root part: "C:\", "\\server\share\", "/" or 0 for relative paths
+inline size_t PathRootLength(std::wstring_view path)
+{
+#ifdef _WIN32
+    if (path.size() >= 2 && IsPathSeparator(path[0]) && IsPathSeparator(path[1]))
+    {
+        // UNC: the server and share names are part of the root
+        size_t i = 2;
+        for (int part = 0; part < 2; part++)
+        {
+            while (i < path.size() && !IsPathSeparator(path[i])) i++;
+            if (i < path.size()) i++;
+        }
+        return i;
+    }
+    if (path.size() >= 2 && path[1] == L':') return path.size() >= 3 && IsPathSeparator(path[2]) ? 3 : 2;
+#endif
+    return !path.empty() && IsPathSeparator(path[0]) ? 1 : 0;
+}
+
+inline bool IsAbsolutePathText(std::wstring_view path)
+{
+#ifdef _WIN32
+    size_t root = PathRootLength(path);
+    return root > 0 && IsPathSeparator(path[root - 1]);
+#else
+    return PathRootLength(path) > 0;
+#endif
+}
+
+// Fold "." and "name\.." segments and repeated separators, and use the
+// platform separator throughout
+inline std::wstring NormalizePathText(std::wstring_view path)
+{
+    size_t rootLength = PathRootLength(path);
+    std::wstring out(path.substr(0, rootLength));
+    for (auto& ch : out)
+    {
+        if (IsPathSeparator(ch)) ch = kPathSeparator;
+    }
+    bool rooted = rootLength > 0 && IsPathSeparator(path[rootLength - 1]);
+
+    // Start offsets (within 'out') of the segments kept so far; deeper paths
+    // than this are far past any file system's length limit
+    size_t segmentStarts[256];
+    size_t depth = 0;
+
+    size_t i = rootLength;
+    while (i < path.size())
+    {
+        size_t end = i;
+        while (end < path.size() && !IsPathSeparator(path[end])) end++;
+        std::wstring_view segment = path.substr(i, end - i);
+        i = end + 1;
+
+        if (segment.empty() || segment == L".") continue;
+        if (segment == L"..")
+        {
+            bool previousIsParent = depth > 0 && std::wstring_view(out).substr(segmentStarts[depth - 1]) == L"..";
+            if (depth > 0 && !previousIsParent)
+            {
+                depth--;
+                out.resize(segmentStarts[depth] > rootLength ? segmentStarts[depth] - 1 : rootLength);
+                continue;
+            }
+            if (rooted) continue; // ".." above the root stays at the root
+        }
+
+        if (out.size() > rootLength) out.push_back(kPathSeparator);
+        if (depth < 256) segmentStarts[depth++] = out.size();
+        out.append(segment);
+    }
+    return out;
+}
+
+// Resolve 'path' against 'baseFolder' unless it is already absolute
+inline std::wstring ResolvePathText(std::wstring_view baseFolder, std::wstring_view path)
+{
+    if (IsAbsolutePathText(path)) return NormalizePathText(path);
+
+    std::wstring joined;
+#ifdef _WIN32
+    // "\Music\a.mp3" is relative to the drive of the base folder
+    if (!path.empty() && IsPathSeparator(path[0]))
+    {
+        size_t root = PathRootLength(baseFolder);
+        joined.assign(baseFolder.substr(0, root > 0 && IsPathSeparator(baseFolder[root - 1]) ? root - 1 : root));
+        joined.append(path);
+        return NormalizePathText(joined);
+    }
+#endif
+    joined.reserve(baseFolder.size() + 1 + path.size());
+    joined.assign(baseFolder);
+    joined.push_back(kPathSeparator);
+    joined.append(path);
+    return NormalizePathText(joined);
+}
+
+// Path relative to 'baseFolder' if 'path' lies inside it, otherwise empty.
+// Both paths must already be normalized.
+inline std::wstring RelativePathText(std::wstring_view baseFolder, std::wstring_view path)
+{
+    if (baseFolder.empty() || path.size() <= baseFolder.size() + 1) return std::wstring();
+    if (!IsPathSeparator(path[baseFolder.size()]) && !IsPathSeparator(baseFolder.back())) return std::wstring();
+
+    for (size_t i = 0; i < baseFolder.size(); i++)
+    {
+        wchar_t a = path[i], b = baseFolder[i];
+        if (IsPathSeparator(a) && IsPathSeparator(b)) continue;
+#ifdef _WIN32
+        if (towlower(a) != towlower(b)) return std::wstring();
+#else
+        if (a != b) return std::wstring();
+#endif
+    }
+    size_t start = IsPathSeparator(baseFolder.back()) ? baseFolder.size() : baseFolder.size() + 1;
+    return std::wstring(path.substr(start));
+}
@@ -0,0 +1,480 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwctype>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "library_index.h"
+#include "mapped_file.h"
+#include "parallel.h"
+#include "path_text.h"
+#include "utf8.h"
+
+// Saved playlists.
+//
+// The native format (.wmpl) is laid out so a memory-mapped file can be used
+// in place: a fixed header, a table of count + 1 string offsets and one blob
+// of UTF-8 paths. Entry i is blob[offsets[i], offsets[i + 1]). All fields are
+// little-endian, which is also the byte order of every platform we build for,
+// so the table is read straight out of the mapping.
+//
+// M3U/M3U8/PLS are supported for exchange with other players.
+
+struct PlaylistFileHeader
+{
+    char magic[4];          // "WMPL"
+    uint32_t version;
+    uint64_t entryCount;
+    uint64_t offsetsPos;    // file position of uint64_t offsets[entryCount + 1]
+    uint64_t stringsPos;    // file position of the path blob
+    uint64_t stringBytes;
+};
+static_assert(sizeof(PlaylistFileHeader) == 40, "playlist header must stay packed");
+
+const uint32_t kPlaylistFileVersion = 1;
+
+// Read-only view of a mapped .wmpl file
+class PlaylistView
+{
+public:
+    bool Open(const std::filesystem::path& path)
+    {
+        m_count = 0;
+        if (!m_file.Open(path)) return false;
+        if (m_file.Size() < sizeof(PlaylistFileHeader)) return false;
+
+        PlaylistFileHeader header;
+        memcpy(&header, m_file.Data(), sizeof(header));
+        if (memcmp(header.magic, "WMPL", 4) != 0 || header.version != kPlaylistFileVersion) return false;
+
+        // Bounds-check every section before handing out pointers into the map
+        uint64_t size = m_file.Size();
+        if (header.entryCount > size / sizeof(uint64_t)) return false;
+        uint64_t tableBytes = (header.entryCount + 1) * sizeof(uint64_t);
+        if (header.offsetsPos % sizeof(uint64_t) != 0 || header.offsetsPos > size || tableBytes > size - header.offsetsPos) return false;
+        if (header.stringsPos > size || header.stringBytes > size - header.stringsPos) return false;
+
+        m_offsets = reinterpret_cast<const uint64_t*>(m_file.Data() + header.offsetsPos);
+        m_strings = reinterpret_cast<const char*>(m_file.Data() + header.stringsPos);
+        if (m_offsets[0] != 0 || m_offsets[header.entryCount] != header.stringBytes) return false;
+        for (uint64_t i = 0; i < header.entryCount; i++)
+        {
+            if (m_offsets[i + 1] < m_offsets[i]) return false;
+        }
+
+        m_count = (size_t)header.entryCount;
+        return true;
+    }
+
+    size_t Count() const { return m_count; }
+
+    std::string_view Entry(size_t index) const
+    {
+        return std::string_view(m_strings + m_offsets[index], (size_t)(m_offsets[index + 1] - m_offsets[index]));
+    }
+
+private:
+    MappedFile m_file;
+    const uint64_t* m_offsets = nullptr;
+    const char* m_strings = nullptr;
+    size_t m_count = 0;
+};
+
+// Load a .wmpl file into 'entries'
+inline bool LoadPlaylistFile(const std::filesystem::path& path, std::vector<std::wstring>& entries)
+{
+    PlaylistView view;
+    if (!view.Open(path)) return false;
+
+    entries.clear();
+    entries.resize(view.Count());
+    ParallelFor(view.Count(), 16384, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++) Utf8ToWide(view.Entry(i), entries[i]);
+    });
+    return true;
+}
+
+// Write 'entries' as a .wmpl file. The file is written beside 'path' and
+// renamed into place so a failed save never leaves a truncated playlist.
+inline bool SavePlaylistFile(const std::filesystem::path& path, const std::vector<std::wstring>& entries)
+{
+    const size_t kChunk = 16384;
+    size_t chunkCount = (entries.size() + kChunk - 1) / kChunk;
+    std::vector<std::string> blobs(chunkCount);
+    std::vector<uint64_t> offsets(entries.size() + 1, 0);
+
+    // Encode chunks in parallel, recording each entry's end within its chunk
+    ParallelFor(chunkCount, 1, [&](size_t beginChunk, size_t endChunk)
+    {
+        for (size_t c = beginChunk; c < endChunk; c++)
+        {
+            size_t end = std::min((c + 1) * kChunk, entries.size());
+            for (size_t i = c * kChunk; i < end; i++)
+            {
+                AppendUtf8(blobs[c], entries[i]);
+                offsets[i + 1] = blobs[c].size();
+            }
+        }
+    });
+
+    // Turn per-chunk ends into absolute offsets
+    uint64_t base = 0;
+    for (size_t c = 0; c < chunkCount; c++)
+    {
+        size_t end = std::min((c + 1) * kChunk, entries.size());
+        for (size_t i = c * kChunk; i < end; i++) offsets[i + 1] += base;
+        base += blobs[c].size();
+    }
+
+    PlaylistFileHeader header = {};
+    memcpy(header.magic, "WMPL", 4);
+    header.version = kPlaylistFileVersion;
+    header.entryCount = entries.size();
+    header.offsetsPos = sizeof(PlaylistFileHeader);
+    header.stringsPos = header.offsetsPos + offsets.size() * sizeof(uint64_t);
+    header.stringBytes = base;
+
+    std::filesystem::path tempPath = path;
+    tempPath += L".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file) return false;
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)offsets.data(), offsets.size() * sizeof(uint64_t));
+        for (const auto& blob : blobs) file.write(blob.data(), blob.size());
+        if (!file.flush()) return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tempPath, path, ec);
+    if (ec)
+    {
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+    return true;
+}
+
+// M3U/M3U8/PLS
+
+struct PlaylistImportStats
+{
+    size_t lines = 0;        // entry lines read from the file
+    size_t entries = 0;      // entries added to the playlist
+    size_t duplicates = 0;   // entries dropped because the track was already listed
+    double seconds = 0.0;
+};
+
+inline bool IsPlsPlaylist(const std::filesystem::path& path)
+{
+    std::wstring ext = path.extension().wstring();
+    for (auto& ch : ext) ch = (wchar_t)towlower(ch);
+    return ext == L".pls";
+}
+
+inline bool StartsWithNoCase(std::string_view text, const char* prefix)
+{
+    size_t length = strlen(prefix);
+    if (text.size() < length) return false;
+    for (size_t i = 0; i < length; i++)
+    {
+        if (tolower((unsigned char)text[i]) != prefix[i]) return false;
+    }
+    return true;
+}
+
+// Decode one playlist line: UTF-8 when valid, otherwise Windows-1252 as
+// written by older players
+inline void DecodePlaylistText(std::string_view text, std::wstring& out)
+{
+    if (!Utf8ToWide(text, out)) Cp1252ToWide(text, out);
+}
+
+// Turn a "file://" URI into a local path, undoing percent escapes
+inline std::string FileUriToPath(std::string_view uri)
+{
+    std::string_view rest = uri.substr(7);
+    if (StartsWithNoCase(rest, "localhost/")) rest.remove_prefix(9);
+#ifdef _WIN32
+    if (rest.size() >= 3 && rest[0] == '/' && rest[2] == ':') rest.remove_prefix(1); // "/C:/..."
+#endif
+
+    auto hex = [](char ch) -> int
+    {
+        if (ch >= '0' && ch <= '9') return ch - '0';
+        if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+        if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+        return -1;
+    };
+
+    std::string path;
+    path.reserve(rest.size());
+    for (size_t i = 0; i < rest.size(); i++)
+    {
+        if (rest[i] == '%' && i + 2 < rest.size() && hex(rest[i + 1]) >= 0 && hex(rest[i + 2]) >= 0)
+        {
+            path.push_back((char)(hex(rest[i + 1]) * 16 + hex(rest[i + 2])));
+            i += 2;
+        }
+        else
+        {
+            path.push_back(rest[i]);
+        }
+    }
+    return path;
+}
+
+// Lines are parsed on the reading thread and resolved on workers in batches
+struct PlaylistImportBatch
+{
+    std::vector<std::string> lines;
+    std::vector<uint32_t> order;        // PLS "FileN" number, line number for M3U
+    std::vector<std::wstring> paths;
+    std::vector<std::wstring> keys;
+};
+
+// Resolve a raw entry against the playlist's folder and compute its library key
+inline void ResolvePlaylistEntry(std::string_view line, const std::wstring& baseFolder, std::wstring& path, std::wstring& key)
+{
+    std::string local;
+    if (StartsWithNoCase(line, "file://"))
+    {
+        local = FileUriToPath(line);
+        line = local;
+    }
+    else if (line.find("://") != std::string_view::npos)
+    {
+        // Stream URL: keep as written
+        DecodePlaylistText(line, path);
+        key = LibraryIndex::KeyFromNormalized(path);
+        return;
+    }
+
+    std::wstring text;
+    DecodePlaylistText(line, text);
+    path = ResolvePathText(baseFolder, text);
+    key = LibraryIndex::KeyFromNormalized(path);
+}
+
+// Import an M3U, M3U8 or PLS file into 'entries'. Relative paths are resolved
+// against the playlist's folder, each track is registered in 'library', and a
+// track that appears more than once is only kept the first time.
+inline bool ImportPlaylistText(const std::filesystem::path& playlistPath, LibraryIndex& library,
+                               std::vector<std::wstring>& entries, PlaylistImportStats* pStats = nullptr)
+{
+    const size_t kBatchLines = 8192;
+    const size_t kReadBytes = 1 << 20;
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::ifstream file(playlistPath, std::ios::binary);
+    if (!file) return false;
+
+    const bool isPls = IsPlsPlaylist(playlistPath);
+    const std::wstring baseFolder = NormalizePathText(std::filesystem::absolute(playlistPath).parent_path().wstring());
+
+    std::vector<std::unique_ptr<PlaylistImportBatch>> batches;
+    size_t nextBatch = 0;
+    bool doneReading = false;
+    std::mutex batchMutex;
+    std::condition_variable batchReady;
+
+    // Workers resolve batches while the file is still being read
+    auto worker = [&]()
+    {
+        for (;;)
+        {
+            PlaylistImportBatch* batch = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(batchMutex);
+                batchReady.wait(lock, [&]() { return nextBatch < batches.size() || doneReading; });
+                if (nextBatch == batches.size()) return;
+                batch = batches[nextBatch++].get();
+            }
+
+            batch->paths.resize(batch->lines.size());
+            batch->keys.resize(batch->lines.size());
+            for (size_t i = 0; i < batch->lines.size(); i++)
+                ResolvePlaylistEntry(batch->lines[i], baseFolder, batch->paths[i], batch->keys[i]);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    unsigned workerCount = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i = 0; i < workerCount; i++) workers.emplace_back(worker);
+
+    auto submit = [&](std::unique_ptr<PlaylistImportBatch>& batch)
+    {
+        if (!batch || batch->lines.empty()) return;
+        {
+            std::lock_guard<std::mutex> lock(batchMutex);
+            batches.push_back(std::move(batch));
+        }
+        batchReady.notify_one();
+    };
+
+    std::unique_ptr<PlaylistImportBatch> current = std::make_unique<PlaylistImportBatch>();
+    uint32_t lineNumber = 0;
+    auto addLine = [&](std::string_view line)
+    {
+        if (lineNumber == 0 && line.size() >= 3 && memcmp(line.data(), "\xEF\xBB\xBF", 3) == 0) line.remove_prefix(3);
+        lineNumber++;
+
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' ' || line.back() == '\t')) line.remove_suffix(1);
+        while (!line.empty() && (line.front() == ' ' || line.front() == '\t')) line.remove_prefix(1);
+        if (line.empty()) return;
+
+        uint32_t order = lineNumber;
+        if (isPls)
+        {
+            // Only "FileN=path" lines carry entries
+            if (!StartsWithNoCase(line, "file")) return;
+            size_t equals = line.find('=');
+            if (equals == std::string_view::npos) return;
+            order = (uint32_t)strtoul(std::string(line.substr(4, equals - 4)).c_str(), nullptr, 10);
+            line.remove_prefix(equals + 1);
+            if (line.empty()) return;
+        }
+        else if (line[0] == '#')
+        {
+            return; // #EXTM3U, #EXTINF and other directives
+        }
+
+        current->lines.emplace_back(line);
+        current->order.push_back(order);
+        if (current->lines.size() == kBatchLines)
+        {
+            submit(current);
+            current = std::make_unique<PlaylistImportBatch>();
+        }
+    };
+
+    // Stream the file in large reads, carrying the partial last line over
+    std::vector<char> buffer(kReadBytes);
+    std::string carry;
+    while (file)
+    {
+        file.read(buffer.data(), buffer.size());
+        size_t got = (size_t)file.gcount();
+        if (got == 0) break;
+
+        size_t lineStart = 0;
+        for (size_t i = 0; i < got; i++)
+        {
+            if (buffer[i] != '\n') continue;
+            if (carry.empty())
+            {
+                addLine(std::string_view(buffer.data() + lineStart, i - lineStart));
+            }
+            else
+            {
+                carry.append(buffer.data() + lineStart, i - lineStart);
+                addLine(carry);
+                carry.clear();
+            }
+            lineStart = i + 1;
+        }
+        carry.append(buffer.data() + lineStart, got - lineStart);
+    }
+    if (!carry.empty()) addLine(carry);
+    submit(current);
+
+    {
+        std::lock_guard<std::mutex> lock(batchMutex);
+        doneReading = true;
+    }
+    batchReady.notify_all();
+    for (auto& t : workers) t.join();
+
+    // Merge in file order (PLS: by entry number) and drop repeats
+    struct Resolved
+    {
+        uint32_t order;
+        std::wstring* path;
+        std::wstring* key;
+    };
+    std::vector<Resolved> resolved;
+    for (auto& batch : batches)
+    {
+        for (size_t i = 0; i < batch->lines.size(); i++)
+            resolved.push_back({ batch->order[i], &batch->paths[i], &batch->keys[i] });
+    }
+    if (isPls)
+        std::stable_sort(resolved.begin(), resolved.end(), [](const Resolved& a, const Resolved& b) { return a.order < b.order; });
+
+    PlaylistImportStats stats;
+    stats.lines = resolved.size();
+    std::vector<bool> listed(library.Count(), false);
+    for (const auto& entry : resolved)
+    {
+        uint32_t id = library.Add(std::move(*entry.path), std::move(*entry.key));
+        if (id >= listed.size()) listed.resize(id + 1, false);
+        if (listed[id])
+        {
+            stats.duplicates++;
+            continue;
+        }
+        listed[id] = true;
+        entries.push_back(library.Path(id));
+    }
+
+    stats.entries = stats.lines - stats.duplicates;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (pStats) *pStats = stats;
+    return true;
+}
+
+// Write 'entries' as M3U8 (any extension but .pls) or PLS. Tracks inside the
+// playlist's folder are written relative to it so the folder can be moved.
+inline bool ExportPlaylistText(const std::filesystem::path& playlistPath, const std::vector<std::wstring>& entries)
+{
+    const size_t kChunk = 8192;
+    const bool isPls = IsPlsPlaylist(playlistPath);
+    const std::wstring baseFolder = NormalizePathText(std::filesystem::absolute(playlistPath).parent_path().wstring());
+
+    size_t chunkCount = (entries.size() + kChunk - 1) / kChunk;
+    std::vector<std::string> chunks(chunkCount);
+    ParallelFor(chunkCount, 1, [&](size_t beginChunk, size_t endChunk)
+    {
+        for (size_t c = beginChunk; c < endChunk; c++)
+        {
+            std::string& out = chunks[c];
+            size_t end = std::min((c + 1) * kChunk, entries.size());
+            for (size_t i = c * kChunk; i < end; i++)
+            {
+                std::wstring relative = RelativePathText(baseFolder, entries[i]);
+
+                if (isPls)
+                {
+                    char prefix[32];
+                    snprintf(prefix, sizeof(prefix), "File%zu=", i + 1);
+                    out += prefix;
+                }
+                AppendUtf8(out, relative.empty() ? entries[i] : relative);
+                out += '\n';
+            }
+        }
+    });
+
+    std::ofstream file(playlistPath, std::ios::binary | std::ios::trunc);
+    if (!file) return false;
+
+    file << (isPls ? "[playlist]\n" : "#EXTM3U\n");
+    for (const auto& chunk : chunks) file.write(chunk.data(), chunk.size());
+    if (isPls) file << "NumberOfEntries=" << entries.size() << "\nVersion=2\n";
+    return (bool)file.flush();
+}
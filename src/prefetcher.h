@@ -0,0 +1,329 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "log.h"
+#include "utf8.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+// Background read-ahead of the next few playlist entries. Opening a track on
+// a sleeping NAS share can stall for seconds; reading the start of the
+// upcoming files ahead of time moves that wait off the play path. Data goes
+// through the OS file cache (the decoders open the files themselves), so
+// the prefetcher only issues large sequential reads with access hints and
+// throws the bytes away.
+
+struct PrefetchSettings
+{
+    size_t lookahead = 3;                       // upcoming tracks to warm
+    uint64_t bytesPerTrack = 8ull << 20;        // leading bytes read from each track
+    uint64_t budgetBytes = 24ull << 20;         // across all upcoming tracks
+    size_t chunkBytes = 1 << 20;                // size of one sequential read
+    uint64_t bytesPerSecond = 16ull << 20;      // throttle so playback reads keep priority
+};
+
+enum class PrefetchState
+{
+    Cold,       // nothing read yet
+    Partial,    // reading in progress
+    Warm        // the leading bytes are cached
+};
+
+// Open timings by how warm the file was
+struct PrefetchOpenStats
+{
+    uint64_t opens = 0;
+    double totalMilliseconds = 0.0;
+    double maxMilliseconds = 0.0;
+};
+
+class TrackPrefetcher
+{
+public:
+    ~TrackPrefetcher() { Stop(); }
+
+    void Start(const PrefetchSettings& settings = PrefetchSettings())
+    {
+        Stop();
+        m_settings = settings;
+        m_quit = false;
+        m_thread = std::thread(&TrackPrefetcher::WorkerLoop, this);
+    }
+
+    void Stop()
+    {
+        if (!m_thread.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_wake.notify_all();
+        m_thread.join();
+    }
+
+    // Replace the upcoming tracks, nearest first. Progress on tracks that
+    // are still upcoming is kept; the rest is forgotten.
+    void SetUpcoming(const std::vector<std::wstring>& paths)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<Entry> entries;
+        for (size_t i = 0; i < paths.size() && entries.size() < m_settings.lookahead; i++)
+        {
+            auto existing = std::find_if(m_entries.begin(), m_entries.end(), [&](const Entry& e) { return e.path == paths[i]; });
+            if (existing != m_entries.end())
+            {
+                entries.push_back(*existing);
+            }
+            else
+            {
+                Entry entry;
+                entry.path = paths[i];
+                entries.push_back(entry);
+            }
+        }
+        m_entries.swap(entries);
+        m_wake.notify_one();
+    }
+
+    PrefetchState State(const std::wstring& path) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& entry : m_entries)
+        {
+            if (entry.path != path) continue;
+            if (entry.done && !entry.failed) return PrefetchState::Warm;
+            return entry.bytesRead > 0 ? PrefetchState::Partial : PrefetchState::Cold;
+        }
+        return PrefetchState::Cold;
+    }
+
+    // Time from starting to open a track to its first decoded bytes, by
+    // the state State() reported just before the open
+    void RecordOpen(PrefetchState state, double milliseconds)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        PrefetchOpenStats& stats = m_openStats[(int)state];
+        stats.opens++;
+        stats.totalMilliseconds += milliseconds;
+        if (milliseconds > stats.maxMilliseconds) stats.maxMilliseconds = milliseconds;
+    }
+
+    void LogReport() const
+    {
+        static const char* kNames[3] = { "cold", "partly prefetched", "prefetched" };
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (int i = 0; i < 3; i++)
+        {
+            const PrefetchOpenStats& stats = m_openStats[i];
+            if (stats.opens == 0) continue;
+            LogMessage("Time to first byte, %s: %.1f ms average, %.1f ms worst over %llu opens", kNames[i],
+                stats.totalMilliseconds / stats.opens, stats.maxMilliseconds, (unsigned long long)stats.opens);
+        }
+        LogMessage("Prefetcher: %.1f MB read", m_totalBytesRead / (1024.0 * 1024.0));
+    }
+
+private:
+    struct Entry
+    {
+        std::wstring path;
+        uint64_t bytesRead = 0;
+        uint64_t target = 0;    // known once the file is opened
+        bool done = false;
+        bool failed = false;
+    };
+
+    // One file opened for sequential reading with read-ahead hints
+    class PrefetchFile
+    {
+    public:
+        ~PrefetchFile() { Close(); }
+
+        bool Open(const std::wstring& path, uint64_t hintBytes, uint64_t& size)
+        {
+            Close();
+#ifdef _WIN32
+            m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                 NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+            if (m_file == INVALID_HANDLE_VALUE) return false;
+            LARGE_INTEGER fileSize;
+            if (!GetFileSizeEx(m_file, &fileSize))
+            {
+                Close();
+                return false;
+            }
+            size = (uint64_t)fileSize.QuadPart;
+            (void)hintBytes; // FILE_FLAG_SEQUENTIAL_SCAN is the hint: the cache manager reads further ahead
+#else
+            m_fd = open(WideToUtf8(path).c_str(), O_RDONLY);
+            if (m_fd < 0) return false;
+            struct stat info;
+            if (fstat(m_fd, &info) != 0)
+            {
+                Close();
+                return false;
+            }
+            size = (uint64_t)info.st_size;
+            // Ask for aggressive read-ahead and start fetching the range now
+            posix_fadvise(m_fd, 0, (off_t)hintBytes, POSIX_FADV_SEQUENTIAL);
+            posix_fadvise(m_fd, 0, (off_t)hintBytes, POSIX_FADV_WILLNEED);
+#endif
+            return true;
+        }
+
+        // Bytes read, 0 at end of file, -1 on error
+        long long Read(void* buffer, size_t bytes)
+        {
+#ifdef _WIN32
+            DWORD read = 0;
+            if (!ReadFile(m_file, buffer, (DWORD)bytes, &read, NULL)) return -1;
+            return read;
+#else
+            ssize_t result = read(m_fd, buffer, bytes);
+            return result;
+#endif
+        }
+
+        void Close()
+        {
+#ifdef _WIN32
+            if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+            m_file = INVALID_HANDLE_VALUE;
+#else
+            if (m_fd >= 0) close(m_fd);
+            m_fd = -1;
+#endif
+        }
+
+    private:
+#ifdef _WIN32
+        HANDLE m_file = INVALID_HANDLE_VALUE;
+#else
+        int m_fd = -1;
+#endif
+    };
+
+    static void LowerIoPriority()
+    {
+#ifdef _WIN32
+        // Very low I/O and CPU priority for this thread
+        SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+#elif defined(__linux__)
+        // ioprio_set(IOPRIO_WHO_PROCESS, this thread, IOPRIO_CLASS_IDLE)
+        syscall(SYS_ioprio_set, 1, 0, 3 << 13);
+#endif
+    }
+
+    void WorkerLoop()
+    {
+        LowerIoPriority();
+        std::vector<char> buffer(m_settings.chunkBytes);
+        PrefetchFile file;
+        std::wstring openPath;
+        auto windowStart = std::chrono::steady_clock::now();
+        uint64_t windowBytes = 0;
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_quit)
+        {
+            // Nearest upcoming track with bytes left, within the total budget
+            uint64_t budgetUsed = 0;
+            for (const auto& entry : m_entries) budgetUsed += entry.bytesRead;
+            Entry* next = nullptr;
+            for (auto& entry : m_entries)
+            {
+                if (!entry.done)
+                {
+                    next = &entry;
+                    break;
+                }
+            }
+            if (!next || budgetUsed >= m_settings.budgetBytes)
+            {
+                file.Close();
+                openPath.clear();
+                m_wake.wait(lock);
+                continue;
+            }
+
+            std::wstring path = next->path;
+            uint64_t offset = next->bytesRead;
+            uint64_t target = next->target;
+            lock.unlock();
+
+            long long read = -1;
+            if (path != openPath || offset == 0)
+            {
+                // Switching tracks restarts the read: cached pages make the
+                // repeated part cheap
+                uint64_t size = 0;
+                openPath.clear();
+                if (file.Open(path, m_settings.bytesPerTrack, size))
+                {
+                    openPath = path;
+                    target = std::min<uint64_t>(size, m_settings.bytesPerTrack);
+                    offset = 0;
+                }
+            }
+            if (!openPath.empty())
+            {
+                size_t chunk = (size_t)std::min<uint64_t>(m_settings.chunkBytes, target > offset ? target - offset : 0);
+                read = chunk > 0 ? file.Read(buffer.data(), chunk) : 0;
+            }
+
+            lock.lock();
+            for (auto& entry : m_entries)
+            {
+                if (entry.path != path) continue;
+                entry.target = target;
+                entry.bytesRead = offset + (read > 0 ? (uint64_t)read : 0);
+                entry.failed = read < 0;
+                entry.done = read <= 0 || entry.bytesRead >= target;
+                if (entry.done && read < 0) LogMessage("Prefetch failed for %s", WideToUtf8(path).c_str());
+            }
+            if (read > 0)
+            {
+                m_totalBytesRead += (uint64_t)read;
+                windowBytes += (uint64_t)read;
+            }
+
+            // Hold the average rate under the limit
+            auto now = std::chrono::steady_clock::now();
+            double elapsed = std::chrono::duration<double>(now - windowStart).count();
+            double allowed = (double)windowBytes / m_settings.bytesPerSecond;
+            if (allowed > elapsed)
+            {
+                m_wake.wait_for(lock, std::chrono::duration<double>(allowed - elapsed));
+            }
+            if (elapsed > 1.0)
+            {
+                windowStart = now;
+                windowBytes = 0;
+            }
+        }
+    }
+
+    PrefetchSettings m_settings;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::thread m_thread;
+    bool m_quit = false;
+    std::vector<Entry> m_entries;
+    PrefetchOpenStats m_openStats[3];
+    uint64_t m_totalBytesRead = 0;
+};
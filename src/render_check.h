@@ -0,0 +1,416 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "audio_engine.h"
+#include "audio_sink.h"
+#include "log.h"
+#include "md5.h"
+#include "render_golden.h"
+#include "wav_file.h"
+
+// Render regression check: a scripted scenario (track changes, seeks,
+// volume, EQ, speed, pause) is played through AudioEngine on a simulated
+// clock, every block of output is hashed, and the hashes are compared with
+// the golden checksums in render_golden.h. Decode work runs synchronously
+// before each block and the read-ahead is kept full, so a run does not
+// depend on thread timing and two runs of the same build are bit for bit
+// identical. Any change to decoding, resampling, stretching, mixing or the
+// DSP chain that alters a single sample shows up as a changed step.
+//
+// Goldens are kept per platform: the resampler, EQ and limiter designs use
+// libm, and compilers differ in floating-point code generation.
+
+struct RenderCheckStep
+{
+    std::string name;
+    std::string md5;        // of the float output, hex
+    uint64_t frames = 0;
+};
+
+struct RenderCheckRun
+{
+    std::vector<RenderCheckStep> steps;
+    uint64_t frames = 0;
+    uint64_t underruns = 0;
+    double decodeSeconds = 0.0;     // decode, resample and stretch
+    double renderSeconds = 0.0;     // Render(): mixing, volume and DSP
+};
+
+// "<os>-<compiler>-<architecture>", the key of a set of goldens
+inline std::string RenderPlatformTag()
+{
+    std::string tag;
+#if defined(_WIN32)
+    tag = "windows";
+#elif defined(__APPLE__)
+    tag = "macos";
+#elif defined(__linux__)
+    tag = "linux";
+#else
+    tag = "unknown";
+#endif
+#if defined(_MSC_VER) && !defined(__clang__)
+    tag += "-msvc";
+#elif defined(__clang__)
+    tag += "-clang";
+#elif defined(__GNUC__)
+    tag += "-gcc";
+#endif
+#if defined(_M_X64) || defined(__x86_64__)
+    tag += "-x64";
+#elif defined(_M_IX86) || defined(__i386__)
+    tag += "-x86";
+#elif defined(_M_ARM64) || defined(__aarch64__)
+    tag += "-arm64";
+#endif
+    return tag;
+}
+
+// Input tracks from integer arithmetic only (triangle waves and LCG noise),
+// so they are the same on every platform
+inline bool WriteRenderCheckTrack(const std::filesystem::path& path, uint32_t sampleRate, uint32_t channels,
+                                  bool writeFloat, double seconds, uint32_t seed)
+{
+    WavWriter writer;
+    if (!writer.Open(path, sampleRate, channels, writeFloat)) return false;
+    std::vector<float> block(4096 * channels);
+    uint32_t phase[2] = { 0, 0 };
+    const uint32_t increment[2] = { 40000000u + seed * 7000000u, 61000000u + seed * 5000000u };
+    uint32_t noise = seed * 2654435761u + 1;
+    size_t total = (size_t)(seconds * sampleRate);
+    for (size_t done = 0; done < total;)
+    {
+        size_t n = std::min<size_t>(4096, total - done);
+        for (size_t i = 0; i < n; i++)
+        {
+            for (uint32_t c = 0; c < channels; c++)
+            {
+                phase[c & 1] += increment[c & 1];
+                int32_t p = (int32_t)(phase[c & 1] >> 16);
+                int32_t triangle = p < 32768 ? p : 65535 - p;
+                noise = noise * 1664525u + 1013904223u;
+                int32_t hiss = (int32_t)(noise >> 22) - 512;
+                block[i * channels + c] = (float)(triangle - 16384) * (0.6f / 16384.0f) + (float)hiss * (0.02f / 512.0f);
+            }
+        }
+        if (!writer.Write(block.data(), n)) return false;
+        done += n;
+    }
+    writer.Close();
+    return true;
+}
+
+// The sink of the simulated clock: the scenario calls Render() itself
+class RenderCheckSink : public AudioSink
+{
+public:
+    static const uint32_t kSampleRate = 48000;
+    static const uint32_t kChannels = 2;
+
+    uint32_t SampleRate() const override { return kSampleRate; }
+    uint32_t Channels() const override { return kChannels; }
+    bool Start() override { return m_running = true; }
+    void Stop() override { m_running = false; }
+    bool Running() const { return m_running; }
+
+private:
+    bool m_running = false;
+};
+
+// Decoding happens only when the scenario calls Service()
+class RenderCheckDriver : public DecodeDriver
+{
+public:
+    void Attach(AudioEngine*) override {}
+    void Detach(AudioEngine*) override {}
+    void Wake(AudioEngine*) override {}
+};
+
+// Play the scenario once over 'tracks' (three files, see CheckRender())
+inline bool RunRenderScenario(const std::vector<std::filesystem::path>& tracks, RenderCheckRun& run)
+{
+    enum class Action { Volume, Seek, Eq, Speed, Pause, Play };
+    struct Event
+    {
+        double at;          // scenario seconds
+        Action action;
+        double value;
+        const char* name;
+    };
+    // Track changes happen on their own at the end of each track
+    const Event kEvents[] =
+    {
+        { 0.50, Action::Volume, 0.5, "volume 0.5" },
+        { 1.00, Action::Seek, 2.0, "seek 2 s" },
+        { 2.30, Action::Eq, 6.0, "eq +6 dB low shelf, volume 1" },
+        { 2.80, Action::Speed, 1.5, "speed 1.5x" },
+        { 3.30, Action::Pause, 0.0, "pause" },
+        { 3.50, Action::Play, 0.0, "play" },
+        { 4.20, Action::Speed, 1.0, "speed 1x" },
+        { 4.50, Action::Seek, 0.25, "seek 0.25 s" },
+    };
+    const size_t kEventCount = sizeof(kEvents) / sizeof(kEvents[0]);
+    const uint32_t kTickFrames = RenderCheckSink::kSampleRate / 100;   // 10 ms device period
+    const double kMaxSeconds = 10.0;
+
+    RenderCheckSink sink;
+    RenderCheckDriver driver;
+    AudioEngine engine;
+    if (!engine.Configure(&sink, &driver)) return false;
+    bool trackEnded = false;
+    engine.SetEndCallback([&]() { trackEnded = true; });
+
+    size_t current = 0;
+    auto load = [&](size_t index) -> bool
+    {
+        std::unique_ptr<WavSource> source = std::make_unique<WavSource>();
+        if (!source->Open(tracks[index])) return false;
+        return engine.Load(std::move(source));
+    };
+
+    Md5 md5;
+    RenderCheckStep step;
+    auto beginStep = [&](const std::string& name)
+    {
+        if (!step.name.empty())
+        {
+            uint8_t digest[16];
+            md5.Finish(digest);
+            char hex[33];
+            for (int i = 0; i < 16; i++) snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+            step.md5 = hex;
+            run.steps.push_back(step);
+        }
+        md5.Reset();
+        step = RenderCheckStep();
+        step.name = name;
+    };
+
+    beginStep("track 1");
+    if (!load(0)) return false;
+    engine.Play();
+
+    std::vector<float> block(kTickFrames * RenderCheckSink::kChannels);
+    size_t nextEvent = 0;
+    for (uint64_t tick = 0; tick < (uint64_t)(kMaxSeconds * 100); tick++)
+    {
+        double now = tick / 100.0;
+        while (nextEvent < kEventCount && kEvents[nextEvent].at <= now + 1e-9)
+        {
+            const Event& event = kEvents[nextEvent++];
+            beginStep(event.name);
+            switch (event.action)
+            {
+            case Action::Volume:
+                engine.SetVolume((float)event.value);
+                break;
+            case Action::Seek:
+                engine.Seek((uint64_t)(event.value * engine.SourceRate()));
+                break;
+            case Action::Eq:
+            {
+                EqBand band;
+                band.type = EqBandType::LowShelf;
+                band.frequency = 120.0;
+                band.gainDb = event.value;
+                band.enabled = true;
+                engine.Dsp().Eq().SetBand(0, band);
+                engine.SetVolume(1.0f);     // into the limiter
+                break;
+            }
+            case Action::Speed:
+                engine.SetSpeed(event.value);
+                break;
+            case Action::Pause:
+                engine.Pause();
+                break;
+            case Action::Play:
+                engine.Play();
+                break;
+            }
+        }
+
+        // Fill the read-ahead; the end-of-track callback comes from here
+        auto decodeStart = std::chrono::steady_clock::now();
+        while (engine.Service() || engine.NeedsService()) {}
+        auto decodeEnd = std::chrono::steady_clock::now();
+        run.decodeSeconds += std::chrono::duration<double>(decodeEnd - decodeStart).count();
+
+        if (trackEnded)
+        {
+            trackEnded = false;
+            if (++current == tracks.size()) break;
+            beginStep("track " + std::to_string(current + 1));
+            if (!load(current)) return false;
+            engine.Play();
+            decodeStart = std::chrono::steady_clock::now();
+            while (engine.Service() || engine.NeedsService()) {}
+            run.decodeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - decodeStart).count();
+        }
+
+        // A paused device pulls nothing, so the step hashes only what was heard
+        if (!sink.Running()) continue;
+        auto renderStart = std::chrono::steady_clock::now();
+        engine.Render(block.data(), kTickFrames);
+        run.renderSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - renderStart).count();
+        md5.Update(block.data(), block.size() * sizeof(float));
+        step.frames += kTickFrames;
+        run.frames += kTickFrames;
+    }
+    beginStep("");
+    run.underruns = engine.Stats().underruns;
+    engine.Shutdown();
+    return true;
+}
+
+// Write render_golden.h with this platform's steps from 'run' and every
+// other platform's as they were
+inline bool WriteRenderGolden(const std::filesystem::path& path, const RenderCheckRun& run)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) return false;
+    file << "#pragma once\n\n"
+            "// Golden checksums of the render regression scenario, one set per platform\n"
+            "// (see render_check.h). Written by render_check_test (or the player's\n"
+            "// --check-render) --write-golden <this file>; rewrite only for a change\n"
+            "// that is meant to alter the output.\n\n"
+            "struct RenderGolden\n{\n"
+            "    const char* platform;\n"
+            "    const char* step;\n"
+            "    const char* md5;\n"
+            "};\n\n"
+            "const RenderGolden kRenderGolden[] =\n{\n";
+    std::string platform = RenderPlatformTag();
+    for (const RenderGolden& golden : kRenderGolden)
+    {
+        if (platform != golden.platform)
+            file << "    { \"" << golden.platform << "\", \"" << golden.step << "\", \"" << golden.md5 << "\" },\n";
+    }
+    for (const RenderCheckStep& step : run.steps)
+        file << "    { \"" << platform << "\", \"" << step.name << "\", \"" << step.md5 << "\" },\n";
+    file << "};\n";
+    return (bool)file;
+}
+
+enum class RenderCheckResult
+{
+    Match = 0,
+    Mismatch = 1,
+    NoGolden = 2,       // nothing recorded for this platform yet
+    Failed = 3
+};
+
+// Run the scenario several times: every run must produce the same hashes,
+// the hashes are checked against the goldens, and the fastest run gives the
+// throughput. With 'writeGolden' the goldens are rewritten instead.
+inline RenderCheckResult CheckRender(const std::filesystem::path& writeGolden = std::filesystem::path(), int runs = 5)
+{
+    std::error_code ec;
+    std::filesystem::path folder = std::filesystem::temp_directory_path(ec) / "render_check";
+    std::filesystem::create_directories(folder, ec);
+    // Resampled 16-bit stereo, native-rate float stereo, upsampled 16-bit mono
+    std::vector<std::filesystem::path> tracks = { folder / "a.wav", folder / "b.wav", folder / "c.wav" };
+    if (!WriteRenderCheckTrack(tracks[0], 44100, 2, false, 3.0, 1) ||
+        !WriteRenderCheckTrack(tracks[1], 48000, 2, true, 2.0, 2) ||
+        !WriteRenderCheckTrack(tracks[2], 22050, 1, false, 2.0, 3))
+    {
+        LogMessage("Render check: cannot write the input tracks to %s", folder.string().c_str());
+        return RenderCheckResult::Failed;
+    }
+
+    RenderCheckRun first, fastest;
+    bool ok = true;
+    for (int i = 0; i < runs && ok; i++)
+    {
+        RenderCheckRun run;
+        if (!RunRenderScenario(tracks, run))
+        {
+            LogMessage("Render check: the scenario did not run");
+            ok = false;
+            break;
+        }
+        if (i == 0)
+        {
+            first = run;
+            fastest = run;
+            continue;
+        }
+        for (size_t s = 0; s < run.steps.size() && s < first.steps.size(); s++)
+        {
+            if (run.steps[s].md5 != first.steps[s].md5)
+            {
+                LogMessage("Render check: run %d differs from run 1 at \"%s\": the render is not deterministic", i + 1, run.steps[s].name.c_str());
+                ok = false;
+            }
+        }
+        if (run.decodeSeconds + run.renderSeconds < fastest.decodeSeconds + fastest.renderSeconds) fastest = run;
+    }
+    for (const std::filesystem::path& track : tracks) std::filesystem::remove(track, ec);
+    std::filesystem::remove(folder, ec);
+    if (!ok) return RenderCheckResult::Failed;
+
+    double audioSeconds = (double)first.frames / RenderCheckSink::kSampleRate;
+    double wall = fastest.decodeSeconds + fastest.renderSeconds;
+    LogMessage("Render check: %zu steps, %.2f s of audio, %.0fx realtime (decode and resample %.1f ms, render and DSP %.1f ms), %llu underruns",
+        first.steps.size(), audioSeconds, wall > 0.0 ? audioSeconds / wall : 0.0,
+        fastest.decodeSeconds * 1000.0, fastest.renderSeconds * 1000.0, (unsigned long long)first.underruns);
+    if (first.underruns)
+    {
+        LogMessage("Render check: the read-ahead ran dry, so the output depends on timing");
+        return RenderCheckResult::Failed;
+    }
+
+    std::string platform = RenderPlatformTag();
+    if (!writeGolden.empty())
+    {
+        if (!WriteRenderGolden(writeGolden, first))
+        {
+            LogMessage("Render check: cannot write %s", writeGolden.string().c_str());
+            return RenderCheckResult::Failed;
+        }
+        LogMessage("Render check: wrote %zu goldens for %s to %s", first.steps.size(), platform.c_str(), writeGolden.string().c_str());
+        return RenderCheckResult::Match;
+    }
+
+    std::vector<const RenderGolden*> goldens;
+    for (const RenderGolden& golden : kRenderGolden)
+    {
+        if (platform == golden.platform) goldens.push_back(&golden);
+    }
+    if (goldens.empty())
+    {
+        LogMessage("Render check: no goldens for %s; record them with render_check_test --write-golden src/render_golden.h", platform.c_str());
+        return RenderCheckResult::NoGolden;
+    }
+
+    size_t mismatches = 0;
+    size_t count = std::max(goldens.size(), first.steps.size());
+    for (size_t s = 0; s < count; s++)
+    {
+        const char* expectedName = s < goldens.size() ? goldens[s]->step : "(none)";
+        const char* expected = s < goldens.size() ? goldens[s]->md5 : "";
+        const RenderCheckStep* actual = s < first.steps.size() ? &first.steps[s] : nullptr;
+        if (actual && actual->name == expectedName && actual->md5 == expected) continue;
+        mismatches++;
+        LogMessage("Render check: step %zu \"%s\" (%.2f s) is %s, golden \"%s\" is %s", s + 1,
+            actual ? actual->name.c_str() : "(none)", actual ? (double)actual->frames / RenderCheckSink::kSampleRate : 0.0,
+            actual ? actual->md5.c_str() : "-", expectedName, expected);
+    }
+    if (mismatches)
+    {
+        LogMessage("Render check: %zu of %zu steps differ from the goldens for %s", mismatches, count, platform.c_str());
+        return RenderCheckResult::Mismatch;
+    }
+    LogMessage("Render check: output matches the goldens for %s", platform.c_str());
+    return RenderCheckResult::Match;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+// Golden checksums of the render regression scenario, one set per platform
+// (see render_check.h). Written by render_check_test (or the player's
+// --check-render) --write-golden <this file>; rewrite only for a change
+// that is meant to alter the output.
+
+struct RenderGolden
+{
+    const char* platform;
+    const char* step;
+    const char* md5;
+};
+
+const RenderGolden kRenderGolden[] =
+{
+    { "linux-gcc-x64", "track 1", "1324bcf273eee15592253d42b9fcc9ab" },
+    { "linux-gcc-x64", "volume 0.5", "14a1a661a1bc18d552d051fbd651612d" },
+    { "linux-gcc-x64", "seek 2 s", "e9b5c776bd2c1368d1b6a3a040d3c12b" },
+    { "linux-gcc-x64", "track 2", "87a186926911f76e2ef834d61ae865d9" },
+    { "linux-gcc-x64", "eq +6 dB low shelf, volume 1", "314a2c517e9b1277947243284832cdb3" },
+    { "linux-gcc-x64", "speed 1.5x", "62d2e0f2aeef8564fc23240878086596" },
+    { "linux-gcc-x64", "pause", "d41d8cd98f00b204e9800998ecf8427e" },
+    { "linux-gcc-x64", "play", "6b2d334f75cd46e4b31bc60807cd6d4b" },
+    { "linux-gcc-x64", "track 3", "f2996ace5d40c3cc4f3babdea443f9d3" },
+    { "linux-gcc-x64", "speed 1x", "d0f44ec25df467f656492006da1cfe13" },
+    { "linux-gcc-x64", "seek 0.25 s", "cbb9abe1d66f2f1a7bad9b978ff3f8b5" },
+};
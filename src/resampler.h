@@ -0,0 +1,166 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Streaming polyphase windowed-sinc sample rate converter for interleaved
+// float audio. Memory use is fixed by Configure(); Process() consumes as much
+// input as fits in its internal window and produces as much output as the
+// caller has room for.
+class Resampler
+{
+public:
+    static const int kTaps = 32;       // filter length per output sample
+    static const int kPhaseBits = 8;
+    static const int kPhases = 1 << kPhaseBits; // sub-sample positions in the table
+
+    void Configure(uint32_t inRate, uint32_t outRate, uint32_t channels, size_t maxInputFrames = 4096)
+    {
+        m_inRate = inRate;
+        m_outRate = outRate;
+        m_channels = channels;
+        m_capacity = maxInputFrames + kTaps;
+        m_buffer.assign(m_capacity * channels, 0.0f);
+
+        // Step through the input in 32.32 fixed point
+        m_step = ((uint64_t)inRate << 32) / outRate;
+
+        // Lowpass at the lower of the two Nyquist frequencies, slightly below
+        // it so the transition band does not alias
+        double cutoff = (outRate < inRate ? (double)outRate / inRate : 1.0) * 0.94;
+        m_table.resize((kPhases + 1) * kTaps);
+        for (int phase = 0; phase <= kPhases; phase++)
+        {
+            double frac = (double)phase / kPhases;
+            double sum = 0.0;
+            for (int k = 0; k < kTaps; k++)
+            {
+                double t = frac + (kTaps / 2 - 1) - k;
+                double x = t * cutoff;
+                double sinc = (x == 0.0) ? 1.0 : sin(kPi * x) / (kPi * x);
+                double w = t / (kTaps / 2);
+                double window = (w <= -1.0 || w >= 1.0) ? 0.0 : BesselI0(kKaiserBeta * sqrt(1.0 - w * w)) / BesselI0(kKaiserBeta);
+                double h = sinc * window;
+                m_table[phase * kTaps + k] = (float)h;
+                sum += h;
+            }
+            // Normalize each phase for unity DC gain
+            for (int k = 0; k < kTaps; k++) m_table[phase * kTaps + k] = (float)(m_table[phase * kTaps + k] / sum);
+        }
+
+        Reset();
+    }
+
+    void Reset()
+    {
+        // Prime the window with silence so the first output lines up with
+        // the first input frame
+        std::fill(m_buffer.begin(), m_buffer.end(), 0.0f);
+        m_filled = kTaps / 2;
+        m_position = (uint64_t)(kTaps / 2) << 32;
+    }
+
+    bool IsPassthrough() const { return m_inRate == m_outRate; }
+
+    // Convert from 'in' to 'out'. Returns frames written to 'out' and stores
+    // the number of input frames consumed in 'inUsed'.
+    size_t Process(const float* in, size_t inFrames, float* out, size_t outCapacity, size_t& inUsed)
+    {
+        if (IsPassthrough())
+        {
+            // The flush padding is not needed without a filter delay
+            if (!in)
+            {
+                inUsed = inFrames;
+                return 0;
+            }
+            size_t frames = inFrames < outCapacity ? inFrames : outCapacity;
+            memcpy(out, in, frames * m_channels * sizeof(float));
+            inUsed = frames;
+            return frames;
+        }
+
+        // Append as much input as the window can hold
+        size_t space = m_capacity - m_filled;
+        inUsed = inFrames < space ? inFrames : space;
+        if (in)
+            memcpy(&m_buffer[m_filled * m_channels], in, inUsed * m_channels * sizeof(float));
+        else
+            memset(&m_buffer[m_filled * m_channels], 0, inUsed * m_channels * sizeof(float));
+        m_filled += inUsed;
+
+        size_t produced = 0;
+        while (produced < outCapacity)
+        {
+            size_t index = (size_t)(m_position >> 32);
+            if (index + kTaps / 2 >= m_filled) break;
+
+            uint32_t fracBits = (uint32_t)m_position;
+            uint32_t phase = fracBits >> (32 - kPhaseBits);                     // top bits select the phase
+            float blend = (float)(fracBits << kPhaseBits) * (1.0f / 4294967296.0f); // remainder interpolates
+            const float* h0 = &m_table[phase * kTaps];
+            const float* h1 = h0 + kTaps;
+            const float* x = &m_buffer[(index - (kTaps / 2 - 1)) * m_channels];
+
+            for (uint32_t c = 0; c < m_channels; c++)
+            {
+                float acc0 = 0.0f, acc1 = 0.0f;
+                for (int k = 0; k < kTaps; k++)
+                {
+                    float s = x[k * m_channels + c];
+                    acc0 += s * h0[k];
+                    acc1 += s * h1[k];
+                }
+                out[produced * m_channels + c] = acc0 + (acc1 - acc0) * blend;
+            }
+
+            produced++;
+            m_position += m_step;
+        }
+
+        // Drop frames that no future output can reach
+        size_t index = (size_t)(m_position >> 32);
+        if (index >= (size_t)(kTaps / 2 - 1))
+        {
+            size_t drop = index - (kTaps / 2 - 1);
+            if (drop > m_filled) drop = m_filled;
+            memmove(&m_buffer[0], &m_buffer[drop * m_channels], (m_filled - drop) * m_channels * sizeof(float));
+            m_filled -= drop;
+            m_position -= (uint64_t)drop << 32;
+        }
+
+        return produced;
+    }
+
+    // Number of trailing silent input frames to push (with in == nullptr)
+    // at end of stream so the tail of the signal is emitted
+    static size_t FlushFrames() { return kTaps / 2; }
+
+private:
+    static double BesselI0(double x)
+    {
+        double sum = 1.0, term = 1.0;
+        for (int k = 1; k < 32; k++)
+        {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    static constexpr double kPi = 3.14159265358979323846;
+    static constexpr double kKaiserBeta = 8.0;
+
+    uint32_t m_inRate = 0;
+    uint32_t m_outRate = 0;
+    uint32_t m_channels = 0;
+    uint64_t m_step = 0;
+    uint64_t m_position = 0;
+    size_t m_capacity = 0;
+    size_t m_filled = 0;
+    std::vector<float> m_buffer;
+    std::vector<float> m_table;
+};
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// Real-time guard: counts heap allocations, frees and blocking calls made on
+// a thread while it is marked real-time (see RealtimeScope). The audio
+// callback must never do any of these; a non-zero count is a bug.
+//
+// Allocation counting replaces the global operator new/delete and is only
+// compiled when RT_GUARD is defined (debug builds define it by default).
+// Blocking calls are counted through GuardedMutex and RealtimeGuardNoteBlocking().
+// The replacements are emitted by the one translation unit that defines
+// RT_GUARD_IMPLEMENTATION before its first include of this header; every
+// other translation unit links against those.
+
+#if !defined(RT_GUARD) && defined(_DEBUG)
+#define RT_GUARD 1
+#endif
+
+struct RealtimeGuardStats
+{
+    std::atomic<uint64_t> allocations{ 0 };
+    std::atomic<uint64_t> frees{ 0 };
+    std::atomic<uint64_t> blockingCalls{ 0 };
+};
+
+inline RealtimeGuardStats& GetRealtimeGuardStats()
+{
+    static RealtimeGuardStats stats;
+    return stats;
+}
+
+inline bool& RealtimeThreadFlag()
+{
+    thread_local bool isRealtime = false;
+    return isRealtime;
+}
+
+inline bool IsRealtimeThread() { return RealtimeThreadFlag(); }
+
+// Marks the current thread as real-time for the lifetime of the object
+class RealtimeScope
+{
+public:
+    RealtimeScope() : m_previous(RealtimeThreadFlag()) { RealtimeThreadFlag() = true; }
+    ~RealtimeScope() { RealtimeThreadFlag() = m_previous; }
+
+private:
+    bool m_previous;
+};
+
+inline void RealtimeGuardNoteBlocking()
+{
+    if (IsRealtimeThread()) GetRealtimeGuardStats().blockingCalls.fetch_add(1, std::memory_order_relaxed);
+}
+
+// std::mutex that reports any lock taken on a real-time thread
+class GuardedMutex
+{
+public:
+    void lock()
+    {
+        RealtimeGuardNoteBlocking();
+        m_mutex.lock();
+    }
+    bool try_lock() { return m_mutex.try_lock(); }
+    void unlock() { m_mutex.unlock(); }
+
+private:
+    std::mutex m_mutex;
+};
+
+inline bool RealtimeGuardEnabled()
+{
+#ifdef RT_GUARD
+    return true;
+#else
+    return false;
+#endif
+}
+
+#if defined(RT_GUARD) && defined(RT_GUARD_IMPLEMENTATION)
+
+inline void CountRealtimeAllocation()
+{
+    if (IsRealtimeThread()) GetRealtimeGuardStats().allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void CountRealtimeFree()
+{
+    if (IsRealtimeThread()) GetRealtimeGuardStats().frees.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline void* RealtimeGuardAlignedAlloc(size_t size, size_t alignment)
+{
+#ifdef _WIN32
+    return _aligned_malloc(size ? size : 1, alignment);
+#else
+    void* p = nullptr;
+    if (alignment < sizeof(void*)) alignment = sizeof(void*);
+    return posix_memalign(&p, alignment, size ? size : 1) == 0 ? p : nullptr;
+#endif
+}
+
+inline void RealtimeGuardAlignedFree(void* p)
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+// Every operator delete overload calls one of these directly: forwarding
+// to another overload trips GCC's -Wmismatched-new-delete once inlined
+inline void RealtimeGuardRelease(void* p)
+{
+    if (!p) return;
+    CountRealtimeFree();
+    free(p);
+}
+
+inline void RealtimeGuardReleaseAligned(void* p)
+{
+    if (!p) return;
+    CountRealtimeFree();
+    RealtimeGuardAlignedFree(p);
+}
+
+void* operator new(size_t size)
+{
+    CountRealtimeAllocation();
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    CountRealtimeAllocation();
+    return malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept { RealtimeGuardRelease(p); }
+void operator delete[](void* p) noexcept { RealtimeGuardRelease(p); }
+void operator delete(void* p, size_t) noexcept { RealtimeGuardRelease(p); }
+void operator delete[](void* p, size_t) noexcept { RealtimeGuardRelease(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { RealtimeGuardRelease(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { RealtimeGuardRelease(p); }
+
+// Over-aligned types (alignas above the default new alignment)
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    CountRealtimeAllocation();
+    void* p = RealtimeGuardAlignedAlloc(size, (size_t)alignment);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    CountRealtimeAllocation();
+    return RealtimeGuardAlignedAlloc(size, (size_t)alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t& tag) noexcept
+{
+    return operator new(size, alignment, tag);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept { RealtimeGuardReleaseAligned(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { RealtimeGuardReleaseAligned(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { RealtimeGuardReleaseAligned(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { RealtimeGuardReleaseAligned(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { RealtimeGuardReleaseAligned(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { RealtimeGuardReleaseAligned(p); }
+#endif
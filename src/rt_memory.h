@@ -0,0 +1,168 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+// Pre-allocated storage for the audio path. Everything here is sized up
+// front on a control thread; the real-time thread only hands out and returns
+// memory that already exists.
+
+// Bump allocator over a single block. Allocation is a pointer increment and
+// memory is reclaimed all at once with Reset()/ResetTo().
+class Arena
+{
+public:
+    bool Init(size_t bytes)
+    {
+        m_storage.reset(new (std::nothrow) uint8_t[bytes]);
+        m_capacity = m_storage ? bytes : 0;
+        m_used = 0;
+        return m_storage != nullptr;
+    }
+
+    // Returns nullptr when the arena is exhausted
+    void* Allocate(size_t bytes, size_t alignment = 64)
+    {
+        size_t start = (m_used + alignment - 1) & ~(alignment - 1);
+        if (start + bytes > m_capacity) return nullptr;
+        m_used = start + bytes;
+        return m_storage.get() + start;
+    }
+
+    template <class T> T* AllocateArray(size_t count)
+    {
+        void* p = Allocate(count * sizeof(T), alignof(T) > 64 ? alignof(T) : 64);
+        if (!p) return nullptr;
+        T* items = static_cast<T*>(p);
+        for (size_t i = 0; i < count; i++) new (&items[i]) T();
+        return items;
+    }
+
+    // Allocations made after Mark() can be dropped with ResetTo() while
+    // keeping the earlier ones
+    size_t Mark() const { return m_used; }
+    void ResetTo(size_t mark) { if (mark <= m_used) m_used = mark; }
+    void Reset() { m_used = 0; }
+
+    size_t Used() const { return m_used; }
+    size_t Capacity() const { return m_capacity; }
+
+private:
+    std::unique_ptr<uint8_t[]> m_storage;
+    size_t m_capacity = 0;
+    size_t m_used = 0;
+};
+
+// Fixed number of equally sized blocks with a lock-free free list, so any
+// thread (including the real-time one) can acquire and release blocks
+// without locking or touching the heap.
+class BufferPool
+{
+public:
+    bool Init(Arena& arena, size_t blockBytes, uint32_t blockCount)
+    {
+        m_blockBytes = (blockBytes + 63) & ~(size_t)63;
+        m_blockCount = blockCount;
+        m_storage = static_cast<uint8_t*>(arena.Allocate(m_blockBytes * blockCount));
+        m_next = arena.AllocateArray<std::atomic<uint32_t>>(blockCount);
+        if (!m_storage || !m_next) return false;
+
+        for (uint32_t i = 0; i < blockCount; i++) m_next[i].store(i + 1 < blockCount ? i + 1 : kNone, std::memory_order_relaxed);
+        m_head.store(blockCount ? 0 : kNone);
+        m_available.store(blockCount);
+        return true;
+    }
+
+    // Returns nullptr when every block is in use
+    void* Acquire()
+    {
+        uint64_t head = m_head.load(std::memory_order_acquire);
+        for (;;)
+        {
+            uint32_t index = (uint32_t)head;
+            if (index == kNone) return nullptr;
+
+            // The tag in the upper half changes on every update, so a block
+            // that was popped and pushed back in between cannot fool the CAS
+            uint64_t next = ((head >> 32) + 1) << 32 | m_next[index].load(std::memory_order_relaxed);
+            if (m_head.compare_exchange_weak(head, next, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                m_available.fetch_sub(1, std::memory_order_relaxed);
+                return m_storage + (size_t)index * m_blockBytes;
+            }
+        }
+    }
+
+    void Release(void* block)
+    {
+        uint32_t index = (uint32_t)(((uint8_t*)block - m_storage) / m_blockBytes);
+        uint64_t head = m_head.load(std::memory_order_acquire);
+        for (;;)
+        {
+            m_next[index].store((uint32_t)head, std::memory_order_relaxed);
+            uint64_t next = ((head >> 32) + 1) << 32 | index;
+            if (m_head.compare_exchange_weak(head, next, std::memory_order_acq_rel, std::memory_order_acquire)) break;
+        }
+        m_available.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    size_t BlockBytes() const { return m_blockBytes; }
+    uint32_t BlockCount() const { return m_blockCount; }
+    uint32_t Available() const { return m_available.load(std::memory_order_relaxed); }
+
+private:
+    static const uint32_t kNone = 0xFFFFFFFF;
+
+    uint8_t* m_storage = nullptr;
+    std::atomic<uint32_t>* m_next = nullptr;
+    std::atomic<uint64_t> m_head{ kNone };
+    std::atomic<uint32_t> m_available{ 0 };
+    size_t m_blockBytes = 0;
+    uint32_t m_blockCount = 0;
+};
+
+// Lock-free single-producer single-consumer queue with fixed capacity
+template <class T> class SpscQueue
+{
+public:
+    // 'capacity' is rounded up to a power of two
+    void Init(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        m_items.assign(size, T());
+        m_mask = size - 1;
+        m_head.store(0);
+        m_tail.store(0);
+    }
+
+    bool Push(const T& item)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) > m_mask) return false;
+        m_items[tail & m_mask] = item;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool Pop(T& item)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire)) return false;
+        item = m_items[head & m_mask];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t Size() const { return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire); }
+
+private:
+    std::vector<T> m_items;
+    size_t m_mask = 0;
+    alignas(64) std::atomic<size_t> m_head{ 0 };
+    alignas(64) std::atomic<size_t> m_tail{ 0 };
+};
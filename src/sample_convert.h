@@ -0,0 +1,823 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "cpu_features.h"
+#include "log.h"
+
+// Conversion between the engine's float samples and integer PCM, plus
+// interleaving between planar and interleaved buffers. Every operation has
+// a scalar reference and SIMD kernels (SSE2/AVX2 on x86, NEON on ARM64)
+// picked at run time; the kernels produce exactly the reference's bits,
+// which BenchmarkSampleConversion() checks along with their throughput.
+//
+// Integer output rounds to nearest (ties to even) after scaling by full
+// scale (32768 for 16-bit) and clamping. TPDF dither adds triangular noise
+// of +-1 LSB taken from a hash of the running sample index, so the noise is
+// the same whichever kernel runs and a render is reproducible. Noise-shaped
+// dither feeds the error back per channel, which is sequential, so it only
+// has the scalar form.
+
+enum class PcmFormat
+{
+    Int16,
+    Int24,      // packed, 3 bytes per sample
+    Int32,
+    Float32
+};
+
+inline size_t PcmBytesPerSample(PcmFormat format)
+{
+    return format == PcmFormat::Int16 ? 2 : format == PcmFormat::Int24 ? 3 : 4;
+}
+
+enum class DitherMode
+{
+    None,       // round to nearest
+    Tpdf,       // triangular noise, flat spectrum
+    Shaped      // triangular noise with the error pushed toward high frequencies
+};
+
+// Dither state of one output stream
+struct SampleDither
+{
+    static const uint32_t kMaxChannels = 8;
+
+    DitherMode mode = DitherMode::Tpdf;
+    uint32_t counter = 0;                   // noise index of the next sample
+    float error[kMaxChannels][3] = {};      // noise-shaping history per channel, newest first
+
+    void Reset(uint32_t seed = 0)
+    {
+        counter = seed;
+        memset(error, 0, sizeof(error));
+    }
+};
+
+// Full scale and the largest value that converts without overflow
+struct PcmRange
+{
+    float scale;
+    float max;
+};
+
+inline PcmRange PcmOutputRange(PcmFormat format)
+{
+    switch (format)
+    {
+    case PcmFormat::Int16: return { 32768.0f, 32767.0f };
+    case PcmFormat::Int24: return { 8388608.0f, 8388607.0f };
+    default:               return { 2147483648.0f, 2147483520.0f };  // largest float below 2^31
+    }
+}
+
+inline uint32_t DitherHash(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// Triangular noise in (-1, 1) LSB: the difference of two 16-bit uniforms
+inline float TpdfNoise(uint32_t index)
+{
+    uint32_t h = DitherHash(index);
+    return (float)((int32_t)(h & 0xFFFF) - (int32_t)(h >> 16)) * (1.0f / 65536.0f);
+}
+
+// Same operand order as the SSE max/min instructions, so NaN clamps to 'lo'
+inline float ClampSample(float value, float lo, float hi)
+{
+    value = value > lo ? value : lo;
+    return value < hi ? value : hi;
+}
+
+inline void StorePcm(void* out, PcmFormat format, size_t i, int32_t value)
+{
+    switch (format)
+    {
+    case PcmFormat::Int16:
+        ((int16_t*)out)[i] = (int16_t)value;
+        break;
+    case PcmFormat::Int24:
+    {
+        uint8_t* p = (uint8_t*)out + i * 3;
+        p[0] = (uint8_t)value;
+        p[1] = (uint8_t)(value >> 8);
+        p[2] = (uint8_t)(value >> 16);
+        break;
+    }
+    default:
+        ((int32_t*)out)[i] = value;
+        break;
+    }
+}
+
+// Scalar reference
+
+inline void PcmToFloatScalar(const void* in, PcmFormat format, float* out, size_t samples)
+{
+    switch (format)
+    {
+    case PcmFormat::Int16:
+        for (size_t i = 0; i < samples; i++) out[i] = ((const int16_t*)in)[i] * (1.0f / 32768.0f);
+        break;
+    case PcmFormat::Int24:
+        for (size_t i = 0; i < samples; i++)
+        {
+            const uint8_t* p = (const uint8_t*)in + i * 3;
+            int32_t v = (int32_t)(((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 24)) >> 8;
+            out[i] = v * (1.0f / 8388608.0f);
+        }
+        break;
+    case PcmFormat::Int32:
+        for (size_t i = 0; i < samples; i++) out[i] = ((const int32_t*)in)[i] * (1.0f / 2147483648.0f);
+        break;
+    case PcmFormat::Float32:
+        memcpy(out, in, samples * sizeof(float));
+        break;
+    }
+}
+
+// Integer formats only; 'noiseIndex' is the dither index of in[0]
+inline void FloatToPcmScalar(const float* in, PcmFormat format, void* out, size_t samples, bool dither, uint32_t noiseIndex)
+{
+    PcmRange range = PcmOutputRange(format);
+    for (size_t i = 0; i < samples; i++)
+    {
+        float value = in[i] * range.scale;
+        if (dither) value = value + TpdfNoise(noiseIndex + (uint32_t)i);
+        StorePcm(out, format, i, (int32_t)lrintf(ClampSample(value, -range.scale, range.max)));
+    }
+}
+
+// Error-feedback dither through the F-weighted 3-tap filter of Wannamaker:
+// the requantization noise moves up toward the band edge, where hearing is
+// least sensitive, lowering it in the midrange
+inline void FloatToPcmShaped(const float* in, PcmFormat format, void* out, size_t frames, uint32_t channels, SampleDither& dither)
+{
+    static const float kShape[3] = { 1.623f, -0.982f, 0.109f };
+    PcmRange range = PcmOutputRange(format);
+    size_t i = 0;
+    for (size_t frame = 0; frame < frames; frame++)
+    {
+        for (uint32_t c = 0; c < channels; c++, i++)
+        {
+            float* error = dither.error[c];
+            float target = in[i] * range.scale - (kShape[0] * error[0] + kShape[1] * error[1] + kShape[2] * error[2]);
+            float value = ClampSample(target + TpdfNoise(dither.counter + (uint32_t)i), -range.scale, range.max);
+            int32_t quantized = (int32_t)lrintf(value);
+
+            // A clipped sample would feed back a huge error and ring; keep
+            // the history to the size of normal dithered rounding
+            float e = (float)quantized - target;
+            e = e > 4.0f ? 4.0f : e < -4.0f ? -4.0f : e;
+            error[2] = error[1];
+            error[1] = error[0];
+            error[0] = e;
+            StorePcm(out, format, i, quantized);
+        }
+    }
+}
+
+// Planar 32-bit integers (decoder output) to interleaved float
+inline void InterleaveToFloatScalar(const int32_t* const* planes, uint32_t channels, float scale, float* out, size_t frames)
+{
+    for (uint32_t c = 0; c < channels; c++)
+    {
+        const int32_t* src = planes[c];
+        float* dst = out + c;
+        for (size_t i = 0; i < frames; i++) dst[i * channels] = src[i] * scale;
+    }
+}
+
+inline void DeinterleaveScalar(const float* in, uint32_t channels, float* const* planes, size_t frames)
+{
+    for (uint32_t c = 0; c < channels; c++)
+        for (size_t i = 0; i < frames; i++) planes[c][i] = in[i * channels + c];
+}
+
+inline void InterleaveScalar(const float* const* planes, uint32_t channels, float* out, size_t frames)
+{
+    for (uint32_t c = 0; c < channels; c++)
+        for (size_t i = 0; i < frames; i++) out[i * channels + c] = planes[c][i];
+}
+
+// SIMD kernels. Each handles a prefix of the buffer and returns its length;
+// the scalar reference finishes the rest.
+
+#if defined(CPU_X86)
+
+// SSE2 has no 32-bit low multiply: two 32x32->64 multiplies on the even and
+// odd lanes, low halves gathered back
+inline __m128i MulLo32Sse2(__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+inline __m128 TpdfNoiseSse2(uint32_t index)
+{
+    __m128i x = _mm_add_epi32(_mm_set1_epi32((int)index), _mm_setr_epi32(0, 1, 2, 3));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+    x = MulLo32Sse2(x, _mm_set1_epi32(0x7FEB352D));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 15));
+    x = MulLo32Sse2(x, _mm_set1_epi32((int)0x846CA68Bu));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+    __m128i diff = _mm_sub_epi32(_mm_and_si128(x, _mm_set1_epi32(0xFFFF)), _mm_srli_epi32(x, 16));
+    return _mm_mul_ps(_mm_cvtepi32_ps(diff), _mm_set1_ps(1.0f / 65536.0f));
+}
+
+// Packed 24-bit needs a byte shuffle (SSSE3)
+TARGET_SSE41 inline size_t Int24ToFloatSse41(const uint8_t* in, float* out, size_t samples)
+{
+    const __m128i shuffle = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+    const __m128 scale = _mm_set1_ps(1.0f / 8388608.0f);
+    size_t i = 0;
+    // Each 16-byte load covers 4 samples and a bit of the next ones
+    for (; i + 6 <= samples; i += 4)
+    {
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + i * 3)), shuffle);
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(v, 8)), scale));
+    }
+    return i;
+}
+
+inline size_t PcmToFloatSse2(const void* in, PcmFormat format, float* out, size_t samples)
+{
+    size_t i = 0;
+    if (format == PcmFormat::Int16)
+    {
+        const int16_t* src = (const int16_t*)in;
+        const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+        for (; i + 8 <= samples; i += 8)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+            __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+            __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+            _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+            _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+        }
+    }
+    else if (format == PcmFormat::Int24 && GetCpuFeatures().sse41)
+    {
+        i = Int24ToFloatSse41((const uint8_t*)in, out, samples);
+    }
+    else if (format == PcmFormat::Int32)
+    {
+        const int32_t* src = (const int32_t*)in;
+        const __m128 scale = _mm_set1_ps(1.0f / 2147483648.0f);
+        for (; i + 4 <= samples; i += 4)
+            _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(src + i))), scale));
+    }
+    return i;
+}
+
+inline size_t FloatToPcmSse2(const float* in, PcmFormat format, void* out, size_t samples, bool dither, uint32_t noiseIndex)
+{
+    PcmRange range = PcmOutputRange(format);
+    const __m128 scale = _mm_set1_ps(range.scale);
+    const __m128 lo = _mm_set1_ps(-range.scale);
+    const __m128 hi = _mm_set1_ps(range.max);
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8)
+    {
+        __m128 a = _mm_mul_ps(_mm_loadu_ps(in + i), scale);
+        __m128 b = _mm_mul_ps(_mm_loadu_ps(in + i + 4), scale);
+        if (dither)
+        {
+            a = _mm_add_ps(a, TpdfNoiseSse2(noiseIndex + (uint32_t)i));
+            b = _mm_add_ps(b, TpdfNoiseSse2(noiseIndex + (uint32_t)i + 4));
+        }
+        __m128i qa = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(a, lo), hi));
+        __m128i qb = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(b, lo), hi));
+
+        if (format == PcmFormat::Int16)
+        {
+            _mm_storeu_si128((__m128i*)((int16_t*)out + i), _mm_packs_epi32(qa, qb));
+        }
+        else if (format == PcmFormat::Int32)
+        {
+            _mm_storeu_si128((__m128i*)((int32_t*)out + i), qa);
+            _mm_storeu_si128((__m128i*)((int32_t*)out + i + 4), qb);
+        }
+        else
+        {
+            alignas(16) int32_t values[8];
+            _mm_store_si128((__m128i*)values, qa);
+            _mm_store_si128((__m128i*)(values + 4), qb);
+            for (int k = 0; k < 8; k++) StorePcm(out, PcmFormat::Int24, i + k, values[k]);
+        }
+    }
+    return i;
+}
+
+inline size_t InterleaveToFloatSse2(const int32_t* const* planes, uint32_t channels, float scale, float* out, size_t frames)
+{
+    if (channels != 2) return 0;
+    const __m128 s = _mm_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4)
+    {
+        __m128 l = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(planes[0] + i))), s);
+        __m128 r = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(planes[1] + i))), s);
+        _mm_storeu_ps(out + i * 2, _mm_unpacklo_ps(l, r));
+        _mm_storeu_ps(out + i * 2 + 4, _mm_unpackhi_ps(l, r));
+    }
+    return i;
+}
+
+inline size_t DeinterleaveSse2(const float* in, uint32_t channels, float* const* planes, size_t frames)
+{
+    if (channels != 2) return 0;
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4)
+    {
+        __m128 a = _mm_loadu_ps(in + i * 2);
+        __m128 b = _mm_loadu_ps(in + i * 2 + 4);
+        _mm_storeu_ps(planes[0] + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(planes[1] + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+    return i;
+}
+
+inline size_t InterleaveSse2(const float* const* planes, uint32_t channels, float* out, size_t frames)
+{
+    if (channels != 2) return 0;
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4)
+    {
+        __m128 l = _mm_loadu_ps(planes[0] + i);
+        __m128 r = _mm_loadu_ps(planes[1] + i);
+        _mm_storeu_ps(out + i * 2, _mm_unpacklo_ps(l, r));
+        _mm_storeu_ps(out + i * 2 + 4, _mm_unpackhi_ps(l, r));
+    }
+    return i;
+}
+
+TARGET_AVX2 inline __m256 TpdfNoiseAvx2(uint32_t index)
+{
+    __m256i x = _mm256_add_epi32(_mm256_set1_epi32((int)index), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+    x = _mm256_mullo_epi32(x, _mm256_set1_epi32(0x7FEB352D));
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 15));
+    x = _mm256_mullo_epi32(x, _mm256_set1_epi32((int)0x846CA68Bu));
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+    __m256i diff = _mm256_sub_epi32(_mm256_and_si256(x, _mm256_set1_epi32(0xFFFF)), _mm256_srli_epi32(x, 16));
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(diff), _mm256_set1_ps(1.0f / 65536.0f));
+}
+
+TARGET_AVX2 inline size_t PcmToFloatAvx2(const void* in, PcmFormat format, float* out, size_t samples)
+{
+    size_t i = 0;
+    if (format == PcmFormat::Int16)
+    {
+        const int16_t* src = (const int16_t*)in;
+        const __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+        for (; i + 16 <= samples; i += 16)
+        {
+            __m256i a = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src + i)));
+            __m256i b = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(src + i + 8)));
+            _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(a), scale));
+            _mm256_storeu_ps(out + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(b), scale));
+        }
+    }
+    else if (format == PcmFormat::Int24)
+    {
+        i = Int24ToFloatSse41((const uint8_t*)in, out, samples);
+    }
+    else if (format == PcmFormat::Int32)
+    {
+        const int32_t* src = (const int32_t*)in;
+        const __m256 scale = _mm256_set1_ps(1.0f / 2147483648.0f);
+        for (; i + 8 <= samples; i += 8)
+            _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(src + i))), scale));
+    }
+    return i;
+}
+
+TARGET_AVX2 inline size_t FloatToPcmAvx2(const float* in, PcmFormat format, void* out, size_t samples, bool dither, uint32_t noiseIndex)
+{
+    PcmRange range = PcmOutputRange(format);
+    const __m256 scale = _mm256_set1_ps(range.scale);
+    const __m256 lo = _mm256_set1_ps(-range.scale);
+    const __m256 hi = _mm256_set1_ps(range.max);
+    size_t i = 0;
+    for (; i + 16 <= samples; i += 16)
+    {
+        __m256 a = _mm256_mul_ps(_mm256_loadu_ps(in + i), scale);
+        __m256 b = _mm256_mul_ps(_mm256_loadu_ps(in + i + 8), scale);
+        if (dither)
+        {
+            a = _mm256_add_ps(a, TpdfNoiseAvx2(noiseIndex + (uint32_t)i));
+            b = _mm256_add_ps(b, TpdfNoiseAvx2(noiseIndex + (uint32_t)i + 8));
+        }
+        __m256i qa = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(a, lo), hi));
+        __m256i qb = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(b, lo), hi));
+
+        if (format == PcmFormat::Int16)
+        {
+            // packs works per 128-bit lane: restore the order afterwards
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(qa, qb), _MM_SHUFFLE(3, 1, 2, 0));
+            _mm256_storeu_si256((__m256i*)((int16_t*)out + i), packed);
+        }
+        else if (format == PcmFormat::Int32)
+        {
+            _mm256_storeu_si256((__m256i*)((int32_t*)out + i), qa);
+            _mm256_storeu_si256((__m256i*)((int32_t*)out + i + 8), qb);
+        }
+        else
+        {
+            alignas(32) int32_t values[16];
+            _mm256_store_si256((__m256i*)values, qa);
+            _mm256_store_si256((__m256i*)(values + 8), qb);
+            for (int k = 0; k < 16; k++) StorePcm(out, PcmFormat::Int24, i + k, values[k]);
+        }
+    }
+    return i;
+}
+
+TARGET_AVX2 inline size_t InterleaveToFloatAvx2(const int32_t* const* planes, uint32_t channels, float scale, float* out, size_t frames)
+{
+    if (channels != 2) return 0;
+    const __m256 s = _mm256_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8)
+    {
+        __m256 l = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(planes[0] + i))), s);
+        __m256 r = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(planes[1] + i))), s);
+        __m256 lo = _mm256_unpacklo_ps(l, r);   // frames 0, 1 | 4, 5
+        __m256 hi = _mm256_unpackhi_ps(l, r);   // frames 2, 3 | 6, 7
+        _mm256_storeu_ps(out + i * 2, _mm256_permute2f128_ps(lo, hi, 0x20));
+        _mm256_storeu_ps(out + i * 2 + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+    }
+    return i;
+}
+
+#elif defined(CPU_ARM64)
+
+inline float32x4_t TpdfNoiseNeon(uint32_t index)
+{
+    const uint32_t lanes[4] = { 0, 1, 2, 3 };
+    uint32x4_t x = vaddq_u32(vdupq_n_u32(index), vld1q_u32(lanes));
+    x = veorq_u32(x, vshrq_n_u32(x, 16));
+    x = vmulq_u32(x, vdupq_n_u32(0x7FEB352Du));
+    x = veorq_u32(x, vshrq_n_u32(x, 15));
+    x = vmulq_u32(x, vdupq_n_u32(0x846CA68Bu));
+    x = veorq_u32(x, vshrq_n_u32(x, 16));
+    int32x4_t diff = vsubq_s32(vreinterpretq_s32_u32(vandq_u32(x, vdupq_n_u32(0xFFFF))), vreinterpretq_s32_u32(vshrq_n_u32(x, 16)));
+    return vmulq_n_f32(vcvtq_f32_s32(diff), 1.0f / 65536.0f);
+}
+
+inline size_t PcmToFloatNeon(const void* in, PcmFormat format, float* out, size_t samples)
+{
+    size_t i = 0;
+    if (format == PcmFormat::Int16)
+    {
+        const int16_t* src = (const int16_t*)in;
+        for (; i + 8 <= samples; i += 8)
+        {
+            int16x8_t v = vld1q_s16(src + i);
+            vst1q_f32(out + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), 1.0f / 32768.0f));
+            vst1q_f32(out + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), 1.0f / 32768.0f));
+        }
+    }
+    else if (format == PcmFormat::Int24)
+    {
+        const uint8_t* src = (const uint8_t*)in;
+        for (; i + 8 <= samples; i += 8)
+        {
+            // De-interleaves the low, middle and high bytes of 8 samples
+            uint8x8x3_t bytes = vld3_u8(src + i * 3);
+            uint16x8_t low = vorrq_u16(vmovl_u8(bytes.val[0]), vshll_n_u8(bytes.val[1], 8));
+            int16x8_t high = vmovl_s8(vreinterpret_s8_u8(bytes.val[2]));
+            int32x4_t a = vorrq_s32(vshlq_n_s32(vmovl_s16(vget_low_s16(high)), 16), vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(low))));
+            int32x4_t b = vorrq_s32(vshlq_n_s32(vmovl_s16(vget_high_s16(high)), 16), vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(low))));
+            vst1q_f32(out + i, vmulq_n_f32(vcvtq_f32_s32(a), 1.0f / 8388608.0f));
+            vst1q_f32(out + i + 4, vmulq_n_f32(vcvtq_f32_s32(b), 1.0f / 8388608.0f));
+        }
+    }
+    else if (format == PcmFormat::Int32)
+    {
+        const int32_t* src = (const int32_t*)in;
+        for (; i + 4 <= samples; i += 4)
+            vst1q_f32(out + i, vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(src + i)), 1.0f / 2147483648.0f));
+    }
+    return i;
+}
+
+inline size_t FloatToPcmNeon(const float* in, PcmFormat format, void* out, size_t samples, bool dither, uint32_t noiseIndex)
+{
+    PcmRange range = PcmOutputRange(format);
+    const float32x4_t lo = vdupq_n_f32(-range.scale);
+    const float32x4_t hi = vdupq_n_f32(range.max);
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8)
+    {
+        float32x4_t a = vmulq_n_f32(vld1q_f32(in + i), range.scale);
+        float32x4_t b = vmulq_n_f32(vld1q_f32(in + i + 4), range.scale);
+        if (dither)
+        {
+            a = vaddq_f32(a, TpdfNoiseNeon(noiseIndex + (uint32_t)i));
+            b = vaddq_f32(b, TpdfNoiseNeon(noiseIndex + (uint32_t)i + 4));
+        }
+        // The "nm" forms pick the number over a NaN, as the scalar clamp does
+        int32x4_t qa = vcvtnq_s32_f32(vminnmq_f32(vmaxnmq_f32(a, lo), hi));
+        int32x4_t qb = vcvtnq_s32_f32(vminnmq_f32(vmaxnmq_f32(b, lo), hi));
+
+        if (format == PcmFormat::Int16)
+        {
+            vst1q_s16((int16_t*)out + i, vcombine_s16(vqmovn_s32(qa), vqmovn_s32(qb)));
+        }
+        else if (format == PcmFormat::Int32)
+        {
+            vst1q_s32((int32_t*)out + i, qa);
+            vst1q_s32((int32_t*)out + i + 4, qb);
+        }
+        else
+        {
+            int32_t values[8];
+            vst1q_s32(values, qa);
+            vst1q_s32(values + 4, qb);
+            for (int k = 0; k < 8; k++) StorePcm(out, PcmFormat::Int24, i + k, values[k]);
+        }
+    }
+    return i;
+}
+
+inline size_t InterleaveToFloatNeon(const int32_t* const* planes, uint32_t channels, float scale, float* out, size_t frames)
+{
+    if (channels != 2) return 0;
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4)
+    {
+        float32x4x2_t v;
+        v.val[0] = vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(planes[0] + i)), scale);
+        v.val[1] = vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(planes[1] + i)), scale);
+        vst2q_f32(out + i * 2, v);
+    }
+    return i;
+}
+
+inline size_t DeinterleaveNeon(const float* in, uint32_t channels, float* const* planes, size_t frames)
+{
+    if (channels != 2) return 0;
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4)
+    {
+        float32x4x2_t v = vld2q_f32(in + i * 2);
+        vst1q_f32(planes[0] + i, v.val[0]);
+        vst1q_f32(planes[1] + i, v.val[1]);
+    }
+    return i;
+}
+
+inline size_t InterleaveNeon(const float* const* planes, uint32_t channels, float* out, size_t frames)
+{
+    if (channels != 2) return 0;
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4)
+    {
+        float32x4x2_t v;
+        v.val[0] = vld1q_f32(planes[0] + i);
+        v.val[1] = vld1q_f32(planes[1] + i);
+        vst2q_f32(out + i * 2, v);
+    }
+    return i;
+}
+
+#endif
+
+// Dispatch
+
+inline void PcmToFloat(const void* in, PcmFormat format, float* out, size_t samples)
+{
+    size_t done = 0;
+    if (format != PcmFormat::Float32)
+    {
+#if defined(CPU_X86)
+        done = GetCpuFeatures().avx2 ? PcmToFloatAvx2(in, format, out, samples) : PcmToFloatSse2(in, format, out, samples);
+#elif defined(CPU_ARM64)
+        done = PcmToFloatNeon(in, format, out, samples);
+#endif
+    }
+    PcmToFloatScalar((const uint8_t*)in + done * PcmBytesPerSample(format), format, out + done, samples - done);
+}
+
+// Interleaved float to 'format'. 'dither' may be null (round to nearest);
+// float output is copied as is.
+inline void FloatToPcm(const float* in, PcmFormat format, void* out, size_t frames, uint32_t channels, SampleDither* dither)
+{
+    size_t samples = frames * channels;
+    if (format == PcmFormat::Float32)
+    {
+        memcpy(out, in, samples * sizeof(float));
+        return;
+    }
+    if (dither && dither->mode == DitherMode::Shaped && channels <= SampleDither::kMaxChannels)
+    {
+        FloatToPcmShaped(in, format, out, frames, channels, *dither);
+        dither->counter += (uint32_t)samples;
+        return;
+    }
+
+    bool useDither = dither && dither->mode != DitherMode::None;
+    uint32_t noiseIndex = dither ? dither->counter : 0;
+    size_t done = 0;
+#if defined(CPU_X86)
+    done = GetCpuFeatures().avx2 ? FloatToPcmAvx2(in, format, out, samples, useDither, noiseIndex)
+                                 : FloatToPcmSse2(in, format, out, samples, useDither, noiseIndex);
+#elif defined(CPU_ARM64)
+    done = FloatToPcmNeon(in, format, out, samples, useDither, noiseIndex);
+#endif
+    FloatToPcmScalar(in + done, format, (uint8_t*)out + done * PcmBytesPerSample(format), samples - done, useDither, noiseIndex + (uint32_t)done);
+    if (dither) dither->counter += (uint32_t)samples;
+}
+
+inline void InterleaveToFloat(const int32_t* const* planes, uint32_t channels, float scale, float* out, size_t frames)
+{
+    size_t done = 0;
+#if defined(CPU_X86)
+    done = GetCpuFeatures().avx2 ? InterleaveToFloatAvx2(planes, channels, scale, out, frames)
+                                 : InterleaveToFloatSse2(planes, channels, scale, out, frames);
+#elif defined(CPU_ARM64)
+    done = InterleaveToFloatNeon(planes, channels, scale, out, frames);
+#endif
+    if (done == frames) return;
+    // The kernels only take stereo
+    const int32_t* rest[2] = { planes[0] + done, channels > 1 ? planes[1] + done : nullptr };
+    InterleaveToFloatScalar(done ? rest : planes, channels, scale, out + done * channels, frames - done);
+}
+
+inline void Deinterleave(const float* in, uint32_t channels, float* const* planes, size_t frames)
+{
+    size_t done = 0;
+#if defined(CPU_X86)
+    done = DeinterleaveSse2(in, channels, planes, frames);
+#elif defined(CPU_ARM64)
+    done = DeinterleaveNeon(in, channels, planes, frames);
+#endif
+    if (done == frames) return;
+    float* rest[2] = { planes[0] + done, channels > 1 ? planes[1] + done : nullptr };
+    DeinterleaveScalar(in + done * channels, channels, done ? rest : planes, frames - done);
+}
+
+inline void Interleave(const float* const* planes, uint32_t channels, float* out, size_t frames)
+{
+    size_t done = 0;
+#if defined(CPU_X86)
+    done = InterleaveSse2(planes, channels, out, frames);
+#elif defined(CPU_ARM64)
+    done = InterleaveNeon(planes, channels, out, frames);
+#endif
+    if (done == frames) return;
+    const float* rest[2] = { planes[0] + done, channels > 1 ? planes[1] + done : nullptr };
+    InterleaveScalar(done ? rest : planes, channels, out + done * channels, frames - done);
+}
+
+// Checks every kernel this CPU runs against the scalar reference, bit for
+// bit, and logs the throughput of each. Returns false on a mismatch.
+inline bool BenchmarkSampleConversion(size_t samples = 1 << 20)
+{
+    typedef size_t (*ToFloatKernel)(const void*, PcmFormat, float*, size_t);
+    typedef size_t (*ToPcmKernel)(const float*, PcmFormat, void*, size_t, bool, uint32_t);
+    typedef size_t (*InterleaveKernel)(const int32_t* const*, uint32_t, float, float*, size_t);
+    struct Kernels
+    {
+        const char* name;
+        ToFloatKernel toFloat;
+        ToPcmKernel toPcm;
+        InterleaveKernel interleave;
+    };
+    std::vector<Kernels> kernels;
+    kernels.push_back({ "scalar", [](const void*, PcmFormat, float*, size_t) -> size_t { return 0; },
+                        [](const float*, PcmFormat, void*, size_t, bool, uint32_t) -> size_t { return 0; },
+                        [](const int32_t* const*, uint32_t, float, float*, size_t) -> size_t { return 0; } });
+#if defined(CPU_X86)
+    kernels.push_back({ "sse2", PcmToFloatSse2, FloatToPcmSse2, InterleaveToFloatSse2 });
+    if (GetCpuFeatures().avx2) kernels.push_back({ "avx2", PcmToFloatAvx2, FloatToPcmAvx2, InterleaveToFloatAvx2 });
+#elif defined(CPU_ARM64)
+    kernels.push_back({ "neon", PcmToFloatNeon, FloatToPcmNeon, InterleaveToFloatNeon });
+#endif
+
+    // Odd length so the scalar tails run too
+    samples |= 7;
+    std::mt19937 random(42);
+    std::vector<uint8_t> pcm(samples * 4);
+    for (auto& byte : pcm) byte = (uint8_t)random();
+    std::vector<float> floats(samples);
+    std::uniform_real_distribution<float> level(-1.2f, 1.2f);
+    for (auto& value : floats) value = level(random);
+    // Rounding ties, full scale, clipping and non-finite values
+    const float kEdges[] = { 0.0f, -0.0f, 1.0f, -1.0f, 0.5f / 32768.0f, 1.5f / 32768.0f, -2.5f / 32768.0f, 32767.5f / 32768.0f,
+                             0.5f / 8388608.0f, 1e30f, -1e30f, INFINITY, -INFINITY, NAN };
+    for (size_t i = 0; i < sizeof(kEdges) / sizeof(kEdges[0]); i++) floats[i * 97] = kEdges[i];
+    std::vector<int32_t> planeData(samples);
+    for (auto& value : planeData) value = (int32_t)(random() & 0xFFFFFF) - 0x800000;
+    const int32_t* planes[2] = { planeData.data(), planeData.data() + samples / 2 };
+    size_t frames = samples / 2;
+
+    std::vector<float> reference(samples), result(samples);
+    std::vector<uint8_t> referencePcm(samples * 4), resultPcm(samples * 4);
+    auto bestOf = [](auto fn)
+    {
+        double best = 1e30;
+        for (int run = 0; run < 10; run++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            fn();
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        return best;
+    };
+
+    bool exact = true;
+    char line[512];
+    static const PcmFormat kFormats[3] = { PcmFormat::Int16, PcmFormat::Int24, PcmFormat::Int32 };
+    static const char* kNames[3] = { "int16", "int24", "int32" };
+    for (int f = 0; f < 3; f++)
+    {
+        PcmFormat format = kFormats[f];
+        size_t bytes = PcmBytesPerSample(format);
+
+        PcmToFloatScalar(pcm.data(), format, reference.data(), samples);
+        int used = snprintf(line, sizeof(line), "%s to float:", kNames[f]);
+        for (const auto& kernel : kernels)
+        {
+            auto run = [&]()
+            {
+                size_t done = kernel.toFloat(pcm.data(), format, result.data(), samples);
+                PcmToFloatScalar(pcm.data() + done * bytes, format, result.data() + done, samples - done);
+            };
+            double seconds = bestOf(run);
+            bool same = memcmp(result.data(), reference.data(), samples * sizeof(float)) == 0;
+            exact &= same;
+            used += snprintf(line + used, sizeof(line) - used, " %s %.0f M/s%s", kernel.name, samples / seconds / 1e6, same ? "" : " MISMATCH");
+        }
+        LogMessage("%s", line);
+
+        for (int dither = 0; dither < 2; dither++)
+        {
+            FloatToPcmScalar(floats.data(), format, referencePcm.data(), samples, dither != 0, 12345);
+            used = snprintf(line, sizeof(line), "float to %s%s:", kNames[f], dither ? " with TPDF dither" : "");
+            for (const auto& kernel : kernels)
+            {
+                auto run = [&]()
+                {
+                    size_t done = kernel.toPcm(floats.data(), format, resultPcm.data(), samples, dither != 0, 12345);
+                    FloatToPcmScalar(floats.data() + done, format, resultPcm.data() + done * bytes, samples - done, dither != 0, 12345 + (uint32_t)done);
+                };
+                double seconds = bestOf(run);
+                bool same = memcmp(resultPcm.data(), referencePcm.data(), samples * bytes) == 0;
+                exact &= same;
+                used += snprintf(line + used, sizeof(line) - used, " %s %.0f M/s%s", kernel.name, samples / seconds / 1e6, same ? "" : " MISMATCH");
+            }
+            LogMessage("%s", line);
+        }
+
+        SampleDither shaped;
+        shaped.mode = DitherMode::Shaped;
+        double seconds = bestOf([&]() { FloatToPcm(floats.data(), format, resultPcm.data(), frames, 2, &shaped); });
+        LogMessage("float to %s noise-shaped: scalar %.0f M/s", kNames[f], frames * 2 / seconds / 1e6);
+    }
+
+    const float kScale = 1.0f / 8388608.0f;
+    InterleaveToFloatScalar(planes, 2, kScale, reference.data(), frames);
+    int used = snprintf(line, sizeof(line), "planar int32 to interleaved float:");
+    for (const auto& kernel : kernels)
+    {
+        auto run = [&]()
+        {
+            size_t done = kernel.interleave(planes, 2, kScale, result.data(), frames);
+            const int32_t* rest[2] = { planes[0] + done, planes[1] + done };
+            InterleaveToFloatScalar(rest, 2, kScale, result.data() + done * 2, frames - done);
+        };
+        double seconds = bestOf(run);
+        bool same = memcmp(result.data(), reference.data(), frames * 2 * sizeof(float)) == 0;
+        exact &= same;
+        used += snprintf(line + used, sizeof(line) - used, " %s %.0f M/s%s", kernel.name, frames * 2 / seconds / 1e6, same ? "" : " MISMATCH");
+    }
+    LogMessage("%s", line);
+
+    // Round trip through planar buffers
+    std::vector<float> left(frames), right(frames), restored(frames * 2);
+    float* split[2] = { left.data(), right.data() };
+    const float* joined[2] = { left.data(), right.data() };
+    double seconds = bestOf([&]() { Deinterleave(floats.data(), 2, split, frames); Interleave(joined, 2, restored.data(), frames); });
+    bool same = memcmp(restored.data(), floats.data(), frames * 2 * sizeof(float)) == 0;
+    exact &= same;
+    LogMessage("stereo deinterleave + interleave: %.0f M/s%s", frames * 2 / seconds / 1e6, same ? "" : " MISMATCH");
+
+    LogMessage("Sample conversion: %s", exact ? "all kernels bit-exact" : "KERNEL MISMATCH");
+    return exact;
+}
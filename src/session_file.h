@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+
+// Player state kept across runs. The state itself is one small fixed-size
+// record, cheap enough to rewrite every few seconds; the playlist it points
+// into is saved beside it as a .wmpl file (see playlist_file.h) and only
+// rewritten when it changes. The record names the playlist snapshot it was
+// written with by entry count and file size, so a state file is never
+// applied to a playlist it does not belong to.
+
+struct SessionState
+{
+    uint64_t trackIndex = 0;
+    int64_t position100ns = 0;      // within the current track
+    int64_t duration100ns = 0;      // of the current track, for the progress bar before it is opened
+    float volume = 1.0f;
+    int32_t eqPreset = 0;
+    int32_t speedIndex = -1;        // -1 = default speed
+    bool trimSilence = false;
+    uint64_t playlistEntries = 0;
+    uint64_t playlistBytes = 0;
+};
+
+struct SessionFileHeader
+{
+    char magic[4];          // "WMSS"
+    uint32_t version;
+    uint64_t trackIndex;
+    int64_t position100ns;
+    int64_t duration100ns;
+    float volume;
+    int32_t eqPreset;
+    int32_t speedIndex;
+    uint32_t flags;             // kSessionFlag*
+    uint64_t playlistEntries;
+    uint64_t playlistBytes;
+};
+static_assert(sizeof(SessionFileHeader) == 64, "session header must stay packed");
+
+const uint32_t kSessionFileVersion = 1;
+const uint32_t kSessionFlagTrimSilence = 1;
+
+inline bool LoadSessionState(const std::filesystem::path& path, SessionState& state)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    SessionFileHeader header;
+    if (!file.read((char*)&header, sizeof(header))) return false;
+    if (memcmp(header.magic, "WMSS", 4) != 0 || header.version != kSessionFileVersion) return false;
+    if (!(header.volume >= 0.0f && header.volume <= 1.0f) || header.position100ns < 0) return false;
+
+    state.trackIndex = header.trackIndex;
+    state.position100ns = header.position100ns;
+    state.duration100ns = header.duration100ns;
+    state.volume = header.volume;
+    state.eqPreset = header.eqPreset;
+    state.speedIndex = header.speedIndex;
+    state.trimSilence = (header.flags & kSessionFlagTrimSilence) != 0;
+    state.playlistEntries = header.playlistEntries;
+    state.playlistBytes = header.playlistBytes;
+    return true;
+}
+
+// Written beside 'path' and renamed into place, so a crash mid-save leaves
+// the previous snapshot intact
+inline bool SaveSessionState(const std::filesystem::path& path, const SessionState& state)
+{
+    SessionFileHeader header = {};
+    memcpy(header.magic, "WMSS", 4);
+    header.version = kSessionFileVersion;
+    header.trackIndex = state.trackIndex;
+    header.position100ns = state.position100ns;
+    header.duration100ns = state.duration100ns;
+    header.volume = state.volume;
+    header.eqPreset = state.eqPreset;
+    header.speedIndex = state.speedIndex;
+    header.flags = state.trimSilence ? kSessionFlagTrimSilence : 0;
+    header.playlistEntries = state.playlistEntries;
+    header.playlistBytes = state.playlistBytes;
+
+    std::filesystem::path tempPath = path;
+    tempPath += L".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file) return false;
+        file.write((const char*)&header, sizeof(header));
+        if (!file.flush()) return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tempPath, path, ec);
+    if (ec)
+    {
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+    return true;
+}
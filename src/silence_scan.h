@@ -0,0 +1,300 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "audio_source.h"
+#include "cpu_features.h"
+
+// Leading and trailing silence. ScanAudibleRange() finds the first and last
+// frame with any sample above a threshold by decoding from the start until
+// the first audible frame, then seeking near the end and working backwards
+// in growing windows until the last one; a track with a few seconds of
+// silence at each end costs a few seconds of decoding, not a full pass.
+// TrimmedSource then plays only that range.
+
+const float kSilenceThreshold = 0.001f;     // -60 dBFS
+
+// Index of the first sample with |x| > threshold, or 'count' if none
+inline size_t FindFirstAboveScalar(const float* samples, size_t count, float threshold)
+{
+    for (size_t i = 0; i < count; i++)
+        if (std::fabs(samples[i]) > threshold) return i;
+    return count;
+}
+
+// Index of the last sample with |x| > threshold, or 'count' if none
+inline size_t FindLastAboveScalar(const float* samples, size_t count, float threshold)
+{
+    for (size_t i = count; i > 0; i--)
+        if (std::fabs(samples[i - 1]) > threshold) return i - 1;
+    return count;
+}
+
+// The SIMD kernels test 16 samples per step and leave the exact position
+// within a step, and the samples they do not cover, to the scalar code.
+// FindFirst kernels return where the scalar search starts: the first step
+// holding a hit, or the uncovered tail. FindLast kernels return where the
+// scalar search (backwards) ends: past the last step holding a hit, or past
+// the uncovered head.
+
+#if defined(CPU_X86)
+
+inline bool AnyAbove16Sse2(const float* p, __m128 threshold)
+{
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    __m128 a = _mm_cmpgt_ps(_mm_and_ps(_mm_loadu_ps(p), absMask), threshold);
+    __m128 b = _mm_cmpgt_ps(_mm_and_ps(_mm_loadu_ps(p + 4), absMask), threshold);
+    __m128 c = _mm_cmpgt_ps(_mm_and_ps(_mm_loadu_ps(p + 8), absMask), threshold);
+    __m128 d = _mm_cmpgt_ps(_mm_and_ps(_mm_loadu_ps(p + 12), absMask), threshold);
+    return _mm_movemask_ps(_mm_or_ps(_mm_or_ps(a, b), _mm_or_ps(c, d))) != 0;
+}
+
+inline size_t FindFirstAboveSse2(const float* samples, size_t count, float threshold)
+{
+    __m128 t = _mm_set1_ps(threshold);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+        if (AnyAbove16Sse2(samples + i, t)) return i;
+    return i;
+}
+
+inline size_t FindLastAboveSse2(const float* samples, size_t count, float threshold)
+{
+    __m128 t = _mm_set1_ps(threshold);
+    size_t i = count;
+    for (; i >= 16; i -= 16)
+        if (AnyAbove16Sse2(samples + i - 16, t)) return i;
+    return i;
+}
+
+TARGET_AVX2 inline bool AnyAbove16Avx2(const float* p, __m256 threshold)
+{
+    const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    __m256 a = _mm256_cmp_ps(_mm256_and_ps(_mm256_loadu_ps(p), absMask), threshold, _CMP_GT_OQ);
+    __m256 b = _mm256_cmp_ps(_mm256_and_ps(_mm256_loadu_ps(p + 8), absMask), threshold, _CMP_GT_OQ);
+    return _mm256_movemask_ps(_mm256_or_ps(a, b)) != 0;
+}
+
+TARGET_AVX2 inline size_t FindFirstAboveAvx2(const float* samples, size_t count, float threshold)
+{
+    __m256 t = _mm256_set1_ps(threshold);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+        if (AnyAbove16Avx2(samples + i, t)) return i;
+    return i;
+}
+
+TARGET_AVX2 inline size_t FindLastAboveAvx2(const float* samples, size_t count, float threshold)
+{
+    __m256 t = _mm256_set1_ps(threshold);
+    size_t i = count;
+    for (; i >= 16; i -= 16)
+        if (AnyAbove16Avx2(samples + i - 16, t)) return i;
+    return i;
+}
+
+#elif defined(CPU_ARM64)
+
+inline bool AnyAbove16Neon(const float* p, float32x4_t threshold)
+{
+    uint32x4_t a = vcagtq_f32(vld1q_f32(p), threshold);
+    uint32x4_t b = vcagtq_f32(vld1q_f32(p + 4), threshold);
+    uint32x4_t c = vcagtq_f32(vld1q_f32(p + 8), threshold);
+    uint32x4_t d = vcagtq_f32(vld1q_f32(p + 12), threshold);
+    return vmaxvq_u32(vorrq_u32(vorrq_u32(a, b), vorrq_u32(c, d))) != 0;
+}
+
+inline size_t FindFirstAboveNeon(const float* samples, size_t count, float threshold)
+{
+    float32x4_t t = vdupq_n_f32(threshold);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+        if (AnyAbove16Neon(samples + i, t)) return i;
+    return i;
+}
+
+inline size_t FindLastAboveNeon(const float* samples, size_t count, float threshold)
+{
+    float32x4_t t = vdupq_n_f32(threshold);
+    size_t i = count;
+    for (; i >= 16; i -= 16)
+        if (AnyAbove16Neon(samples + i - 16, t)) return i;
+    return i;
+}
+
+#endif
+
+inline size_t FindFirstAbove(const float* samples, size_t count, float threshold)
+{
+    size_t start = 0;
+#if defined(CPU_X86)
+    start = GetCpuFeatures().avx2 ? FindFirstAboveAvx2(samples, count, threshold) : FindFirstAboveSse2(samples, count, threshold);
+#elif defined(CPU_ARM64)
+    start = FindFirstAboveNeon(samples, count, threshold);
+#endif
+    return start + FindFirstAboveScalar(samples + start, count - start, threshold);
+}
+
+inline size_t FindLastAbove(const float* samples, size_t count, float threshold)
+{
+    size_t end = count;
+#if defined(CPU_X86)
+    end = GetCpuFeatures().avx2 ? FindLastAboveAvx2(samples, count, threshold) : FindLastAboveSse2(samples, count, threshold);
+#elif defined(CPU_ARM64)
+    end = FindLastAboveNeon(samples, count, threshold);
+#endif
+    size_t last = FindLastAboveScalar(samples, end, threshold);
+    return last == end ? count : last;
+}
+
+// First audible frame and one past the last, in source frames. An empty
+// range means the whole track is below the threshold.
+struct AudibleRange
+{
+    uint64_t start = 0;
+    uint64_t end = 0;
+};
+
+// 'framesDecoded', if given, receives how much of the track had to be decoded.
+// Returns false if nothing could be decoded. Sources that do not know their
+// length are read through to the end; if seeking fails, the end is kept.
+inline bool ScanAudibleRange(AudioSource& source, float threshold, AudibleRange& range, uint64_t* framesDecoded = nullptr)
+{
+    const size_t kScanFrames = 16384;
+    const uint32_t channels = source.Format().channels;
+    std::vector<float> buffer(kScanFrames * channels);
+    uint64_t decoded = 0;
+    range = AudibleRange();
+
+    // Forward from the start to the first audible frame
+    uint64_t position = 0;
+    size_t got = 0;
+    bool found = false;
+    for (;;)
+    {
+        got = source.Read(buffer.data(), kScanFrames);
+        if (got == 0) break;
+        decoded += got;
+        size_t samples = got * channels;
+        size_t hit = FindFirstAbove(buffer.data(), samples, threshold);
+        if (hit < samples)
+        {
+            range.start = position + hit / channels;
+            range.end = position + FindLastAbove(buffer.data(), samples, threshold) / channels + 1;
+            found = true;
+            break;
+        }
+        position += got;
+    }
+    if (framesDecoded) *framesDecoded = decoded;
+    if (!found) return position > 0;
+    position += got;
+
+    // Backwards from the end in windows that double each time, so a long
+    // silent tail still takes few seeks. The first window reads on to the
+    // real end in case the source's length is an estimate.
+    uint64_t total = source.TotalFrames();
+    uint64_t windowEnd = total;
+    uint64_t window = kScanFrames;
+    bool seekable = total > position;
+    while (seekable && windowEnd > position)
+    {
+        uint64_t windowStart = windowEnd - std::min(window, windowEnd - position);
+        if (!source.Seek(windowStart))
+        {
+            // Lost the place: keep the rest of the track
+            range.end = std::max(range.end, total);
+            break;
+        }
+
+        uint64_t limit = windowEnd == total ? ~0ull : windowEnd;
+        bool hitInWindow = false;
+        for (uint64_t at = windowStart; at < limit; at += got)
+        {
+            got = source.Read(buffer.data(), (size_t)std::min<uint64_t>(kScanFrames, limit - at));
+            if (got == 0) break;
+            decoded += got;
+            size_t samples = got * channels;
+            size_t hit = FindLastAbove(buffer.data(), samples, threshold);
+            if (hit < samples)
+            {
+                range.end = at + hit / channels + 1;
+                hitInWindow = true;
+            }
+        }
+        if (hitInWindow) break;
+        windowEnd = windowStart;
+        window *= 2;
+    }
+
+    if (!seekable)
+    {
+        // Read on from where the forward scan stopped
+        for (;;)
+        {
+            got = source.Read(buffer.data(), kScanFrames);
+            if (got == 0) break;
+            decoded += got;
+            size_t samples = got * channels;
+            size_t hit = FindLastAbove(buffer.data(), samples, threshold);
+            if (hit < samples) range.end = position + hit / channels + 1;
+            position += got;
+        }
+    }
+
+    if (framesDecoded) *framesDecoded = decoded;
+    return true;
+}
+
+// Plays frames [start, end) of another source. Positions stay those of the
+// whole track, so the caller seeks to 'start' after loading; seeks before
+// 'start' land on it and reading stops at 'end'. An 'end' of 0 plays to the
+// end of the source, whose length may be unknown.
+class TrimmedSource : public AudioSource
+{
+public:
+    TrimmedSource(std::unique_ptr<AudioSource> source, uint64_t start, uint64_t end)
+        : m_source(std::move(source)), m_start(start), m_end(end), m_position(0)
+    {
+        uint64_t total = m_source->TotalFrames();
+        if (m_end == 0 || (total && m_end > total)) m_end = total;
+        if (m_end && m_start > m_end) m_start = m_end;
+    }
+
+    const AudioFormat& Format() const override { return m_source->Format(); }
+    uint64_t TotalFrames() const override { return m_end; }
+
+    size_t Read(float* out, size_t frames) override
+    {
+        if (m_end)
+        {
+            if (m_position >= m_end) return 0;
+            if (frames > m_end - m_position) frames = (size_t)(m_end - m_position);
+        }
+        size_t got = m_source->Read(out, frames);
+        m_position += got;
+        return got;
+    }
+
+    bool Seek(uint64_t frame) override
+    {
+        if (frame < m_start) frame = m_start;
+        if (m_end && frame > m_end) frame = m_end;
+        if (!m_source->Seek(frame)) return false;
+        m_position = frame;
+        return true;
+    }
+
+    uint64_t StartFrame() const override { return m_start; }
+    bool SeeksExactly() const override { return m_source->SeeksExactly(); }
+
+private:
+    std::unique_ptr<AudioSource> m_source;
+    uint64_t m_start;
+    uint64_t m_end;
+    uint64_t m_position;
+};
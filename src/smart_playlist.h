@@ -0,0 +1,665 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cwchar>
+#include <iterator>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "cpu_features.h"
+#include "log.h"
+#include "metadata_store.h"
+#include "utf8.h"
+
+// Smart playlists: a small query language over the metadata store, e.g.
+//
+//     duration < 6 min AND artist ~ 'beatles' AND NOT played in 30 days
+//
+// Fields: title, artist, album, genre (= exact, != not equal, ~ contains,
+// case-insensitive), duration (s by default; ms, s, min, h or m:ss),
+// year and plays (< <= > >= = !=). "played in N days|weeks|months" matches
+// tracks played within that window, and a bare "played" any played track.
+// Predicates combine with AND/OR/NOT (or && || !) and parentheses.
+//
+// A query compiles to a tree of column tests. Text tests are resolved
+// against the column dictionary at compile time: one matching string
+// becomes an integer compare on its code, several become a code bitset.
+// Evaluation runs a block (MetadataStore::kBlockRows rows) at a time on
+// 64-row bitmasks: a node only looks at rows still alive in its input mask,
+// zone maps settle whole blocks without touching the column, AND stops once
+// its mask is empty and OR only tests rows no earlier branch matched.
+
+class SmartPlaylistQuery
+{
+public:
+    // 'now' anchors "played in" windows
+    bool Compile(std::wstring_view text, const MetadataStore& store, uint32_t now, std::wstring& error)
+    {
+        m_nodes.clear();
+        m_tokens.clear();
+        m_next = 0;
+        m_store = &store;
+        m_now = now;
+        m_error.clear();
+
+        if (!Tokenize(text)) { error = m_error; return false; }
+        m_root = ParseOr();
+        if (m_root >= 0 && Peek().kind != TokenKind::End) Fail(L"Unexpected '" + Peek().text + L"'");
+        if (!m_error.empty()) { error = m_error; return false; }
+        return true;
+    }
+
+    // Rows with tags that match, in row order
+    std::vector<uint32_t> Run(const MetadataStore& store) const
+    {
+        std::vector<uint32_t> rows;
+        uint64_t mask[MetadataStore::kBlockWords];
+        for (size_t block = 0; block < store.Blocks(); block++)
+        {
+            const uint64_t* tagged = store.TaggedBits() + block * MetadataStore::kBlockWords;
+            Evaluate(store, m_root, block, tagged, mask);
+            for (size_t w = 0; w < MetadataStore::kBlockWords; w++)
+            {
+                uint64_t bits = mask[w];
+                uint32_t base = (uint32_t)((block * MetadataStore::kBlockWords + w) * 64);
+                while (bits)
+                {
+                    rows.push_back(base + MetadataStore::CountTrailingZeros(bits));
+                    bits &= bits - 1;
+                }
+            }
+        }
+        return rows;
+    }
+
+private:
+    enum class TokenKind { Word, String, Op, LParen, RParen, End };
+
+    struct Token
+    {
+        TokenKind kind;
+        std::wstring text;
+    };
+
+    enum class NodeKind { False, True, Compare, CodeSet, And, Or, Not };
+    enum class CompareOp { Less, Greater, Equal };
+
+    struct Node
+    {
+        NodeKind kind = NodeKind::False;
+        MetadataColumn column = MetadataColumn::Title;
+        CompareOp op = CompareOp::Equal;
+        bool invert = false;            // Compare: <=, >= and != are the negated <, > and =
+        uint32_t value = 0;
+        std::vector<uint64_t> codes;    // CodeSet: one bit per dictionary code
+        std::vector<int> children;
+    };
+
+    // Parsing
+
+    bool Tokenize(std::wstring_view text)
+    {
+        size_t i = 0;
+        while (i < text.size())
+        {
+            wchar_t ch = text[i];
+            if (iswspace(ch)) { i++; continue; }
+            Token token;
+            if (ch == L'(' || ch == L')')
+            {
+                token.kind = ch == L'(' ? TokenKind::LParen : TokenKind::RParen;
+                token.text.assign(1, ch);
+                i++;
+            }
+            else if (ch == L'\'' || ch == L'"')
+            {
+                size_t close = text.find(ch, i + 1);
+                if (close == std::wstring_view::npos) return Fail(L"Unterminated string");
+                token.kind = TokenKind::String;
+                token.text = text.substr(i + 1, close - i - 1);
+                i = close + 1;
+            }
+            else if ((ch == L'&' || ch == L'|') && i + 1 < text.size() && text[i + 1] == ch)
+            {
+                token.kind = TokenKind::Word;
+                token.text = ch == L'&' ? L"and" : L"or";
+                i += 2;
+            }
+            else if (ch == L'!' && (i + 1 >= text.size() || text[i + 1] != L'='))
+            {
+                token.kind = TokenKind::Word;
+                token.text = L"not";
+                i++;
+            }
+            else if (wcschr(L"<>=!~", ch))
+            {
+                token.kind = TokenKind::Op;
+                token.text.assign(1, ch);
+                i++;
+                if (i < text.size() && text[i] == L'=' && ch != L'~') token.text += text[i++];
+                if (token.text == L"==") token.text = L"=";
+            }
+            else
+            {
+                token.kind = TokenKind::Word;
+                size_t start = i;
+                while (i < text.size() && !iswspace(text[i]) && !wcschr(L"()<>=!~'\"&|", text[i])) i++;
+                if (i == start) return Fail(std::wstring(L"Unexpected '") + ch + L"'");
+                token.text = text.substr(start, i - start);
+            }
+            m_tokens.push_back(token);
+        }
+        m_tokens.push_back(Token{ TokenKind::End, L"end of query" });
+        return true;
+    }
+
+    bool Fail(const std::wstring& message)
+    {
+        if (m_error.empty()) m_error = message;
+        return false;
+    }
+
+    const Token& Peek() const { return m_tokens[m_next]; }
+
+    bool IsWord(const wchar_t* word) const
+    {
+        return Peek().kind == TokenKind::Word && StringDictionary::Fold(Peek().text) == word;
+    }
+
+    int Add(Node node)
+    {
+        m_nodes.push_back(std::move(node));
+        return (int)m_nodes.size() - 1;
+    }
+
+    int Combine(NodeKind kind, int left, int right)
+    {
+        if (left < 0 || right < 0) return -1;
+        if (m_nodes[left].kind == kind)
+        {
+            m_nodes[left].children.push_back(right);
+            return left;
+        }
+        Node node;
+        node.kind = kind;
+        node.children = { left, right };
+        return Add(node);
+    }
+
+    int ParseOr()
+    {
+        int node = ParseAnd();
+        while (node >= 0 && IsWord(L"or"))
+        {
+            m_next++;
+            node = Combine(NodeKind::Or, node, ParseAnd());
+        }
+        return node;
+    }
+
+    int ParseAnd()
+    {
+        int node = ParseNot();
+        while (node >= 0 && IsWord(L"and"))
+        {
+            m_next++;
+            node = Combine(NodeKind::And, node, ParseNot());
+        }
+        return node;
+    }
+
+    int ParseNot()
+    {
+        if (!IsWord(L"not")) return ParsePrimary();
+        m_next++;
+        int child = ParseNot();
+        if (child < 0) return -1;
+        Node node;
+        node.kind = NodeKind::Not;
+        node.children = { child };
+        return Add(node);
+    }
+
+    int ParsePrimary()
+    {
+        if (Peek().kind == TokenKind::LParen)
+        {
+            m_next++;
+            int node = ParseOr();
+            if (node < 0) return -1;
+            if (Peek().kind != TokenKind::RParen) { Fail(L"Missing ')'"); return -1; }
+            m_next++;
+            return node;
+        }
+        if (Peek().kind != TokenKind::Word) { Fail(L"Expected a field, found '" + Peek().text + L"'"); return -1; }
+
+        std::wstring field = StringDictionary::Fold(Peek().text);
+        m_next++;
+        if (field == L"played") return ParsePlayed();
+
+        static const struct { const wchar_t* name; MetadataColumn column; } kFields[] =
+        {
+            { L"title", MetadataColumn::Title }, { L"artist", MetadataColumn::Artist },
+            { L"album", MetadataColumn::Album }, { L"genre", MetadataColumn::Genre },
+            { L"duration", MetadataColumn::Duration }, { L"length", MetadataColumn::Duration },
+            { L"year", MetadataColumn::Year }, { L"plays", MetadataColumn::PlayCount },
+            { L"bpm", MetadataColumn::Bpm }, { L"tempo", MetadataColumn::Bpm },
+        };
+        const auto* match = std::find_if(std::begin(kFields), std::end(kFields), [&](const auto& f) { return field == f.name; });
+        if (match == std::end(kFields)) { Fail(L"Unknown field '" + field + L"'"); return -1; }
+
+        if (Peek().kind != TokenKind::Op) { Fail(L"Expected an operator after '" + field + L"'"); return -1; }
+        std::wstring op = Peek().text;
+        m_next++;
+        if (Peek().kind != TokenKind::Word && Peek().kind != TokenKind::String) { Fail(L"Expected a value after '" + op + L"'"); return -1; }
+
+        if ((size_t)match->column < kMetadataTextColumns) return ParseTextTest(match->column, op);
+        return ParseNumberTest(match->column, op);
+    }
+
+    // played [in|within] [the] [last|past] N days|weeks|months
+    int ParsePlayed()
+    {
+        if (IsWord(L"in") || IsWord(L"within"))
+        {
+            m_next++;
+            if (IsWord(L"the")) m_next++;
+            if (IsWord(L"last") || IsWord(L"past")) m_next++;
+            double count = 0.0;
+            std::wstring unit;
+            if (Peek().kind != TokenKind::Word || !SplitNumber(Peek().text, count, unit)) { Fail(L"Expected a number of days"); return -1; }
+            m_next++;
+            if (unit.empty() && Peek().kind == TokenKind::Word) unit = StringDictionary::Fold(m_tokens[m_next++].text);
+
+            uint64_t seconds = unit == L"h" || unit == L"hour" || unit == L"hours" ? 3600
+                             : unit == L"d" || unit == L"day" || unit == L"days" ? 86400
+                             : unit == L"w" || unit == L"week" || unit == L"weeks" ? 7 * 86400
+                             : unit == L"month" || unit == L"months" ? 30 * 86400
+                             : unit == L"y" || unit == L"year" || unit == L"years" ? 365 * 86400 : 0;
+            if (seconds == 0) { Fail(L"Unknown time unit '" + unit + L"'"); return -1; }
+
+            // lastPlayed >= now - window; never-played rows hold 0
+            uint64_t window = (uint64_t)(seconds * count);
+            Node node;
+            node.kind = NodeKind::Compare;
+            node.column = MetadataColumn::LastPlayed;
+            node.op = CompareOp::Less;
+            node.invert = true;
+            node.value = window >= m_now ? 1 : (uint32_t)(m_now - window);
+            return Add(node);
+        }
+
+        Node node;
+        node.kind = NodeKind::Compare;
+        node.column = MetadataColumn::PlayCount;
+        node.op = CompareOp::Greater;
+        node.value = 0;
+        return Add(node);
+    }
+
+    int ParseTextTest(MetadataColumn column, const std::wstring& op)
+    {
+        std::wstring value = StringDictionary::Fold(m_tokens[m_next++].text);
+        if (op != L"=" && op != L"!=" && op != L"~") { Fail(L"Text fields take =, != or ~"); return -1; }
+
+        // The distinct strings are few next to the rows: find the codes once
+        const StringDictionary& strings = m_store->Strings(column);
+        Node set;
+        set.kind = NodeKind::CodeSet;
+        set.column = column;
+        set.codes.assign((strings.Count() + 63) / 64, 0);
+        uint32_t matches = 0, lastMatch = 0;
+        for (uint32_t code = 0; code < strings.Count(); code++)
+        {
+            const std::wstring& text = strings.Folded(code);
+            bool hit = op == L"~" ? (!value.empty() ? text.find(value) != std::wstring::npos : true) : text == value;
+            if (!hit) continue;
+            set.codes[code / 64] |= 1ull << (code % 64);
+            matches++;
+            lastMatch = code;
+        }
+
+        Node node;
+        if (matches == 0)
+        {
+            node.kind = NodeKind::False;
+        }
+        else if (matches == 1)
+        {
+            node.kind = NodeKind::Compare;
+            node.column = column;
+            node.op = CompareOp::Equal;
+            node.value = lastMatch;
+        }
+        else
+        {
+            node = std::move(set);
+        }
+        int id = Add(std::move(node));
+        if (op != L"!=") return id;
+
+        Node negate;
+        negate.kind = NodeKind::Not;
+        negate.children = { id };
+        return Add(negate);
+    }
+
+    // Leading number (with an optional m:ss part) and whatever follows it
+    static bool SplitNumber(const std::wstring& text, double& number, std::wstring& unit)
+    {
+        size_t i = 0;
+        double value = 0.0;
+        while (i < text.size() && iswdigit(text[i])) value = value * 10 + (text[i++] - L'0');
+        if (i == 0) return false;
+        if (i < text.size() && text[i] == L':')
+        {
+            size_t start = ++i;
+            double seconds = 0.0;
+            while (i < text.size() && iswdigit(text[i])) seconds = seconds * 10 + (text[i++] - L'0');
+            if (i == start) return false;
+            value = value * 60 + seconds;
+            unit = L"s";
+        }
+        else if (i < text.size() && text[i] == L'.')
+        {
+            double scale = 0.1;
+            for (i++; i < text.size() && iswdigit(text[i]); i++, scale *= 0.1) value += (text[i] - L'0') * scale;
+        }
+        if (i < text.size())
+        {
+            if (!unit.empty()) return false;
+            unit = StringDictionary::Fold(text.substr(i));
+        }
+        number = value;
+        return true;
+    }
+
+    int ParseNumberTest(MetadataColumn column, const std::wstring& op)
+    {
+        const Token& token = m_tokens[m_next++];
+        double number = 0.0;
+        std::wstring unit;
+        if (token.kind != TokenKind::Word || !SplitNumber(token.text, number, unit)) { Fail(L"Expected a number, found '" + token.text + L"'"); return -1; }
+
+        double value = number;
+        if (column == MetadataColumn::Duration)
+        {
+            static const struct { const wchar_t* name; uint32_t ms; } kUnits[] =
+            {
+                { L"ms", 1 }, { L"s", 1000 }, { L"sec", 1000 }, { L"secs", 1000 }, { L"seconds", 1000 },
+                { L"m", 60000 }, { L"min", 60000 }, { L"mins", 60000 }, { L"minutes", 60000 },
+                { L"h", 3600000 }, { L"hour", 3600000 }, { L"hours", 3600000 },
+            };
+            if (unit.empty() && Peek().kind == TokenKind::Word &&
+                std::any_of(std::begin(kUnits), std::end(kUnits), [&](const auto& u) { return StringDictionary::Fold(Peek().text) == u.name; }))
+            {
+                unit = StringDictionary::Fold(m_tokens[m_next++].text);
+            }
+            if (unit.empty()) unit = L"s";
+            const auto* match = std::find_if(std::begin(kUnits), std::end(kUnits), [&](const auto& u) { return unit == u.name; });
+            if (match == std::end(kUnits)) { Fail(L"Unknown duration unit '" + unit + L"'"); return -1; }
+            value = number * match->ms;
+        }
+        else if (!unit.empty())
+        {
+            Fail(L"Unexpected unit '" + unit + L"'");
+            return -1;
+        }
+        else if (column == MetadataColumn::Bpm)
+        {
+            value = number * 10.0;
+        }
+        value = std::min(value + 0.5, 4294967295.0);
+
+        Node node;
+        node.kind = NodeKind::Compare;
+        node.column = column;
+        node.value = (uint32_t)value;
+        if (op == L"<") node.op = CompareOp::Less;
+        else if (op == L">=") { node.op = CompareOp::Less; node.invert = true; }
+        else if (op == L">") node.op = CompareOp::Greater;
+        else if (op == L"<=") { node.op = CompareOp::Greater; node.invert = true; }
+        else if (op == L"=") node.op = CompareOp::Equal;
+        else if (op == L"!=") { node.op = CompareOp::Equal; node.invert = true; }
+        else { Fail(L"Numeric fields take < <= > >= = or !="); return -1; }
+        return Add(node);
+    }
+
+    // Evaluation
+
+    // Whole-block answer from the zone map: 0 = no row matches, 1 = every
+    // tagged row matches, -1 = look at the rows
+    static int ZoneVerdict(const Node& node, const MetadataStore::Zone& zone)
+    {
+        if (zone.min > zone.max) return 0;
+        int verdict = -1;
+        switch (node.op)
+        {
+        case CompareOp::Less:
+            verdict = zone.min >= node.value ? 0 : zone.max < node.value ? 1 : -1;
+            break;
+        case CompareOp::Greater:
+            verdict = zone.max <= node.value ? 0 : zone.min > node.value ? 1 : -1;
+            break;
+        case CompareOp::Equal:
+            verdict = node.value < zone.min || node.value > zone.max ? 0 : zone.min == zone.max ? 1 : -1;
+            break;
+        }
+        return verdict < 0 || !node.invert ? verdict : 1 - verdict;
+    }
+
+    // One bit per value in values[0..63]
+    template <CompareOp Op> static uint64_t CompareWord(const uint32_t* values, uint32_t constant)
+    {
+        uint64_t bits = 0;
+#if defined(CPU_X86)
+        // SSE2 only compares signed lanes: flip the top bit of both sides
+        const __m128i bias = _mm_set1_epi32((int)0x80000000);
+        const __m128i c = _mm_set1_epi32((int)(constant ^ 0x80000000));
+        for (int i = 0; i < 64; i += 4)
+        {
+            __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(values + i)), bias);
+            __m128i r = Op == CompareOp::Less ? _mm_cmplt_epi32(v, c) : Op == CompareOp::Greater ? _mm_cmpgt_epi32(v, c) : _mm_cmpeq_epi32(v, c);
+            bits |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(r)) << i;
+        }
+#elif defined(CPU_ARM64)
+        const uint32x4_t c = vdupq_n_u32(constant);
+        const uint32_t laneBits[4] = { 1, 2, 4, 8 };
+        const uint32x4_t weights = vld1q_u32(laneBits);
+        for (int i = 0; i < 64; i += 4)
+        {
+            uint32x4_t v = vld1q_u32(values + i);
+            uint32x4_t r = Op == CompareOp::Less ? vcltq_u32(v, c) : Op == CompareOp::Greater ? vcgtq_u32(v, c) : vceqq_u32(v, c);
+            bits |= (uint64_t)vaddvq_u32(vandq_u32(r, weights)) << i;
+        }
+#else
+        for (int i = 0; i < 64; i++)
+        {
+            bool hit = Op == CompareOp::Less ? values[i] < constant : Op == CompareOp::Greater ? values[i] > constant : values[i] == constant;
+            bits |= (uint64_t)hit << i;
+        }
+#endif
+        return bits;
+    }
+
+    template <CompareOp Op> static void CompareBlock(const uint32_t* values, uint32_t constant, bool invert, const uint64_t* active, uint64_t* out)
+    {
+        for (size_t w = 0; w < MetadataStore::kBlockWords; w++)
+        {
+            if (active[w] == 0) { out[w] = 0; continue; }
+            uint64_t bits = CompareWord<Op>(values + w * 64, constant);
+            out[w] = (invert ? ~bits : bits) & active[w];
+        }
+    }
+
+    // out = rows of 'active' in 'block' that match node 'id'
+    void Evaluate(const MetadataStore& store, int id, size_t block, const uint64_t* active, uint64_t* out) const
+    {
+        const size_t kWords = MetadataStore::kBlockWords;
+        const Node& node = m_nodes[id];
+        switch (node.kind)
+        {
+        case NodeKind::False:
+            std::fill(out, out + kWords, 0);
+            break;
+
+        case NodeKind::True:
+            std::copy(active, active + kWords, out);
+            break;
+
+        case NodeKind::Compare:
+        {
+            int verdict = ZoneVerdict(node, store.BlockZone(node.column, block));
+            if (verdict == 0) { std::fill(out, out + kWords, 0); break; }
+            if (verdict == 1) { std::copy(active, active + kWords, out); break; }
+            const uint32_t* values = store.Column(node.column) + block * MetadataStore::kBlockRows;
+            if (node.op == CompareOp::Less) CompareBlock<CompareOp::Less>(values, node.value, node.invert, active, out);
+            else if (node.op == CompareOp::Greater) CompareBlock<CompareOp::Greater>(values, node.value, node.invert, active, out);
+            else CompareBlock<CompareOp::Equal>(values, node.value, node.invert, active, out);
+            break;
+        }
+
+        case NodeKind::CodeSet:
+        {
+            const uint32_t* values = store.Column(node.column) + block * MetadataStore::kBlockRows;
+            const size_t codeWords = node.codes.size();
+            for (size_t w = 0; w < kWords; w++)
+            {
+                uint64_t bits = 0;
+                uint64_t rows = active[w];
+                while (rows)
+                {
+                    int i = MetadataStore::CountTrailingZeros(rows);
+                    uint32_t code = values[w * 64 + i];
+                    // Codes added after compiling are not in the set
+                    if (code / 64 < codeWords && (node.codes[code / 64] >> (code % 64)) & 1) bits |= 1ull << i;
+                    rows &= rows - 1;
+                }
+                out[w] = bits;
+            }
+            break;
+        }
+
+        case NodeKind::And:
+        {
+            uint64_t scratch[MetadataStore::kBlockWords];
+            const uint64_t* input = active;
+            for (size_t c = 0; c < node.children.size(); c++)
+            {
+                Evaluate(store, node.children[c], block, input, out);
+                if (std::all_of(out, out + kWords, [](uint64_t word) { return word == 0; })) break;
+                std::copy(out, out + kWords, scratch);
+                input = scratch;
+            }
+            break;
+        }
+
+        case NodeKind::Or:
+        {
+            uint64_t remaining[MetadataStore::kBlockWords];
+            uint64_t matched[MetadataStore::kBlockWords];
+            std::copy(active, active + kWords, remaining);
+            std::fill(out, out + kWords, 0);
+            for (size_t c = 0; c < node.children.size(); c++)
+            {
+                Evaluate(store, node.children[c], block, remaining, matched);
+                bool any = false;
+                for (size_t w = 0; w < kWords; w++)
+                {
+                    out[w] |= matched[w];
+                    remaining[w] &= ~matched[w];
+                    any |= remaining[w] != 0;
+                }
+                if (!any) break;
+            }
+            break;
+        }
+
+        case NodeKind::Not:
+        {
+            Evaluate(store, node.children[0], block, active, out);
+            for (size_t w = 0; w < kWords; w++) out[w] = active[w] & ~out[w];
+            break;
+        }
+        }
+    }
+
+    std::vector<Node> m_nodes;
+    int m_root = -1;
+
+    // Compile state
+    std::vector<Token> m_tokens;
+    size_t m_next = 0;
+    const MetadataStore* m_store = nullptr;
+    uint32_t m_now = 0;
+    std::wstring m_error;
+};
+
+inline uint32_t UnixTimeNow()
+{
+    return (uint32_t)std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Times a few queries over a synthetic library of 'rows' tracks
+inline void BenchmarkSmartPlaylists(size_t rows)
+{
+    auto start = std::chrono::steady_clock::now();
+    MetadataStore store;
+    std::mt19937 random(1234);
+    const uint32_t now = UnixTimeNow();
+    static const wchar_t* kGenres[] = { L"Rock", L"Pop", L"Jazz", L"Classical", L"Electronic", L"Hip-Hop", L"Folk", L"Metal" };
+
+    store.Resize(rows);
+    TrackTags tags;
+    for (size_t row = 0; row < rows; row++)
+    {
+        uint32_t artist = random() % 20000;
+        tags.title = L"Track " + std::to_wstring(row);
+        tags.artist = L"Artist " + std::to_wstring(artist);
+        tags.album = L"Album " + std::to_wstring(artist) + L"-" + std::to_wstring(random() % 8);
+        tags.genre = kGenres[artist % 8];
+        tags.year = 1960 + random() % 65;
+        tags.durationMs = 90000 + random() % 510000;
+        store.Set((uint32_t)row, tags);
+        if (random() % 3 == 0) store.MarkPlayed((uint32_t)row, now - random() % (365 * 86400));
+    }
+    store.RebuildZoneMaps();
+    LogMessage("Smart playlist benchmark: %zu rows built in %.0f ms", rows,
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+    static const wchar_t* kQueries[] =
+    {
+        L"duration < 6 min AND artist ~ 'artist 12' AND NOT played in 30 days",
+        L"genre = jazz AND year >= 1990",
+        L"(genre = rock OR genre = metal) AND duration > 4:30",
+        L"title ~ '99' OR plays > 0 AND year < 1970",
+        L"album ~ '-3' AND NOT (year > 2000 OR played in 2 weeks)",
+    };
+    for (const wchar_t* text : kQueries)
+    {
+        SmartPlaylistQuery query;
+        std::wstring error;
+        const int kRuns = 20;
+        double best = 1e30, compileMs = 0.0;
+        size_t matches = 0;
+        for (int run = 0; run < kRuns; run++)
+        {
+            auto t0 = std::chrono::steady_clock::now();
+            if (!query.Compile(text, store, now, error))
+            {
+                LogMessage("Query failed to compile: %s", WideToUtf8(error).c_str());
+                break;
+            }
+            auto t1 = std::chrono::steady_clock::now();
+            matches = query.Run(store).size();
+            auto t2 = std::chrono::steady_clock::now();
+            compileMs = std::chrono::duration<double, std::milli>(t1 - t0).count();
+            best = std::min(best, std::chrono::duration<double, std::milli>(t2 - t1).count());
+        }
+        LogMessage("  %s: %zu matches, %.2f ms (compile %.2f ms)", WideToUtf8(text).c_str(), matches, best, compileMs);
+    }
+}
@@ -0,0 +1,409 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "utf8.h"
+#include "wav_file.h"
+
+// Track metadata for the library: the common text tags and the duration,
+// read straight from the file headers without decoding audio. Handles FLAC
+// (STREAMINFO + Vorbis comments), WAV (fmt/data + LIST INFO) and MP3 (ID3v2,
+// ID3v1 and the Xing/Info/VBRI frame count, or the CBR bitrate). Anything
+// else gets the file name as its title.
+
+struct TrackTags
+{
+    std::wstring title;
+    std::wstring artist;
+    std::wstring album;
+    std::wstring genre;
+    uint32_t year = 0;
+    uint32_t durationMs = 0;
+};
+
+inline uint32_t ReadBE32(const uint8_t* p) { return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]; }
+
+// First four-digit number in a date field ("2004", "2004-05-01")
+inline uint32_t ParseTagYear(std::wstring_view text)
+{
+    for (size_t i = 0; i + 4 <= text.size(); i++)
+    {
+        uint32_t year = 0;
+        size_t k = 0;
+        for (; k < 4 && text[i + k] >= L'0' && text[i + k] <= L'9'; k++) year = year * 10 + (text[i + k] - L'0');
+        if (k == 4) return year;
+    }
+    return 0;
+}
+
+inline void TrimTagText(std::wstring& text)
+{
+    size_t end = text.size();
+    while (end > 0 && (text[end - 1] == L'\0' || text[end - 1] == L' ')) end--;
+    size_t start = 0;
+    while (start < end && text[start] == L' ') start++;
+    text = text.substr(start, end - start);
+}
+
+// UTF-8 if it decodes cleanly, otherwise Windows-1252 (older RIFF INFO tags)
+inline void DecodeTagBytes(std::string_view bytes, std::wstring& out)
+{
+    if (!Utf8ToWide(bytes, out)) Cp1252ToWide(bytes, out);
+    TrimTagText(out);
+}
+
+inline bool ReadFlacTags(std::ifstream& file, TrackTags& tags)
+{
+    file.seekg(4, std::ios::beg);
+    bool last = false;
+    while (!last)
+    {
+        uint8_t header[4];
+        if (!file.read((char*)header, 4)) return false;
+        last = (header[0] & 0x80) != 0;
+        uint32_t type = header[0] & 0x7F;
+        uint32_t length = ((uint32_t)header[1] << 16) | ((uint32_t)header[2] << 8) | header[3];
+
+        if (type == 0 && length >= 34)
+        {
+            uint8_t info[34];
+            if (!file.read((char*)info, 34)) return false;
+            file.seekg(length - 34, std::ios::cur);
+            uint32_t sampleRate = ((uint32_t)info[10] << 12) | ((uint32_t)info[11] << 4) | (info[12] >> 4);
+            uint64_t totalSamples = ((uint64_t)(info[13] & 0x0F) << 32) | ReadBE32(info + 14);
+            if (sampleRate) tags.durationMs = (uint32_t)(totalSamples * 1000 / sampleRate);
+        }
+        else if (type == 4 && length <= (4u << 20))
+        {
+            std::vector<uint8_t> block(length);
+            if (!file.read((char*)block.data(), length)) return false;
+
+            // Little-endian lengths: vendor string, count, then "KEY=value" entries
+            size_t pos = 0;
+            if (length < 8) continue;
+            pos = 4 + (size_t)ReadLE32(block.data());
+            if (pos + 4 > length) continue;
+            uint32_t count = ReadLE32(block.data() + pos);
+            pos += 4;
+            for (uint32_t i = 0; i < count && pos + 4 <= length; i++)
+            {
+                uint32_t size = ReadLE32(block.data() + pos);
+                pos += 4;
+                if (size > length - pos) break;
+                std::string_view entry((const char*)block.data() + pos, size);
+                pos += size;
+
+                size_t equals = entry.find('=');
+                if (equals == std::string_view::npos) continue;
+                std::string key(entry.substr(0, equals));
+                for (auto& ch : key) ch = (char)toupper((unsigned char)ch);
+                std::string_view value = entry.substr(equals + 1);
+
+                std::wstring* field = key == "TITLE" ? &tags.title : key == "ARTIST" ? &tags.artist :
+                                      key == "ALBUM" ? &tags.album : key == "GENRE" ? &tags.genre : nullptr;
+                if (field && field->empty())
+                {
+                    DecodeTagBytes(value, *field);
+                }
+                else if (key == "DATE" && tags.year == 0)
+                {
+                    std::wstring date;
+                    DecodeTagBytes(value, date);
+                    tags.year = ParseTagYear(date);
+                }
+            }
+        }
+        else
+        {
+            file.seekg(length, std::ios::cur);
+        }
+    }
+    return true;
+}
+
+inline bool ReadWavTags(std::ifstream& file, TrackTags& tags)
+{
+    file.seekg(12, std::ios::beg);
+    uint32_t byteRate = 0;
+    uint64_t dataBytes = 0;
+    for (;;)
+    {
+        uint8_t chunk[8];
+        if (!file.read((char*)chunk, 8)) break;
+        uint32_t size = ReadLE32(chunk + 4);
+        uint32_t padded = size + (size & 1);
+
+        if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16)
+        {
+            uint8_t fmt[16];
+            if (!file.read((char*)fmt, 16)) break;
+            byteRate = ReadLE32(fmt + 8);
+            file.seekg(padded - 16, std::ios::cur);
+        }
+        else if (memcmp(chunk, "data", 4) == 0)
+        {
+            dataBytes = size;
+            file.seekg(padded, std::ios::cur);
+        }
+        else if (memcmp(chunk, "LIST", 4) == 0 && size >= 4 && size <= (1u << 20))
+        {
+            std::vector<uint8_t> list(size);
+            if (!file.read((char*)list.data(), size)) break;
+            file.seekg(padded - size, std::ios::cur);
+            if (memcmp(list.data(), "INFO", 4) != 0) continue;
+
+            for (size_t pos = 4; pos + 8 <= size;)
+            {
+                const uint8_t* item = list.data() + pos;
+                uint32_t itemSize = ReadLE32(item + 4);
+                if (itemSize > size - pos - 8) break;
+                std::string_view text((const char*)item + 8, itemSize);
+                size_t nul = text.find('\0');
+                if (nul != std::string_view::npos) text = text.substr(0, nul);
+
+                std::wstring* field = memcmp(item, "INAM", 4) == 0 ? &tags.title : memcmp(item, "IART", 4) == 0 ? &tags.artist :
+                                      memcmp(item, "IPRD", 4) == 0 ? &tags.album : memcmp(item, "IGNR", 4) == 0 ? &tags.genre : nullptr;
+                if (field)
+                {
+                    DecodeTagBytes(text, *field);
+                }
+                else if (memcmp(item, "ICRD", 4) == 0)
+                {
+                    std::wstring date;
+                    DecodeTagBytes(text, date);
+                    tags.year = ParseTagYear(date);
+                }
+                pos += 8 + itemSize + (itemSize & 1);
+            }
+        }
+        else
+        {
+            file.seekg(padded, std::ios::cur);
+        }
+    }
+    if (byteRate) tags.durationMs = (uint32_t)(dataBytes * 1000 / byteRate);
+    return byteRate != 0;
+}
+
+// ID3v2 text frame body: encoding byte, then text; only the first of
+// several NUL-separated values is kept
+inline void DecodeId3Text(const uint8_t* data, size_t size, std::wstring& out)
+{
+    out.clear();
+    if (size < 1) return;
+    uint8_t encoding = data[0];
+    data++;
+    size--;
+
+    if (encoding == 1 || encoding == 2)
+    {
+        bool bigEndian = encoding == 2;
+        if (size >= 2 && data[0] == 0xFF && data[1] == 0xFE) { bigEndian = false; data += 2; size -= 2; }
+        else if (size >= 2 && data[0] == 0xFE && data[1] == 0xFF) { bigEndian = true; data += 2; size -= 2; }
+        size_t end = 0;
+        while (end + 1 < size && (data[end] | data[end + 1]) != 0) end += 2;
+        Utf16ToWide(data, end, bigEndian, out);
+    }
+    else
+    {
+        size_t end = 0;
+        while (end < size && data[end] != 0) end++;
+        std::string_view text((const char*)data, end);
+        if (encoding == 3)
+            Utf8ToWide(text, out);
+        else
+            Cp1252ToWide(text, out);
+    }
+    TrimTagText(out);
+}
+
+// Frame count / sample count of the first MPEG audio frame at 'header'.
+// Returns the duration in ms, or 0 if 'header' is not a frame header.
+inline uint32_t Mp3DurationFromFrame(const uint8_t* header, size_t available, uint64_t audioBytes)
+{
+    static const uint16_t kBitrates[2][3][15] =
+    {
+        {   // MPEG-1: layer I, II, III
+            { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },
+            { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384 },
+            { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 },
+        },
+        {   // MPEG-2 and 2.5
+            { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256 },
+            { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },
+            { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },
+        },
+    };
+    static const uint32_t kSampleRates[3] = { 44100, 48000, 32000 };
+
+    if (available < 4 || header[0] != 0xFF || (header[1] & 0xE0) != 0xE0) return 0;
+    uint32_t versionBits = (header[1] >> 3) & 3;   // 0 = 2.5, 2 = 2, 3 = 1
+    uint32_t layerBits = (header[1] >> 1) & 3;     // 1 = III, 2 = II, 3 = I
+    uint32_t bitrateIndex = header[2] >> 4;
+    uint32_t rateIndex = (header[2] >> 2) & 3;
+    if (versionBits == 1 || layerBits == 0 || bitrateIndex == 15 || rateIndex == 3) return 0;
+
+    bool mpeg1 = versionBits == 3;
+    int layer = 4 - (int)layerBits;
+    uint32_t sampleRate = kSampleRates[rateIndex] >> (versionBits == 3 ? 0 : versionBits == 2 ? 1 : 2);
+    uint32_t samplesPerFrame = layer == 1 ? 384 : (layer == 3 && !mpeg1) ? 576 : 1152;
+    bool mono = (header[3] >> 6) == 3;
+
+    // VBR files carry a total frame count in their first frame
+    size_t xing = 4 + (mpeg1 ? (mono ? 17 : 32) : (mono ? 9 : 17));
+    if (available >= xing + 12 && (memcmp(header + xing, "Xing", 4) == 0 || memcmp(header + xing, "Info", 4) == 0))
+    {
+        uint32_t flags = ReadBE32(header + xing + 4);
+        if (flags & 1) return (uint32_t)((uint64_t)ReadBE32(header + xing + 8) * samplesPerFrame * 1000 / sampleRate);
+    }
+    if (available >= 36 + 18 && memcmp(header + 36, "VBRI", 4) == 0)
+        return (uint32_t)((uint64_t)ReadBE32(header + 36 + 14) * samplesPerFrame * 1000 / sampleRate);
+
+    uint32_t kbps = kBitrates[mpeg1 ? 0 : 1][layer - 1][bitrateIndex];
+    return kbps ? (uint32_t)(audioBytes * 8 / kbps) : 0;
+}
+
+inline bool ReadMp3Tags(std::ifstream& file, uint64_t fileSize, TrackTags& tags)
+{
+    uint64_t audioStart = 0;
+    uint32_t tagLengthMs = 0;
+
+    uint8_t header[10];
+    file.seekg(0, std::ios::beg);
+    if (file.read((char*)header, 10) && memcmp(header, "ID3", 3) == 0)
+    {
+        int major = header[3];
+        uint32_t tagSize = ((uint32_t)(header[6] & 0x7F) << 21) | ((uint32_t)(header[7] & 0x7F) << 14) |
+                           ((uint32_t)(header[8] & 0x7F) << 7) | (header[9] & 0x7F);
+        audioStart = 10 + (uint64_t)tagSize + ((header[5] & 0x10) ? 10 : 0);
+
+        uint64_t pos = 10;
+        uint64_t end = 10 + (uint64_t)tagSize;
+        if ((header[5] & 0x40) && major >= 3)
+        {
+            // Extended header: v2.4 counts its own size, v2.3 does not
+            uint8_t ext[4];
+            if (file.read((char*)ext, 4))
+                pos += major == 4 ? (((uint32_t)(ext[0] & 0x7F) << 21) | ((uint32_t)(ext[1] & 0x7F) << 14) | ((uint32_t)(ext[2] & 0x7F) << 7) | (ext[3] & 0x7F))
+                                  : 4 + ReadBE32(ext);
+        }
+
+        size_t idLength = major == 2 ? 3 : 4;
+        size_t frameHeaderLength = major == 2 ? 6 : 10;
+        std::vector<uint8_t> body;
+        while (pos + frameHeaderLength <= end)
+        {
+            uint8_t frame[10];
+            file.seekg((std::streamoff)pos, std::ios::beg);
+            if (!file.read((char*)frame, frameHeaderLength) || frame[0] == 0) break;
+            uint32_t size = major == 2 ? (((uint32_t)frame[3] << 16) | ((uint32_t)frame[4] << 8) | frame[5])
+                          : major == 4 ? (((uint32_t)(frame[4] & 0x7F) << 21) | ((uint32_t)(frame[5] & 0x7F) << 14) | ((uint32_t)(frame[6] & 0x7F) << 7) | (frame[7] & 0x7F))
+                          : ReadBE32(frame + 4);
+            pos += frameHeaderLength + size;
+            if (pos > end) break;
+
+            std::string id((const char*)frame, idLength);
+            std::wstring* field = (id == "TIT2" || id == "TT2") ? &tags.title : (id == "TPE1" || id == "TP1") ? &tags.artist :
+                                  (id == "TALB" || id == "TAL") ? &tags.album : (id == "TCON" || id == "TCO") ? &tags.genre : nullptr;
+            bool isYear = id == "TYER" || id == "TDRC" || id == "TYE";
+            bool isLength = id == "TLEN" || id == "TLE";
+            if ((!field && !isYear && !isLength) || size > (64u << 10)) continue;
+
+            body.resize(size);
+            if (!file.read((char*)body.data(), size)) break;
+            std::wstring text;
+            DecodeId3Text(body.data(), size, text);
+            if (field)
+            {
+                // "(17)Rock" style genre references keep only the name
+                if (field == &tags.genre && !text.empty() && text[0] == L'(')
+                {
+                    size_t close = text.find(L')');
+                    if (close != std::wstring::npos && close + 1 < text.size()) text = text.substr(close + 1);
+                }
+                *field = text;
+            }
+            else if (isYear)
+            {
+                tags.year = ParseTagYear(text);
+            }
+            else
+            {
+                tagLengthMs = (uint32_t)wcstoul(text.c_str(), nullptr, 10);
+            }
+        }
+    }
+
+    // ID3v1 at the end fills whatever v2 did not
+    uint64_t audioEnd = fileSize;
+    uint8_t v1[128];
+    file.clear();
+    if (fileSize >= 128 && file.seekg((std::streamoff)(fileSize - 128), std::ios::beg) && file.read((char*)v1, 128) && memcmp(v1, "TAG", 3) == 0)
+    {
+        audioEnd -= 128;
+        std::wstring* fields[3] = { &tags.title, &tags.artist, &tags.album };
+        for (int i = 0; i < 3; i++)
+        {
+            if (fields[i]->empty()) DecodeTagBytes(std::string_view((const char*)v1 + 3 + 30 * i, strnlen((const char*)v1 + 3 + 30 * i, 30)), *fields[i]);
+        }
+        if (tags.year == 0)
+        {
+            std::wstring year;
+            Cp1252ToWide(std::string_view((const char*)v1 + 93, 4), year);
+            tags.year = ParseTagYear(year);
+        }
+    }
+
+    // Find the first frame header in the next 64 KB
+    std::vector<uint8_t> scan(64 << 10);
+    file.clear();
+    file.seekg((std::streamoff)audioStart, std::ios::beg);
+    file.read((char*)scan.data(), scan.size());
+    size_t got = (size_t)file.gcount();
+    for (size_t i = 0; i + 4 <= got; i++)
+    {
+        if (scan[i] != 0xFF || (scan[i + 1] & 0xE0) != 0xE0) continue;
+        uint64_t audioBytes = audioEnd > audioStart + i ? audioEnd - audioStart - i : 0;
+        uint32_t duration = Mp3DurationFromFrame(scan.data() + i, got - i, audioBytes);
+        if (duration)
+        {
+            tags.durationMs = duration;
+            break;
+        }
+    }
+    if (tags.durationMs == 0) tags.durationMs = tagLengthMs;
+    return got > 0;
+}
+
+// Read what the file offers into 'tags'. Returns false only if the file
+// cannot be opened; the title falls back to the file name.
+inline bool ReadTrackTags(const std::filesystem::path& path, TrackTags& tags)
+{
+    tags = TrackTags();
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    file.seekg(0, std::ios::end);
+    uint64_t fileSize = (uint64_t)file.tellg();
+    file.seekg(0, std::ios::beg);
+
+    uint8_t magic[12] = {};
+    file.read((char*)magic, sizeof(magic));
+    file.clear();
+
+    if (memcmp(magic, "fLaC", 4) == 0)
+        ReadFlacTags(file, tags);
+    else if (memcmp(magic, "RIFF", 4) == 0 && memcmp(magic + 8, "WAVE", 4) == 0)
+        ReadWavTags(file, tags);
+    else if (memcmp(magic, "ID3", 3) == 0 || (magic[0] == 0xFF && (magic[1] & 0xE0) == 0xE0))
+        ReadMp3Tags(file, fileSize, tags);
+
+    if (tags.title.empty()) tags.title = path.stem().wstring();
+    return true;
+}
@@ -0,0 +1,309 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "cpu_features.h"
+#include "log.h"
+
+// Pitch-preserving speed change by WSOLA (waveform-similarity overlap-add).
+// Output is built from 50%-overlapping Hann-windowed frames. Each frame is
+// read from the input near 'output position * speed', nudged within a
+// tolerance to the offset whose waveform best continues the previous frame.
+//
+// The stream interface matches Resampler: Configure() fixes the memory,
+// Process() takes interleaved float input and returns what it produced.
+// Output frame n maps to input frame n * speed (within one frame length).
+class TimeStretch
+{
+public:
+    static constexpr double kMinSpeed = 0.5;
+    static constexpr double kMaxSpeed = 3.0;
+
+    void Configure(uint32_t sampleRate, uint32_t channels, size_t maxInputFrames = 4096)
+    {
+        m_sampleRate = sampleRate;
+        m_channels = channels;
+
+        // 30 ms frames with a +-10 ms search; the search step stays near
+        // 0.1 ms at any rate
+        m_frameLength = (size_t)(sampleRate * 0.030) & ~(size_t)7;
+        m_hop = m_frameLength / 2;
+        m_tolerance = sampleRate / 100;
+        m_coarseStep = std::max<size_t>(1, sampleRate / 12000);
+
+        m_window.resize(m_frameLength);
+        const double kPi = 3.14159265358979323846;
+        for (size_t i = 0; i < m_frameLength; i++)
+            m_window[i] = (float)(0.5 - 0.5 * cos(2.0 * kPi * i / m_frameLength)); // periodic: halves sum to 1
+
+        // Room for one call's input (or the end-of-stream padding) on top of
+        // what the search and the next continuation still need
+        m_maxInputFrames = std::max(maxInputFrames, FlushFrames());
+        m_capacity = m_maxInputFrames + m_frameLength * 2 + m_tolerance * 2 + m_hop;
+        m_buffer.assign(m_capacity * channels, 0.0f);
+        m_mono.assign(m_capacity, 0.0f);
+        m_overlap.assign(m_hop * channels, 0.0f);
+
+        Reset();
+    }
+
+    void SetSpeed(double speed)
+    {
+        m_speed = std::min(std::max(speed, kMinSpeed), kMaxSpeed);
+    }
+
+    double Speed() const { return m_speed; }
+    bool IsPassthrough() const { return m_speed == 1.0; }
+
+    void Reset()
+    {
+        // Half a frame of leading silence lets the first real frame overlap
+        // a predecessor instead of fading in
+        std::fill(m_buffer.begin(), m_buffer.end(), 0.0f);
+        std::fill(m_mono.begin(), m_mono.end(), 0.0f);
+        std::fill(m_overlap.begin(), m_overlap.end(), 0.0f);
+        m_filled = m_hop;
+        m_analysis = 0.0;
+        m_previous = 0;
+        m_firstFrame = true;
+        m_inputFrames = 0;
+        m_outputFrames = 0;
+    }
+
+    // Most frames one Process() call can return for 'inputFrames' of input
+    size_t MaxOutputFrames(size_t inputFrames) const
+    {
+        return (size_t)((inputFrames + m_capacity - m_maxInputFrames) / kMinSpeed) + m_hop;
+    }
+
+    // Silent input frames to push (with in == nullptr) at end of stream so
+    // the last frames are emitted
+    size_t FlushFrames() const { return m_frameLength + m_tolerance + (size_t)(m_hop * kMaxSpeed); }
+
+    // Stretch 'in' into 'out'. Returns frames written and stores the input
+    // frames consumed in 'inUsed'. Input given as nullptr is end-of-stream
+    // padding; the output is then cut at the stretched length of the real
+    // input.
+    size_t Process(const float* in, size_t inFrames, float* out, size_t outCapacity, size_t& inUsed)
+    {
+        if (IsPassthrough())
+        {
+            size_t frames = inFrames < outCapacity ? inFrames : outCapacity;
+            if (in) memcpy(out, in, frames * m_channels * sizeof(float));
+            inUsed = in ? frames : inFrames;
+            return in ? frames : 0;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+
+        // Append as much input as the buffer can hold, with a mono copy for the search
+        size_t space = m_capacity - m_filled;
+        inUsed = inFrames < space ? inFrames : space;
+        float* dst = &m_buffer[m_filled * m_channels];
+        if (in)
+        {
+            memcpy(dst, in, inUsed * m_channels * sizeof(float));
+            m_inputFrames += inUsed;
+        }
+        else
+        {
+            memset(dst, 0, inUsed * m_channels * sizeof(float));
+        }
+        const float scale = 1.0f / m_channels;
+        for (size_t i = 0; i < inUsed; i++)
+        {
+            float sum = 0.0f;
+            for (uint32_t c = 0; c < m_channels; c++) sum += dst[i * m_channels + c];
+            m_mono[m_filled + i] = sum * scale;
+        }
+        m_filled += inUsed;
+
+        // The stretched length of the real input, once padding arrives
+        uint64_t outputLimit = in ? UINT64_MAX : (uint64_t)(m_inputFrames / m_speed + 0.5);
+
+        size_t produced = 0;
+        while (produced + m_hop <= outCapacity && m_outputFrames < outputLimit)
+        {
+            size_t ideal = (size_t)(m_analysis + 0.5);
+            if (ideal + m_tolerance + m_frameLength > m_filled) break;
+
+            size_t position = m_firstFrame ? ideal : FindBestOffset(ideal);
+            const float* frame = &m_buffer[position * m_channels];
+
+            // First half completes the previous frame's tail; second half is kept
+            if (!m_firstFrame)
+            {
+                size_t n = m_hop;
+                if (m_outputFrames + n > outputLimit) n = (size_t)(outputLimit - m_outputFrames);
+                float* o = out + produced * m_channels;
+                for (size_t i = 0; i < n; i++)
+                {
+                    float w = m_window[i];
+                    for (uint32_t c = 0; c < m_channels; c++)
+                        o[i * m_channels + c] = m_overlap[i * m_channels + c] + w * frame[i * m_channels + c];
+                }
+                produced += n;
+                m_outputFrames += n;
+            }
+            for (size_t i = 0; i < m_hop; i++)
+            {
+                float w = m_window[m_hop + i];
+                for (uint32_t c = 0; c < m_channels; c++)
+                    m_overlap[i * m_channels + c] = w * frame[(m_hop + i) * m_channels + c];
+            }
+
+            m_previous = position;
+            m_analysis += m_hop * m_speed;
+            m_firstFrame = false;
+        }
+
+        // Drop input that neither the search window nor the next
+        // continuation can reach
+        size_t keepFrom = std::min((size_t)m_analysis > m_tolerance ? (size_t)m_analysis - m_tolerance : 0, m_previous + m_hop);
+        if (keepFrom > m_filled) keepFrom = m_filled;
+        if (keepFrom > 0)
+        {
+            memmove(&m_buffer[0], &m_buffer[keepFrom * m_channels], (m_filled - keepFrom) * m_channels * sizeof(float));
+            memmove(&m_mono[0], &m_mono[keepFrom], (m_filled - keepFrom) * sizeof(float));
+            m_filled -= keepFrom;
+            m_analysis -= (double)keepFrom;
+            m_previous -= keepFrom;
+        }
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        m_statNanoseconds.fetch_add((uint64_t)elapsed.count(), std::memory_order_relaxed);
+        m_statFrames.fetch_add(produced, std::memory_order_relaxed);
+        return produced;
+    }
+
+    // CPU time spent per second of stretched audio, at whatever speeds were
+    // used since the last report; starts new figures
+    void LogReport()
+    {
+        uint64_t frames = m_statFrames.load(std::memory_order_relaxed);
+        if (frames == 0) return;
+        double seconds = (double)frames / m_sampleRate;
+        LogMessage("Time-stretch: %.2f ms CPU per realtime second over %.1f s at %u Hz (now %.2fx)",
+            m_statNanoseconds.load(std::memory_order_relaxed) / 1e6 / seconds, seconds, m_sampleRate, m_speed);
+        ResetStats();
+    }
+
+private:
+    void ResetStats()
+    {
+        m_statNanoseconds.store(0, std::memory_order_relaxed);
+        m_statFrames.store(0, std::memory_order_relaxed);
+    }
+
+    // Offset near 'ideal' whose start best matches where the previous frame
+    // would have continued: a coarse pass over the whole tolerance, then a
+    // fine pass around the winner
+    size_t FindBestOffset(size_t ideal) const
+    {
+        const float* target = &m_mono[m_previous + m_hop];
+        size_t low = ideal > m_tolerance ? ideal - m_tolerance : 0;
+        size_t high = ideal + m_tolerance;
+
+        size_t best = ideal;
+        float bestScore = -1e30f;
+        for (size_t candidate = low; candidate <= high; candidate += m_coarseStep)
+            Score(target, candidate, best, bestScore);
+
+        if (m_coarseStep > 1)
+        {
+            size_t center = best;
+            size_t fineLow = center > low + m_coarseStep ? center - m_coarseStep : low;
+            size_t fineHigh = std::min(center + m_coarseStep, high);
+            for (size_t candidate = fineLow; candidate <= fineHigh; candidate++)
+            {
+                if (candidate != center) Score(target, candidate, best, bestScore);
+            }
+        }
+        return best;
+    }
+
+    void Score(const float* target, size_t candidate, size_t& best, float& bestScore) const
+    {
+        float energy = 0.0f;
+        float correlation = Correlate(target, &m_mono[candidate], m_hop, energy);
+        // Normalized by the candidate's level so loud passages do not win by default
+        float score = correlation / sqrtf(energy + 1e-9f);
+        if (score > bestScore)
+        {
+            bestScore = score;
+            best = candidate;
+        }
+    }
+
+    // Dot products a.b and b.b over 'count' samples
+    static float Correlate(const float* a, const float* b, size_t count, float& energy)
+    {
+        size_t i = 0;
+        float correlation = 0.0f;
+        energy = 0.0f;
+#if defined(CPU_X86)
+        __m128 c0 = _mm_setzero_ps(), c1 = _mm_setzero_ps(), e0 = _mm_setzero_ps(), e1 = _mm_setzero_ps();
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128 b0 = _mm_loadu_ps(b + i), b1 = _mm_loadu_ps(b + i + 4);
+            c0 = _mm_add_ps(c0, _mm_mul_ps(_mm_loadu_ps(a + i), b0));
+            c1 = _mm_add_ps(c1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), b1));
+            e0 = _mm_add_ps(e0, _mm_mul_ps(b0, b0));
+            e1 = _mm_add_ps(e1, _mm_mul_ps(b1, b1));
+        }
+        float lanes[4];
+        _mm_storeu_ps(lanes, _mm_add_ps(c0, c1));
+        correlation = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        _mm_storeu_ps(lanes, _mm_add_ps(e0, e1));
+        energy = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(CPU_ARM64)
+        float32x4_t c0 = vdupq_n_f32(0.0f), c1 = vdupq_n_f32(0.0f), e0 = vdupq_n_f32(0.0f), e1 = vdupq_n_f32(0.0f);
+        for (; i + 8 <= count; i += 8)
+        {
+            float32x4_t b0 = vld1q_f32(b + i), b1 = vld1q_f32(b + i + 4);
+            c0 = vfmaq_f32(c0, vld1q_f32(a + i), b0);
+            c1 = vfmaq_f32(c1, vld1q_f32(a + i + 4), b1);
+            e0 = vfmaq_f32(e0, b0, b0);
+            e1 = vfmaq_f32(e1, b1, b1);
+        }
+        correlation = vaddvq_f32(vaddq_f32(c0, c1));
+        energy = vaddvq_f32(vaddq_f32(e0, e1));
+#endif
+        for (; i < count; i++)
+        {
+            correlation += a[i] * b[i];
+            energy += b[i] * b[i];
+        }
+        return correlation;
+    }
+
+    uint32_t m_sampleRate = 0;
+    uint32_t m_channels = 0;
+    double m_speed = 1.0;
+    size_t m_frameLength = 0;
+    size_t m_hop = 0;
+    size_t m_tolerance = 0;
+    size_t m_coarseStep = 1;
+    size_t m_capacity = 0;
+    size_t m_maxInputFrames = 0;
+    size_t m_filled = 0;
+    double m_analysis = 0.0;     // ideal start of the next frame in m_buffer
+    size_t m_previous = 0;       // actual start of the last frame in m_buffer
+    bool m_firstFrame = true;
+    uint64_t m_inputFrames = 0;  // real (non-padding) input since Reset()
+    uint64_t m_outputFrames = 0;
+    std::vector<float> m_window;
+    std::vector<float> m_buffer;
+    std::vector<float> m_mono;
+    std::vector<float> m_overlap;
+
+    // Read by LogReport() on the control thread
+    std::atomic<uint64_t> m_statNanoseconds{ 0 };
+    std::atomic<uint64_t> m_statFrames{ 0 };
+};
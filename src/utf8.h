@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// UTF-8 <-> wchar_t conversion without locale or Win32 calls, so it can run
+// on worker threads and behaves the same everywhere. wchar_t is UTF-16 on
+// Windows and UTF-32 elsewhere.
+
+// Append the UTF-8 form of 'text' to 'out'
+inline void AppendUtf8(std::string& out, std::wstring_view text)
+{
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        uint32_t cp = (uint32_t)text[i];
+        if (sizeof(wchar_t) == 2 && cp >= 0xD800 && cp <= 0xDBFF && i + 1 < text.size())
+        {
+            uint32_t low = (uint32_t)text[i + 1];
+            if (low >= 0xDC00 && low <= 0xDFFF)
+            {
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                i++;
+            }
+        }
+        if (cp >= 0xD800 && cp <= 0xDFFF) cp = 0xFFFD; // unpaired surrogate
+
+        if (cp < 0x80)
+        {
+            out.push_back((char)cp);
+        }
+        else if (cp < 0x800)
+        {
+            out.push_back((char)(0xC0 | (cp >> 6)));
+            out.push_back((char)(0x80 | (cp & 0x3F)));
+        }
+        else if (cp < 0x10000)
+        {
+            out.push_back((char)(0xE0 | (cp >> 12)));
+            out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back((char)(0x80 | (cp & 0x3F)));
+        }
+        else
+        {
+            out.push_back((char)(0xF0 | (cp >> 18)));
+            out.push_back((char)(0x80 | ((cp >> 12) & 0x3F)));
+            out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back((char)(0x80 | (cp & 0x3F)));
+        }
+    }
+}
+
+inline std::string WideToUtf8(std::wstring_view text)
+{
+    std::string out;
+    out.reserve(text.size());
+    AppendUtf8(out, text);
+    return out;
+}
+
+// Decode UTF-8 into 'out'. Returns false if 'text' is not valid UTF-8; the
+// offending bytes are replaced with U+FFFD.
+inline bool Utf8ToWide(std::string_view text, std::wstring& out)
+{
+    // Never more code units than bytes, so size once and write in place
+    out.resize(text.size());
+    wchar_t* dst = &out[0];
+    size_t written = 0;
+    bool valid = true;
+
+    size_t i = 0;
+    while (i < text.size())
+    {
+        uint8_t b = (uint8_t)text[i];
+        if (b < 0x80)
+        {
+            dst[written++] = (wchar_t)b;
+            i++;
+            continue;
+        }
+
+        int length = (b & 0xE0) == 0xC0 ? 2 : (b & 0xF0) == 0xE0 ? 3 : (b & 0xF8) == 0xF0 ? 4 : 0;
+        uint32_t cp = length == 2 ? (b & 0x1F) : length == 3 ? (b & 0x0F) : (b & 0x07);
+        bool ok = length != 0 && i + length <= text.size();
+        for (int k = 1; ok && k < length; k++)
+        {
+            uint8_t c = (uint8_t)text[i + k];
+            if ((c & 0xC0) != 0x80) ok = false;
+            cp = (cp << 6) | (c & 0x3F);
+        }
+
+        // Reject overlong forms, surrogates and values past U+10FFFF
+        static const uint32_t kMinimum[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+        if (ok && (cp < kMinimum[length] || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))) ok = false;
+
+        if (!ok)
+        {
+            dst[written++] = (wchar_t)0xFFFD;
+            valid = false;
+            i++;
+        }
+        else if (sizeof(wchar_t) == 2 && cp >= 0x10000)
+        {
+            cp -= 0x10000;
+            dst[written++] = (wchar_t)(0xD800 + (cp >> 10));
+            dst[written++] = (wchar_t)(0xDC00 + (cp & 0x3FF));
+            i += length;
+        }
+        else
+        {
+            dst[written++] = (wchar_t)cp;
+            i += length;
+        }
+    }
+    out.resize(written);
+    return valid;
+}
+
+inline std::wstring Utf8ToWide(std::string_view text)
+{
+    std::wstring out;
+    Utf8ToWide(text, out);
+    return out;
+}
+
+// UTF-16 bytes (as found in ID3 tags) to wchar_t. Unpaired surrogates
+// become U+FFFD.
+inline void Utf16ToWide(const uint8_t* data, size_t bytes, bool bigEndian, std::wstring& out)
+{
+    out.clear();
+    out.reserve(bytes / 2);
+    for (size_t i = 0; i + 1 < bytes; i += 2)
+    {
+        uint32_t unit = bigEndian ? (uint32_t)(data[i] << 8 | data[i + 1]) : (uint32_t)(data[i] | data[i + 1] << 8);
+        if (unit >= 0xD800 && unit <= 0xDBFF && i + 3 < bytes)
+        {
+            uint32_t low = bigEndian ? (uint32_t)(data[i + 2] << 8 | data[i + 3]) : (uint32_t)(data[i + 2] | data[i + 3] << 8);
+            if (low >= 0xDC00 && low <= 0xDFFF)
+            {
+                if (sizeof(wchar_t) == 2)
+                {
+                    out.push_back((wchar_t)unit);
+                    out.push_back((wchar_t)low);
+                }
+                else
+                {
+                    out.push_back((wchar_t)(0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00)));
+                }
+                i += 2;
+                continue;
+            }
+        }
+        if (unit >= 0xD800 && unit <= 0xDFFF) unit = 0xFFFD;
+        out.push_back((wchar_t)unit);
+    }
+}
+
+// Windows-1252 (the usual encoding of legacy .m3u/.pls files) to wchar_t
+inline void Cp1252ToWide(std::string_view text, std::wstring& out)
+{
+    static const uint16_t kHigh[32] =
+    {
+        0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021, 0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F,
+        0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014, 0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178
+    };
+
+    out.clear();
+    out.reserve(text.size());
+    for (char ch : text)
+    {
+        uint8_t b = (uint8_t)ch;
+        out.push_back((wchar_t)(b >= 0x80 && b < 0xA0 ? kHigh[b - 0x80] : b));
+    }
+}
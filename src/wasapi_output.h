@@ -0,0 +1,209 @@
+#pragma once
+
+#include <windows.h>
+#include <mmdeviceapi.h>
+#include <audioclient.h>
+#include <avrt.h>
+#include <ksmedia.h>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "audio_sink.h"
+#include "log.h"
+#include "rt_guard.h"
+#include "sample_convert.h"
+
+#pragma comment(lib, "avrt.lib")
+
+// Shared-mode, event-driven WASAPI output on the default render device. The
+// render thread is registered with MMCSS ("Pro Audio") and marked real-time
+// for the guard. The stream uses the device's shared-mode mix format as
+// is: 32-bit float is rendered straight into the buffer, and a 16-, 24- or
+// 32-bit integer mix format gets float audio converted (and dithered) by
+// FloatToPcm(). Other mix formats fail Open().
+class WasapiOutput : public AudioSink
+{
+public:
+    static const REFERENCE_TIME kBufferDuration = 200000; // 20 ms in 100ns units
+    static const uint32_t kMaxChannels = 8;
+
+    ~WasapiOutput() { Close(); }
+
+    HRESULT Open(AudioRenderer* renderer)
+    {
+        HRESULT hr = S_OK;
+        IMMDeviceEnumerator* pEnumerator = nullptr;
+        WAVEFORMATEX* pMixFormat = nullptr;
+
+        m_renderer = renderer;
+
+        hr = CoCreateInstance(__uuidof(MMDeviceEnumerator), NULL, CLSCTX_ALL, IID_PPV_ARGS(&pEnumerator));
+        if (FAILED(hr)) goto done;
+        hr = pEnumerator->GetDefaultAudioEndpoint(eRender, eConsole, &m_pDevice);
+        if (FAILED(hr)) goto done;
+        hr = m_pDevice->Activate(__uuidof(IAudioClient), CLSCTX_ALL, NULL, (void**)&m_pClient);
+        if (FAILED(hr)) goto done;
+
+        hr = m_pClient->GetMixFormat(&pMixFormat);
+        if (FAILED(hr)) goto done;
+
+        m_sampleRate = pMixFormat->nSamplesPerSec;
+        m_channels = pMixFormat->nChannels;
+        bool isFloat = pMixFormat->wFormatTag == WAVE_FORMAT_IEEE_FLOAT;
+        if (pMixFormat->wFormatTag == WAVE_FORMAT_EXTENSIBLE)
+        {
+            WAVEFORMATEXTENSIBLE* pExtensible = reinterpret_cast<WAVEFORMATEXTENSIBLE*>(pMixFormat);
+            isFloat = IsEqualGUID(pExtensible->SubFormat, KSDATAFORMAT_SUBTYPE_IEEE_FLOAT) != FALSE;
+        }
+        // 24-bit samples in 32-bit containers are left-justified, so they
+        // take the 32-bit conversion
+        switch (pMixFormat->wBitsPerSample)
+        {
+        case 16: m_format = PcmFormat::Int16; break;
+        case 24: m_format = PcmFormat::Int24; break;
+        case 32: m_format = isFloat ? PcmFormat::Float32 : PcmFormat::Int32; break;
+        default: m_channels = 0; break;
+        }
+        if (m_channels == 0 || m_channels > kMaxChannels || (isFloat && m_format != PcmFormat::Float32))
+        {
+            LogMessage("WASAPI: unsupported mix format (%u channels, %u bits)", m_channels, pMixFormat->wBitsPerSample);
+            hr = AUDCLNT_E_UNSUPPORTED_FORMAT;
+            goto done;
+        }
+
+        hr = m_pClient->Initialize(AUDCLNT_SHAREMODE_SHARED, AUDCLNT_STREAMFLAGS_EVENTCALLBACK, kBufferDuration, 0, pMixFormat, NULL);
+        if (FAILED(hr)) goto done;
+        hr = m_pClient->GetBufferSize(&m_bufferFrames);
+        if (FAILED(hr)) goto done;
+
+        m_hBufferEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+        m_hStopEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+        if (!m_hBufferEvent || !m_hStopEvent)
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+            goto done;
+        }
+        hr = m_pClient->SetEventHandle(m_hBufferEvent);
+        if (FAILED(hr)) goto done;
+        hr = m_pClient->GetService(IID_PPV_ARGS(&m_pRenderClient));
+        if (FAILED(hr)) goto done;
+
+        // Conversion scratch for integer devices, sized once here
+        if (m_format != PcmFormat::Float32) m_convert.assign((size_t)m_bufferFrames * m_channels, 0.0f);
+        m_dither.Reset();
+
+    done:
+        if (pMixFormat) CoTaskMemFree(pMixFormat);
+        SafeReleaseCom(&pEnumerator);
+        if (FAILED(hr)) Close();
+        return hr;
+    }
+
+    void Close()
+    {
+        Stop();
+        SafeReleaseCom(&m_pRenderClient);
+        SafeReleaseCom(&m_pClient);
+        SafeReleaseCom(&m_pDevice);
+        if (m_hBufferEvent) CloseHandle(m_hBufferEvent);
+        if (m_hStopEvent) CloseHandle(m_hStopEvent);
+        m_hBufferEvent = m_hStopEvent = NULL;
+    }
+
+    uint32_t SampleRate() const override { return m_sampleRate; }
+    uint32_t Channels() const override { return m_channels; }
+
+    bool Start() override
+    {
+        if (!m_pClient || m_thread.joinable()) return m_thread.joinable();
+
+        // Prefill with silence so the first device period doesn't glitch
+        BYTE* pData = nullptr;
+        if (SUCCEEDED(m_pRenderClient->GetBuffer(m_bufferFrames, &pData)))
+            m_pRenderClient->ReleaseBuffer(m_bufferFrames, AUDCLNT_BUFFERFLAGS_SILENT);
+
+        ResetEvent(m_hStopEvent);
+        m_thread = std::thread(&WasapiOutput::RenderLoop, this);
+        if (FAILED(m_pClient->Start()))
+        {
+            Stop();
+            return false;
+        }
+        return true;
+    }
+
+    void Stop() override
+    {
+        if (!m_thread.joinable()) return;
+        m_pClient->Stop();
+        SetEvent(m_hStopEvent);
+        m_thread.join();
+        m_pClient->Reset();
+    }
+
+private:
+    template <class T> static void SafeReleaseCom(T** ppT)
+    {
+        if (*ppT)
+        {
+            (*ppT)->Release();
+            *ppT = NULL;
+        }
+    }
+
+    void RenderLoop()
+    {
+        HRESULT hrCom = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+        DWORD taskIndex = 0;
+        HANDLE hTask = AvSetMmThreadCharacteristicsW(L"Pro Audio", &taskIndex);
+        if (!hTask) LogMessage("WASAPI: MMCSS registration failed (%lu)", GetLastError());
+
+        {
+            RealtimeScope realtime;
+            HANDLE waitHandles[2] = { m_hStopEvent, m_hBufferEvent };
+            for (;;)
+            {
+                DWORD wait = WaitForMultipleObjects(2, waitHandles, FALSE, 2000);
+                if (wait == WAIT_OBJECT_0) break;
+                if (wait != WAIT_OBJECT_0 + 1) continue; // device stalled; keep waiting for stop
+
+                UINT32 padding = 0;
+                if (FAILED(m_pClient->GetCurrentPadding(&padding))) break;
+                UINT32 frames = m_bufferFrames - padding;
+                if (frames == 0) continue;
+
+                BYTE* pData = nullptr;
+                if (FAILED(m_pRenderClient->GetBuffer(frames, &pData))) break;
+
+                if (m_format == PcmFormat::Float32)
+                {
+                    m_renderer->Render(reinterpret_cast<float*>(pData), frames);
+                }
+                else
+                {
+                    m_renderer->Render(m_convert.data(), frames);
+                    FloatToPcm(m_convert.data(), m_format, pData, frames, m_channels, &m_dither);
+                }
+                m_pRenderClient->ReleaseBuffer(frames, 0);
+            }
+        }
+
+        if (hTask) AvRevertMmThreadCharacteristics(hTask);
+        if (SUCCEEDED(hrCom)) CoUninitialize();
+    }
+
+    AudioRenderer* m_renderer = nullptr;
+    IMMDevice* m_pDevice = nullptr;
+    IAudioClient* m_pClient = nullptr;
+    IAudioRenderClient* m_pRenderClient = nullptr;
+    HANDLE m_hBufferEvent = NULL;
+    HANDLE m_hStopEvent = NULL;
+    UINT32 m_bufferFrames = 0;
+    uint32_t m_sampleRate = 0;
+    uint32_t m_channels = 0;
+    PcmFormat m_format = PcmFormat::Float32;
+    SampleDither m_dither;          // TPDF on integer devices
+    std::vector<float> m_convert;
+    std::thread m_thread;
+};
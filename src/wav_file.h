@@ -0,0 +1,229 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include "audio_source.h"
+#include "sample_convert.h"
+
+// Little-endian helpers for RIFF headers
+inline uint16_t ReadLE16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+inline uint32_t ReadLE32(const uint8_t* p) { return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24); }
+inline void WriteLE16(uint8_t* p, uint16_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); }
+inline void WriteLE32(uint8_t* p, uint32_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); p[2] = (uint8_t)(v >> 16); p[3] = (uint8_t)(v >> 24); }
+
+// PCM/IEEE float .wav reader
+class WavSource : public AudioSource
+{
+public:
+    bool Open(const std::filesystem::path& path)
+    {
+        m_file.open(path, std::ios::binary);
+        if (!m_file) return false;
+
+        uint8_t riff[12];
+        if (!m_file.read((char*)riff, sizeof(riff))) return false;
+        if (memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) return false;
+
+        bool haveFormat = false;
+        for (;;)
+        {
+            uint8_t chunk[8];
+            if (!m_file.read((char*)chunk, sizeof(chunk))) return false;
+            uint32_t chunkSize = ReadLE32(chunk + 4);
+
+            if (memcmp(chunk, "fmt ", 4) == 0)
+            {
+                uint8_t fmt[40] = {};
+                if (chunkSize < 16) return false;
+                uint32_t toRead = chunkSize < sizeof(fmt) ? chunkSize : (uint32_t)sizeof(fmt);
+                if (!m_file.read((char*)fmt, toRead)) return false;
+                m_file.seekg(chunkSize - toRead + (chunkSize & 1), std::ios::cur);
+
+                uint16_t formatTag = ReadLE16(fmt);
+                m_format.channels = ReadLE16(fmt + 2);
+                m_format.sampleRate = ReadLE32(fmt + 4);
+                m_blockAlign = ReadLE16(fmt + 12);
+                m_bitsPerSample = ReadLE16(fmt + 14);
+
+                // WAVE_FORMAT_EXTENSIBLE carries the real format tag in its sub-format GUID
+                if (formatTag == 0xFFFE && chunkSize >= 40) formatTag = ReadLE16(fmt + 24);
+
+                if (formatTag == 1)
+                    m_isFloat = false;
+                else if (formatTag == 3 && m_bitsPerSample == 32)
+                    m_isFloat = true;
+                else
+                    return false;
+
+                if (m_bitsPerSample != 8 && m_bitsPerSample != 16 && m_bitsPerSample != 24 && m_bitsPerSample != 32) return false;
+                if (m_format.channels == 0 || m_format.sampleRate == 0) return false;
+                if (m_blockAlign != m_format.channels * (m_bitsPerSample / 8)) return false;
+                haveFormat = true;
+            }
+            else if (memcmp(chunk, "data", 4) == 0)
+            {
+                if (!haveFormat) return false;
+                m_dataOffset = (uint64_t)m_file.tellg();
+                m_totalFrames = chunkSize / m_blockAlign;
+                break;
+            }
+            else
+            {
+                // Chunks are padded to an even size
+                m_file.seekg(chunkSize + (chunkSize & 1), std::ios::cur);
+            }
+        }
+
+        m_scratch.resize(kScratchFrames * m_blockAlign);
+        m_position = 0;
+        return true;
+    }
+
+    const AudioFormat& Format() const override { return m_format; }
+    uint64_t TotalFrames() const override { return m_totalFrames; }
+
+    size_t Read(float* out, size_t frames) override
+    {
+        size_t done = 0;
+        while (done < frames && m_position < m_totalFrames)
+        {
+            size_t chunk = frames - done;
+            if (chunk > kScratchFrames) chunk = kScratchFrames;
+            if (chunk > m_totalFrames - m_position) chunk = (size_t)(m_totalFrames - m_position);
+
+            if (!m_file.read((char*)m_scratch.data(), chunk * m_blockAlign)) break;
+            ConvertToFloat(m_scratch.data(), out + done * m_format.channels, chunk * m_format.channels);
+
+            done += chunk;
+            m_position += chunk;
+        }
+        return done;
+    }
+
+    bool Seek(uint64_t frame) override
+    {
+        if (frame > m_totalFrames) frame = m_totalFrames;
+        m_file.clear();
+        m_file.seekg((std::streamoff)(m_dataOffset + frame * m_blockAlign), std::ios::beg);
+        m_position = frame;
+        return (bool)m_file;
+    }
+
+    bool SeeksExactly() const override { return true; }
+
+private:
+    void ConvertToFloat(const uint8_t* in, float* out, size_t samples) const
+    {
+        switch (m_bitsPerSample)
+        {
+        case 8:
+            for (size_t i = 0; i < samples; i++) out[i] = ((int)in[i] - 128) * (1.0f / 128.0f);
+            break;
+        case 16:
+            PcmToFloat(in, PcmFormat::Int16, out, samples);
+            break;
+        case 24:
+            PcmToFloat(in, PcmFormat::Int24, out, samples);
+            break;
+        case 32:
+            PcmToFloat(in, m_isFloat ? PcmFormat::Float32 : PcmFormat::Int32, out, samples);
+            break;
+        }
+    }
+
+    static const size_t kScratchFrames = 4096;
+
+    std::ifstream m_file;
+    AudioFormat m_format;
+    uint16_t m_blockAlign = 0;
+    uint16_t m_bitsPerSample = 0;
+    bool m_isFloat = false;
+    uint64_t m_dataOffset = 0;
+    uint64_t m_totalFrames = 0;
+    uint64_t m_position = 0;
+    std::vector<uint8_t> m_scratch;
+};
+
+// 16-bit PCM or 32-bit float .wav writer. The header is patched with the
+// final sizes on Close().
+class WavWriter
+{
+public:
+    ~WavWriter() { Close(); }
+
+    bool Open(const std::filesystem::path& path, uint32_t sampleRate, uint32_t channels, bool writeFloat)
+    {
+        m_file.open(path, std::ios::binary | std::ios::trunc);
+        if (!m_file) return false;
+
+        m_channels = channels;
+        m_isFloat = writeFloat;
+        m_bytesPerSample = writeFloat ? 4 : 2;
+        m_dataBytes = 0;
+        m_dither.Reset();
+        m_scratch.resize(kScratchFrames * channels * m_bytesPerSample);
+
+        uint8_t header[44] = {};
+        memcpy(header, "RIFF", 4);
+        memcpy(header + 8, "WAVE", 4);
+        memcpy(header + 12, "fmt ", 4);
+        WriteLE32(header + 16, 16);
+        WriteLE16(header + 20, writeFloat ? 3 : 1);
+        WriteLE16(header + 22, (uint16_t)channels);
+        WriteLE32(header + 24, sampleRate);
+        WriteLE32(header + 28, sampleRate * channels * m_bytesPerSample);
+        WriteLE16(header + 32, (uint16_t)(channels * m_bytesPerSample));
+        WriteLE16(header + 34, (uint16_t)(m_bytesPerSample * 8));
+        memcpy(header + 36, "data", 4);
+        return (bool)m_file.write((const char*)header, sizeof(header));
+    }
+
+    bool Write(const float* in, size_t frames)
+    {
+        while (frames > 0)
+        {
+            size_t chunk = frames < kScratchFrames ? frames : kScratchFrames;
+            size_t samples = chunk * m_channels;
+
+            FloatToPcm(in, m_isFloat ? PcmFormat::Float32 : PcmFormat::Int16, m_scratch.data(), chunk, m_channels, &m_dither);
+
+            if (!m_file.write((const char*)m_scratch.data(), samples * m_bytesPerSample)) return false;
+            m_dataBytes += samples * m_bytesPerSample;
+            in += samples;
+            frames -= chunk;
+        }
+        return true;
+    }
+
+    uint64_t BytesWritten() const { return m_dataBytes + 44; }
+
+    void Close()
+    {
+        if (!m_file.is_open()) return;
+
+        uint8_t size[4];
+        WriteLE32(size, (uint32_t)(m_dataBytes + 36));
+        m_file.seekp(4, std::ios::beg);
+        m_file.write((const char*)size, 4);
+        WriteLE32(size, (uint32_t)m_dataBytes);
+        m_file.seekp(40, std::ios::beg);
+        m_file.write((const char*)size, 4);
+        m_file.close();
+    }
+
+private:
+    static const size_t kScratchFrames = 4096;
+
+    std::ofstream m_file;
+    uint32_t m_channels = 0;
+    uint32_t m_bytesPerSample = 2;
+    bool m_isFloat = false;
+    SampleDither m_dither;          // TPDF, from the same seed on every export
+    uint64_t m_dataBytes = 0;
+    std::vector<uint8_t> m_scratch;
+};
@@ -0,0 +1,486 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "audio_engine.h"
+#include "decoded_cache.h"
+#include "decoders.h"
+#include "library_index.h"
+#include "log.h"
+#include "wav_file.h"
+#include "zone_scheduler.h"
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#include <tlhelp32.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+// Many independent players ("zones") in one process. Each PlayerZone has
+// its own playlist, position, engine and output sink. What is expensive to
+// duplicate lives once in the ZoneHost: the library index the playlists
+// point into (a zone's playlist is a list of library ids), the decode
+// threads and the decoded-audio cache.
+
+class ZoneHost
+{
+public:
+    explicit ZoneHost(LibraryIndex& library, size_t cacheBytes = 64u << 20) : m_library(library), m_cache(cacheBytes) {}
+    ~ZoneHost() { Stop(); }
+
+    // 'decodeThreads' as in ZoneScheduler::Start()
+    void Start(unsigned decodeThreads = 0) { m_scheduler.Start(decodeThreads); }
+
+    // Every zone must be closed first
+    void Stop() { m_scheduler.Stop(); }
+
+    // The index is not thread-safe and zones resolve paths from decode
+    // threads, so while zones play it is only used through these
+    uint32_t AddTrack(std::wstring_view path)
+    {
+        std::lock_guard<std::mutex> lock(m_libraryMutex);
+        return m_library.Add(path);
+    }
+
+    std::wstring TrackPath(uint32_t track)
+    {
+        std::lock_guard<std::mutex> lock(m_libraryMutex);
+        return track < m_library.Count() ? m_library.Path(track) : std::wstring();
+    }
+
+    // Decoder for a library track, reading through the shared cache when
+    // it seeks exactly (cache chunks start at seeks)
+    std::unique_ptr<AudioSource> OpenTrack(uint32_t track)
+    {
+        std::unique_ptr<AudioSource> source = OpenAudioSource(TrackPath(track));
+        if (!source || !source->SeeksExactly()) return source;
+        return std::make_unique<CachedSource>(std::move(source), track, m_cache);
+    }
+
+    ZoneScheduler& Scheduler() { return m_scheduler; }
+    DecodedAudioCache& Cache() { return m_cache; }
+
+private:
+    LibraryIndex& m_library;
+    std::mutex m_libraryMutex;
+    DecodedAudioCache m_cache;
+    ZoneScheduler m_scheduler;
+};
+
+// A zone's state as one consistent snapshot, for status reports
+struct ZoneStatus
+{
+    bool loaded = false;
+    bool playing = false;
+    size_t index = 0;
+    size_t count = 0;
+    uint32_t track = LibraryIndex::kNotFound;
+    uint64_t positionFrames = 0;
+    uint64_t durationFrames = 0;
+    uint32_t sourceRate = 0;
+    float volume = 1.0f;
+};
+
+class PlayerZone
+{
+public:
+    explicit PlayerZone(ZoneHost& host) : m_host(host) {}
+    ~PlayerZone() { Close(); }
+
+    // The sink must already render from Engine(). Tracks advance on their
+    // own at the end of each one, wrapping around the playlist, unless a
+    // track-ended callback is set.
+    bool Open(AudioSink* sink)
+    {
+        m_closing = false;
+        if (!m_engine.Configure(sink, &m_host.Scheduler())) return false;
+        // Runs on a decode thread
+        m_engine.SetEndCallback([this]()
+        {
+            if (m_closing) return;
+            std::function<void()> onTrackChanged;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_closing) return;
+                if (m_onTrackEnded)
+                {
+                    m_onTrackEnded();
+                    return;
+                }
+                if (Step(1)) m_engine.Play();
+                onTrackChanged = m_onTrackChanged;
+            }
+            if (onTrackChanged) onTrackChanged();
+        });
+        return true;
+    }
+
+    void Close()
+    {
+        // Let an end-of-track callback in progress finish before the engine goes
+        m_closing = true;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_trackReports && m_engine.IsLoaded()) m_engine.LogReport();
+        }
+        m_engine.Shutdown();
+    }
+
+    AudioEngine& Engine() { return m_engine; }
+
+    // Called on a decode thread after the zone moves on at the end of a track
+    void SetTrackChangedCallback(std::function<void()> callback)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_onTrackChanged = std::move(callback);
+    }
+
+    // Called on a decode thread when a track has played to its end, in place
+    // of the zone moving on by itself. A window steps its zone from the UI
+    // thread this way, so the track opener only ever runs there.
+    void SetTrackEndedCallback(std::function<void()> callback)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_onTrackEnded = std::move(callback);
+    }
+
+    // How a playlist entry is opened, by default ZoneHost::OpenTrack(). The
+    // zone's lock is held, so the opener must not call back into the zone.
+    // A source with a StartFrame() is seeked there once loaded.
+    void SetTrackOpener(std::function<std::unique_ptr<AudioSource>(uint32_t track)> opener)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_openTrack = std::move(opener);
+    }
+
+    // Log the engine's report (AudioEngine::LogReport) for each track as it
+    // is replaced, and for the last one on Close()
+    void SetTrackReports(bool report)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_trackReports = report;
+    }
+
+    // Replace the playlist and load its entry 'start', paused. With 'load'
+    // false only the list and position change and the engine keeps what it
+    // has: a playlist reordered around the playing track, or one restored
+    // before the zone is open (Load() opens the entry later).
+    bool SetPlaylist(std::vector<uint32_t> tracks, size_t start = 0, bool load = true)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_playlist = std::move(tracks);
+        m_current = start;
+        return load ? LoadCurrent() : m_current < m_playlist.size();
+    }
+
+    // Load the current entry, paused
+    bool Load()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return LoadCurrent();
+    }
+
+    std::vector<uint32_t> Playlist()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_playlist;
+    }
+
+    void Play()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_engine.Play();
+    }
+
+    void Pause()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_engine.Pause();
+    }
+
+    // Move through the playlist, keeping the play/pause state
+    bool Next() { return Skip(1); }
+    bool Previous() { return Skip(-1); }
+
+    void Seek(uint64_t frame)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_engine.Seek(frame);
+    }
+
+    void SetVolume(float volume)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_volume = std::min(std::max(volume, 0.0f), 1.0f);
+        m_engine.SetVolume(m_volume);
+    }
+
+    size_t CurrentIndex()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_current;
+    }
+
+    // The current entry, loaded or not; kNotFound with an empty playlist
+    uint32_t CurrentTrack()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_current < m_playlist.size() ? m_playlist[m_current] : LibraryIndex::kNotFound;
+    }
+
+    ZoneStatus Status()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ZoneStatus status;
+        status.loaded = m_engine.IsLoaded();
+        status.playing = m_engine.IsPlaying();
+        status.index = m_current;
+        status.count = m_playlist.size();
+        if (status.loaded && m_current < m_playlist.size()) status.track = m_playlist[m_current];
+        status.positionFrames = m_engine.PositionFrames();
+        status.durationFrames = m_engine.DurationFrames();
+        status.sourceRate = m_engine.SourceRate();
+        status.volume = m_volume;
+        return status;
+    }
+
+    uint64_t TracksStarted() const { return m_tracksStarted.load(std::memory_order_relaxed); }
+
+private:
+    bool Skip(int direction)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        bool wasPlaying = m_engine.IsPlaying();
+        if (!Step(direction)) return false;
+        if (wasPlaying) m_engine.Play();
+        return true;
+    }
+
+    // Caller holds m_mutex. Unplayable entries are skipped, once round the list at most.
+    bool Step(int direction)
+    {
+        size_t count = m_playlist.size();
+        for (size_t tries = 0; tries < count; tries++)
+        {
+            m_current = (m_current + count + direction) % count;
+            if (LoadCurrent()) return true;
+        }
+        return false;
+    }
+
+    // Caller holds m_mutex
+    bool LoadCurrent()
+    {
+        if (m_current >= m_playlist.size()) return false;
+        if (m_trackReports && m_engine.IsLoaded()) m_engine.LogReport();
+        uint32_t track = m_playlist[m_current];
+        std::unique_ptr<AudioSource> source = m_openTrack ? m_openTrack(track) : m_host.OpenTrack(track);
+        uint64_t start = source ? source->StartFrame() : 0;
+        if (!source || !m_engine.Load(std::move(source)))
+        {
+            m_engine.Unload();
+            return false;
+        }
+        if (start) m_engine.Seek(start);
+        m_tracksStarted.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    ZoneHost& m_host;
+    AudioEngine m_engine;
+    std::mutex m_mutex;                 // control calls, including the end-of-track callback
+    std::vector<uint32_t> m_playlist;   // library ids
+    size_t m_current = 0;
+    float m_volume = 1.0f;
+    std::function<void()> m_onTrackChanged;
+    std::function<void()> m_onTrackEnded;
+    std::function<std::unique_ptr<AudioSource>(uint32_t)> m_openTrack;
+    bool m_trackReports = false;
+    std::atomic<bool> m_closing{ false };
+    std::atomic<uint64_t> m_tracksStarted{ 0 };
+};
+
+// CPU time, resident memory and thread count of this process
+struct ProcessUsage
+{
+    double cpuSeconds = 0.0;
+    uint64_t residentBytes = 0;
+    unsigned threads = 0;
+    uint64_t wakeups = 0;   // voluntary context switches, all threads; not sampled on Windows
+};
+
+inline ProcessUsage SampleProcessUsage()
+{
+    ProcessUsage usage;
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+    {
+        auto seconds = [](const FILETIME& time) { return ((uint64_t)time.dwHighDateTime << 32 | time.dwLowDateTime) * 1e-7; };
+        usage.cpuSeconds = seconds(kernel) + seconds(user);
+    }
+    PROCESS_MEMORY_COUNTERS memory;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &memory, sizeof(memory))) usage.residentBytes = memory.WorkingSetSize;
+    HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+    if (snapshot != INVALID_HANDLE_VALUE)
+    {
+        THREADENTRY32 entry;
+        entry.dwSize = sizeof(entry);
+        for (BOOL more = Thread32First(snapshot, &entry); more; more = Thread32Next(snapshot, &entry))
+        {
+            if (entry.th32OwnerProcessID == GetCurrentProcessId()) usage.threads++;
+        }
+        CloseHandle(snapshot);
+    }
+#else
+    struct rusage rusage;
+    if (getrusage(RUSAGE_SELF, &rusage) == 0)
+    {
+        usage.cpuSeconds = rusage.ru_utime.tv_sec + rusage.ru_utime.tv_usec * 1e-6 +
+                           rusage.ru_stime.tv_sec + rusage.ru_stime.tv_usec * 1e-6;
+        usage.wakeups = (uint64_t)rusage.ru_nvcsw;
+    }
+    if (FILE* statm = fopen("/proc/self/statm", "r"))
+    {
+        unsigned long long pages = 0, resident = 0;
+        if (fscanf(statm, "%llu %llu", &pages, &resident) == 2) usage.residentBytes = resident * (uint64_t)sysconf(_SC_PAGESIZE);
+        fclose(statm);
+    }
+    if (FILE* status = fopen("/proc/self/status", "r"))
+    {
+        char line[256];
+        while (fgets(line, sizeof(line), status))
+        {
+            if (sscanf(line, "Threads: %u", &usage.threads) == 1) break;
+        }
+        fclose(status);
+    }
+#endif
+    return usage;
+}
+
+// A 16-bit stereo WAV of two tones, 'frequency' left and 1.5 times that right
+inline bool WriteSyntheticTrack(const std::filesystem::path& path, uint32_t sampleRate, double seconds, double frequency)
+{
+    WavWriter writer;
+    if (!writer.Open(path, sampleRate, 2, false)) return false;
+    std::vector<float> block(4096 * 2);
+    size_t total = (size_t)(seconds * sampleRate);
+    for (size_t done = 0; done < total;)
+    {
+        size_t n = std::min<size_t>(4096, total - done);
+        for (size_t i = 0; i < n; i++)
+        {
+            double phase = 2.0 * 3.14159265358979 * frequency * (double)(done + i) / sampleRate;
+            block[2 * i] = (float)(0.25 * sin(phase));
+            block[2 * i + 1] = (float)(0.25 * sin(phase * 1.5));
+        }
+        writer.Write(block.data(), n);
+        done += n;
+    }
+    writer.Close();
+    return true;
+}
+
+// Run 1, 8 and 64 zones into null sinks for 'seconds' each and log how CPU
+// time, memory and thread count grow. Tracks are synthetic 44.1 kHz WAV
+// files, so every zone resamples to its 48 kHz sink; zone z starts on
+// track z mod 8, so larger runs also share decoded audio. Returns false if
+// a zone could not start or any underran.
+inline bool BenchmarkZones(double seconds = 5.0)
+{
+    const size_t kTracks = 8;
+    const uint32_t kRate = 44100;
+    const double kTrackSeconds = 20.0;
+
+    std::error_code ec;
+    std::filesystem::path folder = std::filesystem::temp_directory_path(ec) / "zone_benchmark";
+    std::filesystem::create_directories(folder, ec);
+    LibraryIndex library;
+    std::vector<uint32_t> tracks;
+    for (size_t t = 0; t < kTracks; t++)
+    {
+        std::filesystem::path path = folder / ("track" + std::to_string(t) + ".wav");
+        if (!WriteSyntheticTrack(path, kRate, kTrackSeconds, 220.0 * (1.0 + t * 0.25)))
+        {
+            LogMessage("Zone benchmark: cannot write %s", path.string().c_str());
+            return false;
+        }
+        tracks.push_back(library.Add(path.wstring()));
+    }
+
+    bool ok = true;
+    const size_t kZoneCounts[] = { 1, 8, 64 };
+    for (size_t zoneCount : kZoneCounts)
+    {
+        ProcessUsage idle = SampleProcessUsage();
+        ZoneHost host(library);
+        host.Start();
+
+        std::vector<std::unique_ptr<NullSink>> sinks;
+        std::vector<std::unique_ptr<PlayerZone>> zones;
+        for (size_t z = 0; z < zoneCount; z++)
+        {
+            sinks.push_back(std::make_unique<NullSink>(host.Scheduler(), 48000, 2));
+            zones.push_back(std::make_unique<PlayerZone>(host));
+            sinks[z]->Open(&zones[z]->Engine());
+            if (!zones[z]->Open(sinks[z].get()) || !zones[z]->SetPlaylist(tracks, z % kTracks))
+            {
+                LogMessage("Zone benchmark: zone %zu did not start", z);
+                ok = false;
+                break;
+            }
+            zones[z]->Play();
+        }
+
+        // Measure the steady state, after every zone has primed its read-ahead
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        ProcessUsage start = SampleProcessUsage();
+        uint64_t framesStart = 0;
+        for (auto& sink : sinks) framesStart += sink->FramesRendered();
+        auto wallStart = std::chrono::steady_clock::now();
+        std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+        ProcessUsage end = SampleProcessUsage();
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+        uint64_t framesEnd = 0, underruns = 0;
+        for (auto& sink : sinks) framesEnd += sink->FramesRendered();
+        for (auto& zone : zones) underruns += zone->Engine().Stats().underruns;
+        DecodedCacheStats cache = host.Cache().Stats();
+        unsigned decodeThreads = host.Scheduler().DecodeThreads();
+
+        for (auto& zone : zones) zone->Close();
+        for (auto& sink : sinks) sink->Close();
+        host.Stop();
+
+        double cpu = wall > 0.0 ? 100.0 * (end.cpuSeconds - start.cpuSeconds) / wall : 0.0;
+        double memory = end.residentBytes > idle.residentBytes ? (end.residentBytes - idle.residentBytes) / (1024.0 * 1024.0) : 0.0;
+        double realtime = wall > 0.0 ? (double)(framesEnd - framesStart) / (48000.0 * zoneCount * wall) : 0.0;
+        LogMessage("Zones: %2zu zones, %u threads (%u decode, 1 clock), %.1f%% CPU (%.2f%% per zone), %.1f MB (%.2f MB per zone), "
+                   "%.2fx realtime per zone, %llu underruns, %.0f%% decoded-audio cache hits",
+            zoneCount, end.threads > idle.threads ? end.threads - idle.threads : 0, decodeThreads,
+            cpu, cpu / zoneCount, memory, memory / zoneCount, realtime, (unsigned long long)underruns,
+            cache.hits + cache.misses ? 100.0 * cache.hits / (cache.hits + cache.misses) : 0.0);
+        if (underruns) ok = false;
+    }
+
+    for (uint32_t track : tracks) std::filesystem::remove(library.Path(track), ec);
+    std::filesystem::remove(folder, ec);
+    return ok;
+}
@@ -0,0 +1,315 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "audio_engine.h"
+#include "audio_sink.h"
+#include "rt_guard.h"
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Drives the engines of many zones from a fixed set of threads: a few
+// decode workers shared by every engine, and one clock thread that polls
+// the playing engines for decode work and renders the zones' NullSinks.
+// Thread count no longer grows with the number of zones (device sinks such
+// as WasapiOutput still run their own render thread). While nothing plays
+// the clock sleeps until an engine wakes it, so an idle host does not tick.
+
+class NullSink;
+
+class ZoneScheduler : public DecodeDriver
+{
+public:
+    static const uint32_t kClockPeriodMs = 10;
+
+    ~ZoneScheduler() { Stop(); }
+
+    // 'decodeThreads' 0 = one per core but one, at least one
+    void Start(unsigned decodeThreads = 0)
+    {
+        Stop();
+        if (decodeThreads == 0)
+        {
+            unsigned cores = std::thread::hardware_concurrency();
+            decodeThreads = cores > 1 ? cores - 1 : 1;
+        }
+        m_quit = false;
+        for (unsigned i = 0; i < decodeThreads; i++) m_workers.emplace_back(&ZoneScheduler::WorkerLoop, this);
+        m_clock = std::thread(&ZoneScheduler::ClockLoop, this);
+    }
+
+    // Engines and sinks must be detached first
+    void Stop()
+    {
+        if (!m_clock.joinable()) return;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_wake.notify_all();
+        m_clockWake.notify_all();
+        for (auto& worker : m_workers) worker.join();
+        m_workers.clear();
+        m_clock.join();
+    }
+
+    unsigned DecodeThreads() const { return (unsigned)m_workers.size(); }
+
+    // Passes of the clock thread so far; stays put while nothing plays
+    uint64_t ClockTicks() const { return m_clockTicks.load(std::memory_order_relaxed); }
+
+    void Attach(AudioEngine* engine) override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_engines[engine] = EngineState();
+    }
+
+    void Detach(AudioEngine* engine) override
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle.wait(lock, [&]() { return !m_engines[engine].running; });
+        m_ready.erase(std::remove(m_ready.begin(), m_ready.end(), engine), m_ready.end());
+        m_engines.erase(engine);
+    }
+
+    void Wake(AudioEngine* engine) override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto state = m_engines.find(engine);
+        if (state != m_engines.end() && Queue(engine, state->second)) m_wake.notify_one();
+        if (m_clockIdle) m_clockWake.notify_one();
+    }
+
+    // Clock thread side of NullSink
+    void AddSink(NullSink* sink)
+    {
+        std::lock_guard<std::mutex> lock(m_sinkMutex);
+        m_sinks.push_back(sink);
+    }
+
+    void RemoveSink(NullSink* sink)
+    {
+        std::lock_guard<std::mutex> lock(m_sinkMutex);
+        m_sinks.erase(std::remove(m_sinks.begin(), m_sinks.end(), sink), m_sinks.end());
+    }
+
+    // Held while sinks render, so taking it waits out a render in progress
+    std::mutex& SinkMutex() { return m_sinkMutex; }
+
+private:
+    struct EngineState
+    {
+        bool queued = false;
+        bool running = false;
+        bool again = false;     // woken while running
+    };
+
+    // Caller holds m_mutex. Returns true if the engine was queued.
+    bool Queue(AudioEngine* engine, EngineState& state)
+    {
+        if (state.running)
+        {
+            state.again = true;
+            return false;
+        }
+        if (state.queued) return false;
+        state.queued = true;
+        m_ready.push_back(engine);
+        return true;
+    }
+
+    void WorkerLoop()
+    {
+#ifdef _WIN32
+        // Media Foundation sources are read from these threads
+        HRESULT hrCom = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+#endif
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_quit)
+        {
+            if (m_ready.empty())
+            {
+                m_wake.wait(lock);
+                continue;
+            }
+            AudioEngine* engine = m_ready.front();
+            m_ready.pop_front();
+            EngineState& state = m_engines[engine];
+            state.queued = false;
+            state.running = true;
+            state.again = false;
+            lock.unlock();
+
+            // One batch per turn, then to the back of the queue, so a zone
+            // refilling from empty does not hold up the others
+            bool more = engine->Service();
+
+            lock.lock();
+            EngineState& after = m_engines[engine];
+            after.running = false;
+            if ((more || after.again) && !after.queued)
+            {
+                after.queued = true;
+                m_ready.push_back(engine);
+            }
+            m_idle.notify_all();
+        }
+        lock.unlock();
+#ifdef _WIN32
+        if (SUCCEEDED(hrCom)) CoUninitialize();
+#endif
+    }
+
+    void ClockLoop();
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;         // workers
+    std::condition_variable m_clockWake;    // the clock thread, on Stop() or when idle
+    bool m_clockIdle = false;               // nothing playing: the clock waits untimed
+    std::atomic<uint64_t> m_clockTicks{ 0 };
+    std::condition_variable m_idle;         // an engine's Service() returned
+    std::vector<std::thread> m_workers;
+    std::thread m_clock;
+    bool m_quit = false;
+    std::unordered_map<AudioEngine*, EngineState> m_engines;
+    std::deque<AudioEngine*> m_ready;
+
+    std::mutex m_sinkMutex;
+    std::vector<NullSink*> m_sinks;
+};
+
+// An output that plays into nothing at real-time speed: the scheduler's
+// clock pulls from the renderer as a device would. Stands in for a zone's
+// device in benchmarks and on machines without one.
+class NullSink : public AudioSink
+{
+public:
+    NullSink(ZoneScheduler& scheduler, uint32_t sampleRate = 48000, uint32_t channels = 2)
+        : m_scheduler(scheduler), m_sampleRate(sampleRate), m_channels(channels)
+    {
+        // Two clock periods of room, in case the clock thread falls behind
+        m_buffer.assign((size_t)sampleRate * ZoneScheduler::kClockPeriodMs * 2 / 1000 * channels, 0.0f);
+    }
+
+    ~NullSink() { Close(); }
+
+    void Open(AudioRenderer* renderer)
+    {
+        m_renderer = renderer;
+        m_scheduler.AddSink(this);
+    }
+
+    void Close()
+    {
+        if (!m_renderer) return;
+        m_scheduler.RemoveSink(this);
+        m_renderer = nullptr;
+    }
+
+    uint32_t SampleRate() const override { return m_sampleRate; }
+    uint32_t Channels() const override { return m_channels; }
+
+    bool Start() override
+    {
+        std::lock_guard<std::mutex> lock(m_scheduler.SinkMutex());
+        m_running = m_renderer != nullptr;
+        m_fraction = 0.0;
+        return m_running;
+    }
+
+    // Sink mutex held
+    bool Running() const { return m_running; }
+
+    void Stop() override
+    {
+        std::lock_guard<std::mutex> lock(m_scheduler.SinkMutex());
+        m_running = false;
+    }
+
+    uint64_t FramesRendered() const { return m_framesRendered.load(std::memory_order_relaxed); }
+
+    // Clock thread, with the scheduler's sink mutex held
+    void Advance(double seconds)
+    {
+        if (!m_running) return;
+        m_fraction += seconds * m_sampleRate;
+        size_t frames = (size_t)m_fraction;
+        m_fraction -= (double)frames;
+        size_t capacity = m_buffer.size() / m_channels;
+        frames = std::min(frames, capacity);    // a stalled clock drops time rather than catching up
+        if (frames == 0) return;
+        m_renderer->Render(m_buffer.data(), frames);
+        m_framesRendered.fetch_add(frames, std::memory_order_relaxed);
+    }
+
+private:
+    ZoneScheduler& m_scheduler;
+    uint32_t m_sampleRate;
+    uint32_t m_channels;
+    AudioRenderer* m_renderer = nullptr;
+    std::vector<float> m_buffer;
+    bool m_running = false;
+    double m_fraction = 0.0;
+    std::atomic<uint64_t> m_framesRendered{ 0 };
+};
+
+inline void ZoneScheduler::ClockLoop()
+{
+    auto last = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_quit)
+    {
+        if (m_clockIdle)
+        {
+            m_clockWake.wait(lock);
+            m_clockIdle = false;
+            last = std::chrono::steady_clock::now();
+        }
+        else
+        {
+            m_clockWake.wait_for(lock, std::chrono::milliseconds((int)kClockPeriodMs));
+        }
+        if (m_quit) break;
+        lock.unlock();
+        m_clockTicks.fetch_add(1, std::memory_order_relaxed);
+
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - last).count();
+        last = now;
+        bool active = false;
+        {
+            std::lock_guard<std::mutex> sinkLock(m_sinkMutex);
+            RealtimeScope realtime;
+            for (NullSink* sink : m_sinks)
+            {
+                sink->Advance(elapsed);
+                active = active || sink->Running();
+            }
+        }
+
+        // Engines the sinks (or device threads) have drained enough to refill.
+        // An engine that starts playing calls Wake(), which ends an idle wait.
+        lock.lock();
+        size_t queued = 0;
+        for (auto& engine : m_engines)
+        {
+            if (engine.first->NeedsService() && Queue(engine.first, engine.second)) queued++;
+            active = active || engine.first->IsPlaying() || engine.second.queued || engine.second.running;
+        }
+        m_clockIdle = !active;
+        if (queued == 1)
+            m_wake.notify_one();
+        else if (queued > 1)
+            m_wake.notify_all();
+    }
+}
@@ -0,0 +1,312 @@
+#!/usr/bin/env python3
+"""Writes fixture.flac, the stream tests/flac_source_test.cpp decodes.
+
+A small reference encoder, deterministic and dependency free, that cycles
+through the stream features the decoder has to handle: every subframe type
+(constant, verbatim, fixed orders 0-4, LPC up to order 32 with both 32- and
+64-bit accumulation), wasted bits, all four stereo decorrelation modes, Rice
+and Rice2 residuals with escaped partitions, and a short final block. The
+SEEKTABLE holds a single point halfway through, so seeks before it bisect on
+frame headers and seeks after it start from the point.
+
+Usage: make_flac_fixture.py [output.flac]
+"""
+
+import hashlib
+import math
+import struct
+import sys
+
+SAMPLE_RATE = 44100
+BLOCK_SIZE = 576            # blocksize code 2
+BITS = 16
+FRAMES = 45                 # 44 full blocks and a short one
+TOTAL = BLOCK_SIZE * (FRAMES - 1) + 300
+
+
+class BitWriter:
+    def __init__(self):
+        self.bytes = bytearray()
+        self.acc = 0
+        self.count = 0
+
+    def write(self, value, bits):
+        if bits == 0:
+            return
+        value &= (1 << bits) - 1
+        self.acc = (self.acc << bits) | value
+        self.count += bits
+        while self.count >= 8:
+            self.count -= 8
+            self.bytes.append((self.acc >> self.count) & 0xFF)
+        self.acc &= (1 << self.count) - 1
+
+    def unary(self, zeros):
+        for _ in range(zeros // 32):
+            self.write(0, 32)
+        self.write(1, zeros % 32 + 1)
+
+    def align(self):
+        if self.count:
+            self.write(0, 8 - self.count)
+
+
+def crc8(data):
+    crc = 0
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def crc16(data):
+    crc = 0
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x8005) & 0xFFFF if crc & 0x8000 else (crc << 1) & 0xFFFF
+    return crc
+
+
+def make_signal():
+    """Two channels of 16-bit audio with quiet, silent and coarse stretches."""
+    seed = 12345
+    left, right = [], []
+    for i in range(TOTAL):
+        seed = (seed * 1103515245 + 12345) & 0x7FFFFFFF
+        noise = (seed >> 16) % 33 - 16
+        t = i / SAMPLE_RATE
+        frame = i // BLOCK_SIZE
+        l = 9000 * math.sin(2 * math.pi * (220 + 400 * t) * t) + 3000 * math.sin(2 * math.pi * 3100 * t) + noise
+        r = 0.7 * l + 5000 * math.sin(2 * math.pi * 660 * t) - noise
+        if frame == 20:                     # full scale: large residuals, 17-bit side samples
+            l = 32767 * math.sin(2 * math.pi * 5000 * t)
+            r = -l
+        l, r = int(round(l)), int(round(r))
+        if 10 <= frame < 13:                # digital silence: constant subframes
+            l = r = 0
+        if 14 <= frame < 17:                # low bits unused: wasted-bits subframes
+            l &= ~7
+            r &= ~3
+        left.append(max(-32768, min(32767, l)))
+        right.append(max(-32768, min(32767, r)))
+    return left, right
+
+
+def zigzag(v):
+    return (v << 1) if v >= 0 else ((-v) << 1) - 1
+
+
+def write_residual(w, residual, order, block, partition_order, escape_first, rice2):
+    coded = [zigzag(v) for v in residual]
+    params = []
+    size = block >> partition_order
+    start = 0
+    for p in range(1 << partition_order):
+        count = size - order if p == 0 else size
+        part = coded[start:start + count]
+        start += count
+        best = min(range(31), key=lambda k: sum(u >> k for u in part) + len(part) * (k + 1))
+        params.append((best, part, residual[start - count:start]))
+
+    rice2 = rice2 or any(k > 14 for k, _, _ in params)
+    w.write(1 if rice2 else 0, 2)
+    w.write(partition_order, 4)
+    for p, (k, part, raw) in enumerate(params):
+        if escape_first and p == 0:
+            bits = max((max(abs(v) for v in raw) if raw else 0).bit_length() + 1, 1)
+            w.write(31 if rice2 else 15, 5 if rice2 else 4)
+            w.write(bits, 5)
+            for v in raw:
+                w.write(v, bits)
+            continue
+        w.write(k, 5 if rice2 else 4)
+        for u in part:
+            w.unary(u >> k)
+            w.write(u, k)
+
+
+def fixed_residual(s, order):
+    out = []
+    for i in range(order, len(s)):
+        if order == 0:
+            p = 0
+        elif order == 1:
+            p = s[i - 1]
+        elif order == 2:
+            p = 2 * s[i - 1] - s[i - 2]
+        elif order == 3:
+            p = 3 * s[i - 1] - 3 * s[i - 2] + s[i - 3]
+        else:
+            p = 4 * s[i - 1] - 6 * s[i - 2] + 4 * s[i - 3] - s[i - 4]
+        out.append(s[i] - p)
+    return out
+
+
+def lpc_coefficients(s, order, precision):
+    n = len(s)
+    window = [0.5 - 0.5 * math.cos(2 * math.pi * i / (n - 1)) for i in range(n)]
+    x = [s[i] * window[i] for i in range(n)]
+    r = [sum(x[i] * x[i + lag] for i in range(n - lag)) for lag in range(order + 1)]
+    r[0] = r[0] * 1.0001 + 1e-9
+    a = [0.0] * order
+    err = r[0]
+    for i in range(order):
+        acc = r[i + 1] - sum(a[j] * r[i - j] for j in range(i))
+        k = acc / err
+        a_new = a[:]
+        a_new[i] = k
+        for j in range(i):
+            a_new[j] = a[j] - k * a[i - 1 - j]
+        a = a_new
+        err *= (1 - k * k)
+
+    cmax = max(abs(c) for c in a) or 1.0
+    shift = precision - 1 - (int(math.floor(math.log2(cmax))) + 1)
+    shift = max(0, min(15, shift))
+    limit = 1 << (precision - 1)
+    q, error = [], 0.0
+    for c in a:
+        error += c * (1 << shift)
+        v = max(-limit, min(limit - 1, int(round(error))))
+        error -= v
+        q.append(v)
+    return q, shift
+
+
+def lpc_residual(s, coefs, shift):
+    order = len(coefs)
+    return [s[i] - (sum(coefs[j] * s[i - 1 - j] for j in range(order)) >> shift) for i in range(order, len(s))]
+
+
+KINDS = ["fixed0", "fixed1", "fixed2", "fixed3", "fixed4", "lpc8", "lpc12", "lpc32", "verbatim"]
+
+
+def write_subframe(w, s, bps, kind, partition_order, escape_first, rice2):
+    order = int(kind.strip("fixedlpc")) if kind != "verbatim" else 0
+    while partition_order and (len(s) >> partition_order) < order:
+        partition_order -= 1
+
+    if all(v == s[0] for v in s):
+        w.write(0, 1)
+        w.write(0, 6)
+        w.write(0, 1)
+        w.write(s[0], bps)
+        return
+
+    wasted = 0
+    while wasted < bps - 1 and all(((v >> wasted) & 1) == 0 for v in s):
+        wasted += 1
+    s = [v >> wasted for v in s]
+    bps -= wasted
+
+    def header(type_code):
+        w.write(0, 1)
+        w.write(type_code, 6)
+        if wasted:
+            w.write(1, 1)
+            w.unary(wasted - 1)
+        else:
+            w.write(0, 1)
+
+    if kind == "verbatim":
+        header(1)
+        for v in s:
+            w.write(v, bps)
+    elif kind.startswith("fixed"):
+        order = int(kind[5:])
+        header(8 + order)
+        for v in s[:order]:
+            w.write(v, bps)
+        write_residual(w, fixed_residual(s, order), order, len(s), partition_order, escape_first, rice2)
+    else:
+        order = int(kind[3:])
+        precision = 15 if order == 32 else 12
+        coefs, shift = lpc_coefficients(s, order, precision)
+        header(31 + order)
+        for v in s[:order]:
+            w.write(v, bps)
+        w.write(precision - 1, 4)
+        w.write(shift, 5)
+        for c in coefs:
+            w.write(c, precision)
+        write_residual(w, lpc_residual(s, coefs, shift), order, len(s), partition_order, escape_first, rice2)
+
+
+def utf8_number(n):
+    if n < 0x80:
+        return bytes([n])
+    if n < 0x800:
+        return bytes([0xC0 | (n >> 6), 0x80 | (n & 0x3F)])
+    return bytes([0xE0 | (n >> 12), 0x80 | ((n >> 6) & 0x3F), 0x80 | (n & 0x3F)])
+
+
+def encode_frame(index, left, right):
+    block = len(left)
+    assignment = [1, 8, 9, 10][index % 4]
+    if assignment == 1:
+        channels = [(left, BITS), (right, BITS)]
+    elif assignment == 8:
+        channels = [(left, BITS), ([l - r for l, r in zip(left, right)], BITS + 1)]
+    elif assignment == 9:
+        channels = [([l - r for l, r in zip(left, right)], BITS + 1), (right, BITS)]
+    else:
+        channels = [([(l + r) >> 1 for l, r in zip(left, right)], BITS),
+                    ([l - r for l, r in zip(left, right)], BITS + 1)]
+
+    head = bytearray([0xFF, 0xF8])
+    short = block != BLOCK_SIZE
+    head.append(((7 if short else 2) << 4) | 9)         # blocksize, 44.1 kHz
+    head.append((assignment << 4) | (4 << 1))           # 16 bits per sample
+    head += utf8_number(index)
+    if short:
+        head += struct.pack(">H", block - 1)
+    head.append(crc8(head))
+
+    w = BitWriter()
+    partition_order = [0, 2, 4, 6][index % 4] if not short else 0
+    for c, (samples, bps) in enumerate(channels):
+        kind = KINDS[(index * 2 + c) % len(KINDS)]
+        if short and kind == "lpc32":
+            kind = "lpc12"
+        write_subframe(w, samples, bps, kind, partition_order, escape_first=(index % 7 == 3), rice2=(index % 5 == 4))
+    w.align()
+    frame = bytes(head) + bytes(w.bytes)
+    return frame + struct.pack(">H", crc16(frame))
+
+
+def main():
+    output = sys.argv[1] if len(sys.argv) > 1 else "fixture.flac"
+    left, right = make_signal()
+
+    frames = []
+    for index in range(FRAMES):
+        start = index * BLOCK_SIZE
+        frames.append(encode_frame(index, left[start:start + BLOCK_SIZE], right[start:start + BLOCK_SIZE]))
+
+    md5 = hashlib.md5()
+    for l, r in zip(left, right):
+        md5.update(struct.pack("<hh", l, r))
+
+    sizes = [len(f) for f in frames]
+    info = struct.pack(">HH", BLOCK_SIZE, BLOCK_SIZE)
+    info += struct.pack(">I", min(sizes))[1:] + struct.pack(">I", max(sizes))[1:]
+    packed = (SAMPLE_RATE << 44) | ((2 - 1) << 41) | ((BITS - 1) << 36) | TOTAL
+    info += struct.pack(">Q", packed) + md5.digest()
+
+    half = FRAMES // 2
+    seek = struct.pack(">QQH", half * BLOCK_SIZE, sum(sizes[:half]), BLOCK_SIZE)
+
+    out = bytearray(b"fLaC")
+    out += bytes([0x00]) + struct.pack(">I", len(info))[1:] + info
+    out += bytes([0x83]) + struct.pack(">I", len(seek))[1:] + seek
+    for f in frames:
+        out += f
+    with open(output, "wb") as f:
+        f.write(out)
+    print("%s: %d samples, %d frames, %d bytes, md5 %s" % (output, TOTAL, FRAMES, len(out), md5.hexdigest()))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,192 @@
+#!/usr/bin/env python3
+"""Writes fixture.mp3, the stream tests/mp3_source_test.cpp decodes.
+
+A minimal, deterministic and dependency free Layer III writer: MPEG-1 stereo
+at 64 kbps and 44.1 kHz (so frames alternate between 208 and 209 bytes),
+long blocks only, scalefactors of varying widths, and the whole spectrum
+coded as count1 quadruples with table B, which needs no Huffman tables.
+Granules alternate between a few quadruples and the full 576 lines, so the
+large ones do not fit their own frame: their main data starts up to the full
+511 bytes back, across two or three earlier frames. An Info frame in front
+carries the frame count and a LAME tag with the encoder delay and padding.
+
+Usage: make_mp3_fixture.py [output.mp3]
+"""
+
+import sys
+
+FRAMES = 300
+BITRATE_INDEX = 5           # 64 kbps
+FRAME_BYTES = 144 * 64000 // 44100
+SIDE_INFO_BYTES = 32
+RESERVOIR = 511             # main_data_begin is 9 bits
+ENCODER_DELAY = 576
+ENCODER_PADDING = 1234
+
+# MPEG-1 scalefac_compress: bits per scalefactor in bands 0-10 and 11-20
+SLEN = [(0, 0), (0, 1), (0, 2), (0, 3), (3, 0), (1, 1), (1, 2), (1, 3),
+        (2, 1), (2, 2), (2, 3), (3, 1), (3, 2), (3, 3), (4, 2), (4, 3)]
+
+
+class BitWriter:
+    def __init__(self):
+        self.bytes = bytearray()
+        self.acc = 0
+        self.count = 0
+        self.bits = 0
+
+    def write(self, value, bits):
+        if bits == 0:
+            return
+        value &= (1 << bits) - 1
+        self.acc = (self.acc << bits) | value
+        self.count += bits
+        self.bits += bits
+        while self.count >= 8:
+            self.count -= 8
+            self.bytes.append((self.acc >> self.count) & 0xFF)
+        self.acc &= (1 << self.count) - 1
+
+    def append(self, other):
+        for b in other.bytes:
+            self.write(b, 8)
+        self.write(other.acc, other.count)
+
+    def align(self):
+        if self.count:
+            self.write(0, 8 - self.count)
+
+
+class Random:
+    def __init__(self, seed):
+        self.seed = seed
+
+    def next(self, n):
+        self.seed = (self.seed * 1103515245 + 12345) & 0x7FFFFFFF
+        return (self.seed >> 16) % n
+
+
+def encode_granule(rng, quads):
+    """Scalefactors and count1 data of one granule and channel, and its side info fields."""
+    compress = rng.next(16)
+    slen1, slen2 = SLEN[compress]
+    data = BitWriter()
+    for band in range(21):
+        bits = slen1 if band < 11 else slen2
+        data.write(rng.next(1 << bits) if bits else 0, bits)
+
+    # Denser at the bottom of the spectrum, as music is
+    for q in range(quads):
+        density = 3 if q < 32 else 6
+        values = [rng.next(density) == 0 for _ in range(4)]
+        symbol = sum(1 << (3 - k) for k in range(4) if values[k])
+        data.write(symbol ^ 15, 4)
+        for v in values:
+            if v:
+                data.write(rng.next(2), 1)
+
+    side = {
+        "part2_3": data.bits,
+        "global_gain": 168 + rng.next(16),
+        "compress": compress,
+        "scalefac_scale": rng.next(4) == 0,
+    }
+    return data, side
+
+
+def write_side_info(begin, sides):
+    bits = BitWriter()
+    bits.write(begin, 9)
+    bits.write(0, 3)                            # private bits
+    bits.write(0, 8)                            # scfsi, both channels
+    for side in sides:
+        bits.write(side["part2_3"], 12)
+        bits.write(0, 9)                        # big_values: all count1
+        bits.write(side["global_gain"], 8)
+        bits.write(side["compress"], 4)
+        bits.write(0, 1)                        # long blocks
+        bits.write(0, 15)                       # table_select
+        bits.write(0, 4)                        # region0_count
+        bits.write(0, 3)                        # region1_count
+        bits.write(0, 1)                        # preflag
+        bits.write(side["scalefac_scale"], 1)
+        bits.write(1, 1)                        # count1 table B
+    assert len(bits.bytes) == SIDE_INFO_BYTES and bits.count == 0
+    return bits.bytes
+
+
+def header(padded):
+    return bytes([0xFF, 0xFB, (BITRATE_INDEX << 4) | (2 if padded else 0), 0x00])
+
+
+def frame_sizes():
+    sizes, rest = [], 0
+    for _ in range(FRAMES + 1):
+        rest += 144 * 64000 % 44100
+        padded = rest >= 44100
+        if padded:
+            rest -= 44100
+        sizes.append(FRAME_BYTES + padded)
+    return sizes
+
+
+def main():
+    output = sys.argv[1] if len(sys.argv) > 1 else "fixture.mp3"
+    rng = Random(2024)
+    sizes = frame_sizes()
+
+    # Info frame: frame count, then the LAME tag with delay and padding
+    info = bytearray(header(sizes[0] > FRAME_BYTES)) + bytes(SIDE_INFO_BYTES)
+    info += b"Info" + bytes([0, 0, 0, 1]) + FRAMES.to_bytes(4, "big")
+    lame = bytearray(b"LAME3.100".ljust(36, b"\0"))
+    lame[21] = ENCODER_DELAY >> 4
+    lame[22] = ((ENCODER_DELAY & 15) << 4) | (ENCODER_PADDING >> 8)
+    lame[23] = ENCODER_PADDING & 0xFF
+    info += lame
+    info += bytes(sizes[0] - len(info))
+    out = bytearray(info)
+
+    # Main data is one byte stream laid over the frames' slots; a frame's
+    # data starts as early as the reservoir allows, after the previous one's
+    slots = bytearray()
+    frames = []
+    cursor = 0
+    deepest = 0
+    for index in range(FRAMES):
+        size = sizes[index + 1]
+        slot_start = len(slots)
+        slots += bytes(size - 4 - SIDE_INFO_BYTES)
+        start = max(cursor, slot_start - RESERVOIR)
+        quads = 144 if index % 4 == 3 else 4 + rng.next(12)
+        while True:
+            sides, data = [], BitWriter()
+            state = rng.seed
+            for _ in range(4):
+                part, side = encode_granule(rng, quads)
+                data.append(part)
+                sides.append(side)
+            data.align()
+            if start + len(data.bytes) <= len(slots):
+                break
+            rng.seed = state
+            quads -= 8
+        slots[start:start + len(data.bytes)] = data.bytes
+        cursor = start + len(data.bytes)
+        deepest = max(deepest, slot_start - start)
+        frames.append((header(size > FRAME_BYTES), write_side_info(slot_start - start, sides)))
+
+    offset = 0
+    for index, (head, side) in enumerate(frames):
+        main = sizes[index + 1] - 4 - SIDE_INFO_BYTES
+        out += head + side + slots[offset:offset + main]
+        offset += main
+
+    with open(output, "wb") as f:
+        f.write(out)
+    samples = FRAMES * 1152 - ENCODER_DELAY - ENCODER_PADDING
+    print("%s: %d frames, %d samples after trimming, %d bytes, main data up to %d bytes back" %
+          (output, FRAMES, samples, len(out), deepest))
+
+
+if __name__ == "__main__":
+    main()
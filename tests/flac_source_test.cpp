@@ -0,0 +1,207 @@
+// Decodes a FLAC stream sequentially and in decode-ahead batches, checks both
+// against the STREAMINFO MD5, then seeks to boundary and random positions and
+// compares what follows with the sequential decode sample for sample. Logs
+// the decode throughput; built against libFLAC (FLAC_TEST_LIBFLAC) it also
+// decodes the stream with the reference decoder and compares the two.
+//
+// flac_source_test <file.flac>    (ctest runs it on tests/data/fixture.flac)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "flac_source.h"
+#include "log.h"
+#ifdef FLAC_TEST_LIBFLAC
+#include <FLAC/stream_decoder.h>
+#endif
+
+namespace
+{
+
+int g_failures = 0;
+
+void Check(bool condition, const char* what)
+{
+    if (condition) return;
+    LogMessage("FAILED: %s", what);
+    g_failures++;
+}
+
+bool DecodeAll(const char* path, unsigned threads, std::vector<float>& samples, bool& md5Verified)
+{
+    FlacSource source;
+    source.SetDecodeThreads(threads);
+    if (!source.Open(path)) return false;
+
+    uint32_t channels = source.Format().channels;
+    samples.clear();
+    std::vector<float> block(4096 * channels);
+    for (;;)
+    {
+        size_t got = source.Read(block.data(), 4096);
+        if (got == 0) break;
+        samples.insert(samples.end(), block.begin(), block.begin() + got * channels);
+    }
+    md5Verified = source.Md5Verified();
+    return true;
+}
+
+// Seek to 'frame' and compare the next 'count' frames with the reference
+bool SeekMatches(FlacSource& source, const std::vector<float>& reference, uint64_t frame, size_t count)
+{
+    uint32_t channels = source.Format().channels;
+    uint64_t total = reference.size() / channels;
+    if (!source.Seek(frame)) return false;
+
+    size_t expected = frame < total ? (size_t)std::min<uint64_t>(count, total - frame) : 0;
+    std::vector<float> block((count + 1) * channels);
+    size_t got = 0;
+    while (got < count)
+    {
+        size_t n = source.Read(block.data() + got * channels, count - got);
+        if (n == 0) break;
+        got += n;
+    }
+    if (got != expected) return false;
+    return memcmp(block.data(), reference.data() + frame * channels, got * channels * sizeof(float)) == 0;
+}
+
+double DecodeSeconds(const char* path, unsigned threads)
+{
+    double best = 1e30;
+    std::vector<float> samples;
+    bool verified = false;
+    for (int pass = 0; pass < 5; pass++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        DecodeAll(path, threads, samples, verified);
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+#ifdef FLAC_TEST_LIBFLAC
+struct ReferenceDecode
+{
+    std::vector<float> samples;
+    uint32_t bits = 16;
+};
+
+FLAC__StreamDecoderWriteStatus ReferenceWrite(const FLAC__StreamDecoder*, const FLAC__Frame* frame,
+                                              const FLAC__int32* const buffer[], void* data)
+{
+    ReferenceDecode& decode = *(ReferenceDecode*)data;
+    float scale = 1.0f / (float)(1u << (frame->header.bits_per_sample - 1));
+    for (uint32_t i = 0; i < frame->header.blocksize; i++)
+        for (uint32_t c = 0; c < frame->header.channels; c++)
+            decode.samples.push_back((float)buffer[c][i] * scale);
+    return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+}
+
+void ReferenceError(const FLAC__StreamDecoder*, FLAC__StreamDecoderErrorStatus status, void*)
+{
+    LogMessage("libFLAC: %s", FLAC__StreamDecoderErrorStatusString[status]);
+}
+
+bool ReferenceDecodeAll(const char* path, ReferenceDecode& decode)
+{
+    decode.samples.clear();
+    FLAC__StreamDecoder* decoder = FLAC__stream_decoder_new();
+    if (!decoder) return false;
+    FLAC__stream_decoder_set_md5_checking(decoder, true);
+    bool ok = FLAC__stream_decoder_init_file(decoder, path, ReferenceWrite, nullptr, ReferenceError, &decode) ==
+              FLAC__STREAM_DECODER_INIT_STATUS_OK;
+    ok = ok && FLAC__stream_decoder_process_until_end_of_stream(decoder);
+    ok = FLAC__stream_decoder_finish(decoder) && ok;     // false on an MD5 mismatch
+    FLAC__stream_decoder_delete(decoder);
+    return ok;
+}
+#endif
+
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        LogMessage("usage: flac_source_test <file.flac>");
+        return 2;
+    }
+    const char* path = argv[1];
+
+    std::vector<float> reference;
+    bool verified = false;
+    if (!DecodeAll(path, 1, reference, verified))
+    {
+        LogMessage("FAILED: cannot open %s", path);
+        return 1;
+    }
+
+    FlacSource probe;
+    probe.Open(path);
+    const uint32_t channels = probe.Format().channels;
+    const uint64_t total = probe.TotalFrames();
+    const uint32_t blockSize = probe.StreamInfo().maxBlockSize;
+    Check(reference.size() == total * channels, "sequential decode length matches STREAMINFO");
+    Check(verified, "sequential decode matches the STREAMINFO MD5");
+
+    // Decode-ahead batches must hand back exactly the same stream
+    std::vector<float> batched;
+    bool batchedVerified = false;
+    DecodeAll(path, 4, batched, batchedVerified);
+    Check(batched == reference, "batched decode matches the sequential decode");
+    Check(batchedVerified, "batched decode matches the STREAMINFO MD5");
+
+    // Frame boundaries and their neighbours, the first and last frames, the
+    // seek point region and the end of the stream
+    std::vector<uint64_t> targets = { 0, 1, blockSize - 1, blockSize, blockSize + 1, total / 2, total / 2 + 7,
+                                      total - blockSize, total - 1, total };
+    for (uint64_t frame = blockSize * 16; frame < total; frame += blockSize * 5)
+        targets.push_back(frame - 3);
+    uint32_t seed = 1;
+    for (int i = 0; i < 200; i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        targets.push_back((seed >> 8) % total);
+    }
+
+    for (unsigned threads : { 1u, 4u })
+    {
+        FlacSource source;
+        source.SetDecodeThreads(threads);
+        source.Open(path);
+        size_t wrong = 0;
+        for (uint64_t frame : targets)
+            if (!SeekMatches(source, reference, frame, 1000)) wrong++;
+        if (wrong) LogMessage("%zu of %zu seeks landed wrong with %u decode thread(s)", wrong, targets.size(), threads);
+        Check(wrong == 0, "seeks land on the exact sample");
+    }
+
+    double seconds = (double)total / probe.Format().sampleRate;
+    double sequential = seconds / DecodeSeconds(path, 1);
+    double parallel = seconds / DecodeSeconds(path, 4);
+    LogMessage("FLAC decode: %.0fx realtime sequential, %.0fx with 4 decode threads", sequential, parallel);
+
+#ifdef FLAC_TEST_LIBFLAC
+    ReferenceDecode decode;
+    Check(ReferenceDecodeAll(path, decode), "libFLAC decodes the stream");
+    Check(decode.samples == reference, "output matches libFLAC");
+
+    double best = 1e30;
+    for (int pass = 0; pass < 5; pass++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        ReferenceDecodeAll(path, decode);
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    LogMessage("libFLAC decode: %.0fx realtime (FlacSource sequential is %.2fx libFLAC)", seconds / best,
+               sequential / (seconds / best));
+#endif
+
+    if (g_failures) return 1;
+    LogMessage("FLAC decoder checks passed (%zu seeks, %llu frames)", targets.size() * 2, (unsigned long long)total);
+    return 0;
+}
@@ -0,0 +1,19 @@
+// Runs the headless benchmark (BenchmarkHeadless()) outside the player: a
+// zone is driven through the control socket as a client would, with a
+// status subscription open, and this process's wakeups per second are
+// counted while playing and while paused. Fails if a command fails or the
+// paused rate is above one per second. Wakeups are sampled from getrusage(),
+// so on Windows only the control path is checked.
+//
+// Usage: headless_test [seconds per measurement, default 5]
+
+#include <cstdlib>
+
+#include "control_server.h"
+
+int main(int argc, char** argv)
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 5.0;
+    if (seconds <= 0.0) seconds = 5.0;
+    return BenchmarkHeadless(seconds) ? 0 : 1;
+}
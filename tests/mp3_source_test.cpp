@@ -0,0 +1,166 @@
+// Decodes an MP3 stream sequentially and in decode-ahead batches and checks
+// that both give the same samples, that the LAME tag's encoder delay and
+// padding are trimmed (the gapless output is the raw decoder output less
+// delay + 529 samples in front and the padding behind), then seeks to frame
+// boundaries and random positions and compares what follows with the
+// sequential decode sample for sample. Seeks restart frames early to refill
+// the bit reservoir; the fixture's main data reaches back as far as it can.
+// Logs the decode throughput.
+//
+// mp3_source_test <file.mp3>    (ctest runs it on tests/data/fixture.mp3)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "log.h"
+#include "mp3_source.h"
+
+namespace
+{
+
+int g_failures = 0;
+
+void Check(bool condition, const char* what)
+{
+    if (condition) return;
+    LogMessage("FAILED: %s", what);
+    g_failures++;
+}
+
+bool DecodeAll(const char* path, unsigned threads, bool gapless, std::vector<float>& samples)
+{
+    Mp3Source source;
+    source.SetDecodeThreads(threads);
+    source.SetGapless(gapless);
+    if (!source.Open(path)) return false;
+
+    uint32_t channels = source.Format().channels;
+    samples.clear();
+    std::vector<float> block(4096 * channels);
+    for (;;)
+    {
+        size_t got = source.Read(block.data(), 4096);
+        if (got == 0) break;
+        samples.insert(samples.end(), block.begin(), block.begin() + got * channels);
+    }
+    return source.FramesDropped() == 0;
+}
+
+// Seek to 'frame' and compare the next 'count' frames with the reference
+bool SeekMatches(Mp3Source& source, const std::vector<float>& reference, uint64_t frame, size_t count)
+{
+    uint32_t channels = source.Format().channels;
+    uint64_t total = reference.size() / channels;
+    if (!source.Seek(frame)) return false;
+
+    size_t expected = frame < total ? (size_t)std::min<uint64_t>(count, total - frame) : 0;
+    std::vector<float> block((count + 1) * channels);
+    size_t got = 0;
+    while (got < count)
+    {
+        size_t n = source.Read(block.data() + got * channels, count - got);
+        if (n == 0) break;
+        got += n;
+    }
+    if (got != expected) return false;
+    return memcmp(block.data(), reference.data() + frame * channels, got * channels * sizeof(float)) == 0;
+}
+
+double DecodeSeconds(const char* path, unsigned threads)
+{
+    double best = 1e30;
+    std::vector<float> samples;
+    for (int pass = 0; pass < 5; pass++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        DecodeAll(path, threads, true, samples);
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        LogMessage("usage: mp3_source_test <file.mp3>");
+        return 2;
+    }
+    const char* path = argv[1];
+
+    std::vector<float> reference;
+    if (!DecodeAll(path, 1, true, reference))
+    {
+        LogMessage("FAILED: cannot decode %s", path);
+        return 1;
+    }
+
+    Mp3Source probe;
+    probe.Open(path);
+    const uint32_t channels = probe.Format().channels;
+    const uint64_t total = probe.TotalFrames();
+    const uint32_t frameSamples = 1152;
+    const Mp3StreamInfo& info = probe.StreamInfo();
+    Check(info.haveGapless && info.frames > 0, "the Info frame gives the frame count and a LAME tag");
+
+    // Gapless length and placement against the raw decoder output
+    uint64_t trimmed = (uint64_t)info.frames * frameSamples - info.encoderDelay - info.encoderPadding;
+    uint64_t skip = info.encoderDelay + 529;
+    std::vector<float> raw;
+    Check(DecodeAll(path, 1, false, raw), "raw decode has no dropped frames");
+    Check(raw.size() == (size_t)info.frames * frameSamples * channels, "raw decode gives every coded sample");
+    Check(total == trimmed && reference.size() == trimmed * channels, "gapless length is the coded length less delay and padding");
+    Check(raw.size() >= (skip + trimmed) * channels &&
+          std::equal(reference.begin(), reference.end(), raw.begin() + skip * channels),
+          "gapless output is the raw output from delay + 529 on");
+
+    // Decode-ahead batches must hand back exactly the same stream
+    for (unsigned threads : { 2u, 4u })
+    {
+        std::vector<float> batched;
+        Check(DecodeAll(path, threads, true, batched), "batched decode has no dropped frames");
+        Check(batched == reference, "batched decode matches the sequential decode");
+    }
+
+    // Frame boundaries (in stream samples, so offset by the trimmed delay)
+    // and their neighbours, the first and last frames and the end
+    std::vector<uint64_t> targets = { 0, 1, total / 2, total / 2 + 7, total - frameSamples, total - 1, total };
+    for (uint64_t boundary = frameSamples; boundary < skip + total; boundary += frameSamples * 3)
+    {
+        if (boundary < skip + 1) continue;
+        targets.push_back(boundary - skip - 1);
+        targets.push_back(boundary - skip);
+    }
+    uint32_t seed = 1;
+    for (int i = 0; i < 200; i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        targets.push_back((seed >> 8) % total);
+    }
+
+    for (unsigned threads : { 1u, 4u })
+    {
+        Mp3Source source;
+        source.SetDecodeThreads(threads);
+        source.Open(path);
+        size_t wrong = 0;
+        for (uint64_t frame : targets)
+            if (!SeekMatches(source, reference, frame, 2000)) wrong++;
+        if (wrong) LogMessage("%zu of %zu seeks landed wrong with %u decode thread(s)", wrong, targets.size(), threads);
+        Check(wrong == 0, "seeks land on the exact sample");
+    }
+
+    double seconds = (double)total / probe.Format().sampleRate;
+    double sequential = seconds / DecodeSeconds(path, 1);
+    double parallel = seconds / DecodeSeconds(path, 4);
+    LogMessage("MP3 decode: %.0fx realtime sequential, %.0fx with 4 decode threads", sequential, parallel);
+
+    if (g_failures) return 1;
+    LogMessage("MP3 decoder checks passed (%zu seeks, %llu frames)", targets.size() * 2, (unsigned long long)total);
+    return 0;
+}
@@ -0,0 +1,162 @@
+// Tempo and key detection on inputs with a known answer: click tracks (an
+// impulse per beat, nothing else) must give their tempo, chord tones (an
+// I-IV-V-I or i-iv-v-i progression, no percussion) their key, and the
+// drum-and-chord corpus of BenchmarkMusicAnalysis() must get at least 90%
+// of tempi right on the parallel AnalyzeTracks() path.
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "audio_source.h"
+#include "log.h"
+#include "music_analysis.h"
+
+namespace
+{
+
+int g_failures = 0;
+
+void Check(bool condition, const char* what)
+{
+    if (condition) return;
+    LogMessage("FAILED: %s", what);
+    g_failures++;
+}
+
+const double kPi = 3.14159265358979323846;
+const uint32_t kRate = 44100;
+
+// Generated frame by frame from 'Sample(position)'
+class GeneratedSource : public AudioSource
+{
+public:
+    explicit GeneratedSource(double seconds)
+    {
+        m_format.sampleRate = kRate;
+        m_format.channels = 2;
+        m_total = (uint64_t)(seconds * kRate);
+    }
+
+    const AudioFormat& Format() const override { return m_format; }
+    uint64_t TotalFrames() const override { return m_total; }
+
+    size_t Read(float* out, size_t frames) override
+    {
+        size_t n = (size_t)std::min<uint64_t>(frames, m_total - m_position);
+        for (size_t i = 0; i < n; i++, m_position++)
+        {
+            float sample = Sample(m_position);
+            out[i * 2] = sample;
+            out[i * 2 + 1] = sample;
+        }
+        return n;
+    }
+
+    bool Seek(uint64_t frame) override
+    {
+        m_position = std::min(frame, m_total);
+        return true;
+    }
+
+protected:
+    virtual float Sample(uint64_t position) = 0;
+
+private:
+    AudioFormat m_format;
+    uint64_t m_total = 0;
+    uint64_t m_position = 0;
+};
+
+// A 5 ms decaying 2 kHz click on every beat
+class ClickTrackSource : public GeneratedSource
+{
+public:
+    ClickTrackSource(double bpm, double seconds) : GeneratedSource(seconds), m_beatFrames(60.0 * kRate / bpm) {}
+
+protected:
+    float Sample(uint64_t position) override
+    {
+        double sinceBeat = fmod((double)position, m_beatFrames) / kRate;
+        if (sinceBeat > 0.005) return 0.0f;
+        return (float)(0.8 * exp(-sinceBeat * 800.0) * sin(2 * kPi * 2000.0 * sinceBeat));
+    }
+
+private:
+    double m_beatFrames;
+};
+
+// Sustained triads with a bass root, two seconds per chord
+class ChordToneSource : public GeneratedSource
+{
+public:
+    ChordToneSource(int key, double seconds) : GeneratedSource(seconds), m_key(key) {}
+
+protected:
+    float Sample(uint64_t position) override
+    {
+        static const int kMajorChords[4][3] = { { 0, 4, 7 }, { 5, 9, 12 }, { 7, 11, 14 }, { 0, 4, 7 } };
+        static const int kMinorChords[4][3] = { { 0, 3, 7 }, { 5, 8, 12 }, { 7, 10, 14 }, { 0, 3, 7 } };
+        const auto& chords = m_key < 12 ? kMajorChords : kMinorChords;
+        const int* chord = chords[(position / (2 * kRate)) % 4];
+        int tonic = m_key % 12;
+        double t = (double)position / kRate;
+
+        double sample = 0.0;
+        for (int v = 0; v < 3; v++)
+        {
+            double frequency = 261.63 * pow(2.0, (tonic + chord[v]) / 12.0);
+            for (int h = 1; h <= 3; h++) sample += sin(2 * kPi * frequency * h * t) / (h * h);
+        }
+        sample += 1.5 * sin(2 * kPi * 65.41 * pow(2.0, (tonic + chord[0]) / 12.0) * t);
+        return (float)(0.08 * sample);
+    }
+
+private:
+    int m_key;
+};
+
+void CheckTempo()
+{
+    const double kTempi[] = { 80.0, 96.0, 110.0, 120.0, 128.0, 140.0, 150.0, 174.0 };
+    FeatureAnalyzer analyzer;
+    for (double bpm : kTempi)
+    {
+        ClickTrackSource source(bpm, 30.0);
+        TrackFeatures features;
+        bool analysed = analyzer.Analyze(source, features);
+        LogMessage("Click track at %.0f BPM: %.1f BPM", bpm, features.bpm);
+        Check(analysed, "click track is analysed");
+        Check(fabs(features.bpm - bpm) <= bpm * 0.02, "click track tempo within 2%");
+    }
+}
+
+void CheckKey()
+{
+    // C, G, D, F and B flat major; A, E, D, F sharp and C minor
+    const int kKeys[] = { 0, 7, 2, 5, 10, 21, 16, 14, 18, 12 };
+    FeatureAnalyzer analyzer;
+    for (int key : kKeys)
+    {
+        ChordToneSource source(key, 24.0);
+        TrackFeatures features;
+        bool analysed = analyzer.Analyze(source, features);
+        LogMessage("Chord tones in %s: %s", KeyName(key).c_str(), KeyName(features.key).c_str());
+        Check(analysed, "chord tones are analysed");
+        Check(features.key == key, "chord tones give their key");
+    }
+}
+
+}
+
+int main()
+{
+    CheckTempo();
+    CheckKey();
+    Check(BenchmarkMusicAnalysis(32, 30.0), "at least 90% of the drum-and-chord corpus tempi are right");
+
+    if (g_failures) return 1;
+    LogMessage("Music analysis checks passed");
+    return 0;
+}
@@ -0,0 +1,116 @@
+// Saved playlists at scale: for each size a synthetic playlist (tracks inside
+// the playlist's folder, written relative on export, and outside it, written
+// absolute; some with non-ASCII names) is saved as .wmpl and loaded back, and
+// exported as M3U8 and PLS and imported back. Every round trip must give the
+// same entries in the same order; the save, load, export and import times
+// are logged.
+//
+// Usage: playlist_file_test [entries...]    (default 100000 1000000)
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "library_index.h"
+#include "log.h"
+#include "path_text.h"
+#include "playlist_file.h"
+
+namespace
+{
+
+int g_failures = 0;
+
+void Check(bool condition, const char* what)
+{
+    if (condition) return;
+    LogMessage("FAILED: %s", what);
+    g_failures++;
+}
+
+double SecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Distinct normalized paths, three in four under 'folder' and the rest under
+// another folder on the same root
+std::vector<std::wstring> MakeEntries(size_t count, const std::wstring& folder)
+{
+    std::wstring outside = folder.substr(0, PathRootLength(folder)) + L"Music Archive";
+    std::vector<std::wstring> entries(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        std::wstring path = i % 4 == 3 ? outside : folder;
+        path += L"/Artist " + std::to_wstring(i / 1000);
+        path += i % 7 == 0 ? L"/Caf\u00e9 \u00c9t\u00e9 " : L"/Album ";
+        path += std::to_wstring(i / 12 % 100) + L"/" + std::to_wstring(i) + (i % 5 == 0 ? L" \u266b.flac" : L" Track.mp3");
+        entries[i] = NormalizePathText(path);
+    }
+    return entries;
+}
+
+void RoundTrip(size_t count, const std::filesystem::path& folder)
+{
+    std::vector<std::wstring> entries = MakeEntries(count, NormalizePathText(folder.wstring()));
+
+    std::filesystem::path native = folder / "playlist.wmpl";
+    auto start = std::chrono::steady_clock::now();
+    Check(SavePlaylistFile(native, entries), "the playlist saves as .wmpl");
+    double saveSeconds = SecondsSince(start);
+
+    std::vector<std::wstring> loaded;
+    start = std::chrono::steady_clock::now();
+    Check(LoadPlaylistFile(native, loaded), "the .wmpl playlist loads");
+    double loadSeconds = SecondsSince(start);
+    Check(loaded == entries, ".wmpl round trip gives the same entries");
+    LogMessage("%zu entries, .wmpl: save %.1f ms, load %.1f ms", count, saveSeconds * 1000.0, loadSeconds * 1000.0);
+
+    for (const char* name : { "playlist.m3u8", "playlist.pls" })
+    {
+        std::filesystem::path text = folder / name;
+        start = std::chrono::steady_clock::now();
+        Check(ExportPlaylistText(text, entries), "the playlist exports as text");
+        double exportSeconds = SecondsSince(start);
+
+        LibraryIndex library;
+        std::vector<std::wstring> imported;
+        PlaylistImportStats stats;
+        start = std::chrono::steady_clock::now();
+        Check(ImportPlaylistText(text, library, imported, &stats), "the text playlist imports");
+        double importSeconds = SecondsSince(start);
+        Check(imported == entries, "text round trip gives the same entries");
+        Check(stats.lines == count && stats.duplicates == 0, "every line is imported once");
+        LogMessage("%zu entries, %s: export %.1f ms, import %.1f ms", count, name, exportSeconds * 1000.0,
+                   importSeconds * 1000.0);
+
+        std::error_code ec;
+        std::filesystem::remove(text, ec);
+    }
+
+    std::error_code ec;
+    std::filesystem::remove(native, ec);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<size_t> sizes;
+    for (int i = 1; i < argc; i++) sizes.push_back((size_t)strtoull(argv[i], nullptr, 10));
+    if (sizes.empty()) sizes = { 100000, 1000000 };
+
+    std::error_code ec;
+    std::filesystem::path folder = std::filesystem::temp_directory_path(ec) / "playlist_file_test";
+    std::filesystem::create_directories(folder, ec);
+    for (size_t count : sizes) RoundTrip(count, folder);
+    std::filesystem::remove(folder, ec);
+
+    if (g_failures) return 1;
+    LogMessage("Playlist file checks passed");
+    return 0;
+}
@@ -0,0 +1,23 @@
+// Runs the render regression check (CheckRender()) outside the player: the
+// scripted scenario is played through AudioEngine on a simulated clock and
+// each step's output checksum is compared with this platform's goldens in
+// src/render_golden.h. Exit code 0 on a match, 1 on a mismatch, 2 when this
+// platform has no goldens yet (ctest reports the test as skipped) and 3 if
+// the scenario could not run.
+//
+// Usage: render_check_test [--write-golden <src/render_golden.h>]
+
+#include <cstring>
+#include <filesystem>
+
+#include "render_check.h"
+
+int main(int argc, char** argv)
+{
+    std::filesystem::path goldenPath;
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "--write-golden") == 0) goldenPath = argv[i + 1];
+    }
+    return (int)CheckRender(goldenPath);
+}
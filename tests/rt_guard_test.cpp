@@ -0,0 +1,200 @@
+// Steady-state real-time check: plays a track through AudioEngine with the
+// EQ, limiter, resampler and time-stretch all in the path, calling Render()
+// for every 10 ms device period on a thread marked real-time, and requires
+// that those calls made no heap allocation, no free and took no lock.
+// Decoding runs synchronously between periods (on a non-real-time thread),
+// so the result does not depend on scheduling.
+
+#define RT_GUARD 1
+#define RT_GUARD_IMPLEMENTATION
+
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <vector>
+
+#include "audio_engine.h"
+#include "audio_sink.h"
+#include "log.h"
+#include "rt_guard.h"
+#include "wav_file.h"
+
+namespace
+{
+
+int g_failures = 0;
+
+void Check(bool condition, const char* what)
+{
+    if (condition) return;
+    LogMessage("FAILED: %s", what);
+    g_failures++;
+}
+
+class TestSink : public AudioSink
+{
+public:
+    uint32_t SampleRate() const override { return 48000; }
+    uint32_t Channels() const override { return 2; }
+    bool Start() override { return m_running = true; }
+    void Stop() override { m_running = false; }
+    bool Running() const { return m_running; }
+
+private:
+    bool m_running = false;
+};
+
+// Decoding happens only when the test calls Service()
+class TestDriver : public DecodeDriver
+{
+public:
+    void Attach(AudioEngine*) override {}
+    void Detach(AudioEngine*) override {}
+    void Wake(AudioEngine*) override {}
+};
+
+struct GuardCounts
+{
+    uint64_t allocations;
+    uint64_t frees;
+    uint64_t blockingCalls;
+};
+
+GuardCounts ReadCounts()
+{
+    RealtimeGuardStats& stats = GetRealtimeGuardStats();
+    return { stats.allocations.load(), stats.frees.load(), stats.blockingCalls.load() };
+}
+
+// The guard itself must see every kind of allocation and lock, or a clean
+// steady-state result would prove nothing
+void CheckGuardCounts()
+{
+    struct alignas(64) Aligned
+    {
+        float values[16];
+    };
+
+    GuardCounts before = ReadCounts();
+    GuardedMutex mutex;
+    {
+        // volatile, or the compiler may elide the new/delete pairs
+        RealtimeScope realtime;
+        int* volatile single = new int(1);
+        delete single;
+        char* volatile array = new char[100];
+        delete[] array;
+        Aligned* volatile aligned = new Aligned();
+        delete aligned;
+        Aligned* volatile alignedArray = new Aligned[4];
+        delete[] alignedArray;
+        std::lock_guard<GuardedMutex> lock(mutex);
+    }
+    std::vector<int> outside(100);     // not on a real-time thread: not counted
+    GuardCounts after = ReadCounts();
+    Check(after.allocations - before.allocations == 4, "plain and aligned allocations are counted");
+    Check(after.frees - before.frees == 4, "plain and aligned frees are counted");
+    Check(after.blockingCalls - before.blockingCalls == 1, "locks are counted");
+
+    // Start the engine's own report from zero
+    RealtimeGuardStats& stats = GetRealtimeGuardStats();
+    stats.allocations = 0;
+    stats.frees = 0;
+    stats.blockingCalls = 0;
+}
+
+const double kPi = 3.14159265358979323846;
+
+bool WriteTrack(const std::filesystem::path& path, double seconds)
+{
+    WavWriter writer;
+    if (!writer.Open(path, 44100, 2, false)) return false;
+    std::vector<float> block(4096 * 2);
+    size_t total = (size_t)(seconds * 44100);
+    for (size_t done = 0; done < total;)
+    {
+        size_t n = std::min<size_t>(4096, total - done);
+        for (size_t i = 0; i < n; i++)
+        {
+            double t = (double)(done + i) / 44100;
+            block[i * 2] = (float)(0.5 * sin(2 * kPi * 440 * t));
+            block[i * 2 + 1] = (float)(0.5 * sin(2 * kPi * 660 * t));
+        }
+        if (!writer.Write(block.data(), n)) return false;
+        done += n;
+    }
+    writer.Close();
+    return true;
+}
+
+}
+
+int main()
+{
+    const uint32_t kPeriodFrames = 480;     // 10 ms at 48 kHz
+    const int kPeriods = 2000;
+
+    CheckGuardCounts();
+
+    std::error_code ec;
+    std::filesystem::path track = std::filesystem::temp_directory_path(ec) / "rt_guard_test.wav";
+    if (!WriteTrack(track, 40.0))
+    {
+        LogMessage("FAILED: cannot write %s", track.string().c_str());
+        return 1;
+    }
+
+    TestSink sink;
+    TestDriver driver;
+    AudioEngine engine;
+    Check(engine.Configure(&sink, &driver), "engine configures");
+    auto source = std::make_unique<WavSource>();
+    Check(source->Open(track), "track opens");
+    Check(engine.Load(std::move(source)), "track loads");
+
+    EqBand band;
+    band.type = EqBandType::Peaking;
+    band.frequency = 1000.0;
+    band.gainDb = 6.0;
+    band.enabled = true;
+    engine.Dsp().Eq().SetBand(0, band);
+    engine.SetSpeed(1.25);
+    engine.SetVolume(0.9f);
+    engine.Play();
+
+    std::vector<float> out(kPeriodFrames * 2);
+    GuardCounts before = ReadCounts();
+    double peak = 0.0;
+    for (int period = 0; period < kPeriods; period++)
+    {
+        // Control-thread changes while playing, then refill the read-ahead
+        if (period == kPeriods / 2) engine.SetVolume(0.5f);
+        if (period == kPeriods / 4) engine.Seek(44100 * 5);
+        while (engine.Service() || engine.NeedsService()) {}
+
+        RealtimeScope realtime;
+        engine.Render(out.data(), kPeriodFrames);
+        for (float sample : out) peak = std::max(peak, (double)std::fabs(sample));
+    }
+    GuardCounts after = ReadCounts();
+    uint64_t underruns = engine.Stats().underruns;
+    engine.LogReport();
+    engine.Shutdown();
+    std::filesystem::remove(track, ec);
+
+    LogMessage("%d render periods: %llu allocations, %llu frees, %llu locks, %llu underruns", kPeriods,
+               (unsigned long long)(after.allocations - before.allocations), (unsigned long long)(after.frees - before.frees),
+               (unsigned long long)(after.blockingCalls - before.blockingCalls), (unsigned long long)underruns);
+    Check(after.allocations == before.allocations, "Render() does not allocate");
+    Check(after.frees == before.frees, "Render() does not free");
+    Check(after.blockingCalls == before.blockingCalls, "Render() does not lock");
+    Check(underruns == 0, "the read-ahead never runs dry");
+    Check(peak > 0.1, "audio was rendered");
+
+    if (g_failures) return 1;
+    LogMessage("Real-time guard checks passed");
+    return 0;
+}
@@ -0,0 +1,19 @@
+// Runs the sample-format conversion check (BenchmarkSampleConversion())
+// outside the player: every SIMD kernel this CPU runs (SSE2, AVX2 or NEON)
+// converts 16-, 24- and 32-bit PCM to float and back, with and without TPDF
+// dither, and planar to interleaved, and must match the scalar code bit
+// for bit, including rounding ties, clipping and non-finite input. Fails on
+// any mismatch; the throughput of each kernel is logged.
+//
+// Usage: sample_convert_test [samples, default 1048576]
+
+#include <cstdlib>
+
+#include "sample_convert.h"
+
+int main(int argc, char** argv)
+{
+    size_t samples = argc > 1 ? (size_t)strtoull(argv[1], nullptr, 10) : 0;
+    if (samples == 0) samples = 1 << 20;
+    return BenchmarkSampleConversion(samples) ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+// Many zones on one ZoneHost: 'zones' PlayerZones play synthetic tracks
+// into NullSinks on the shared decode threads and clock. Every zone must
+// render in real time without an underrun, and the clock thread must not
+// tick while nothing plays: before the first zone starts and once all are
+// paused. Then BenchmarkZones() logs how CPU, memory and threads grow with
+// 1, 8 and 64 zones, and fails on an underrun there too.
+//
+// Usage: zones_test [zones, default 16] [seconds playing, default 3]
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "library_index.h"
+#include "log.h"
+#include "zone_player.h"
+#include "zone_scheduler.h"
+
+namespace
+{
+
+int g_failures = 0;
+
+void Check(bool condition, const char* what)
+{
+    if (condition) return;
+    LogMessage("FAILED: %s", what);
+    g_failures++;
+}
+
+// Clock passes over 'seconds' of waiting
+uint64_t TicksOver(ZoneScheduler& scheduler, double seconds)
+{
+    uint64_t before = scheduler.ClockTicks();
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    return scheduler.ClockTicks() - before;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    size_t zoneCount = argc > 1 ? (size_t)strtoul(argv[1], nullptr, 10) : 16;
+    double seconds = argc > 2 ? atof(argv[2]) : 3.0;
+    if (zoneCount == 0) zoneCount = 16;
+    if (seconds <= 0.0) seconds = 3.0;
+    const size_t kTracks = 4;
+
+    std::error_code ec;
+    std::filesystem::path folder = std::filesystem::temp_directory_path(ec) / "zones_test";
+    std::filesystem::create_directories(folder, ec);
+    LibraryIndex library;
+    std::vector<uint32_t> tracks;
+    for (size_t t = 0; t < kTracks; t++)
+    {
+        std::filesystem::path path = folder / ("track" + std::to_string(t) + ".wav");
+        if (!WriteSyntheticTrack(path, 44100, seconds + 10.0, 220.0 * (1.0 + t * 0.25)))
+        {
+            LogMessage("FAILED: cannot write %s", path.string().c_str());
+            return 1;
+        }
+        tracks.push_back(library.Add(path.wstring()));
+    }
+
+    {
+        ZoneHost host(library);
+        host.Start(2);
+        ZoneScheduler& scheduler = host.Scheduler();
+
+        std::vector<std::unique_ptr<NullSink>> sinks;
+        std::vector<std::unique_ptr<PlayerZone>> zones;
+        bool started = true;
+        for (size_t z = 0; z < zoneCount; z++)
+        {
+            sinks.push_back(std::make_unique<NullSink>(scheduler, 48000, 2));
+            zones.push_back(std::make_unique<PlayerZone>(host));
+            sinks[z]->Open(&zones[z]->Engine());
+            started = started && zones[z]->Open(sinks[z].get()) && zones[z]->SetPlaylist(tracks, z % kTracks);
+        }
+        Check(started, "every zone opens and loads its track");
+
+        // Loaded but paused: nothing to render or decode
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        uint64_t loadedTicks = TicksOver(scheduler, 1.0);
+        LogMessage("Zones loaded, none playing: %llu clock ticks in 1 s", (unsigned long long)loadedTicks);
+        Check(loadedTicks == 0, "the clock does not tick before any zone plays");
+
+        for (auto& zone : zones) zone->Play();
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        uint64_t framesStart = 0;
+        for (auto& sink : sinks) framesStart += sink->FramesRendered();
+        auto wallStart = std::chrono::steady_clock::now();
+        uint64_t playingTicks = TicksOver(scheduler, seconds);
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+        uint64_t framesEnd = 0, underruns = 0;
+        for (auto& sink : sinks) framesEnd += sink->FramesRendered();
+        for (auto& zone : zones) underruns += zone->Engine().Stats().underruns;
+        double realtime = (double)(framesEnd - framesStart) / (48000.0 * zoneCount * wall);
+        LogMessage("%zu zones playing: %.2fx realtime per zone, %llu underruns, %.0f clock ticks/s",
+            zoneCount, realtime, (unsigned long long)underruns, playingTicks / wall);
+        Check(underruns == 0, "no zone underruns");
+        Check(realtime > 0.9 && realtime < 1.1, "every zone renders in real time");
+        Check(playingTicks > 0, "the clock ticks while zones play");
+
+        for (auto& zone : zones) zone->Pause();
+        // One pass to notice, then the clock waits untimed
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        uint64_t pausedTicks = TicksOver(scheduler, 1.0);
+        LogMessage("All zones paused: %llu clock ticks in 1 s", (unsigned long long)pausedTicks);
+        Check(pausedTicks == 0, "the clock idles once every zone is paused");
+
+        for (auto& zone : zones) zone->Close();
+        for (auto& sink : sinks) sink->Close();
+        host.Stop();
+    }
+
+    for (uint32_t track : tracks) std::filesystem::remove(library.Path(track), ec);
+    std::filesystem::remove(folder, ec);
+
+    Check(BenchmarkZones(2.0), "1, 8 and 64 zones play without an underrun");
+
+    if (g_failures) return 1;
+    LogMessage("Zone checks passed");
+    return 0;
+}